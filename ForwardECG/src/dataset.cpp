@@ -0,0 +1,149 @@
+#include "dataset.h"
+#include "deflate.h"
+#include "file_io.h"
+#include "network/serializer.h"
+#include <string.h>
+
+
+using namespace Eigen;
+
+
+static const char DATASET_MAGIC[8] = { 'E', 'C', 'G', 'D', 'S', 'E', 'T', 0 };
+static const uint32_t DATASET_BYTE_ORDER = 0x01020304; // written in the native byte order
+
+// native byte order
+struct DatasetHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t dtype; // ArrayDataType
+	uint32_t flags; // reserved
+	uint64_t samples_count;
+	uint32_t channels_count;
+	uint32_t chunk_samples;
+	double t0;
+	double dt;
+	uint64_t reserved;
+};
+static_assert(sizeof(DatasetHeader) == 64, "dataset header must be 64 bytes");
+
+struct DatasetChunkEntry
+{
+	uint64_t offset; // from the start of the file
+	uint64_t size; // stored bytes
+	uint32_t encoding; // DatasetChunkEncoding
+	uint32_t reserved;
+};
+static_assert(sizeof(DatasetChunkEntry) == 24, "dataset chunk entry must be 24 bytes");
+
+template<typename T>
+static void push_native(std::vector<uint8_t>& bytes, const T& value)
+{
+	bytes.insert(bytes.end(), (const uint8_t*)&value, (const uint8_t*)&value + sizeof(T));
+}
+
+// values of the channels one after the other
+template<typename T>
+static void push_chunk_values(std::vector<uint8_t>& bytes, const MatrixX<Real>& values, int first_sample, int samples_count)
+{
+	size_t offset = bytes.size();
+	bytes.resize(offset + sizeof(T)*samples_count*values.cols());
+	T* chunk_values = (T*)&bytes[offset];
+	for (int j = 0; j < values.cols(); j++)
+	{
+		for (int i = 0; i < samples_count; i++)
+		{
+			*chunk_values++ = (T)values(first_sample + i, j);
+		}
+	}
+}
+
+void serialize_dataset(const std::vector<std::string>& channels_names, const MatrixX<Real>& values, Real t0, Real dt, 
+	const DatasetOptions& options, std::vector<uint8_t>& bytes)
+{
+	const int chunk_samples = (options.chunk_samples > 0) ? options.chunk_samples : 4096;
+	const int chunks_count = (values.rows() + chunk_samples - 1)/chunk_samples;
+	const size_t value_size = options.single_precision ? sizeof(float) : sizeof(double);
+
+	// header
+	DatasetHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DATASET_MAGIC, sizeof(header.magic));
+	header.version = DATASET_VERSION;
+	header.byte_order = DATASET_BYTE_ORDER;
+	header.dtype = options.single_precision ? ARRAY_DTYPE_F32 : ARRAY_DTYPE_F64;
+	header.samples_count = values.rows();
+	header.channels_count = values.cols();
+	header.chunk_samples = chunk_samples;
+	header.t0 = t0;
+	header.dt = dt;
+
+	bytes.clear();
+	bytes.reserve(sizeof(header) + values.size()*value_size);
+	push_native(bytes, header);
+
+	// channels names
+	for (int j = 0; j < values.cols(); j++)
+	{
+		const std::string name = (j < channels_names.size()) ? channels_names[j] : std::string("channel_") + std::to_string(j);
+		push_native(bytes, (uint32_t)name.size());
+		bytes.insert(bytes.end(), name.begin(), name.end());
+	}
+
+	// chunks table, filled after the chunks are written
+	const size_t chunks_table_offset = bytes.size();
+	bytes.resize(bytes.size() + chunks_count*sizeof(DatasetChunkEntry));
+
+	// chunks
+	std::vector<uint8_t> raw_chunk, shuffled_chunk;
+	for (int chunk = 0; chunk < chunks_count; chunk++)
+	{
+		const int first_sample = chunk*chunk_samples;
+		const int samples_count = (values.rows() - first_sample < chunk_samples) ? (int)values.rows() - first_sample : chunk_samples;
+
+		raw_chunk.clear();
+		if (options.single_precision)
+		{
+			push_chunk_values<float>(raw_chunk, values, first_sample, samples_count);
+		}
+		else
+		{
+			push_chunk_values<double>(raw_chunk, values, first_sample, samples_count);
+		}
+
+		DatasetChunkEntry entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.offset = bytes.size();
+		entry.encoding = DATASET_CHUNK_RAW;
+		if (options.compress && !raw_chunk.empty())
+		{
+			shuffled_chunk.resize(raw_chunk.size());
+			shuffle_bytes(&raw_chunk[0], value_size, raw_chunk.size()/value_size, &shuffled_chunk[0]);
+			zlib_compress(&shuffled_chunk[0], shuffled_chunk.size(), bytes);
+			entry.encoding = DATASET_CHUNK_SHUFFLE_ZLIB;
+
+			// keep the chunk raw if it didn't compress
+			if (bytes.size() - entry.offset >= raw_chunk.size())
+			{
+				bytes.resize(entry.offset);
+				entry.encoding = DATASET_CHUNK_RAW;
+			}
+		}
+		if (entry.encoding == DATASET_CHUNK_RAW)
+		{
+			bytes.insert(bytes.end(), raw_chunk.begin(), raw_chunk.end());
+		}
+		entry.size = bytes.size() - entry.offset;
+
+		memcpy(&bytes[chunks_table_offset + chunk*sizeof(DatasetChunkEntry)], &entry, sizeof(entry));
+	}
+}
+
+bool save_dataset(const std::string& file_name, const std::vector<std::string>& channels_names, const MatrixX<Real>& values, 
+	Real t0, Real dt, const DatasetOptions& options)
+{
+	std::vector<uint8_t> bytes;
+	serialize_dataset(channels_names, values, t0, dt, options, bytes);
+	return file_write(file_name.c_str(), bytes);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include "math.h"
+
+
+// binary columnar dataset file ("ECGDSET"), values of named channels sampled every dt starting from t0:
+// - 64 bytes header (native byte order): magic, version, byte order, element type (F32/F64), samples count,
+//   channels count, samples per chunk, t0, dt
+// - channels names (u32 size + characters each)
+// - chunks table: offset, stored size and encoding of every chunk
+// - chunks of samples, each chunk holds the values of one channel after the other, either raw or byte shuffled
+//   and compressed into a zlib stream (chunks that don't compress are stored raw)
+#define DATASET_VERSION 1
+
+enum DatasetChunkEncoding
+{
+	DATASET_CHUNK_RAW = 0,
+	DATASET_CHUNK_SHUFFLE_ZLIB = 1,
+};
+
+struct DatasetOptions
+{
+	bool single_precision = false;
+	bool compress = false;
+	int chunk_samples = 4096;
+};
+
+// values: SAMPLE_COUNTxCHANNELS_COUNT
+void serialize_dataset(const std::vector<std::string>& channels_names, const Eigen::MatrixX<Real>& values, Real t0, Real dt, 
+	const DatasetOptions& options, std::vector<uint8_t>& bytes);
+bool save_dataset(const std::string& file_name, const std::vector<std::string>& channels_names, const Eigen::MatrixX<Real>& values, 
+	Real t0, Real dt, const DatasetOptions& options);
@@ -0,0 +1,222 @@
+#include "deflate.h"
+
+
+// deflate (RFC 1951) with a single fixed huffman codes block, LZ77 matches are found with hash chains
+static const int WINDOW_SIZE = 32768;
+static const int HASH_BITS = 15;
+static const int MAX_CHAIN_LENGTH = 32;
+static const int MIN_MATCH = 3;
+static const int MAX_MATCH = 258;
+
+static const int LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const int LENGTH_EXTRA_BITS[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const int DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+	4097, 6145, 8193, 12289, 16385, 24577 };
+static const int DISTANCE_EXTRA_BITS[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+
+// writes bits starting from the least significant bit
+class BitWriter
+{
+public:
+	BitWriter(std::vector<uint8_t>& out)
+		: m_out(out)
+	{
+
+	}
+
+	void write_bits(uint32_t value, int bits_count)
+	{
+		m_buffer |= value << m_bits_count;
+		m_bits_count += bits_count;
+		while (m_bits_count >= 8)
+		{
+			m_out.push_back(m_buffer & 0xFF);
+			m_buffer >>= 8;
+			m_bits_count -= 8;
+		}
+	}
+
+	// huffman codes are stored starting from their most significant bit
+	void write_code(uint32_t code, int bits_count)
+	{
+		uint32_t reversed = 0;
+		for (int i = 0; i < bits_count; i++)
+		{
+			reversed = (reversed << 1) | ((code >> i) & 1);
+		}
+		write_bits(reversed, bits_count);
+	}
+
+	void flush()
+	{
+		if (m_bits_count > 0)
+		{
+			m_out.push_back(m_buffer & 0xFF);
+		}
+		m_buffer = 0;
+		m_bits_count = 0;
+	}
+
+private:
+	std::vector<uint8_t>& m_out;
+	uint32_t m_buffer = 0;
+	int m_bits_count = 0;
+};
+
+static void write_literal_length_symbol(BitWriter& writer, int symbol)
+{
+	if (symbol < 144)
+	{
+		writer.write_code(0x30 + symbol, 8);
+	}
+	else if (symbol < 256)
+	{
+		writer.write_code(0x190 + (symbol - 144), 9);
+	}
+	else if (symbol < 280)
+	{
+		writer.write_code(symbol - 256, 7);
+	}
+	else
+	{
+		writer.write_code(0xC0 + (symbol - 280), 8);
+	}
+}
+
+static void write_match(BitWriter& writer, int length, int distance)
+{
+	int length_code = 28;
+	while (LENGTH_BASE[length_code] > length)
+	{
+		length_code--;
+	}
+	write_literal_length_symbol(writer, 257 + length_code);
+	writer.write_bits(length - LENGTH_BASE[length_code], LENGTH_EXTRA_BITS[length_code]);
+
+	int distance_code = 29;
+	while (DISTANCE_BASE[distance_code] > distance)
+	{
+		distance_code--;
+	}
+	writer.write_code(distance_code, 5);
+	writer.write_bits(distance - DISTANCE_BASE[distance_code], DISTANCE_EXTRA_BITS[distance_code]);
+}
+
+static uint32_t hash3(const uint8_t* data)
+{
+	return ((data[0] << 10) ^ (data[1] << 5) ^ data[2]) & ((1 << HASH_BITS) - 1);
+}
+
+static uint32_t adler32(const uint8_t* data, size_t size)
+{
+	uint32_t a = 1;
+	uint32_t b = 0;
+	while (size > 0)
+	{
+		// largest block that can't overflow b
+		size_t block_size = (size < 5552) ? size : 5552;
+		for (size_t i = 0; i < block_size; i++)
+		{
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		data += block_size;
+		size -= block_size;
+	}
+	return (b << 16) | a;
+}
+
+void zlib_compress(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+	// zlib header: deflate with a 32K window, no preset dictionary
+	out.push_back(0x78);
+	out.push_back(0x01);
+
+	BitWriter writer(out);
+	writer.write_bits(1, 1); // last block
+	writer.write_bits(1, 2); // fixed huffman codes
+
+	std::vector<int> head(1 << HASH_BITS, -1);
+	std::vector<int> prev(WINDOW_SIZE, -1);
+	auto insert_position = [&](size_t position)
+	{
+		if (position + MIN_MATCH <= size)
+		{
+			uint32_t hash = hash3(data + position);
+			prev[position & (WINDOW_SIZE-1)] = head[hash];
+			head[hash] = (int)position;
+		}
+	};
+
+	size_t i = 0;
+	while (i < size)
+	{
+		// longest match in the window
+		int best_length = 0;
+		int best_distance = 0;
+		if (i + MIN_MATCH <= size)
+		{
+			int max_length = (size - i < MAX_MATCH) ? (int)(size - i) : MAX_MATCH;
+			int candidate = head[hash3(data + i)];
+			for (int chain = 0; candidate >= 0 && i - candidate <= WINDOW_SIZE && chain < MAX_CHAIN_LENGTH; chain++)
+			{
+				int length = 0;
+				while (length < max_length && data[candidate + length] == data[i + length])
+				{
+					length++;
+				}
+				if (length > best_length)
+				{
+					best_length = length;
+					best_distance = (int)(i - candidate);
+					if (length == max_length)
+					{
+						break;
+					}
+				}
+				candidate = prev[candidate & (WINDOW_SIZE-1)];
+			}
+		}
+
+		if (best_length >= MIN_MATCH)
+		{
+			write_match(writer, best_length, best_distance);
+			for (int j = 0; j < best_length; j++)
+			{
+				insert_position(i + j);
+			}
+			i += best_length;
+		}
+		else
+		{
+			write_literal_length_symbol(writer, data[i]);
+			insert_position(i);
+			i++;
+		}
+	}
+
+	// end of block
+	write_literal_length_symbol(writer, 256);
+	writer.flush();
+
+	// checksum of the uncompressed data (big endian)
+	uint32_t checksum = adler32(data, size);
+	out.push_back((checksum >> 24) & 0xFF);
+	out.push_back((checksum >> 16) & 0xFF);
+	out.push_back((checksum >> 8) & 0xFF);
+	out.push_back(checksum & 0xFF);
+}
+
+void shuffle_bytes(const uint8_t* data, size_t element_size, size_t elements_count, uint8_t* out)
+{
+	for (size_t i = 0; i < elements_count; i++)
+	{
+		for (size_t b = 0; b < element_size; b++)
+		{
+			out[b*elements_count + i] = data[i*element_size + b];
+		}
+	}
+}
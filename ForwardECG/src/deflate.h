@@ -0,0 +1,13 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+// compresses data as a zlib stream (deflate with the fixed huffman codes), readable by any zlib implementation,
+// the stream is appended to out
+void zlib_compress(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+
+// byte shuffle: byte b of element i is moved to b*elements_count + i, so the bytes with the same significance
+// (sign/exponent bytes of floating point values) are next to each other and compress better
+void shuffle_bytes(const uint8_t* data, size_t element_size, size_t elements_count, uint8_t* out);
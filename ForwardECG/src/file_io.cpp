@@ -92,3 +92,227 @@ bool file_write(const char* file_path, const std::vector<uint8_t>& data)
 	return file_write(file_path, &data[0], data.size());
 }
 
+
+
+// MappedFile
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::is_open() const
+{
+	return m_data != NULL;
+}
+
+const uint8_t* MappedFile::get_data() const
+{
+	return m_data;
+}
+
+size_t MappedFile::get_size() const
+{
+	return m_size;
+}
+
+#ifdef _WIN32
+
+////////////////////
+// Windows
+////////////////////
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+bool directory_create(const char* directory_path)
+{
+	return CreateDirectoryA(directory_path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+bool directory_list_files(const char* directory_path, std::vector<DirectoryFile>& files)
+{
+	files.clear();
+
+	WIN32_FIND_DATAA find_data;
+	HANDLE find = FindFirstFileA((std::string(directory_path) + "\\*").c_str(), &find_data);
+	if (find == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	do
+	{
+		if (!(find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+		{
+			files.push_back({ find_data.cFileName, ((uint64_t)find_data.nFileSizeHigh << 32) | find_data.nFileSizeLow,
+				((uint64_t)find_data.ftLastWriteTime.dwHighDateTime << 32) | find_data.ftLastWriteTime.dwLowDateTime });
+		}
+	} while (FindNextFileA(find, &find_data));
+
+	FindClose(find);
+	return true;
+}
+
+bool file_touch(const char* file_path)
+{
+	HANDLE file = CreateFileA(file_path, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	bool result = SetFileTime(file, NULL, NULL, &now);
+	CloseHandle(file);
+	return result;
+}
+
+bool MappedFile::open(const char* file_path)
+{
+	close();
+
+	m_file = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		m_file = NULL;
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(m_file, &file_size) || file_size.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!m_mapping)
+	{
+		close();
+		return false;
+	}
+
+	m_data = (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!m_data)
+	{
+		close();
+		return false;
+	}
+	m_size = file_size.QuadPart;
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data)
+	{
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping)
+	{
+		CloseHandle(m_mapping);
+	}
+	if (m_file)
+	{
+		CloseHandle(m_file);
+	}
+	m_data = NULL;
+	m_size = 0;
+	m_mapping = NULL;
+	m_file = NULL;
+}
+
+#else
+
+////////////////////
+// Linux
+////////////////////
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <utime.h>
+
+bool directory_create(const char* directory_path)
+{
+	return mkdir(directory_path, 0755) == 0 || errno == EEXIST;
+}
+
+bool directory_list_files(const char* directory_path, std::vector<DirectoryFile>& files)
+{
+	files.clear();
+
+	DIR* dir = opendir(directory_path);
+	if (!dir)
+	{
+		return false;
+	}
+
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		std::string path = std::string(directory_path) + "/" + entry->d_name;
+		struct stat file_stat;
+		if (stat(path.c_str(), &file_stat) == 0 && S_ISREG(file_stat.st_mode))
+		{
+			files.push_back({ entry->d_name, (uint64_t)file_stat.st_size, (uint64_t)file_stat.st_mtime });
+		}
+	}
+
+	closedir(dir);
+	return true;
+}
+
+bool file_touch(const char* file_path)
+{
+	return utime(file_path, NULL) == 0;
+}
+
+bool MappedFile::open(const char* file_path)
+{
+	close();
+
+	int fd = ::open(file_path, O_RDONLY);
+	if (fd == -1)
+	{
+		return false;
+	}
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	// the mapping stays valid after the file is closed
+	void* data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+
+	m_data = (const uint8_t*)data;
+	m_size = file_stat.st_size;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data)
+	{
+		munmap((void*)m_data, m_size);
+	}
+	m_data = NULL;
+	m_size = 0;
+}
+
+#endif
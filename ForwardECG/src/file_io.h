@@ -1,6 +1,8 @@
 #pragma once
+#include <stddef.h>
 #include <stdint.h>
 #include <vector>
+#include <string>
 
 // caller must free the buffer
 uint8_t* file_read(const char* file_path, size_t* out_size);
@@ -8,3 +10,42 @@ bool file_read_vector(const char* file_path, std::vector<uint8_t>& contents_vect
 
 bool file_write(const char* file_path, const uint8_t* data, size_t size);
 bool file_write(const char* file_path, const std::vector<uint8_t>& data);
+
+struct DirectoryFile
+{
+	std::string name;
+	uint64_t size;
+	uint64_t modified_time; // only comparable between files of the same system
+};
+
+// creates the directory if it doesn't exist (not its parents)
+bool directory_create(const char* directory_path);
+// regular files in the directory
+bool directory_list_files(const char* directory_path, std::vector<DirectoryFile>& files);
+// sets the modified time of an existing file to now
+bool file_touch(const char* file_path);
+
+// read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const char* file_path);
+	void close();
+	bool is_open() const;
+
+	const uint8_t* get_data() const;
+	size_t get_size() const;
+
+private:
+	const uint8_t* m_data = NULL;
+	size_t m_size = 0;
+#ifdef _WIN32
+	void* m_file = NULL;
+	void* m_mapping = NULL;
+#endif
+};
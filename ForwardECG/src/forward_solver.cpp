@@ -0,0 +1,171 @@
+#include "forward_solver.h"
+#include "parallel.h"
+#include "timer.h"
+#include <stdio.h>
+
+
+using namespace Eigen;
+
+// samples per parallel_for block of the batched forward solve
+static const int SAMPLES_BLOCK_SIZE = 64;
+
+
+void calculate_torso_potentials(const MatrixX<Real>& ZBH, const MatrixX<Real>& QH, MatrixX<Real>& QB)
+{
+	// TMP forward ecg
+	// Q_B = ZBH * Q_H
+	QB = ZBH * QH;
+}
+
+void calculate_action_potential_tmp(const std::vector<ActionPotentialParameters>& params, Real t, Real dt, MatrixX<Real>& QH)
+{
+	QH.resize(params.size(), 1);
+	for (int i = 0; i < params.size(); i++)
+	{
+		QH(i) = extracellular_potential(t, dt, params[i]);
+	}
+}
+
+void calculate_action_potential_tmp_samples(const std::vector<ActionPotentialParameters>& params, int sample_count, Real dt, MatrixX<Real>& QH_samples, 
+	int threads_count)
+{
+	QH_samples.resize(params.size(), sample_count);
+	parallel_for(sample_count, SAMPLES_BLOCK_SIZE, threads_count, [&](int samples_begin, int samples_end)
+	{
+		for (int sample = samples_begin; sample < samples_end; sample++)
+		{
+			Real t = sample*dt;
+			for (int i = 0; i < params.size(); i++)
+			{
+				QH_samples(i, sample) = extracellular_potential(t, dt, params[i]);
+			}
+		}
+	});
+}
+
+void calculate_torso_potentials_samples(const MatrixX<Real>& ZBH, const MatrixX<Real>& QH_samples, MatrixX<Real>& QB_samples, 
+	int threads_count)
+{
+	QB_samples.resize(ZBH.rows(), QH_samples.cols());
+	parallel_for(QH_samples.cols(), SAMPLES_BLOCK_SIZE, threads_count, [&](int samples_begin, int samples_end)
+	{
+		QB_samples.middleCols(samples_begin, samples_end-samples_begin).noalias() = ZBH * QH_samples.middleCols(samples_begin, samples_end-samples_begin);
+	});
+}
+
+void apply_reference_probe(const SparseMatrix<Real, RowMajor>& sampling_matrix, int reference_probe, MatrixX<Real>& QB_samples)
+{
+	RowVectorX<Real> reference_values = sampling_matrix.row(reference_probe) * QB_samples;
+	QB_samples.rowwise() -= reference_values;
+}
+
+
+void make_single_precision_matrix(const MatrixX<Real>& Z, SinglePrecisionMatrix& Z_single)
+{
+	Z_single.matrix = Z.cast<float>();
+	Z_single.row_sums = Z.rowwise().sum();
+}
+
+void calculate_torso_potentials_samples(const SinglePrecisionMatrix& Z, const MatrixX<Real>& QH_samples, MatrixX<float>& QB_samples, 
+	int threads_count)
+{
+	QB_samples.resize(Z.matrix.rows(), QH_samples.cols());
+	parallel_for(QH_samples.cols(), SAMPLES_BLOCK_SIZE, threads_count, [&](int samples_begin, int samples_end)
+	{
+		int block_size = samples_end-samples_begin;
+		RowVectorX<Real> means = QH_samples.middleCols(samples_begin, block_size).colwise().mean();
+		MatrixX<float> QH_centered = (QH_samples.middleCols(samples_begin, block_size).rowwise() - means).cast<float>();
+
+		auto QB_block = QB_samples.middleCols(samples_begin, block_size);
+		QB_block.noalias() = Z.matrix * QH_centered;
+		QB_block += (Z.row_sums * means).cast<float>();
+	});
+}
+
+
+PrecisionErrorReport calculate_precision_error(const MatrixX<Real>& values, const MatrixX<float>& single_precision_values)
+{
+	PrecisionErrorReport report;
+	if (values.size() == 0 || values.rows() != single_precision_values.rows() || values.cols() != single_precision_values.cols())
+	{
+		return report;
+	}
+
+	MatrixX<Real> error = single_precision_values.cast<Real>() - values;
+	report.max_abs_error = error.cwiseAbs().maxCoeff();
+	report.rms_error = sqrt(error.squaredNorm()/error.size());
+	report.max_abs_value = values.cwiseAbs().maxCoeff();
+	report.relative_error = (report.max_abs_value > 0) ? report.max_abs_error/report.max_abs_value : 0;
+	return report;
+}
+
+void print_precision_error_report(const char* name, const PrecisionErrorReport& report)
+{
+	printf("Single precision error (%s): max abs error: %.3e, rms error: %.3e, max abs value: %.3e, relative error: %.3e\n", 
+		name, report.max_abs_error, report.rms_error, report.max_abs_value, report.relative_error);
+}
+
+void calculate_probes_transfer_matrix(const SparseMatrix<Real, RowMajor>& sampling_matrix, const MatrixX<Real>& ZBH, int reference_probe, MatrixX<Real>& ZPH)
+{
+	ZPH = sampling_matrix * ZBH;
+
+	// same as subtracting the reference probe value from every torso vertex before sampling
+	if (reference_probe != -1)
+	{
+		RowVectorX<Real> reference_row = ZPH.row(reference_probe);
+		VectorX<Real> weights_sum = sampling_matrix * VectorX<Real>::Ones(sampling_matrix.cols());
+		ZPH -= weights_sum * reference_row;
+	}
+}
+
+
+const MatrixX<Real>& ProbesTransferMatrix::get_matrix(const MatrixX<Real>& ZBH, ProbesOperator& probes_operator, 
+	const MeshPlot& torso, const std::vector<Probe>& probes, int reference_probe)
+{
+	const SparseMatrix<Real, RowMajor>& sampling_matrix = probes_operator.get_matrix(torso, probes);
+
+	if (m_valid && m_probes_version == probes_operator.get_version() && m_reference_probe == reference_probe 
+		&& m_ZPH.cols() == ZBH.cols())
+	{
+		return m_ZPH;
+	}
+
+	Timer timer;
+	timer.start();
+	calculate_probes_transfer_matrix(sampling_matrix, ZBH, reference_probe, m_ZPH);
+	printf("Calculated the probes transfer matrix (%dx%d) in: %.3f sec\n", (int)m_ZPH.rows(), (int)m_ZPH.cols(), timer.elapsed_seconds());
+
+	m_valid = true;
+	m_interpolated_valid = false;
+	m_probes_version = probes_operator.get_version();
+	m_reference_probe = reference_probe;
+
+	return m_ZPH;
+}
+
+const MatrixX<Real>& ProbesTransferMatrix::get_interpolated_matrix(const MatrixX<Real>& ZBH, ProbesOperator& probes_operator, 
+	const MeshPlot& torso, const std::vector<Probe>& probes, int reference_probe, const MatrixX<Real>& interpolation_matrix)
+{
+	const MatrixX<Real>& ZPH = get_matrix(ZBH, probes_operator, torso, probes, reference_probe);
+
+	if (m_interpolated_valid && m_ZPH_interpolated.cols() == interpolation_matrix.cols())
+	{
+		return m_ZPH_interpolated;
+	}
+
+	m_ZPH_interpolated = ZPH * interpolation_matrix;
+	m_interpolated_valid = true;
+
+	return m_ZPH_interpolated;
+}
+
+void ProbesTransferMatrix::invalidate()
+{
+	m_valid = false;
+	m_interpolated_valid = false;
+}
+
+void ProbesTransferMatrix::invalidate_interpolation()
+{
+	m_interpolated_valid = false;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <vector>
+#include <Eigen/Dense>
+#include "math.h"
+#include "mesh_plot.h"
+#include "probe.h"
+#include "action_potential.h"
+
+
+// body surface potentials from the heart potentials (QB = ZBH*QH)
+void calculate_torso_potentials(const Eigen::MatrixX<Real>& ZBH, const Eigen::MatrixX<Real>& QH, Eigen::MatrixX<Real>& QB);
+
+// heart potentials at time t from the action potential parameters of each heart vertex
+void calculate_action_potential_tmp(const std::vector<ActionPotentialParameters>& params, Real t, Real dt, Eigen::MatrixX<Real>& QH);
+
+
+// batched forward solve, every column is a sample
+// threads_count: threads the batch is split across (0 = all the available threads, see parallel_for)
+
+// heart potentials of sample_count samples (MxSAMPLE_COUNT), sample i is at t = i*dt
+void calculate_action_potential_tmp_samples(const std::vector<ActionPotentialParameters>& params, int sample_count, Real dt, Eigen::MatrixX<Real>& QH_samples, 
+	int threads_count = 0);
+
+// body surface potentials of all the samples in one GEMM (QB_samples = ZBH*QH_samples, NxSAMPLE_COUNT)
+void calculate_torso_potentials_samples(const Eigen::MatrixX<Real>& ZBH, const Eigen::MatrixX<Real>& QH_samples, Eigen::MatrixX<Real>& QB_samples, 
+	int threads_count = 0);
+
+// subtracts the reference probe value of each sample (row reference_probe of the probes sampling matrix) from the sample
+void apply_reference_probe(const Eigen::SparseMatrix<Real, Eigen::RowMajor>& sampling_matrix, int reference_probe, Eigen::MatrixX<Real>& QB_samples);
+
+
+// single precision copy of a transfer matrix (assembled in double precision)
+struct SinglePrecisionMatrix
+{
+	Eigen::MatrixX<float> matrix;
+	Eigen::VectorX<Real> row_sums; // of the double precision matrix
+};
+
+void make_single_precision_matrix(const Eigen::MatrixX<Real>& Z, SinglePrecisionMatrix& Z_single);
+
+// single precision batched forward solve (QB_samples = Z*QH_samples), every sample is centered on its mean before the
+// single precision GEMM and the mean is added back in double precision (Z*mean = row_sums*mean), the rows of the transfer
+// matrices sum to almost 0 so the common offset of the heart potentials would otherwise cost most of the precision
+void calculate_torso_potentials_samples(const SinglePrecisionMatrix& Z, const Eigen::MatrixX<Real>& QH_samples, Eigen::MatrixX<float>& QB_samples, 
+	int threads_count = 0);
+
+
+// precision cost of the single precision path, compared to the double precision values
+struct PrecisionErrorReport
+{
+	Real max_abs_error = 0;
+	Real rms_error = 0;
+	Real max_abs_value = 0; // of the double precision values
+	Real relative_error = 0; // max_abs_error/max_abs_value
+};
+
+PrecisionErrorReport calculate_precision_error(const Eigen::MatrixX<Real>& values, const Eigen::MatrixX<float>& single_precision_values);
+void print_precision_error_report(const char* name, const PrecisionErrorReport& report);
+
+
+// probe-space transfer matrix ZPH (PROBES_COUNTxM): the probes sampling weights folded into ZBH,
+// the reference probe (if not -1) is already subtracted, probes values of the samples are ZPH*QH_samples
+void calculate_probes_transfer_matrix(const Eigen::SparseMatrix<Real, Eigen::RowMajor>& sampling_matrix, const Eigen::MatrixX<Real>& ZBH, 
+	int reference_probe, Eigen::MatrixX<Real>& ZPH);
+
+// keeps ZPH and ZPH*interpolation_matrix of the last calculation,
+// ZPH is rebuilt when the probes sampling matrix or the reference probe changes or after invalidate (ZBH changed)
+class ProbesTransferMatrix
+{
+public:
+	ProbesTransferMatrix() = default;
+	~ProbesTransferMatrix() = default;
+
+	// ZPH (PROBES_COUNTxM)
+	const Eigen::MatrixX<Real>& get_matrix(const Eigen::MatrixX<Real>& ZBH, ProbesOperator& probes_operator, 
+		const MeshPlot& torso, const std::vector<Probe>& probes, int reference_probe);
+	// ZPH*interpolation_matrix (PROBES_COUNTxHEART_PROBES_COUNT): probes values directly from the heart probes values
+	const Eigen::MatrixX<Real>& get_interpolated_matrix(const Eigen::MatrixX<Real>& ZBH, ProbesOperator& probes_operator, 
+		const MeshPlot& torso, const std::vector<Probe>& probes, int reference_probe, const Eigen::MatrixX<Real>& interpolation_matrix);
+
+	// ZBH changed
+	void invalidate();
+	// interpolation matrix changed
+	void invalidate_interpolation();
+
+private:
+	Eigen::MatrixX<Real> m_ZPH;
+	Eigen::MatrixX<Real> m_ZPH_interpolated;
+	bool m_valid = false;
+	bool m_interpolated_valid = false;
+	int m_probes_version = 0;
+	int m_reference_probe = -1;
+};
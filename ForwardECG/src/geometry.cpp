@@ -1,4 +1,8 @@
 #include "geometry.h"
+#include "mesh_bvh.h"
+#include "parallel.h"
+#include <float.h>
+#include <stdio.h>
 
 
 using namespace Eigen;
@@ -90,6 +94,12 @@ Eigen::Vector2<Real> get_point_in_triangle_basis(const Triangle& triangle, const
 
 bool ray_mesh_intersect(const MeshPlot& mesh, const Eigen::Vector3<Real>& mesh_position, const Ray& ray, Real& t, int& tri_idx, int group_index)
 {
+	if (mesh.bvh)
+	{
+		return mesh.bvh->intersect(mesh, mesh_position, ray, t, tri_idx, group_index);
+	}
+
+	// test all the faces
 	bool intersected = false;
 	Real min_t = INFINITY;
 	tri_idx = -1;
@@ -126,6 +136,42 @@ bool ray_mesh_intersect(const MeshPlot& mesh, const Eigen::Vector3<Real>& mesh_p
 	return intersected;
 }
 
+// rays per parallel_for block
+#define RAYS_BLOCK_SIZE 256
+// rays cast at once (the rays, their points and triangles take ~76 bytes per ray)
+#define RAYS_BATCH_SIZE 65536
+
+void rays_mesh_intersect(const MeshPlot& mesh, const Eigen::Vector3<Real>& mesh_position, const std::vector<Ray>& rays,
+	std::vector<int>& triangles_idx, std::vector<Eigen::Vector3<Real>>& points, int group_index)
+{
+	triangles_idx.resize(rays.size());
+	points.resize(rays.size());
+
+	// batches keep the parallel_for count in the int range
+	for (size_t first = 0; first < rays.size(); first += RAYS_BATCH_SIZE)
+	{
+		const int batch_count = (int)((rays.size() - first < RAYS_BATCH_SIZE) ? rays.size() - first : RAYS_BATCH_SIZE);
+		parallel_for(batch_count, RAYS_BLOCK_SIZE, [&](int rays_begin, int rays_end)
+		{
+			for (size_t i = first + rays_begin; i < first + rays_end; i++)
+			{
+				Real t;
+				int tri_idx;
+				if (ray_mesh_intersect(mesh, mesh_position, rays[i], t, tri_idx, group_index))
+				{
+					triangles_idx[i] = tri_idx;
+					points[i] = rays[i].point_at_dir(t);
+				}
+				else
+				{
+					triangles_idx[i] = -1;
+					points[i] = Vector3<Real>(0, 0, 0);
+				}
+			}
+		});
+	}
+}
+
 bool line_plane_intersect(const Eigen::Vector3<Real>& v1, const Eigen::Vector3<Real>& v2, const Eigen::Vector3<Real>& p, const Eigen::Vector3<Real>& n, Real& t)
 {
 	Eigen::Vector3<Real> line_direction = (v2-v1).normalized();
@@ -167,37 +213,44 @@ Eigen::Vector3<Real> calculate_triangle_normal(MeshPlot* mesh, int tri_idx)
 
 
 
-std::vector<Probe> cast_probes_in_sphere(const std::string& prefix, const MeshPlot& mesh, int rows, int cols, Real z_rot, const Eigen::Vector3<Real>& rays_origin, int group_index, bool cast_from_outside)
+// casts the grid of rows x cols rays (make_ray(row, col)) in batches of RAYS_BATCH_SIZE rays,
+// returns the probes of the rays that intersected the mesh, named prefix_row_column
+static std::vector<Probe> cast_probes_grid(const std::string& prefix, const MeshPlot& mesh, int rows, int cols, int group_index, 
+	const std::function<Ray(int row, int col)>& make_ray)
 {
 	std::vector<Probe> probes;
+	if (rows <= 0 || cols <= 0)
+	{
+		return probes;
+	}
 
-	// spherical coordinates to cartisian
-	for (int theta_i = 0; theta_i < rows; theta_i++)
+	const uint64_t rays_count = (uint64_t)rows*cols;
+	std::vector<Ray> rays;
+	std::vector<int> triangles_idx;
+	std::vector<Vector3<Real>> points;
+	rays.reserve((rays_count < RAYS_BATCH_SIZE) ? rays_count : RAYS_BATCH_SIZE);
+	char suffix[32];
+	for (uint64_t first = 0; first < rays_count; first += RAYS_BATCH_SIZE)
 	{
-		Real theta = map_value_to_range<Real>(((Real)theta_i+0.5), 0, rows, -PI/2, PI/2);
-		for (int phi_i = 0; phi_i < cols; phi_i++)
+		const uint64_t last = (rays_count - first < RAYS_BATCH_SIZE) ? rays_count : first + RAYS_BATCH_SIZE;
+
+		// rays of the batch
+		rays.clear();
+		for (uint64_t i = first; i < last; i++)
 		{
-			Real phi = map_value_to_range<Real>(((Real)phi_i+0.5), 0, cols, 0, 2*PI);
-			// calculate ray
-			Vector3<Real> ray_direction = { cos(theta)*cos(phi), sin(theta), cos(theta)*sin(phi) };
-			ray_direction = rodrigues_rotate(ray_direction, { 0, 0, 1 }, z_rot); // apply rotation
-			ray_direction.normalize();
-			Ray cast_ray = { rays_origin, ray_direction };
-
-			// cast from the outside
-			if (cast_from_outside)
-			{
-				cast_ray = { cast_ray.point_at_dir(100), -cast_ray.direction };
-			}
+			rays.push_back(make_ray((int)(i/cols), (int)(i%cols)));
+		}
 
-			// intersect ray with mesh
-			Real t;
-			int tri_idx;
-			if (ray_mesh_intersect(mesh, Vector3<Real>(0, 0, 0), cast_ray, t, tri_idx, group_index))
+		// intersect rays with mesh
+		rays_mesh_intersect(mesh, Vector3<Real>(0, 0, 0), rays, triangles_idx, points, group_index);
+
+		// probes of the hits
+		for (int i = 0; i < rays.size(); i++)
+		{
+			if (triangles_idx[i] != -1)
 			{
-				Vector3<Real> intersection_point = cast_ray.point_at_dir(t);
-				std::string probe_name = prefix + "_" + std::to_string(theta_i) + "_" + std::to_string(phi_i);
-				probes.push_back(Probe{ tri_idx, intersection_point, probe_name });
+				snprintf(suffix, sizeof(suffix), "_%d_%d", (int)((first+i)/cols), (int)((first+i)%cols));
+				probes.push_back(Probe{ triangles_idx[i], points[i], prefix + suffix });
 			}
 		}
 	}
@@ -205,34 +258,38 @@ std::vector<Probe> cast_probes_in_sphere(const std::string& prefix, const MeshPl
 	return probes;
 }
 
-std::vector<Probe> cast_probes_in_plane(const std::string& prefix, const MeshPlot& mesh, int rows, int cols, Real z_plane, Real z_direction, Real x_min, Real x_max, Real y_min, Real y_max, int group_index)
+std::vector<Probe> cast_probes_in_sphere(const std::string& prefix, const MeshPlot& mesh, int rows, int cols, Real z_rot, const Eigen::Vector3<Real>& rays_origin, int group_index, bool cast_from_outside)
 {
-	std::vector<Probe> probes;
-
-	// spherical coordinates to cartisian
-	for (int i = 0; i < rows; i++)
+	return cast_probes_grid(prefix, mesh, rows, cols, group_index, [&](int theta_i, int phi_i)
 	{
-		Real y = map_value_to_range<Real>((Real)i, 0, rows-1, y_min, y_max);
-		for (int j = 0; j < cols; j++)
+		// spherical coordinates to cartisian
+		Real theta = map_value_to_range<Real>(((Real)theta_i+0.5), 0, rows, -PI/2, PI/2);
+		Real phi = map_value_to_range<Real>(((Real)phi_i+0.5), 0, cols, 0, 2*PI);
+		// calculate ray
+		Vector3<Real> ray_direction = { cos(theta)*cos(phi), sin(theta), cos(theta)*sin(phi) };
+		ray_direction = rodrigues_rotate(ray_direction, { 0, 0, 1 }, z_rot); // apply rotation
+		ray_direction.normalize();
+		Ray cast_ray = { rays_origin, ray_direction };
+
+		// cast from the outside
+		if (cast_from_outside)
 		{
-			Real x = map_value_to_range<Real>((Real)j, 0, cols-1, x_min, x_max);
-
-			// calculate ray
-			Ray cast_ray = { {x, y, z_plane}, {0, 0, z_direction} };
-
-			// intersect ray with mesh
-			Real t;
-			int tri_idx;
-			if (ray_mesh_intersect(mesh, Vector3<Real>(0, 0, 0), cast_ray, t, tri_idx, group_index))
-			{
-				Vector3<Real> intersection_point = cast_ray.point_at_dir(t);
-				std::string probe_name = prefix + "_" + std::to_string(i) + "_" + std::to_string(j);
-				probes.push_back(Probe{ tri_idx, intersection_point, probe_name });
-			}
+			cast_ray = { cast_ray.point_at_dir(100), -cast_ray.direction };
 		}
-	}
+		return cast_ray;
+	});
+}
 
-	return probes;
+std::vector<Probe> cast_probes_in_plane(const std::string& prefix, const MeshPlot& mesh, int rows, int cols, Real z_plane, Real z_direction, Real x_min, Real x_max, Real y_min, Real y_max, int group_index)
+{
+	return cast_probes_grid(prefix, mesh, rows, cols, group_index, [&](int i, int j)
+	{
+		Real y = map_value_to_range<Real>((Real)i, 0, rows-1, y_min, y_max);
+		Real x = map_value_to_range<Real>((Real)j, 0, cols-1, x_min, x_max);
+
+		// calculate ray
+		return Ray{ {x, y, z_plane}, {0, 0, z_direction} };
+	});
 }
 
 
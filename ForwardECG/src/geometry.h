@@ -34,6 +34,10 @@ Eigen::Vector2<Real> get_point_in_triangle_basis(const Triangle& triangle, const
 
 bool ray_mesh_intersect(const MeshPlot& mesh, const Eigen::Vector3<Real>& mesh_position, const Ray& ray, Real& t, int& tri_idx, int group_index = -1); // -1 group index = all groups
 
+// intersects all the rays (in parallel), ray i intersected triangle triangles_idx[i] (-1 if it missed) at points[i]
+void rays_mesh_intersect(const MeshPlot& mesh, const Eigen::Vector3<Real>& mesh_position, const std::vector<Ray>& rays,
+	std::vector<int>& triangles_idx, std::vector<Eigen::Vector3<Real>>& points, int group_index = -1);
+
 // checks if line (v1, v2) intersected a plane (p, n)
 bool line_plane_intersect(const Eigen::Vector3<Real>& v1, const Eigen::Vector3<Real>& v2, const Eigen::Vector3<Real>& p, const Eigen::Vector3<Real>& n, Real& t);
 
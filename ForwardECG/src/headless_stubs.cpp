@@ -0,0 +1,42 @@
+#include "mesh_plot.h"
+#include "wave_propagation_simulation.h"
+
+// no-op GPU and GUI definitions for the headless build (replaces mesh_plot_renderer.cpp and wave_propagation_simulation_gui.cpp)
+
+
+// MeshPlot GPU buffers
+
+void MeshPlot::create_gpu_buffers()
+{
+}
+
+void MeshPlot::update_gpu_buffers()
+{
+}
+
+void MeshPlot::update_gpu_geometry()
+{
+}
+
+void MeshPlot::destroy_gpu_buffers()
+{
+	vertex_buffer = nullptr;
+	values_buffer = nullptr;
+	index_buffer = nullptr;
+}
+
+
+// Wave Propagation Operators
+
+#define HEADLESS_OPERATOR_GUI(OPERATOR) \
+	void OPERATOR::render() {} \
+	void OPERATOR::render_gui() {} \
+	void OPERATOR::handle_input(const LookAtCamera& camera) {}
+
+HEADLESS_OPERATOR_GUI(WavePropagationOperator)
+HEADLESS_OPERATOR_GUI(WavePropagationPlaneCut)
+HEADLESS_OPERATOR_GUI(WavePropagationForceDepolarization)
+HEADLESS_OPERATOR_GUI(WavePropagationLinkTwoGroups)
+HEADLESS_OPERATOR_GUI(WavePropagationConductionPath)
+HEADLESS_OPERATOR_GUI(WavePropagationSetParamsInPlane)
+HEADLESS_OPERATOR_GUI(WavePropagationSetParamsInSelect)
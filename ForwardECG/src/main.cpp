@@ -5,6 +5,9 @@
 #include <thread>
 #include <memory>
 #include <map>
+#include <mutex>
+#include <atomic>
+#include <functional>
 #include "opengl/gl_headers.h"
 #include <GLFW/glfw3.h>
 #include "window.h"
@@ -34,6 +37,11 @@
 #include "wave_propagation_simulation.h"
 #include "action_potential.h"
 #include "probe.h"
+#include "parallel.h"
+#include "transfer_matrix.h"
+#include "matrix_io.h"
+#include "forward_solver.h"
+#include "dataset.h"
 
 
 using namespace Eigen;
@@ -113,8 +121,39 @@ enum RequestType
 	REQUEST_GET_TMP_BSP_VALUES_PROBES = 9,
 	REQUEST_GET_TMP_BSP_VALUES_PROBES_2 = 10,
 	REQUEST_GET_TMP_BSP_VALUES_PROBES_TRAIN = 11,
+	REQUEST_GET_TMP_BSP_VALUES_PROBES_DATASET = 12,
+	REQUEST_GET_SERVER_STATS = 13,
 };
 
+// flags in the high bits of the request type
+enum RequestFlags
+{
+	REQUEST_TYPE_MASK = 0xFFFF,
+	REQUEST_FLAG_BULK_ARRAYS = 0x10000, // matrices are serialized as bulk arrays (see Serializer::push_array)
+	REQUEST_FLAG_STREAM = 0x20000, // the response is streamed in chunks of rows (only on persistent connections)
+	REQUEST_FLAG_SINGLE_PRECISION = 0x40000, // values are sent as floats, the snapshot requests are also calculated in single precision
+};
+
+// how the values of a response are calculated and serialized
+struct ValuesFormat
+{
+	bool bulk_arrays;
+	bool single_precision;
+};
+
+static ValuesFormat request_values_format(uint32_t request_word)
+{
+	ValuesFormat format;
+	format.bulk_arrays = request_word & REQUEST_FLAG_BULK_ARRAYS;
+	format.single_precision = request_word & REQUEST_FLAG_SINGLE_PRECISION;
+	return format;
+}
+
+// size of the rows in a streamed response chunk
+static const size_t STREAM_CHUNK_SIZE = 1024*1024;
+// the server runs as many request workers as parallel threads, a request is calculated on its worker only
+static const int SERVER_REQUEST_THREADS_COUNT = 1;
+
 static std::string request_type_to_string(const RequestType req_type)
 {
 	switch (req_type)
@@ -141,6 +180,10 @@ static std::string request_type_to_string(const RequestType req_type)
 		return "REQUEST_GET_TMP_BSP_VALUES_PROBES_2";
 	case REQUEST_GET_TMP_BSP_VALUES_PROBES_TRAIN:
 		return "REQUEST_GET_TMP_BSP_VALUES_PROBES_TRAIN";
+	case REQUEST_GET_TMP_BSP_VALUES_PROBES_DATASET:
+		return "REQUEST_GET_TMP_BSP_VALUES_PROBES_DATASET";
+	case REQUEST_GET_SERVER_STATS:
+		return "REQUEST_GET_SERVER_STATS";
 	default:
 		return "UNKNOWN";
 	}
@@ -161,62 +204,22 @@ enum TMPValuesSource
 	TMP_SOURCE_WAVE_PROPAGATION = 3,
 };
 
-
-static bool import_tmp_direct_values(const std::string& file_name, MatrixX<Real>& tmp_direct_values, int tmp_points_count)
-{
-	// read file contents
-	std::vector<uint8_t> contents;
-	file_read_vector(file_name.c_str(), contents);
-
-	Deserializer des(contents);
-
-	// parse
-
-	// vertex count
-	uint32_t rows_count = des.parse_u32();
-	uint32_t cols_count = des.parse_u32();
-	if (cols_count != tmp_points_count)
-	{
-		printf("TMP points count doesn't match\n");
-		return false;
-	}
-
-	MatrixX<Real> new_tmp_direct_values = MatrixX<Real>::Zero(rows_count, cols_count);
-
-	for (int i = 0; i < rows_count; i++)
-	{
-		for (int j = 0; j < cols_count; j++)
-		{
-			new_tmp_direct_values(i, j) = des.parse_double();
-		}
-	}
-
-	// set parameters
-	tmp_direct_values = new_tmp_direct_values;
-
-	return true;
-}
-
-static bool export_tmp_direct_values(const std::string& file_name, const MatrixX<Real>& tmp_direct_values)
+// read-only copy of what the compute-only server requests need, shared with the server worker threads
+struct ServerSnapshot
 {
-	Serializer ser;
-
-	// write
-
-	// rows and columns count
-	ser.push_u32(tmp_direct_values.rows());
-	ser.push_u32(tmp_direct_values.cols());
-
-	for (int i = 0; i < tmp_direct_values.rows(); i++)
-	{
-		for (int j = 0; j < tmp_direct_values.cols(); j++)
-		{
-			ser.push_double(tmp_direct_values(i, j));
-		}
-	}
+	std::vector<std::string> probes_names;
+	MatrixX<Real> ZPH; // probes transfer matrix (PROBES_COUNTxM)
+	MatrixX<Real> ZPH_interpolated; // ZPH*tmp_probes_interpolation_matrix (PROBES_COUNTxHEART_PROBES_COUNT)
+	SinglePrecisionMatrix ZPH_single;
+	SinglePrecisionMatrix ZPH_interpolated_single;
+	MatrixX<Real> tmp_probes_interpolation_matrix; // MxHEART_PROBES_COUNT
+	MatrixX<Real> heart_probes_matrix; // heart probes values from the heart potentials (HEART_PROBES_COUNTxM)
+	TMPValuesSource tmp_source;
+	std::vector<ActionPotentialParameters> heart_action_potential_params;
+	int sample_count;
+	Real TMP_dt;
+};
 
-	return file_write(file_name.c_str(), ser.get_data());
-}
 
 static bool export_tmp_bsp_values_csv(const std::string& file_name, const MatrixX<Real>& tmp_direct_values, const MatrixX<Real>& probes_values)
 {
@@ -282,108 +285,55 @@ static bool export_tmp_bsp_values_csv(const std::string& file_name, const Matrix
 	return true;
 }
 
-static bool dump_matrix_to_csv(const std::string& file_name, const std::vector<std::string>& names, const MatrixX<Real>& matrix)
+// same channels as the csv file (TMP_i, BSP_i) as a binary dataset
+static bool export_tmp_bsp_values_dataset(const std::string& file_name, const MatrixX<Real>& tmp_direct_values, const MatrixX<Real>& probes_values, 
+	Real dt, const DatasetOptions& options)
 {
-	FILE* file = fopen(file_name.c_str(), "w");
-	if (!file)
+	std::vector<std::string> names;
+	for (int i = 0; i < tmp_direct_values.cols(); i++)
 	{
-		return false;
+		names.push_back(std::string("TMP_") + std::to_string(i));
 	}
-
-	std::string line = "";
-
-	// column names
-	for (int i = 0; i < names.size(); i++)
+	for (int i = 0; i < probes_values.rows(); i++)
 	{
-		if (i != 0)
-		{
-			line += ", ";
-		}
-		line += names[i];
+		names.push_back(std::string("BSP_") + std::to_string(i));
 	}
-	line += "\n";
-	fwrite(line.c_str(), sizeof(char), line.size(), file);
-
-	// values
-	for (int i = 0; i < matrix.rows(); i++)
-	{
-		line = "";
-
-		// TMP values
-		for (int j = 0; j < matrix.cols(); j++)
-		{
-			if (j != 0)
-			{
-				line += ", ";
-			}
-			line += std::to_string(matrix(i, j));
-		}
 
-		line += "\n";
-		fwrite(line.c_str(), sizeof(char), line.size(), file);
-	}
+	MatrixX<Real> values(tmp_direct_values.rows(), tmp_direct_values.cols() + probes_values.rows());
+	values.leftCols(tmp_direct_values.cols()) = tmp_direct_values;
+	values.rightCols(probes_values.rows()) = probes_values.leftCols(tmp_direct_values.rows()).transpose();
 
-	fclose(file);
-	return true;
+	return save_dataset(file_name, names, values, 0, dt, options);
 }
 
-static bool save_matrix_to_file(const std::string& file_name, const MatrixX<Real>& matrix)
-{
-	Serializer ser;
-
-	// write matrix file header
-	ser.push_string("BinaryMatrixFile");
-	
-	// matrix dimensions
-	ser.push_u32(matrix.rows());
-	ser.push_u32(matrix.cols());
 
-	// values
-	for (int i = 0; i < matrix.rows(); i++)
-	{
-		for (int j = 0; j < matrix.cols(); j++)
-		{
-			ser.push_double(matrix(i, j));
-		}
-	}
+// range of the values of a mesh plot, always includes 0
+struct ValuesRange
+{
+	Real min;
+	Real max;
+	Real max_abs;
+};
 
-	return file_write(file_name.c_str(), ser.get_data());
+static ValuesRange make_values_range(Real min, Real max)
+{
+	ValuesRange range;
+	range.max = rmax(max, 0+1e-12);
+	range.min = rmin(min, 0-1e-12);
+	range.max_abs = rmax(rabs(range.max), rabs(range.min));
+	return range;
 }
 
-static bool load_matrix_from_file(const std::string& file_name, MatrixX<Real>& matrix)
+static ValuesRange calculate_values_range(const MeshPlot& mesh)
 {
-	// read file contents
-	std::vector<uint8_t> contents;
-	bool result = file_read_vector(file_name.c_str(), contents);
-	if (!result)
-	{
-		return false;
-	}
-
-	Deserializer des(contents);
-
-	// write matrix file header
-	std::string header = des.parse_string();
-	if (header != "BinaryMatrixFile")
-	{
-		return false;
-	}
-
-	// matrix dimensions
-	uint32_t rows_count = des.parse_u32();
-	uint32_t cols_count = des.parse_u32();
-	matrix.resize(rows_count, cols_count);
-
-	// values
-	for (int i = 0; i < rows_count; i++)
+	Real min = 1e12;
+	Real max = -1e12;
+	for (const MeshPlotVertex& vertex : mesh.vertices)
 	{
-		for (int j = 0; j < cols_count; j++)
-		{
-			matrix(i, j) = des.parse_double();
-		}
+		min = rmin(min, vertex.value);
+		max = rmax(max, vertex.value);
 	}
-
-	return true;
+	return make_values_range(min, max);
 }
 
 
@@ -517,13 +467,10 @@ public:
 		mpr = new MeshPlotRenderer;
 
 		// frame buffers
-		torso_fb = glFrameBuffer::create({ glTexture::create(width, height, FORMAT_RGBA, TYPE_FLOAT) }, glTexture::create(width, height, Format::FORMAT_DEPTH, Type::TYPE_FLOAT));
-		// heart fb
-		for (int i = 0; i < heart_mesh->groups_vertices.size(); i++)
-		{
-			std::shared_ptr<glFrameBuffer> new_fb = std::shared_ptr<glFrameBuffer>(glFrameBuffer::create({ glTexture::create(width, height, FORMAT_RGBA, TYPE_FLOAT) }, glTexture::create(width, height, Format::FORMAT_DEPTH, Type::TYPE_FLOAT)));
-			heart_mesh_groups_frame_buffers.push_back(new_fb);
-		}
+		// the frame buffers hold colors only (RGBA8)
+		torso_fb = glFrameBuffer::create({ glTexture::create(width, height, FORMAT_RGBA, TYPE_UNSIGNED_BYTE) }, glTexture::create(width, height, Format::FORMAT_DEPTH, Type::TYPE_FLOAT));
+		// heart fb, reused by all the groups (every group is composited before rendering the next)
+		heart_group_fb = glFrameBuffer::create({ glTexture::create(width, height, FORMAT_RGBA, TYPE_UNSIGNED_BYTE) }, glTexture::create(width, height, Format::FORMAT_DEPTH, Type::TYPE_FLOAT));
 
 		// LookAtCamera
 		camera = default_camera;
@@ -538,7 +485,7 @@ public:
 
 		// setup server
 		initialize_socket();
-		if (!server.start((server_address_select == 0) ? ADDRESS_LOCALHOST : ADDRESS_THISHOST, server_port))
+		if (!start_server((server_address_select == 0) ? ADDRESS_LOCALHOST : ADDRESS_THISHOST, server_port))
 		{
 			printf("Failed to start the server\n");
 		}
@@ -567,6 +514,10 @@ public:
 		frame_timer.start();
 		while (!glfwWindowShouldClose(window))
 		{
+			// the server request thread waits while the frame is updated and rendered,
+			// and handles the requests while the main loop waits for v-sync and events
+			std::unique_lock<std::mutex> state_lock(app_state_mutex);
+
 			// handle window size change
 			glfwGetWindowSize(window, &width, &height);
 			gldev->resizeBackbuffer(width, height);
@@ -577,10 +528,7 @@ public:
 			torso_fb->resize(width, height);
 			Input::setWindowSize(width, height);
 			// groups fb
-			for (std::shared_ptr<glFrameBuffer> group_fb : heart_mesh_groups_frame_buffers)
-			{
-				group_fb->resize(width, height);
-			}
+			heart_group_fb->resize(width, height);
 
 
 			// frame timer
@@ -597,17 +545,35 @@ public:
 			// render
 			render();
 
+			// keep the snapshot of the server workers up to date
+			if (server.is_running())
+			{
+				update_server_snapshot();
+			}
+
+			state_lock.unlock();
+
+			// server stop requested from the GUI (the request thread can't be joined while the state is locked)
+			if (server_stop_requested)
+			{
+				server_stop_requested = false;
+				if (!stop_server())
+				{
+					printf("Failed to stop the server\n");
+				}
+			}
+
 			// swap buffers
 			glfwSwapBuffers(window);
 
 			// poll events
 			Input::newFrame();
 			glfwPollEvents();
-
-			// handle server requests
-			handle_server_requests();
 		}
 
+		// stop the server first, its request thread uses the application state
+		stop_server();
+
 		// cleanup
 		ImGui_ImplOpenGL3_Shutdown();
 		ImGui_ImplGlfw_Shutdown();
@@ -623,7 +589,6 @@ public:
 		delete gldev;
 		glfwDestroyWindow(window);
 		glfwTerminate();
-		server.stop();
 	}
 
 private:
@@ -638,6 +603,11 @@ private:
 		}
 
 		torso = new_torso;
+		torso_values_range_valid = false;
+
+		// cached transfer matrix blocks belong to the old torso
+		transfer_matrix_pipeline.invalidate();
+		torso_probes_operator.invalidate();
 
 		// vertices count
 		N = torso->vertices.size();
@@ -656,22 +626,31 @@ private:
 		return true;
 	}
 
-	Real evaluate_heart_probe(const Probe& probe, int probe_index)
+	Real evaluate_heart_probe(int probe_index)
 	{
 		if (use_interpolation_to_calculate_probe_value)
 		{
 			return (tmp_probes_interpolation_matrix_inv.row(probe_index)*QH)(0);
 		}
 
-		return evaluate_probe(*heart_mesh, probe);
+		if (QH.rows() != M)
+		{
+			return 0;
+		}
+		return heart_probes_operator.get_matrix(*heart_mesh, heart_probes).row(probe_index).dot(QH.col(0));
 	}
 
-	Real evaluate_torso_probe(const Probe& probe)
+	Real evaluate_torso_probe(int probe_index)
 	{
-		return evaluate_probe(*torso, probe);
+		if (QB.rows() != N)
+		{
+			return 0;
+		}
+		return torso_probes_operator.get_matrix(*torso, probes).row(probe_index).dot(QB.col(0));
 	}
 
-	void calculate_transfer_matrix()
+	// store_in_cache: false for the automatic updates, every heart move would add a matrix to the cache
+	void calculate_transfer_matrix(bool store_in_cache = true)
 	{
 		/*
 		// BEM solver (bounded conductor) for the heart and dipole
@@ -713,106 +692,19 @@ private:
 		// BEM solver (bounded conductor with defined TMP distribution)
 		// Matrices derived from potentials at the torso
 
-		printf("Calculating the transfer matrix...\n");
+		printf("Calculating the transfer matrix (%d threads)...\n", get_parallel_threads_count());
 		Timer matrix_calculations_timer;
 		matrix_calculations_timer.start();
 
-		// PBB (NxN)
-		MatrixX<Real> PBB = MatrixX<Real>::Zero(N, N);
-		for (int i = 0; i < N; i++)
-		{
-			// vertex position
-			const MeshPlotVertex& vertex = torso->vertices[i];
-			Vector3<Real> r = glm2eigen(vertex.pos);
-
-			// A: For torso faces
-			for (const MeshPlotFace& face : torso->faces)
-			{
-				Vector3<Real> a = glm2eigen(torso->vertices[face.idx[0]].pos);
-				Vector3<Real> b = glm2eigen(torso->vertices[face.idx[1]].pos);
-				Vector3<Real> c = glm2eigen(torso->vertices[face.idx[2]].pos);
-				//Vector3<Real> face_normal = (glm2eigen(torso.vertices[face.idx[0]].normal)+glm2eigen(torso.vertices[face.idx[1]].normal)+glm2eigen(torso.vertices[face.idx[2]].normal))/3;
-				Vector3<Real> face_normal = (b-a).cross(c-a).normalized();
-
-				Real area = ((b-a).cross(c-a)).norm()/2;
-				Vector3<Real> center = (a+b+c)/3; // triangle center
-				Vector3<Real> r_vec = r-center; // r-c
-				//Real solid_angle = r_vec.normalized().dot(face_normal)*area / (pow(r_vec.norm(), 2)); // omega = (r^.n^ * ds)/(r*r)
-				Real solid_angle = r_vec.normalized().dot(face_normal)*area / (pow(r_vec.norm(), r_power)); // omega = (r^.n^ * ds)/(r*r)
-				Real const_val = 1/(4*PI)*solid_angle;
-
-				// skip for close region triangles
-				if ((center-r).norm() < close_range_threshold)
-				{
-					continue;
-				}
-
-				// ignore negative dot product
-				if (ignore_negative_dot_product && r_vec.dot(face_normal) < 0)
-				{
-					continue;
-				}
-
-				PBB(i, face.idx[0]) += const_val/3;
-				PBB(i, face.idx[1]) += const_val/3;
-				PBB(i, face.idx[2]) += const_val/3;
-			}
-
-			PBB(i, i) = PBB(i, i) + 1; // test new equation
-			//PBB(i, i) = PBB(i, i) - 1; // TODO: CHECK    PBB(i, i) = -1;
-			//PBB(i, i) = -1;
-		}
-
-		// print status
-		printf("Calculated PBB matrix in: %.3f sec\n", matrix_calculations_timer.elapsed_seconds());
-		matrix_calculations_timer.start();
-
-		// PBH (NxM)
-		MatrixX<Real> PBH = MatrixX<Real>::Zero(N, M);
-		for (int i = 0; i < N; i++)
-		{
-			// vertex position
-			const MeshPlotVertex& vertex = torso->vertices[i];
-			Vector3<Real> r = glm2eigen(vertex.pos);
-
-			// A: For heart faces
-			for (const MeshPlotFace& face : heart_mesh->faces)
-			{
-				Vector3<Real> a = heart_pos + glm2eigen(heart_mesh->vertices[face.idx[0]].pos);
-				Vector3<Real> b = heart_pos + glm2eigen(heart_mesh->vertices[face.idx[1]].pos);
-				Vector3<Real> c = heart_pos + glm2eigen(heart_mesh->vertices[face.idx[2]].pos);
-				//Vector3<Real> face_normal = (glm2eigen(torso.vertices[face.idx[0]].normal)+glm2eigen(torso.vertices[face.idx[1]].normal)+glm2eigen(torso.vertices[face.idx[2]].normal))/3;
-				Vector3<Real> face_normal = (b-a).cross(c-a).normalized();
-
-				// flip normal
-				if (heart_mesh_invert_group_normal[heart_mesh->vertices[face.idx[0]].group]
-					|| heart_mesh_invert_group_normal[heart_mesh->vertices[face.idx[1]].group]
-					|| heart_mesh_invert_group_normal[heart_mesh->vertices[face.idx[2]].group])
-				{
-					face_normal = -face_normal;
-				}
-
-				Real area = ((b-a).cross(c-a)).norm()/2;
-				Vector3<Real> center = (a+b+c)/3; // triangle center
-				Vector3<Real> r_vec = r-center; // r-c
-				//Real solid_angle = r_vec.normalized().dot(face_normal)*area / r_vec.squaredNorm(); // omega = (r^.n^ * ds)/(r*r)
-				Real solid_angle = r_vec.normalized().dot(face_normal)*area / (pow(r_vec.norm(), r_power)); // omega = (r^.n^ * ds)/(r*r)
-				Real const_val = -heart_conductivity/(4*PI*toso_conductivity)*solid_angle;
-
-				// ignore negative dot product
-				if (ignore_negative_dot_product && r_vec.dot(face_normal) < 0)
-				{
-					continue;
-				}
-
-				PBH(i, face.idx[0]) += const_val/3;
-				PBH(i, face.idx[1]) += const_val/3;
-				PBH(i, face.idx[2]) += const_val/3;
-			}
-		}
+		// only the blocks affected by the changed inputs are recalculated
+		transfer_matrix_pipeline.set_inputs(get_transfer_matrix_inputs());
+		transfer_matrix_pipeline.update(ZBH, store_in_cache);
+		transfer_matrix_inputs_hash = hash_transfer_matrix_inputs(transfer_matrix_pipeline.get_inputs());
+		probes_transfer_matrix.invalidate();
+		transfer_matrix_version++;
 
 		// print status
-		printf("Calculated PBH matrix in: %.3f sec\n", matrix_calculations_timer.elapsed_seconds());
+		printf("Calculated the transfer matrix in: %.3f sec\n", matrix_calculations_timer.elapsed_seconds());
 		matrix_calculations_timer.start();
 
 
@@ -837,28 +729,27 @@ private:
 		*/
 
 		
-		// ZBH = PBB^-1 * PBH
-		ZBH = PBB.inverse() * PBH;
-
 		//ZBH = MatrixX<Real>::Zero(N, M);
 
 		//ZBH = -PBH; // without bounded counductor effect
 
 		// TODO: try to fix the first equation.
+	}
 
-		// DEBUG:
-		//printf("%d %d\n", ZBH.rows(), ZBH.cols());
-		//for (int i = 0; i < ZBH.rows(); i++)
-		//{
-		//	for (int j = 0; j < ZBH.cols(); j++)
-		//	{
-		//		printf("%.3f ", ZBH(i, j));
-		//	}
-		//}
-
-		// print status
-		printf("Calculated transfer matrix (ZBH) in: %.3f sec\n", matrix_calculations_timer.elapsed_seconds());
-		matrix_calculations_timer.start();
+	TransferMatrixInputs get_transfer_matrix_inputs()
+	{
+		TransferMatrixInputs inputs;
+		inputs.torso = torso;
+		inputs.heart = heart_mesh;
+		inputs.heart_pos = heart_pos;
+		inputs.heart_scale = heart_scale;
+		inputs.heart_invert_group_normal = heart_mesh_invert_group_normal;
+		inputs.params.torso_conductivity = toso_conductivity;
+		inputs.params.heart_conductivity = heart_conductivity;
+		inputs.params.close_range_threshold = close_range_threshold;
+		inputs.params.r_power = r_power;
+		inputs.params.ignore_negative_dot_product = ignore_negative_dot_product;
+		return inputs;
 	}
 
 	void calculate_torso_potentials()
@@ -909,49 +800,129 @@ private:
 
 		// TMP forward ecg
 		// Q_B = ZBH * Q_H
-		QB = ZBH * QH;
-
-
-		//// debug
-		//if (Input::isKeyDown(GLFW_KEY_I))
-		//{
-		//	Q = IA_inv * B;
-		//}
-		//else
-		//{
-		//	Q = B;
-		//}
+		::calculate_torso_potentials(ZBH, QH, QB);
 
+		// apply reference probe (to potentials in toso model only not Q)
+		if (reference_probe != -1)
+		{
+			apply_reference_probe(torso_probes_operator.get_matrix(*torso, probes), reference_probe, QB);
+		}
 
-		// update torso potentials
+		// update torso potentials (and their range for render)
+		Real torso_min = 1e12;
+		Real torso_max = -1e12;
 		for (int i = 0; i < torso->vertices.size(); i++)
 		{
 			torso->vertices[i].value = QB(i);
+			torso_min = rmin(torso_min, torso->vertices[i].value);
+			torso_max = rmax(torso_max, torso->vertices[i].value);
 		}
+		torso_values_range = make_values_range(torso_min, torso_max);
+		torso_values_range_valid = true;
 
-		// update heart potentials
+		// update heart potentials (and their range for render)
+		Real heart_min = 1e12;
+		Real heart_max = -1e12;
 		for (int i = 0; i < heart_mesh->vertices.size(); i++)
 		{
 			heart_mesh->vertices[i].value = QH(i);
+			heart_min = rmin(heart_min, heart_mesh->vertices[i].value);
+			heart_max = rmax(heart_max, heart_mesh->vertices[i].value);
 		}
+		heart_values_range = make_values_range(heart_min, heart_max);
+		heart_values_range_valid = true;
 
+	}
 
-		// apply reference probe (to potentials in toso model only not Q)
+	// heart potentials of the first samples_count samples of the TMP source (MxSAMPLE_COUNT)
+	void calculate_tmp_samples(int samples_count, MatrixX<Real>& QH_samples)
+	{
+		if (tmp_source == TMP_SOURCE_ACTION_POTENTIAL_PARAMETERS)
+		{
+			calculate_action_potential_tmp_samples(heart_action_potential_params, samples_count, TMP_dt, QH_samples);
+		}
+		else /*TMP_SOURCE_WAVE_PROPAGATION*/
+		{
+			// wave propagation (sequential unless the simulation is event-driven)
+			wave_prop.calculate_potentials_samples(samples_count, QH_samples);
+		}
+	}
+
+	// body surface potentials of all the samples (NxSAMPLE_COUNT), no mesh values are updated
+	void calculate_torso_potentials_samples(const MatrixX<Real>& QH_samples, MatrixX<Real>& QB_samples)
+	{
+		::calculate_torso_potentials_samples(ZBH, QH_samples, QB_samples);
+
+		// apply reference probe
 		if (reference_probe != -1)
 		{
-			Real reference_value = evaluate_torso_probe(probes[reference_probe]);
-			// Torso
-			for (int i = 0; i < torso->vertices.size(); i++)
-			{
-				QB(i) = QB(i) - reference_value;
-			}
-			// update torso potentials
-			for (int i = 0; i < torso->vertices.size(); i++)
+			apply_reference_probe(torso_probes_operator.get_matrix(*torso, probes), reference_probe, QB_samples);
+		}
+	}
+
+	// heart probes values of the given heart potentials samples (HEART_PROBES_COUNTxSAMPLE_COUNT)
+	void evaluate_heart_probes(const MatrixX<Real>& QH_samples, MatrixX<Real>& values)
+	{
+		if (use_interpolation_to_calculate_probe_value)
+		{
+			if (tmp_probes_interpolation_matrix_inv.rows() != heart_probes.size() || tmp_probes_interpolation_matrix_inv.cols() != QH_samples.rows())
 			{
-				torso->vertices[i].value = QB(i);
+				// interpolation matrix is not recalculated yet
+				values = MatrixX<Real>::Zero(heart_probes.size(), QH_samples.cols());
+				return;
 			}
+			values = tmp_probes_interpolation_matrix_inv*QH_samples;
+			return;
+		}
+
+		if (QH_samples.rows() != M)
+		{
+			values = MatrixX<Real>::Zero(heart_probes.size(), QH_samples.cols());
+			return;
+		}
+		values = heart_probes_operator.get_matrix(*heart_mesh, heart_probes)*QH_samples;
+	}
+
+	// torso probes values of the given body surface potentials samples (PROBES_COUNTxSAMPLE_COUNT)
+	void evaluate_torso_probes(const MatrixX<Real>& QB_samples, MatrixX<Real>& values)
+	{
+		if (QB_samples.rows() != N)
+		{
+			values = MatrixX<Real>::Zero(probes.size(), QB_samples.cols());
+			return;
 		}
+		values = torso_probes_operator.get_matrix(*torso, probes)*QB_samples;
+	}
+
+	// torso probes values of the given heart potentials samples through the probes transfer matrix,
+	// the body surface potentials are not calculated (PROBES_COUNTxSAMPLE_COUNT)
+	void calculate_torso_probes_samples(const MatrixX<Real>& QH_samples, MatrixX<Real>& probes_samples)
+	{
+		const MatrixX<Real>& ZPH = probes_transfer_matrix.get_matrix(ZBH, torso_probes_operator, *torso, probes, reference_probe);
+		::calculate_torso_potentials_samples(ZPH, QH_samples, probes_samples);
+	}
+
+	// torso probes values of the given heart probes samples (interpolated to the heart using tmp_probes_interpolation_matrix)
+	// (PROBES_COUNTxSAMPLE_COUNT)
+	void calculate_torso_probes_samples_from_heart_probes(const MatrixX<Real>& heart_probes_samples, MatrixX<Real>& probes_samples)
+	{
+		const MatrixX<Real>& ZPH_interpolated = probes_transfer_matrix.get_interpolated_matrix(ZBH, torso_probes_operator, *torso, probes, 
+			reference_probe, tmp_probes_interpolation_matrix);
+		::calculate_torso_potentials_samples(ZPH_interpolated, heart_probes_samples, probes_samples);
+	}
 
+	// heart probes and torso probes values of the first samples_count samples of the TMP source
+	// (SAMPLE_COUNTx(HEART_PROBES_COUNT+PROBES_COUNT))
+	void calculate_tmp_bsp_probes_values(int samples_count, MatrixX<Real>& TMP_BSP_values)
+	{
+		MatrixX<Real> QH_samples, heart_probes_samples, probes_samples;
+		calculate_tmp_samples(samples_count, QH_samples);
+		calculate_torso_probes_samples(QH_samples, probes_samples);
+		evaluate_heart_probes(QH_samples, heart_probes_samples);
+
+		TMP_BSP_values.resize(samples_count, heart_probes.size()+probes.size());
+		TMP_BSP_values.leftCols(heart_probes.size()) = heart_probes_samples.transpose();
+		TMP_BSP_values.rightCols(probes.size()) = probes_samples.transpose();
 	}
 
 	void update()
@@ -963,6 +934,16 @@ private:
 			camera.eye = camera.look_at + glm::vec3(camera_eye_radius*sin(camera_angle), 0, camera_eye_radius*cos(camera_angle));
 		}
 
+		// keep the transfer matrix up to date with the heart placement
+		if (auto_update_transfer_matrix)
+		{
+			transfer_matrix_pipeline.set_inputs(get_transfer_matrix_inputs());
+			if (transfer_matrix_pipeline.needs_update())
+			{
+				calculate_transfer_matrix(false);
+			}
+		}
+
 		/*
 		// animate dipole vector on the curve
 		if (dipole_vec_source == VALUES_SOURCE_BEZIER_CURVE)
@@ -1109,6 +1090,8 @@ private:
 			}
 
 			last_heart_probes_count = heart_probes.size();
+			probes_transfer_matrix.invalidate_interpolation();
+			interpolation_matrix_version++;
 		}
 
 		// TMP action potential
@@ -1123,8 +1106,6 @@ private:
 				sample_count = TMP_total_duration/TMP_dt + 1;
 				probes_values.resize(probes.size(), sample_count);
 				heart_probes_values.resize(heart_probes.size(), sample_count);
-				// heart_probes_values_temp
-				heart_probes_values_temp.resize(1, heart_probes.size());
 
 				for (int step = 0; step < TMP_steps_per_frame; step++)
 				{
@@ -1136,28 +1117,15 @@ private:
 					t = current_sample*TMP_dt;
 
 					// update heart TMP from action potential parameters
-					for (int i = 0; i < heart_mesh->vertices.size(); i++)
-					{
-						QH(i) = extracellular_potential(t, TMP_dt, heart_action_potential_params[i]); //action_potential_value_2
-					}
+					calculate_action_potential_tmp(heart_action_potential_params, t, TMP_dt, QH);
 
 					if (use_interpolation_for_action_potential)
 					{
 						// update heart TMP from action potential parameters
-						for (int i = 0; i < M; i++)
-						{
-							QH(i) = extracellular_potential(t, dt, heart_action_potential_params[i]); //action_potential_value_2
-						}
+						calculate_action_potential_tmp(heart_action_potential_params, t, dt, QH);
 
 						// update heart probes values
-						for (int i = 0; i < heart_mesh->vertices.size(); i++)
-						{
-							heart_mesh->vertices[i].value = QH(i);
-						}
-						for (int i = 0; i < heart_probes.size(); i++)
-						{
-							heart_probes_values_temp(i) = evaluate_heart_probe(heart_probes[i], i);
-						}
+						evaluate_heart_probes(QH, heart_probes_values_temp);
 
 						// use interpolation for heart potentials using heart probes
 						if (heart_probes.size() > 0)
@@ -1178,16 +1146,12 @@ private:
 					calculate_torso_potentials();
 
 					// update probes
-					for (int i = 0; i < heart_probes.size(); i++)
-					{
-						heart_probes_values(i, current_sample) = evaluate_heart_probe(heart_probes[i], i);
-					}
+					evaluate_heart_probes(QH, heart_probes_current_values);
+					heart_probes_values.col(current_sample) = heart_probes_current_values;
 
 					// calculate probes values at time point
-					for (int i = 0; i < probes.size(); i++)
-					{
-						probes_values(i, current_sample) = evaluate_torso_probe(probes[i]);
-					}
+					evaluate_torso_probes(QB, probes_current_values);
+					probes_values.col(current_sample) = probes_current_values;
 
 					// clear probes graph
 					if (probes_graph_clear_at_t0 && current_sample == 0)
@@ -1234,16 +1198,12 @@ private:
 					calculate_torso_potentials();
 
 					// update probes
-					for (int i = 0; i < heart_probes.size(); i++)
-					{
-						heart_probes_values(i, current_sample) = evaluate_heart_probe(heart_probes[i], i);
-					}
+					evaluate_heart_probes(QH, heart_probes_current_values);
+					heart_probes_values.col(current_sample) = heart_probes_current_values;
 
 					// calculate probes values at time point
-					for (int i = 0; i < probes.size(); i++)
-					{
-						probes_values(i, current_sample) = evaluate_torso_probe(probes[i]);
-					}
+					evaluate_torso_probes(QB, probes_current_values);
+					probes_values.col(current_sample) = probes_current_values;
 
 					// clear probes graph
 					if (probes_graph_clear_at_t0 && current_sample == 0)
@@ -1268,16 +1228,12 @@ private:
 				calculate_torso_potentials();
 
 				// update probes
-				for (int i = 0; i < heart_probes.size(); i++)
-				{
-					heart_probes_values(i, current_sample) = evaluate_heart_probe(heart_probes[i], i);
-				}
+				evaluate_heart_probes(QH, heart_probes_current_values);
+				heart_probes_values.col(current_sample) = heart_probes_current_values;
 
 				// calculate probes values at time point
-				for (int i = 0; i < probes.size(); i++)
-				{
-					probes_values(i, current_sample) = evaluate_torso_probe(probes[i]);
-				}
+				evaluate_torso_probes(QB, probes_current_values);
+				probes_values.col(current_sample) = probes_current_values;
 
 				// clear probes graph
 				if (probes_graph_clear_at_t0 && current_sample == 0)
@@ -1301,23 +1257,15 @@ private:
 		gldev->setAlpha(Alpha{ true, Alpha::SRC_ALPHA, Alpha::ONE_MINUS_SRC_ALPHA });
 
 
-		// calculate torso maximum and minimum values
-		Real torso_potential_max = -1e12;
-		Real torso_potential_min = 1e12;
-		for (MeshPlotVertex& vertex : torso->vertices)
+		// torso maximum and minimum values (calculated with the potentials, scanned only if the values were overwritten)
+		if (!torso_values_range_valid)
 		{
-			torso_potential_min = rmin(torso_potential_min, vertex.value);
-			torso_potential_max = rmax(torso_potential_max, vertex.value);
+			torso_values_range = calculate_values_range(*torso);
+			torso_values_range_valid = true;
 		}
-		// limit min and max to 0
-		torso_potential_max = rmax(torso_potential_max, 0+1e-12);
-		torso_potential_min = rmin(torso_potential_min, 0-1e-12);
-		Real torso_potential_max_abs = rmax(rabs(torso_potential_max), rabs(torso_potential_min));
-		torso_potential_max_abs = rmax(1e-12, torso_potential_max_abs);
-		//torso_potential_max = torso_potential_max_abs;
-		//torso_potential_min = -torso_potential_max_abs;
-
-		Real max_abs_torso = rmax(rabs(torso_potential_max), rabs(torso_potential_min));
+		Real torso_potential_max = torso_values_range.max;
+		Real torso_potential_min = torso_values_range.min;
+		Real max_abs_torso = torso_values_range.max_abs;
 
 		// adaptive range
 		if (torso_potential_adaptive_range)
@@ -1372,6 +1320,7 @@ private:
 					break;
 				}
 			}
+			heart_values_range_valid = false;
 		}
 
 		// prepare renderer 2D
@@ -1382,22 +1331,22 @@ private:
 		if (tmp_source == TMP_SOURCE_WAVE_PROPAGATION)
 		{
 			wave_prop.render();
+			// the preview overwrites the heart values
+			if (wave_prop.is_mesh_in_preview())
+			{
+				heart_values_range_valid = false;
+			}
 		}
 
-		// calculate heart maximum and minimum values
-		Real heart_potential_max = -1e12;
-		Real heart_potential_min = 1e12;
-		for (int i = 0; i < heart_mesh->vertices.size(); i++)
+		// heart maximum and minimum values (calculated with the potentials, scanned only if the values were overwritten)
+		if (!heart_values_range_valid)
 		{
-			heart_potential_min = rmin(heart_potential_min, heart_mesh->vertices[i].value);
-			heart_potential_max = rmax(heart_potential_max, heart_mesh->vertices[i].value);
+			heart_values_range = calculate_values_range(*heart_mesh);
+			heart_values_range_valid = true;
 		}
-
-		heart_potential_max = rmax(heart_potential_max, 0+1e-12);
-		heart_potential_min = rmin(heart_potential_min, 0-1e-12);
-		// calculate maximum absolute value
-		Real max_abs_heart = rmax(rabs(heart_potential_max), rabs(heart_potential_min));
-		max_abs_heart = rmax(1e-12, max_abs_heart);
+		Real heart_potential_max = heart_values_range.max;
+		Real heart_potential_min = heart_values_range.min;
+		Real max_abs_heart = heart_values_range.max_abs;
 
 		// calculate heart maximum and minimum values for the scale
 		if (tmp_source == TMP_SOURCE_WAVE_PROPAGATION && !wave_prop.is_mesh_in_preview())
@@ -1471,37 +1420,38 @@ private:
 			{
 				heart_mesh->vertices[i].value = probe_interpolation_effect(i);
 			}
+			heart_values_range_valid = false;
 
 			// update heart potential values at GPU
 			heart_mesh->update_gpu_buffers();
 		}
 
-		// render heart mesh into separate frame buffers then to the main buffer
+		// render every heart mesh group (its range of the index buffer) into the group frame buffer then to the main buffer
 		for (int i = 0; i < heart_mesh->groups_vertices.size(); i++)
 		{
-			// select only heart mesh vertices in group
-			for (MeshPlotVertex& vertex : heart_mesh->vertices)
+			// skip invisible groups
+			if (heart_mesh_groups_opacity[i] <= 0)
 			{
-				vertex.opacity = vertex.group == i ? 1 : 0;
+				continue;
 			}
-			heart_mesh->update_gpu_buffers();
 
-			// render heart mesh group to a frame buffer
-			heart_mesh_groups_frame_buffers[i]->bind();
+			// render heart mesh group to the frame buffer
+			heart_group_fb->bind();
 			gldev->clearColorBuffer(0, 0, 0, 0);
 			gldev->clearDepthBuffer(1.0);
 			gldev->depthTest(STATE_ENABLED);
 			mpr->set_colors(color_p, color_n);
 			mpr->set_view_projection_matrix(camera.calculateViewProjection());
 			mpr->set_opacity_threshold(0.5);
-			mpr->render_mesh_plot(translate(eigen2glm(heart_pos))*scale(glm::vec3(heart_render_scale)), heart_mesh, render_heart_wireframe, { 0, 0, 0, 1 }, render_heart_wireframe_line_width);
-			torso_fb->unbind();
+			// heart_scale isn't applied, it belongs to the BEM solve only
+			mpr->render_mesh_plot_group(translate(eigen2glm(heart_pos))*scale(glm::vec3(heart_render_scale)), heart_mesh, i, render_heart_wireframe, { 0, 0, 0, 1 }, render_heart_wireframe_line_width);
+			heart_group_fb->unbind();
 			gldev->bindBackbuffer();
 
-			// render torso_fb texture
+			// render heart_group_fb texture
 			gldev->depthTest(STATE_DISABLED);
 			Renderer2D::setProjection(ortho(0, width, height, 0, -1, 1));
-			Renderer2D::drawTexture({ width/2, height/2 }, { width, height }, heart_mesh_groups_frame_buffers[i]->getColorTexture(0), { 1, 1, 1, heart_mesh_groups_opacity[i]});
+			Renderer2D::drawTexture({ width/2, height/2 }, { width, height }, heart_group_fb->getColorTexture(0), { 1, 1, 1, heart_mesh_groups_opacity[i]});
 		}
 
 		// render torso to torso_fb
@@ -1524,21 +1474,38 @@ private:
 		// heart element effect
 		if (view_heart_element_selected_by_probe_effect && heart_current_selected_probe != -1)
 		{
-			// calculate the effect
-			static VectorX<Real> element_heart_values;
-			element_heart_values = VectorX<Real>::Zero(M);
-			element_heart_values(heart_mesh->faces[heart_probes[heart_current_selected_probe].triangle_idx].idx[0]) = 1;
-			element_heart_values(heart_mesh->faces[heart_probes[heart_current_selected_probe].triangle_idx].idx[1]) = 1;
-			element_heart_values(heart_mesh->faces[heart_probes[heart_current_selected_probe].triangle_idx].idx[2]) = 1;
+			// calculate the effect (ZBH times 1 at the element vertices = sum of their ZBH columns),
+			// recalculated only when the element or ZBH change
 			static VectorX<Real> element_torso_values;
-			element_torso_values = ZBH * element_heart_values;
-
-			// set range
-			Real max_abs_effect = 1e-14;
-			for (int i = 0; i < N; i++)
+			static Real max_abs_effect = 1e-14;
+			static int element_triangle_idx = -1;
+			static int element_transfer_matrix_version = -1;
+			const int triangle_idx = heart_probes[heart_current_selected_probe].triangle_idx;
+			if (triangle_idx != element_triangle_idx || transfer_matrix_version != element_transfer_matrix_version || element_torso_values.size() != N)
 			{
-				max_abs_effect = rmax(max_abs_effect, rabs(element_torso_values(i)));
+				const MeshPlotFace& face = heart_mesh->faces[triangle_idx];
+				element_torso_values = ZBH.col(face.idx[0]);
+				if (face.idx[1] != face.idx[0])
+				{
+					element_torso_values += ZBH.col(face.idx[1]);
+				}
+				if (face.idx[2] != face.idx[0] && face.idx[2] != face.idx[1])
+				{
+					element_torso_values += ZBH.col(face.idx[2]);
+				}
+
+				// range
+				max_abs_effect = 1e-14;
+				for (int i = 0; i < N; i++)
+				{
+					max_abs_effect = rmax(max_abs_effect, rabs(element_torso_values(i)));
+				}
+
+				element_triangle_idx = triangle_idx;
+				element_transfer_matrix_version = transfer_matrix_version;
 			}
+
+			// set range
 			mpr->set_values_range(-max_abs_effect*torso_potential_range_multiplier, max_abs_effect*torso_potential_range_multiplier);
 
 			// update torso potentials
@@ -1546,6 +1513,7 @@ private:
 			{
 				torso->vertices[i].value = element_torso_values(i);
 			}
+			torso_values_range_valid = false;
 
 			torso->update_gpu_buffers();
 		}
@@ -1701,7 +1669,8 @@ private:
 			}
 		}
 		ImGui::DragVector3Eigen("Heart position", heart_pos, 0.01f);
-		ImGui::InputReal("Heart scale", &heart_scale);
+		// the transfer matrix solve only, the rendering, probes and wave propagation use the unscaled heart mesh
+		ImGui::InputReal("Heart scale (BEM solve only)", &heart_scale);
 		// conductivities
 		ImGui::InputReal("Air Conductivity", &air_conductivity, 0.01, 10);
 		ImGui::InputReal("Torso Conductivity", &toso_conductivity, 0.01, 10);
@@ -1730,6 +1699,30 @@ private:
 		{
 			calculate_transfer_matrix();
 		}
+		ImGui::Checkbox("Auto Update Coefficients Matrix", &auto_update_transfer_matrix);
+		// cache
+		TransferMatrixCache& transfer_matrix_cache = transfer_matrix_pipeline.get_cache();
+		bool use_cache = transfer_matrix_cache.is_enabled();
+		if (ImGui::Checkbox("Cache Coefficients Matrices", &use_cache))
+		{
+			transfer_matrix_cache.set_directory(use_cache ? transfer_matrix_cache_directory : "");
+		}
+		if (use_cache)
+		{
+			TransferMatrixCacheStats cache_stats = transfer_matrix_cache.get_stats();
+			ImGui::Text("Cache \"%s\": %d matrices, %.1f MB", transfer_matrix_cache_directory.c_str(), cache_stats.files_count, cache_stats.size/(1024.0*1024.0));
+			ImGui::Text("Cache hits: %llu, misses: %llu", (unsigned long long)cache_stats.hits, (unsigned long long)cache_stats.misses);
+			int cache_max_size_mb = transfer_matrix_cache.get_max_size()/(1024*1024);
+			if (ImGui::InputInt("Cache Max Size (MB)", &cache_max_size_mb) && cache_max_size_mb > 0)
+			{
+				transfer_matrix_cache.set_max_size((uint64_t)cache_max_size_mb*1024*1024);
+			}
+			if (ImGui::Button("Clear Cache"))
+			{
+				transfer_matrix_cache.clear();
+				transfer_matrix_cache.reset_stats();
+			}
+		}
 		// save and load
 		if (ImGui::Button("Load Coefficients Matrix"))
 		{
@@ -1739,13 +1732,20 @@ private:
 			// export
 			if (file_name != "")
 			{
+				// rejected if it was calculated from other meshes or parameters
 				MatrixX<Real> new_ZBH;
-				bool result = load_matrix_from_file(file_name, new_ZBH);
+				const TransferMatrixInputs inputs = get_transfer_matrix_inputs();
+				uint64_t inputs_hash = hash_transfer_matrix_inputs(inputs);
+				bool result = load_transfer_matrix_file(file_name, inputs_hash, new_ZBH);
 				if (result)
 				{
-					if (new_ZBH.size() == ZBH.size())
+					if (new_ZBH.rows() == ZBH.rows() && new_ZBH.cols() == ZBH.cols())
 					{
-						ZBH = new_ZBH;
+						ZBH.swap(new_ZBH);
+						transfer_matrix_inputs_hash = inputs_hash;
+						transfer_matrix_pipeline.adopt_transfer_matrix(inputs);
+						probes_transfer_matrix.invalidate();
+						transfer_matrix_version++;
 					}
 					else
 					{
@@ -1772,7 +1772,7 @@ private:
 			// export
 			if (file_name != "")
 			{
-				if (save_matrix_to_file(file_name, ZBH))
+				if (save_matrix_file(file_name, ZBH, transfer_matrix_inputs_hash))
 				{
 					printf("Saved \"%s\" Coefficients Matrix File\n", file_name.c_str());
 				}
@@ -1801,7 +1801,7 @@ private:
 			if (ImGui::Button("Start Server"))
 			{
 				Address addr = (server_address_select == 0) ? ADDRESS_LOCALHOST : ADDRESS_THISHOST;
-				if (!server.start(addr, server_port))
+				if (!start_server(addr, server_port))
 				{
 					printf("Failed to start the server %s:%d\n", addr.to_string().c_str(), server_port);
 				}
@@ -1813,10 +1813,51 @@ private:
 			ImGui::Text("\tBinding Port: %d", server_port);
 			if (ImGui::Button("Stop Server"))
 			{
-				if (!server.stop())
+				server_stop_requested = true;
+			}
+
+			// stats
+			ServerStats stats = server.get_stats();
+			ImGui::Text("\tRequests: %llu (%.1f per second)", (unsigned long long)stats.requests_count, stats.requests_per_second);
+			ImGui::Text("\tLatency: %.2f ms (average %.2f ms, max %.2f ms)", 1000*stats.last_latency, 1000*stats.average_latency, 1000*stats.max_latency);
+			ImGui::Text("\tQueue Depth: %d (max %d)", (int)stats.queue_depth, (int)stats.max_queue_depth);
+			ImGui::Text("\tMain Queue Depth: %d (max %d)", (int)server_main_requests.size(), (int)server_main_requests.max_size());
+			ImGui::Text("\tConnections: %d (accepted %llu, timed out %llu)", (int)stats.connections_count, 
+				(unsigned long long)stats.accepted_connections, (unsigned long long)stats.timed_out_connections);
+			ImGui::Text("\tReceived: %.3f MB, Sent: %.3f MB", stats.bytes_received/(1024.0*1024.0), stats.bytes_sent/(1024.0*1024.0));
+			// latency of every request type
+			if (!stats.type_latency.empty() && ImGui::BeginTable("Server Requests Latency", 6, ImGuiTableFlags_Resizable | ImGuiTableFlags_NoSavedSettings | ImGuiTableFlags_Borders))
+			{
+				ImGui::TableSetupColumn("Request");
+				ImGui::TableSetupColumn("Count");
+				ImGui::TableSetupColumn("Average (ms)");
+				ImGui::TableSetupColumn("P50 (ms)");
+				ImGui::TableSetupColumn("P99 (ms)");
+				ImGui::TableSetupColumn("Max (ms)");
+				ImGui::TableHeadersRow();
+				for (const auto& type_latency : stats.type_latency)
 				{
-					printf("Failed to stop the server\n");
+					const LatencyHistogram& latency = type_latency.second;
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					ImGui::Text("%s", request_type_to_string((RequestType)type_latency.first).c_str());
+					ImGui::TableNextColumn();
+					ImGui::Text("%llu", (unsigned long long)latency.count);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.2f", 1000*latency.average());
+					ImGui::TableNextColumn();
+					ImGui::Text("%.2f", 1000*latency.percentile(0.5));
+					ImGui::TableNextColumn();
+					ImGui::Text("%.2f", 1000*latency.percentile(0.99));
+					ImGui::TableNextColumn();
+					ImGui::Text("%.2f", 1000*latency.max);
 				}
+				ImGui::EndTable();
+			}
+			if (ImGui::Button("Reset Stats"))
+			{
+				server.reset_stats();
+				server_main_requests.reset_max_size();
 			}
 		}
 	}
@@ -1911,37 +1952,25 @@ private:
 			if (ImGui::Button("Calculate TMP direct values from action potential parameters"))
 			{
 				sample_count = TMP_total_duration/TMP_dt + 1;
-				tmp_direct_values = MatrixX<Real>::Zero(sample_count, heart_probes.size());
-
-				for (int sample = 0; sample < sample_count; sample++)
-				{
-					Real t_current = (Real)sample*TMP_dt;
-
-					// update heart TMP from action potential parameters
-					for (int i = 0; i < M; i++)
-					{
-						QH(i) = extracellular_potential(t_current, TMP_dt, heart_action_potential_params[i]); //action_potential_value_2
-					}
 
-					// calculate body surface potentials
-					calculate_torso_potentials();
-
-					for (int i = 0; i < heart_probes.size(); i++)
-					{
-						tmp_direct_values(sample, i) = evaluate_heart_probe(heart_probes[i], i);
-						//tmp_direct_values(sample, i) = (Real)sample/1000.0;
-						//tmp_direct_values(sample, i) = QH(i);
-					}
-				}
+				// heart TMP of all the samples from action potential parameters
+				MatrixX<Real> QH_samples;
+				MatrixX<Real> heart_probes_samples;
+				calculate_action_potential_tmp_samples(heart_action_potential_params, sample_count, TMP_dt, QH_samples);
+				evaluate_heart_probes(QH_samples, heart_probes_samples);
+				tmp_direct_values = heart_probes_samples.transpose();
 
 				tmp_source = TMP_SOURCE_TMP_DIRECT_VALUES;
 				printf("Calculated TMP direct values from action potential parameters\n");
 			}
 
-			if (ImGui::Button("Export TMP and BSP probes values (CSV)"))
+			bool export_csv = ImGui::Button("Export TMP and BSP probes values (CSV)");
+			ImGui::SameLine();
+			bool export_dataset = ImGui::Button("Export TMP and BSP probes values (Dataset)");
+			if (export_csv || export_dataset)
 			{
 				// save file dialog
-				std::string file_name = save_file_dialog("tmp_bsp_values_csv", "All\0*.*\0");
+				std::string file_name = save_file_dialog(export_csv ? "tmp_bsp_values_csv" : "tmp_bsp_values.ecgds", "All\0*.*\0");
 
 				// export
 				if (file_name != "")
@@ -1958,13 +1987,15 @@ private:
 						}
 					}
 
-					if (export_tmp_bsp_values_csv(file_name, tmp_direct_values_temporary, probes_values))
+					bool result = export_csv ? export_tmp_bsp_values_csv(file_name, tmp_direct_values_temporary, probes_values)
+						: export_tmp_bsp_values_dataset(file_name, tmp_direct_values_temporary, probes_values, TMP_dt, dataset_options);
+					if (result)
 					{
-						printf("Exported \"%s\" TMP and BSP values (CSV)\n", file_name.c_str());
+						printf("Exported \"%s\" TMP and BSP values (%s)\n", file_name.c_str(), export_csv ? "CSV" : "Dataset");
 					}
 					else
 					{
-						printf("Failed to export \"%s\" TMP and BSP values (CSV)\n", file_name.c_str());
+						printf("Failed to export \"%s\" TMP and BSP values (%s)\n", file_name.c_str(), export_csv ? "CSV" : "Dataset");
 					}
 				}
 			}
@@ -2027,21 +2058,26 @@ private:
 				}
 			}
 
-			if (ImGui::Button("Export TMP and BSP probes values (CSV)"))
+			bool export_csv = ImGui::Button("Export TMP and BSP probes values (CSV)");
+			ImGui::SameLine();
+			bool export_dataset = ImGui::Button("Export TMP and BSP probes values (Dataset)");
+			if (export_csv || export_dataset)
 			{
 				// save file dialog
-				std::string file_name = save_file_dialog("tmp_bsp_values_csv", "All\0*.*\0");
+				std::string file_name = save_file_dialog(export_csv ? "tmp_bsp_values_csv" : "tmp_bsp_values.ecgds", "All\0*.*\0");
 
 				// export
 				if (file_name != "")
 				{
-					if (export_tmp_bsp_values_csv(file_name, tmp_direct_values, probes_values))
+					bool result = export_csv ? export_tmp_bsp_values_csv(file_name, tmp_direct_values, probes_values)
+						: export_tmp_bsp_values_dataset(file_name, tmp_direct_values, probes_values, TMP_dt, dataset_options);
+					if (result)
 					{
-						printf("Exported \"%s\" TMP and BSP values (CSV)\n", file_name.c_str());
+						printf("Exported \"%s\" TMP and BSP values (%s)\n", file_name.c_str(), export_csv ? "CSV" : "Dataset");
 					}
 					else
 					{
-						printf("Failed to export \"%s\" TMP and BSP values (CSV)\n", file_name.c_str());
+						printf("Failed to export \"%s\" TMP and BSP values (%s)\n", file_name.c_str(), export_csv ? "CSV" : "Dataset");
 					}
 				}
 			}
@@ -2150,6 +2186,8 @@ private:
 
 		if (ImGui::ListBoxHeader("Probes", { 0, 120 }))
 		{
+			evaluate_torso_probes(QB, probes_current_values);
+
 			for (int i = 0; i < probes.size(); i++)
 			{
 				bool is_selected = i==current_selected_probe;
@@ -2161,7 +2199,7 @@ private:
 
 				// value
 				ImGui::SameLine();
-				Real probe_value = evaluate_torso_probe(probes[i]);
+				Real probe_value = probes_current_values(i);
 				std::string item_name = "  " + std::to_string(probe_value);
 				ImGui::Text(item_name.c_str());
 			}
@@ -2182,7 +2220,7 @@ private:
 
 			ImGui::Text("\tTriangle: %d", probe.triangle_idx);
 			ImGui::Text("\tPoint: {%.3lf, %.3lf, %.3lf}", probe.point.x(), probe.point.y(), probe.point.z());
-			ImGui::Text("\tValue: %.3lf", evaluate_torso_probe(probe));
+			ImGui::Text("\tValue: %.3lf", evaluate_torso_probe(current_selected_probe));
 
 			ImGui::End();
 
@@ -2425,6 +2463,8 @@ private:
 
 		if (ImGui::ListBoxHeader("Heart Probes", { 0, 120 }))
 		{
+			evaluate_heart_probes(QH, heart_probes_current_values);
+
 			for (int i = 0; i < heart_probes.size(); i++)
 			{
 				bool is_selected = i==heart_current_selected_probe;
@@ -2436,7 +2476,7 @@ private:
 
 				// value
 				ImGui::SameLine();
-				Real probe_value = evaluate_heart_probe(heart_probes[i], i);
+				Real probe_value = heart_probes_current_values(i);
 
 				if (tmp_source == TMP_SOURCE_TMP_DIRECT_VALUES && current_sample < sample_count)
 				{
@@ -2463,7 +2503,7 @@ private:
 
 			ImGui::Text("\tTriangle: %d", heart_probe.triangle_idx);
 			ImGui::Text("\tPoint: {%.3lf, %.3lf, %.3lf}", heart_probe.point.x(), heart_probe.point.y(), heart_probe.point.z());
-			ImGui::Text("\tValue: %.3lf", evaluate_heart_probe(heart_probe, heart_current_selected_probe));
+			ImGui::Text("\tValue: %.3lf", evaluate_heart_probe(heart_current_selected_probe));
 
 			ImGui::End();
 
@@ -2702,63 +2742,43 @@ private:
 				}
 			}
 		}
-		if (ImGui::Button("Dump TMP BSP Probes to CSV"))
+		// binary dataset settings
+		ImGui::Checkbox("Dataset Single Precision", &dataset_options.single_precision);
+		ImGui::SameLine();
+		ImGui::Checkbox("Dataset Compression", &dataset_options.compress);
+		bool dump_csv = ImGui::Button("Dump TMP BSP Probes to CSV");
+		ImGui::SameLine();
+		bool dump_dataset = ImGui::Button("Dump TMP BSP Probes to Dataset");
+		if (dump_csv || dump_dataset)
 		{
 			Timer generating_timer;
 			generating_timer.start();
 
 			// calculate BSP probes values
+			MatrixX<Real> TMP_BSP_values;
+			calculate_tmp_bsp_probes_values(sample_count, TMP_BSP_values);
+
 			std::vector<std::string> names(heart_probes.size()+probes.size(), "");
-			MatrixX<Real> TMP_BSP_values = MatrixX<Real>::Zero(sample_count, heart_probes.size()+probes.size());
-			for (int sample = 0; sample < sample_count; sample++)
+			for (int i = 0; i < heart_probes.size(); i++)
 			{
-				Real t_current = sample*TMP_dt;
-
-				// update heart potentials
-				if (tmp_source == TMP_SOURCE_ACTION_POTENTIAL_PARAMETERS)
-				{
-					// update heart TMP from action potential parameters
-					for (int i = 0; i < M; i++)
-					{
-						QH(i) = extracellular_potential(t_current, TMP_dt, heart_action_potential_params[i]); //action_potential_value_2
-					}
-				}
-				else /*TMP_SOURCE_WAVE_PROPAGATION*/
-				{
-					// wave propagation
-					if (sample == 0)
-					{
-						wave_prop.reset();
-					}
-					wave_prop.simulation_step();
-					QH = wave_prop.get_potentials();
-				}
-
-				// calculate body surface potentials
-				calculate_torso_potentials();
-
-				for (int i = 0; i < heart_probes.size(); i++)
-				{
-					names[i] = heart_probes[i].name;
-					TMP_BSP_values(sample, i) = evaluate_heart_probe(heart_probes[i], i);
-				}
-
-				for (int i = 0; i < probes.size(); i++)
-				{
-					names[heart_probes.size()+i] = probes[i].name;
-					TMP_BSP_values(sample, heart_probes.size()+i) = evaluate_torso_probe(probes[i]);
-				}
+				names[i] = heart_probes[i].name;
+			}
+			for (int i = 0; i < probes.size(); i++)
+			{
+				names[heart_probes.size()+i] = probes[i].name;
 			}
 
 			printf("Generated TMP BSP probes values in: %.3f seconds\n", generating_timer.elapsed_seconds());
 
 			// save to file
-			std::string file_name = save_file_dialog("TMP_BSP_values.csv", "All\0*.*\0CSV File (.csv)\0*.csv\0");
+			std::string file_name = dump_csv ? save_file_dialog("TMP_BSP_values.csv", "All\0*.*\0CSV File (.csv)\0*.csv\0")
+				: save_file_dialog("TMP_BSP_values.ecgds", "All\0*.*\0");
 
 			// dump
 			if (file_name != "")
 			{
-				bool res = dump_matrix_to_csv(file_name, names, TMP_BSP_values);
+				bool res = dump_csv ? dump_matrix_to_csv(file_name, names, TMP_BSP_values)
+					: save_dataset(file_name, names, TMP_BSP_values, 0, TMP_dt, dataset_options);
 				if (res)
 				{
 					printf("Successfuly dumped probes to \"%s\"\n", file_name.c_str());
@@ -2770,59 +2790,38 @@ private:
 			}
 		}
 
-		if (ImGui::Button("Dump TMP BSP Probes to CSV (integrated)"))
+		bool dump_integrated_csv = ImGui::Button("Dump TMP BSP Probes to CSV (integrated)");
+		ImGui::SameLine();
+		bool dump_integrated_dataset = ImGui::Button("Dump TMP BSP Probes to Dataset (integrated)");
+		if (dump_integrated_csv || dump_integrated_dataset)
 		{
 			Timer generating_timer;
 			generating_timer.start();
 
 			// calculate BSP probes values
+			MatrixX<Real> TMP_BSP_probes_values;
+			calculate_tmp_bsp_probes_values(sample_count, TMP_BSP_probes_values);
+
 			std::vector<std::string> names(heart_probes.size()+probes.size()*2, "");
 			MatrixX<Real> TMP_BSP_values = MatrixX<Real>::Zero(sample_count, heart_probes.size()+probes.size()*2);
-			for (int sample = 0; sample < sample_count; sample++)
+			TMP_BSP_values.leftCols(heart_probes.size()+probes.size()) = TMP_BSP_probes_values;
+			for (int i = 0; i < heart_probes.size(); i++)
 			{
-				Real t_current = sample*TMP_dt;
-
-				// update heart potentials
-				if (tmp_source == TMP_SOURCE_ACTION_POTENTIAL_PARAMETERS)
-				{
-					// update heart TMP from action potential parameters
-					for (int i = 0; i < M; i++)
-					{
-						QH(i) = extracellular_potential(t_current, TMP_dt, heart_action_potential_params[i]); //action_potential_value_2
-					}
-				}
-				else /*TMP_SOURCE_WAVE_PROPAGATION*/
-				{
-					// wave propagation
-					if (sample == 0)
-					{
-						wave_prop.reset();
-					}
-					wave_prop.simulation_step();
-					QH = wave_prop.get_potentials();
-				}
-
-				// calculate body surface potentials
-				calculate_torso_potentials();
-
-				for (int i = 0; i < heart_probes.size(); i++)
-				{
-					names[i] = heart_probes[i].name;
-					TMP_BSP_values(sample, i) = evaluate_heart_probe(heart_probes[i], i);
-				}
-
-				for (int i = 0; i < probes.size(); i++)
-				{
-					names[heart_probes.size()+i] = probes[i].name;
-					TMP_BSP_values(sample, heart_probes.size()+i) = evaluate_torso_probe(probes[i]);
-				}
+				names[i] = heart_probes[i].name;
+			}
+			for (int i = 0; i < probes.size(); i++)
+			{
+				names[heart_probes.size()+i] = probes[i].name;
+				names[heart_probes.size()+probes.size()+i] = probes[i].name + "_int";
+			}
 
-				// itegrated values
+			// itegrated values
+			for (int sample = 0; sample < sample_count; sample++)
+			{
 				if (sample == 0)
 				{
 					for (int i = 0; i < probes.size(); i++)
 					{
-						names[heart_probes.size()+probes.size()+i] = probes[i].name + "_int";
 						TMP_BSP_values(sample, heart_probes.size()+probes.size()+i) = TMP_dt*TMP_BSP_values(sample, heart_probes.size()+i);
 					}
 				}
@@ -2830,7 +2829,6 @@ private:
 				{
 					for (int i = 0; i < probes.size(); i++)
 					{
-						names[heart_probes.size()+probes.size()+i] = probes[i].name + "_int";
 						TMP_BSP_values(sample, heart_probes.size()+probes.size()+i) = TMP_dt*TMP_BSP_values(sample, heart_probes.size()+i) + TMP_BSP_values(sample-1, heart_probes.size()+probes.size()+i);
 					}
 				}
@@ -2839,12 +2837,14 @@ private:
 			printf("Generated TMP BSP probes values (integrated) in: %.3f seconds\n", generating_timer.elapsed_seconds());
 
 			// save to file
-			std::string file_name = save_file_dialog("TMP_BSP_values.csv", "All\0*.*\0CSV File (.csv)\0*.csv\0");
+			std::string file_name = dump_integrated_csv ? save_file_dialog("TMP_BSP_values.csv", "All\0*.*\0CSV File (.csv)\0*.csv\0")
+				: save_file_dialog("TMP_BSP_values.ecgds", "All\0*.*\0");
 
 			// dump
 			if (file_name != "")
 			{
-				bool res = dump_matrix_to_csv(file_name, names, TMP_BSP_values);
+				bool res = dump_integrated_csv ? dump_matrix_to_csv(file_name, names, TMP_BSP_values)
+					: save_dataset(file_name, names, TMP_BSP_values, 0, TMP_dt, dataset_options);
 				if (res)
 				{
 					printf("Successfuly dumped probes to \"%s\"\n", file_name.c_str());
@@ -3445,485 +3445,723 @@ private:
 		wave_prop.handle_input(camera);
 	}
 
-	void handle_server_requests()
+	bool start_server(const Address& addr, const Port port)
 	{
-		Address request_addr; Port request_port;
-		std::vector<uint8_t> request_bytes;
-
-		if (server.poll_request(request_bytes, &request_addr, &request_port))
-		{
-			// handle request
-			Deserializer des(request_bytes);
-			Serializer ser;
-
-			// handle message
-			uint32_t request_type = des.parse_u32();
-			if (request_type == REQUEST_GET_VALUES)
-			{
-				// row and columns count
-				ser.push_u32(sample_count + 1); // row_count = sample_count + 1 row for the names
-				ser.push_u32(probes.size() + 2 + 6); // col_count = sample idx + time + dipole_posx, dipole_posy, dipole_posz + dipole_vecx, dipole_vecy, dipole_vecz + probes_values
-
-				// names row
-				ser.push_string("sample");
-				ser.push_string("time");
-				ser.push_string("dipole_posx");
-				ser.push_string("dipole_posy");
-				ser.push_string("dipole_posz");
-				ser.push_string("dipole_vecx");
-				ser.push_string("dipole_vecy");
-				ser.push_string("dipole_vecz");
-				for (int i = 0; i < probes_values.rows(); i++)
-				{
-					ser.push_string(probes[i].name);
-				}
+		if (!server.start(addr, port))
+		{
+			return false;
+		}
 
-				//// debug
-				//for (int j = 0; j < sample_count; j++)
-				//{
-				//	for (int i = 0; i < probes.size() + 2 + 6; i++)
-				//	{
-				//		ser.push_double(j*sample_count + i);
-				//	}
-				//}
-
-				// values (row major)
-				for (int i = 0; i < sample_count; i++)
-				{
-					Real time = i * dt;
-					ser.push_double(i); // sample
-					ser.push_double(time); // time
-					// dipole_pos
-					ser.push_double(dipole_pos.x());
-					ser.push_double(dipole_pos.y());
-					ser.push_double(dipole_pos.z());
-					// dipole_vec
-					Eigen::Vector3<Real> dipole_vec_current = dipole_curve.point_at(time);
-					ser.push_double(dipole_vec_current.x());
-					ser.push_double(dipole_vec_current.y());
-					ser.push_double(dipole_vec_current.z());
-
-					// probes values
-					for (int j = 0; j < probes.size(); j++)
-					{
-						ser.push_double(probes_values(j, i));
-					}
-				}
-			}
-			else if (request_type == REQUEST_SET_DIPOLE_VECTOR)
+		// worker threads for the requests that only read the server snapshot
+		server_main_requests.reopen();
+		for (int i = 0; i < get_parallel_threads_count(); i++)
+		{
+			server_workers.push_back(std::thread(std::bind(&ForwardECGApp::server_worker_routine, this)));
+		}
+
+		// thread for the requests that need the application state
+		server_request_thread = std::thread(std::bind(&ForwardECGApp::server_request_thread_routine, this));
+
+		return true;
+	}
+
+	bool stop_server()
+	{
+		if (!server.stop())
+		{
+			return false;
+		}
+
+		for (std::thread& worker : server_workers)
+		{
+			worker.join();
+		}
+		server_workers.clear();
+
+		// requests still waiting for the request thread
+		for (std::shared_ptr<ServerRequest>& request : server_main_requests.close())
+		{
+			request->cancel();
+		}
+		server_request_thread.join();
+
+		return true;
+	}
+
+	void server_worker_routine()
+	{
+		std::shared_ptr<ServerRequest> request;
+		while (server.wait_request(request))
+		{
+			std::shared_ptr<const ServerSnapshot> snapshot;
 			{
-				Eigen::Vector3<Real> new_dipole_vec;
-				new_dipole_vec.x() = des.parse_double();
-				new_dipole_vec.y() = des.parse_double();
-				new_dipole_vec.z() = des.parse_double();
-				dipole_vec = new_dipole_vec;
-				dipole_vec_source = VALUES_SOURCE_CONSTANT;
-				ser.push_u8(1); // return true acknowledgement
+				std::lock_guard<std::mutex> lock(server_snapshot_mutex);
+				snapshot = server_snapshot;
 			}
-			else if (request_type == REQUEST_GET_PROBES_NAMES)
+
+			Deserializer des(request->get_bytes());
+			uint32_t request_word = des.parse_u32();
+			uint32_t request_type = request_word & REQUEST_TYPE_MASK;
+			ValuesFormat format = request_values_format(request_word);
+			ServerRequest* stream_request = ((request_word & REQUEST_FLAG_STREAM) && request->can_stream()) ? request.get() : NULL;
+			request->set_type(request_type);
+			if (request_type == REQUEST_GET_SERVER_STATS)
 			{
-				ser.push_u32(probes.size()); // count of probes
-				for (int i = 0; i < probes.size(); i++)
-				{
-					ser.push_string(probes[i].name);
-				}
+				// doesn't need the application state nor the snapshot
+				Serializer ser;
+				serialize_server_stats(ser, server.get_stats(), server_main_requests.size());
+				request->respond(ser.get_data());
 			}
-			else if (request_type == REQUEST_CALCULATE_VALUES_FOR_VECTOR)
+			else if (snapshot && is_snapshot_request(request_type, *snapshot))
 			{
-				Eigen::Vector3<Real> new_dipole_vec;
-				new_dipole_vec.x() = des.parse_double();
-				new_dipole_vec.y() = des.parse_double();
-				new_dipole_vec.z() = des.parse_double();
-				dipole_vec = new_dipole_vec;
-				calculate_torso_potentials();
-
-				ser.push_u32(3 + probes.size()); // vector x, y, z and count of probes
-				// dipole vector
-				ser.push_double(dipole_vec.x());
-				ser.push_double(dipole_vec.y());
-				ser.push_double(dipole_vec.z());
-				// probes values
-				for (int i = 0; i < probes.size(); i++)
-				{
-					ser.push_double(evaluate_torso_probe(probes[i]));
-				}
+				Serializer ser;
+				handle_snapshot_request(*snapshot, request_type, format, stream_request, des, ser);
+				request->respond(ser.get_data());
+				log_server_request(*request, request_type, ser.get_data().size());
 			}
-			else if (request_type == REQUEST_CALCULATE_VALUES_FOR_RANDOM_VECTORS)
+			else if (!server_main_requests.push(request))
 			{
-				uint32_t random_samples_count = des.parse_u32(); // random samples count
-				Real maximum_radius = des.parse_double();
+				request->cancel();
+			}
+		}
+	}
 
-				ser.push_u32(3 + probes.size()); // vector x, y, z and count of probes
-				Timer generating_timer;
-				generating_timer.start();
-				Random rnd;
-				for (uint32_t i = 0; i < random_samples_count; i++)
-				{
-					dipole_vec = rnd.next_vector3(maximum_radius);
-					calculate_torso_potentials();
+	// counters, then the latencies of every request type
+	static void serialize_server_stats(Serializer& ser, const ServerStats& stats, size_t main_queue_depth)
+	{
+		ser.push_u64(stats.requests_count);
+		ser.push_double(stats.requests_per_second);
+		ser.push_u64(stats.bytes_received);
+		ser.push_u64(stats.bytes_sent);
+		ser.push_u32(stats.connections_count);
+		ser.push_u64(stats.accepted_connections);
+		ser.push_u64(stats.timed_out_connections);
+		ser.push_u32(stats.queue_depth);
+		ser.push_u32(stats.max_queue_depth);
+		ser.push_u32(main_queue_depth);
+		ser.push_u32(stats.type_latency.size());
+		for (const auto& type_latency : stats.type_latency)
+		{
+			const LatencyHistogram& latency = type_latency.second;
+			ser.push_u32(type_latency.first);
+			ser.push_u64(latency.count);
+			ser.push_double(latency.average());
+			ser.push_double(latency.percentile(0.5));
+			ser.push_double(latency.percentile(0.9));
+			ser.push_double(latency.percentile(0.99));
+			ser.push_double(latency.max);
+		}
+	}
 
-					// dipole vector
-					ser.push_double(dipole_vec.x());
-					ser.push_double(dipole_vec.y());
-					ser.push_double(dipole_vec.z());
+	// the requests that don't change the application state and don't need anything other than the snapshot
+	static bool is_snapshot_request(uint32_t request_type, const ServerSnapshot& snapshot)
+	{
+		return request_type == REQUEST_GET_PROBES_NAMES
+			|| request_type == REQUEST_GET_TMP_BSP_VALUES_PROBES_TRAIN
+			|| (request_type == REQUEST_GET_TMP_BSP_VALUES_PROBES && snapshot.tmp_source == TMP_SOURCE_ACTION_POTENTIAL_PARAMETERS);
+	}
 
-					// probes values
-					for (int i = 0; i < probes.size(); i++)
-					{
-						ser.push_double(evaluate_torso_probe(probes[i]));
-					}
-				}
-				printf("Generated %u random vector values in %.3f ms\n", random_samples_count, 1000*generating_timer.elapsed_seconds());
-			}
-			else if (request_type == REQUEST_SET_DIPOLE_VECTOR_VALUES)
+	// called from any thread, only reads the snapshot
+	// stream_request: the request to stream the response chunks to, NULL if the response isn't streamed
+	static void handle_snapshot_request(const ServerSnapshot& snapshot, uint32_t request_type, const ValuesFormat& format, ServerRequest* stream_request, 
+		Deserializer& des, Serializer& ser)
+	{
+		if (request_type == REQUEST_GET_PROBES_NAMES)
+		{
+			ser.push_u32(snapshot.probes_names.size()); // count of probes
+			for (int i = 0; i < snapshot.probes_names.size(); i++)
 			{
-				uint32_t values_count = des.parse_u32();
-
-				dipole_vec_values_list.clear();
-
-				for (uint32_t i = 0; i < values_count; i++)
-				{
-					Eigen::Vector3<Real> new_value;
-					new_value.x() = des.parse_double();
-					new_value.y() = des.parse_double();
-					new_value.z() = des.parse_double();
-					dipole_vec_values_list.push_back(new_value);
-				}
-				
-				dipole_vec_source = VALUES_SOURCE_VALUES_LIST;
-				ser.push_u8(1); // return true acknowledgement
+				ser.push_string(snapshot.probes_names[i]);
 			}
-			else if (request_type == REQUEST_GET_TMP_BSP_VALUES)
-			{
-				Timer generating_timer;
-				generating_timer.start();
-				
-				// calculate BSP values
-				MatrixX<Real> TMP_BSP_values = MatrixX<Real>::Zero(sample_count, M+N);
-				for (int sample = 0; sample < sample_count; sample++)
-				{
-					Real t_current = sample*TMP_dt;
+		}
+		else if (request_type == REQUEST_GET_TMP_BSP_VALUES_PROBES)
+		{
+			Timer generating_timer;
+			generating_timer.start();
 
-					// update heart potentials
-					if (tmp_source == TMP_SOURCE_ACTION_POTENTIAL_PARAMETERS)
-					{
-						// update heart TMP from action potential parameters
-						for (int i = 0; i < M; i++)
-						{
-							QH(i) = extracellular_potential(t_current, TMP_dt, heart_action_potential_params[i]); //action_potential_value_2
-						}
-					}
-					else /*TMP_SOURCE_WAVE_PROPAGATION*/
-					{
-						// wave propagation
-						if (sample == 0)
-						{
-							wave_prop.reset();
-						}
-						wave_prop.simulation_step();
-						QH = wave_prop.get_potentials();
-					}
+			// calculate BSP probes values of all the samples
+			MatrixX<Real> QH_samples, heart_probes_samples, probes_samples;
+			calculate_action_potential_tmp_samples(snapshot.heart_action_potential_params, snapshot.sample_count, snapshot.TMP_dt, QH_samples, 
+				SERVER_REQUEST_THREADS_COUNT);
+			calculate_torso_potentials_samples(snapshot.ZPH, snapshot.ZPH_single, format, QH_samples, probes_samples);
+			heart_probes_samples = snapshot.heart_probes_matrix*QH_samples;
 
-					// calculate body surface potentials
-					calculate_torso_potentials();
+			printf("Generated BSP probes values in: %.3f seconds\n", generating_timer.elapsed_seconds());
 
-					for (int i = 0; i < M; i++)
-					{
-						TMP_BSP_values(sample, i) = QH(i);
-					}
+			// serialize data
+			serialize_tmp_bsp_probes_values(ser, heart_probes_samples, probes_samples, format);
+		}
+		else if (request_type == REQUEST_GET_TMP_BSP_VALUES_PROBES_TRAIN)
+		{
+			Timer generating_timer;
+			generating_timer.start();
+			Random rnd;
 
-					for (int i = 0; i < N; i++)
-					{
-						TMP_BSP_values(sample, M+i) = QB(i);
-					}
-				}
+			// samples count
+			uint32_t request_sample_count = des.parse_u32();
+
+			MatrixX<Real> heart_probes_samples, probes_samples;
+			if (!stream_request)
+			{
+				calculate_train_samples(snapshot, format, rnd, request_sample_count, heart_probes_samples, probes_samples);
 
 				printf("Generated BSP probes values in: %.3f seconds\n", generating_timer.elapsed_seconds());
 
 				// serialize data
-				ser.push_u32(sample_count); // sample count
-				ser.push_u32(M); // TMP values count
-				ser.push_u32(N); // BSP values count
+				serialize_tmp_bsp_probes_values(ser, heart_probes_samples, probes_samples, format);
+				return;
+			}
+
+			// stream chunks of samples as soon as they are calculated, each chunk is:
+			// first sample index, total sample count, then the chunk samples as a non-streamed response
+			const int values_count = snapshot.heart_probes_matrix.rows() + snapshot.ZPH_interpolated.rows();
+			const size_t value_size = format.single_precision ? sizeof(float) : sizeof(double);
+			const uint32_t chunk_sample_count = std::max<uint32_t>(1, STREAM_CHUNK_SIZE/(std::max(values_count, 1)*value_size));
+			for (uint32_t first_sample = 0; first_sample < request_sample_count; first_sample += chunk_sample_count)
+			{
+				calculate_train_samples(snapshot, format, rnd, std::min(chunk_sample_count, request_sample_count-first_sample), heart_probes_samples, probes_samples);
 
-				// serialize matrix SAMPLE_COUNTx(M+PROBES_COUNT)
-				for (int i = 0; i < TMP_BSP_values.rows(); i++)
+				Serializer chunk_ser(STREAM_CHUNK_SIZE + 64);
+				chunk_ser.push_u32(first_sample);
+				chunk_ser.push_u32(request_sample_count);
+				serialize_tmp_bsp_probes_values(chunk_ser, heart_probes_samples, probes_samples, format);
+				if (!stream_request->send_chunk(chunk_ser.get_data()))
 				{
-					for (int j = 0; j < TMP_BSP_values.cols(); j++)
-					{
-						ser.push_double(TMP_BSP_values(i, j));
-					}
+					printf("Streaming BSP probes values cancelled\n");
+					return;
 				}
 			}
-			else if (request_type == REQUEST_SET_TMP_VALUES)
+
+			printf("Streamed BSP probes values in: %.3f seconds\n", generating_timer.elapsed_seconds());
+
+			// the response ends the stream: a chunk without samples
+			calculate_train_samples(snapshot, format, rnd, 0, heart_probes_samples, probes_samples);
+			ser.push_u32(request_sample_count);
+			ser.push_u32(request_sample_count);
+			serialize_tmp_bsp_probes_values(ser, heart_probes_samples, probes_samples, format);
+		}
+	}
+
+	// random heart probes values interpolated to the heart, and the heart probes and probes values calculated from them
+	static void calculate_train_samples(const ServerSnapshot& snapshot, const ValuesFormat& format, Random& rnd, uint32_t samples_count, 
+		MatrixX<Real>& heart_probes_samples, MatrixX<Real>& probes_samples)
+	{
+		// random heart probes values of all the samples
+		int heart_probes_count = snapshot.tmp_probes_interpolation_matrix.cols();
+		MatrixX<Real> random_heart_probes_samples(heart_probes_count, samples_count);
+		for (int sample = 0; sample < samples_count; sample++)
+		{
+			for (int i = 0; i < heart_probes_count; i++)
 			{
-				// deserialize data
-				int rows_count = des.parse_u32();
-				int cols_count = des.parse_u32();
+				random_heart_probes_samples(i, sample) = rnd.next_real()*2 - 1;
+			}
+		}
+		MatrixX<Real> QH_samples = snapshot.tmp_probes_interpolation_matrix*random_heart_probes_samples;
 
-				if (cols_count == heart_probes.size())
-				{
-					// deserialize matrix SAMPLE_COUNTxPROBES_COUNT
-					MatrixX<Real> new_tmp_direct_values = MatrixX<Real>::Zero(rows_count, cols_count);
-					for (int i = 0; i < rows_count; i++)
-					{
-						for (int j = 0; j < cols_count; j++)
-						{
-							new_tmp_direct_values(i, j) = des.parse_double();
-						}
-					}
+		// calculate heart probes and probes values of all the samples
+		heart_probes_samples = snapshot.heart_probes_matrix*QH_samples;
+		calculate_torso_potentials_samples(snapshot.ZPH_interpolated, snapshot.ZPH_interpolated_single, format, random_heart_probes_samples, probes_samples);
+	}
 
-					// set new values
-					tmp_direct_values = new_tmp_direct_values;
-					tmp_source = TMP_SOURCE_TMP_DIRECT_VALUES;
-					tmp_direct_values_one_play = true;
-					current_sample = 0;
+	// Z*QH_samples, in single precision if requested (on the calling server thread only)
+	static void calculate_torso_potentials_samples(const MatrixX<Real>& Z, const SinglePrecisionMatrix& Z_single, const ValuesFormat& format, 
+		const MatrixX<Real>& QH_samples, MatrixX<Real>& QB_samples)
+	{
+		if (format.single_precision)
+		{
+			MatrixX<float> QB_samples_single;
+			::calculate_torso_potentials_samples(Z_single, QH_samples, QB_samples_single, SERVER_REQUEST_THREADS_COUNT);
+			QB_samples = QB_samples_single.cast<Real>();
+		}
+		else
+		{
+			::calculate_torso_potentials_samples(Z, QH_samples, QB_samples, SERVER_REQUEST_THREADS_COUNT);
+		}
+	}
 
-					ser.push_u8(1); // return true acknowledgement
-				}
-				else
-				{
-					printf("TMP values count doesn't match\n");
+	// serializes the matrix in row major order, either value by value or as one bulk array, as doubles or floats
+	static void serialize_matrix(Serializer& ser, const MatrixX<Real>& matrix, const ValuesFormat& format)
+	{
+		if (format.bulk_arrays)
+		{
+			if (format.single_precision)
+			{
+				Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> row_major_matrix = matrix.cast<float>();
+				ser.push_array(row_major_matrix.data(), matrix.rows(), matrix.cols());
+			}
+			else
+			{
+				Eigen::Matrix<Real, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> row_major_matrix = matrix;
+				ser.push_array(row_major_matrix.data(), matrix.rows(), matrix.cols());
+			}
+			return;
+		}
 
-					ser.push_u8(0); // return false acknowledgement
-				}
+		ser.reserve(matrix.size()*(format.single_precision ? sizeof(float) : sizeof(double)));
+		for (int i = 0; i < matrix.rows(); i++)
+		{
+			for (int j = 0; j < matrix.cols(); j++)
+			{
+				push_value(ser, matrix(i, j), format);
+			}
+		}
+	}
+
+	static void push_value(Serializer& ser, Real value, const ValuesFormat& format)
+	{
+		if (format.single_precision)
+		{
+			ser.push_float(value);
+		}
+		else
+		{
+			ser.push_double(value);
+		}
+	}
+
+	// sample count, heart probes count, probes count and the SAMPLE_COUNTx(HEART_PROBES_COUNT+PROBES_COUNT) matrix (row major)
+	static void serialize_tmp_bsp_probes_values(Serializer& ser, const MatrixX<Real>& heart_probes_samples, const MatrixX<Real>& probes_samples, const ValuesFormat& format)
+	{
+		ser.push_u32(heart_probes_samples.cols()); // sample count
+		ser.push_u32(heart_probes_samples.rows()); // heart probes count
+		ser.push_u32(probes_samples.rows()); // probes count
+
+		if (format.bulk_arrays)
+		{
+			// the columns of the column major (HEART_PROBES_COUNT+PROBES_COUNT)xSAMPLE_COUNT matrix are the rows
+			MatrixX<Real> TMP_BSP_values(heart_probes_samples.rows()+probes_samples.rows(), heart_probes_samples.cols());
+			TMP_BSP_values.topRows(heart_probes_samples.rows()) = heart_probes_samples;
+			TMP_BSP_values.bottomRows(probes_samples.rows()) = probes_samples;
+			if (format.single_precision)
+			{
+				MatrixX<float> TMP_BSP_values_single = TMP_BSP_values.cast<float>();
+				ser.push_array(TMP_BSP_values_single.data(), TMP_BSP_values.cols(), TMP_BSP_values.rows());
 			}
-			else if (request_type == REQUEST_GET_TMP_BSP_VALUES_PROBES)
+			else
 			{
-				Timer generating_timer;
-				generating_timer.start();
+				ser.push_array(TMP_BSP_values.data(), TMP_BSP_values.cols(), TMP_BSP_values.rows());
+			}
+			return;
+		}
 
-				// calculate BSP probes values
-				MatrixX<Real> TMP_BSP_values = MatrixX<Real>::Zero(sample_count, heart_probes.size()+probes.size());
-				for (int sample = 0; sample < sample_count; sample++)
-				{
-					Real t_current = sample*TMP_dt;
+		ser.reserve((heart_probes_samples.size() + probes_samples.size())*(format.single_precision ? sizeof(float) : sizeof(double)));
 
-					// update heart potentials
-					if (tmp_source == TMP_SOURCE_ACTION_POTENTIAL_PARAMETERS)
-					{
-						// update heart TMP from action potential parameters
-						for (int i = 0; i < M; i++)
-						{
-							QH(i) = extracellular_potential(t_current, TMP_dt, heart_action_potential_params[i]); //action_potential_value_2
-						}
-					}
-					else /*TMP_SOURCE_WAVE_PROPAGATION*/
-					{
-						// wave propagation
-						if (sample == 0)
-						{
-							wave_prop.reset();
-						}
-						wave_prop.simulation_step();
-						QH = wave_prop.get_potentials();
-					}
+		for (int i = 0; i < heart_probes_samples.cols(); i++)
+		{
+			for (int j = 0; j < heart_probes_samples.rows(); j++)
+			{
+				push_value(ser, heart_probes_samples(j, i), format);
+			}
+			for (int j = 0; j < probes_samples.rows(); j++)
+			{
+				push_value(ser, probes_samples(j, i), format);
+			}
+		}
+	}
 
-					// calculate body surface potentials
-					calculate_torso_potentials();
+	// rebuilds the snapshot used by the server workers if anything it is built from changed
+	void update_server_snapshot()
+	{
+		const SparseMatrix<Real, RowMajor>& heart_probes_sampling_matrix = heart_probes_operator.get_matrix(*heart_mesh, heart_probes);
+		torso_probes_operator.get_matrix(*torso, probes);
+
+		Serializer state;
+		state.push_i32(transfer_matrix_version);
+		state.push_i32(interpolation_matrix_version);
+		state.push_i32(torso_probes_operator.get_version());
+		state.push_i32(heart_probes_operator.get_version());
+		state.push_i32(reference_probe);
+		state.push_u8(use_interpolation_to_calculate_probe_value);
+		state.push_i32(tmp_source);
+		state.push_i32(sample_count);
+		state.push_double(TMP_dt);
+		for (int i = 0; i < probes.size(); i++)
+		{
+			state.push_string(probes[i].name);
+		}
+		if (tmp_source == TMP_SOURCE_ACTION_POTENTIAL_PARAMETERS)
+		{
+			for (const ActionPotentialParameters& params : heart_action_potential_params)
+			{
+				state.push_double(params.resting_potential);
+				state.push_double(params.peak_potential);
+				state.push_double(params.depolarization_time);
+				state.push_double(params.repolarization_time);
+			}
+		}
+		if (server_snapshot && state.get_data() == server_snapshot_state)
+		{
+			return;
+		}
 
-					for (int i = 0; i < heart_probes.size(); i++)
-					{
-						TMP_BSP_values(sample, i) = evaluate_heart_probe(heart_probes[i], i);
-					}
+		std::shared_ptr<ServerSnapshot> snapshot(new ServerSnapshot);
+		snapshot->probes_names.resize(probes.size());
+		for (int i = 0; i < probes.size(); i++)
+		{
+			snapshot->probes_names[i] = probes[i].name;
+		}
+		snapshot->ZPH = probes_transfer_matrix.get_matrix(ZBH, torso_probes_operator, *torso, probes, reference_probe);
+		snapshot->ZPH_interpolated = probes_transfer_matrix.get_interpolated_matrix(ZBH, torso_probes_operator, *torso, probes, 
+			reference_probe, tmp_probes_interpolation_matrix);
+		make_single_precision_matrix(snapshot->ZPH, snapshot->ZPH_single);
+		make_single_precision_matrix(snapshot->ZPH_interpolated, snapshot->ZPH_interpolated_single);
+		snapshot->tmp_probes_interpolation_matrix = tmp_probes_interpolation_matrix;
+		if (!use_interpolation_to_calculate_probe_value)
+		{
+			snapshot->heart_probes_matrix = MatrixX<Real>(heart_probes_sampling_matrix);
+		}
+		else if (tmp_probes_interpolation_matrix_inv.rows() == heart_probes.size() && tmp_probes_interpolation_matrix_inv.cols() == M)
+		{
+			snapshot->heart_probes_matrix = tmp_probes_interpolation_matrix_inv;
+		}
+		else
+		{
+			snapshot->heart_probes_matrix = MatrixX<Real>::Zero(heart_probes.size(), M);
+		}
+		snapshot->tmp_source = tmp_source;
+		snapshot->heart_action_potential_params = heart_action_potential_params;
+		snapshot->sample_count = sample_count;
+		snapshot->TMP_dt = TMP_dt;
 
-					for (int i = 0; i < probes.size(); i++)
-					{
-						TMP_BSP_values(sample, heart_probes.size()+i) = evaluate_torso_probe(probes[i]);
-					}
-				}
+		{
+			std::lock_guard<std::mutex> lock(server_snapshot_mutex);
+			server_snapshot = snapshot;
+		}
+		server_snapshot_state = state.get_data();
+	}
 
-				printf("Generated BSP probes values in: %.3f seconds\n", generating_timer.elapsed_seconds());
+	void log_server_request(const ServerRequest& request, uint32_t request_type, size_t response_size)
+	{
+		printf("Request from (%s:%d):\n \tIndex: %d\n \tRequest ID: %s (%d)\n \tRequest size: %u bytes\n \tResponse size: %u bytes\n \tLatency: %.3f ms\n\n",
+			request.get_address().to_string().c_str(), request.get_port(),
+			server_request_counter++,
+			request_type_to_string((RequestType)request_type).c_str(), request_type, 
+			(unsigned int)request.get_bytes().size(), (unsigned int)response_size, 1000*request.get_latency());
+	}
 
-				// serialize data
-				ser.push_u32(sample_count); // sample count
-				ser.push_u32(heart_probes.size()); // heart probes count
-				ser.push_u32(probes.size()); // probes count
+	// handles the requests that need the application state as soon as they arrive,
+	// independent of the frame rate of the main loop
+	void server_request_thread_routine()
+	{
+		std::shared_ptr<ServerRequest> request;
+		while (server_main_requests.pop(request))
+		{
+			std::lock_guard<std::mutex> lock(app_state_mutex);
+			update_server_snapshot();
+			handle_server_request(*request);
+			update_server_snapshot();
+		}
+	}
 
-				// serialize matrix SAMPLE_COUNTx(HEART_PROBES_COUNT+PROBES_COUNT)
-				for (int i = 0; i < TMP_BSP_values.rows(); i++)
-				{
-					for (int j = 0; j < TMP_BSP_values.cols(); j++)
-					{
-						ser.push_double(TMP_BSP_values(i, j));
-					}
-				}
-			}
-			else if (request_type == REQUEST_GET_TMP_BSP_VALUES_PROBES_2)
+	void handle_server_request(ServerRequest& request)
+	{
+		// handle request
+		Deserializer des(request.get_bytes());
+		Serializer ser;
+
+		// handle message
+		uint32_t request_word = des.parse_u32();
+		uint32_t request_type = request_word & REQUEST_TYPE_MASK;
+		ValuesFormat format = request_values_format(request_word);
+		ServerRequest* stream_request = ((request_word & REQUEST_FLAG_STREAM) && request.can_stream()) ? &request : NULL;
+		if (is_snapshot_request(request_type, *server_snapshot))
+		{
+			// same as on the server workers
+			handle_snapshot_request(*server_snapshot, request_type, format, stream_request, des, ser);
+		}
+		else if (request_type == REQUEST_GET_VALUES)
+		{
+			// row and columns count
+			ser.push_u32(sample_count + 1); // row_count = sample_count + 1 row for the names
+			ser.push_u32(probes.size() + 2 + 6); // col_count = sample idx + time + dipole_posx, dipole_posy, dipole_posz + dipole_vecx, dipole_vecy, dipole_vecz + probes_values
+
+			// names row
+			ser.push_string("sample");
+			ser.push_string("time");
+			ser.push_string("dipole_posx");
+			ser.push_string("dipole_posy");
+			ser.push_string("dipole_posz");
+			ser.push_string("dipole_vecx");
+			ser.push_string("dipole_vecy");
+			ser.push_string("dipole_vecz");
+			for (int i = 0; i < probes_values.rows(); i++)
 			{
-				Timer generating_timer;
-				generating_timer.start();
+				ser.push_string(probes[i].name);
+			}
 
-				// progress bar
-				print_progress_bar(0);
+			//// debug
+			//for (int j = 0; j < sample_count; j++)
+			//{
+			//	for (int i = 0; i < probes.size() + 2 + 6; i++)
+			//	{
+			//		ser.push_double(j*sample_count + i);
+			//	}
+			//}
 
-				// calculate BSP probes values
-				MatrixX<Real> TMP_BSP_values = MatrixX<Real>::Zero(sample_count, heart_probes.size()+probes.size());
-				heart_probes_values_temp.resize(1, heart_probes.size());
-				for (int sample = 0; sample < sample_count; sample++)
-				{
-					Real t_current = sample*TMP_dt;
+			// values (row major)
+			for (int i = 0; i < sample_count; i++)
+			{
+				Real time = i * dt;
+				ser.push_double(i); // sample
+				ser.push_double(time); // time
+				// dipole_pos
+				ser.push_double(dipole_pos.x());
+				ser.push_double(dipole_pos.y());
+				ser.push_double(dipole_pos.z());
+				// dipole_vec
+				Eigen::Vector3<Real> dipole_vec_current = dipole_curve.point_at(time);
+				ser.push_double(dipole_vec_current.x());
+				ser.push_double(dipole_vec_current.y());
+				ser.push_double(dipole_vec_current.z());
 
-					// update heart potentials
-					if (tmp_source == TMP_SOURCE_ACTION_POTENTIAL_PARAMETERS)
-					{
-						// update heart TMP from action potential parameters
-						for (int i = 0; i < M; i++)
-						{
-							QH(i) = extracellular_potential(t_current, TMP_dt, heart_action_potential_params[i]); //action_potential_value_2
-						}
-					}
-					else /*TMP_SOURCE_WAVE_PROPAGATION*/
-					{
-						// wave propagation
-						if (sample == 0)
-						{
-							wave_prop.reset();
-						}
-						wave_prop.simulation_step();
-						QH = wave_prop.get_potentials();
-					}
+				// probes values
+				for (int j = 0; j < probes.size(); j++)
+				{
+					ser.push_double(probes_values(j, i));
+				}
+			}
+		}
+		else if (request_type == REQUEST_SET_DIPOLE_VECTOR)
+		{
+			Eigen::Vector3<Real> new_dipole_vec;
+			new_dipole_vec.x() = des.parse_double();
+			new_dipole_vec.y() = des.parse_double();
+			new_dipole_vec.z() = des.parse_double();
+			dipole_vec = new_dipole_vec;
+			dipole_vec_source = VALUES_SOURCE_CONSTANT;
+			ser.push_u8(1); // return true acknowledgement
+		}
+		else if (request_type == REQUEST_CALCULATE_VALUES_FOR_VECTOR)
+		{
+			Eigen::Vector3<Real> new_dipole_vec;
+			new_dipole_vec.x() = des.parse_double();
+			new_dipole_vec.y() = des.parse_double();
+			new_dipole_vec.z() = des.parse_double();
+			dipole_vec = new_dipole_vec;
+			calculate_torso_potentials();
+
+			ser.push_u32(3 + probes.size()); // vector x, y, z and count of probes
+			// dipole vector
+			ser.push_double(dipole_vec.x());
+			ser.push_double(dipole_vec.y());
+			ser.push_double(dipole_vec.z());
+			// probes values
+			evaluate_torso_probes(QB, probes_current_values);
+			for (int i = 0; i < probes.size(); i++)
+			{
+				ser.push_double(probes_current_values(i));
+			}
+		}
+		else if (request_type == REQUEST_CALCULATE_VALUES_FOR_RANDOM_VECTORS)
+		{
+			uint32_t random_samples_count = des.parse_u32(); // random samples count
+			Real maximum_radius = des.parse_double();
 
-					// update heart probes values
-					for (int i = 0; i < heart_mesh->vertices.size(); i++)
-					{
-						heart_mesh->vertices[i].value = QH(i);
-					}
-					for (int i = 0; i < heart_probes.size(); i++)
-					{
-						heart_probes_values_temp(i) = evaluate_heart_probe(heart_probes[i], i);
-					}
+			ser.push_u32(3 + probes.size()); // vector x, y, z and count of probes
+			Timer generating_timer;
+			generating_timer.start();
+			Random rnd;
+			MatrixX<Real> random_values(random_samples_count, 3 + probes.size());
+			for (uint32_t i = 0; i < random_samples_count; i++)
+			{
+				dipole_vec = rnd.next_vector3(maximum_radius);
+				calculate_torso_potentials();
 
-					// use interpolation for heart potentials using heart probes
-					if (heart_probes.size() > 0)
-					{
-						QH = tmp_probes_interpolation_matrix*heart_probes_values_temp;
-					}
-					else
-					{
-						// set values to 0
-						for (int i = 0; i < heart_mesh->vertices.size(); i++)
-						{
-							QH(i) = 0;
-						}
-					}
+				// dipole vector
+				random_values(i, 0) = dipole_vec.x();
+				random_values(i, 1) = dipole_vec.y();
+				random_values(i, 2) = dipole_vec.z();
 
-					// calculate body surface potentials
-					calculate_torso_potentials();
+				// probes values
+				evaluate_torso_probes(QB, probes_current_values);
+				random_values.row(i).tail(probes.size()) = probes_current_values.transpose();
+			}
+			printf("Generated %u random vector values in %.3f ms\n", random_samples_count, 1000*generating_timer.elapsed_seconds());
 
-					// fill the matrix
-					for (int i = 0; i < heart_probes.size(); i++)
-					{
-						TMP_BSP_values(sample, i) = heart_probes_values_temp(i);
-					}
+			// serialize matrix RANDOM_SAMPLES_COUNTx(3+PROBES_COUNT)
+			serialize_matrix(ser, random_values, format);
+		}
+		else if (request_type == REQUEST_SET_DIPOLE_VECTOR_VALUES)
+		{
+			uint32_t values_count = des.parse_u32();
 
-					for (int i = 0; i < probes.size(); i++)
-					{
-						TMP_BSP_values(sample, heart_probes.size()+i) = evaluate_torso_probe(probes[i]);
-					}
+			dipole_vec_values_list.clear();
 
-					print_progress_bar((sample*100)/sample_count);
-				}
+			for (uint32_t i = 0; i < values_count; i++)
+			{
+				Eigen::Vector3<Real> new_value;
+				new_value.x() = des.parse_double();
+				new_value.y() = des.parse_double();
+				new_value.z() = des.parse_double();
+				dipole_vec_values_list.push_back(new_value);
+			}
+			
+			dipole_vec_source = VALUES_SOURCE_VALUES_LIST;
+			ser.push_u8(1); // return true acknowledgement
+		}
+		else if (request_type == REQUEST_GET_TMP_BSP_VALUES)
+		{
+			Timer generating_timer;
+			generating_timer.start();
+			
+			// calculate BSP values of all the samples
+			MatrixX<Real> QH_samples, QB_samples;
+			calculate_tmp_samples(sample_count, QH_samples);
+			calculate_torso_potentials_samples(QH_samples, QB_samples);
 
-				print_progress_bar(100);
-				printf("\n");
+			MatrixX<Real> TMP_BSP_values(sample_count, M+N);
+			TMP_BSP_values.leftCols(M) = QH_samples.transpose();
+			TMP_BSP_values.rightCols(N) = QB_samples.transpose();
 
-				printf("Generated BSP probes values in: %.3f seconds\n", generating_timer.elapsed_seconds());
+			printf("Generated BSP probes values in: %.3f seconds\n", generating_timer.elapsed_seconds());
 
-				// serialize data
-				ser.push_u32(sample_count); // sample count
-				ser.push_u32(heart_probes.size()); // heart probes count
-				ser.push_u32(probes.size()); // probes count
+			// serialize data
+			ser.push_u32(sample_count); // sample count
+			ser.push_u32(M); // TMP values count
+			ser.push_u32(N); // BSP values count
 
-				// serialize matrix SAMPLE_COUNTx(HEART_PROBES_COUNT+PROBES_COUNT)
-				for (int i = 0; i < TMP_BSP_values.rows(); i++)
+			// serialize matrix SAMPLE_COUNTx(M+N)
+			serialize_matrix(ser, TMP_BSP_values, format);
+		}
+		else if (request_type == REQUEST_SET_TMP_VALUES)
+		{
+			// deserialize data
+			int rows_count = 0;
+			int cols_count = 0;
+			std::vector<double> bulk_values;
+			if (format.bulk_arrays)
+			{
+				std::vector<uint32_t> shape;
+				bulk_values = des.parse_array_f64(shape);
+				if (shape.size() == 2)
 				{
-					for (int j = 0; j < TMP_BSP_values.cols(); j++)
-					{
-						ser.push_double(TMP_BSP_values(i, j));
-					}
+					rows_count = shape[0];
+					cols_count = shape[1];
 				}
 			}
-			else if (request_type == REQUEST_GET_TMP_BSP_VALUES_PROBES_TRAIN)
+			else
 			{
-				Timer generating_timer;
-				generating_timer.start();
-				Random rnd;
-
-				// progress bar
-				print_progress_bar(0);
-
-				// samples count
-				uint32_t request_sample_count = des.parse_u32();
+				rows_count = des.parse_u32();
+				cols_count = des.parse_u32();
+			}
 
-				// calculate BSP probes values
-				MatrixX<Real> TMP_BSP_values = MatrixX<Real>::Zero(request_sample_count, heart_probes.size()+probes.size());
-				for (int sample = 0; sample < request_sample_count; sample++)
+			if (cols_count == heart_probes.size())
+			{
+				// deserialize matrix SAMPLE_COUNTxPROBES_COUNT
+				MatrixX<Real> new_tmp_direct_values = MatrixX<Real>::Zero(rows_count, cols_count);
+				for (int i = 0; i < rows_count; i++)
 				{
-					Real t_current = sample*TMP_dt;
-
-					// update heart potentials
-					heart_probes_values_temp.resize(1, heart_probes.size());
-					for (int i = 0; i < heart_probes.size(); i++)
+					for (int j = 0; j < cols_count; j++)
 					{
-						heart_probes_values_temp(i) = rnd.next_real()*2 - 1;
+						new_tmp_direct_values(i, j) = format.bulk_arrays ? bulk_values[i*cols_count + j] : des.parse_double();
 					}
-					QH = tmp_probes_interpolation_matrix*heart_probes_values_temp;
+				}
 
-					// calculate body surface potentials
-					calculate_torso_potentials();
+				// set new values
+				tmp_direct_values = new_tmp_direct_values;
+				tmp_source = TMP_SOURCE_TMP_DIRECT_VALUES;
+				tmp_direct_values_one_play = true;
+				current_sample = 0;
 
-					for (int i = 0; i < heart_probes.size(); i++)
-					{
-						TMP_BSP_values(sample, i) = evaluate_heart_probe(heart_probes[i], i);
-					}
+				ser.push_u8(1); // return true acknowledgement
+			}
+			else
+			{
+				printf("TMP values count doesn't match\n");
 
-					for (int i = 0; i < probes.size(); i++)
-					{
-						TMP_BSP_values(sample, heart_probes.size()+i) = evaluate_torso_probe(probes[i]);
-					}
+				ser.push_u8(0); // return false acknowledgement
+			}
+		}
+		else if (request_type == REQUEST_GET_TMP_BSP_VALUES_PROBES)
+		{
+			Timer generating_timer;
+			generating_timer.start();
 
-					print_progress_bar((sample*100)/request_sample_count);
-				}
+			// calculate BSP probes values of all the samples
+			MatrixX<Real> TMP_BSP_values;
+			calculate_tmp_bsp_probes_values(sample_count, TMP_BSP_values);
 
-				print_progress_bar(100);
-				printf("\n");
+			printf("Generated BSP probes values in: %.3f seconds\n", generating_timer.elapsed_seconds());
 
-				printf("Generated BSP probes values in: %.3f seconds\n", generating_timer.elapsed_seconds());
+			// serialize data
+			ser.push_u32(sample_count); // sample count
+			ser.push_u32(heart_probes.size()); // heart probes count
+			ser.push_u32(probes.size()); // probes count
 
-				// serialize data
-				ser.push_u32(request_sample_count); // sample count
-				ser.push_u32(heart_probes.size()); // heart probes count
-				ser.push_u32(probes.size()); // probes count
+			// serialize matrix SAMPLE_COUNTx(HEART_PROBES_COUNT+PROBES_COUNT)
+			serialize_matrix(ser, TMP_BSP_values, format);
+		}
+		else if (request_type == REQUEST_GET_TMP_BSP_VALUES_PROBES_2)
+		{
+			Timer generating_timer;
+			generating_timer.start();
 
-				// serialize matrix SAMPLE_COUNTx(HEART_PROBES_COUNT+PROBES_COUNT)
-				for (int i = 0; i < TMP_BSP_values.rows(); i++)
-				{
-					for (int j = 0; j < TMP_BSP_values.cols(); j++)
-					{
-						ser.push_double(TMP_BSP_values(i, j));
-					}
-				}
+			// progress bar
+			print_progress_bar(0);
+
+			// heart TMP of all the samples
+			MatrixX<Real> QH_samples, heart_probes_samples, probes_samples;
+			calculate_tmp_samples(sample_count, QH_samples);
+			evaluate_heart_probes(QH_samples, heart_probes_samples);
+
+			// probes values of the heart potentials interpolated from the heart probes
+			if (heart_probes.size() > 0)
+			{
+				calculate_torso_probes_samples_from_heart_probes(heart_probes_samples, probes_samples);
 			}
 			else
 			{
-				printf("Unknown request\n");
+				// set values to 0
+				probes_samples = MatrixX<Real>::Zero(probes.size(), sample_count);
 			}
 
-			// send response
-			if (!server.push_response(ser.get_data()))
+			print_progress_bar(100);
+			printf("\n");
+
+			printf("Generated BSP probes values in: %.3f seconds\n", generating_timer.elapsed_seconds());
+
+			// serialize data
+			serialize_tmp_bsp_probes_values(ser, heart_probes_samples, probes_samples, format);
+		}
+		else if (request_type == REQUEST_GET_TMP_BSP_VALUES_PROBES_DATASET)
+		{
+			// compress
+			DatasetOptions options;
+			options.single_precision = format.single_precision;
+			options.compress = des.parse_u8();
+
+			Timer generating_timer;
+			generating_timer.start();
+
+			// calculate BSP probes values of all the samples
+			MatrixX<Real> TMP_BSP_values;
+			calculate_tmp_bsp_probes_values(sample_count, TMP_BSP_values);
+
+			std::vector<std::string> names;
+			for (int i = 0; i < heart_probes.size(); i++)
 			{
-				printf("Failed to push response\n");
+				names.push_back(heart_probes[i].name);
+			}
+			for (int i = 0; i < probes.size(); i++)
+			{
+				names.push_back(probes[i].name);
 			}
 
-			// log request
-			printf("Request from (%s:%d):\n \tIndex: %d\n \tRequest ID: %s (%d)\n \tRequest size: %u bytes\n \tResponse size: %u bytes\n\n",
-				request_addr.to_string().c_str(), request_port,
-				server_request_counter,
-				request_type_to_string((RequestType)request_type).c_str(), request_type, 
-				request_bytes.size(), ser.get_data().size());
+			// the response is the dataset file
+			std::vector<uint8_t> dataset_bytes;
+			serialize_dataset(names, TMP_BSP_values, 0, TMP_dt, options, dataset_bytes);
+			ser.push_bytes(dataset_bytes);
 
-			server_request_counter++;
+			printf("Generated BSP probes values dataset in: %.3f seconds\n", generating_timer.elapsed_seconds());
 		}
+		else
+		{
+			printf("Unknown request\n");
+		}
+
+		// send response
+		request.respond(ser.get_data());
+		log_server_request(request, request_type, ser.get_data().size());
 	}
 
 private:
@@ -3938,6 +4176,12 @@ private:
 	AxisRenderer* axis_renderer;
 	MeshPlotRenderer* mpr;
 	glFrameBuffer* torso_fb;
+	// ranges of the torso and heart values, calculated with the potentials and
+	// invalidated when the values are overwritten (previews)
+	ValuesRange torso_values_range;
+	bool torso_values_range_valid = false;
+	ValuesRange heart_values_range;
+	bool heart_values_range_valid = false;
 	float torso_opacity = 0.5;
 	float mesh_plot_ambient = 0.6;
 	float mesh_plot_specular = 2;
@@ -3951,7 +4195,7 @@ private:
 	Real toso_conductivity;
 	Real heart_conductivity;
 	Vector3<Real> heart_pos;
-	Real heart_scale = 1;
+	Real heart_scale = 1; // BEM solve only
 	Vector3<Real> dipole_pos;
 	Vector3<Real> dipole_vec;
 	Real t;
@@ -3965,6 +4209,11 @@ private:
 	MatrixX<Real> QH; // Heart potentials
 	MatrixX<Real> QB; // Body potentials
 	MatrixX<Real> ZBH; // transfer matrix
+	TransferMatrixPipeline transfer_matrix_pipeline; // cached PBB factorization and PBH
+	ProbesTransferMatrix probes_transfer_matrix; // cached ZBH folded into the torso probes (PROBES_COUNTxM)
+	bool auto_update_transfer_matrix = false;
+	DatasetOptions dataset_options; // binary dataset exports
+	std::string transfer_matrix_cache_directory = "transfer_matrix_cache";
 	std::vector<bool> heart_mesh_invert_group_normal;
 
 	// dipole vector source
@@ -4007,7 +4256,7 @@ private:
 	Real heart_potential_min_value = 1e12;
 	Real heart_potential_range_multiplier = 1;
 	// Heart groups render option
-	std::vector<std::shared_ptr<glFrameBuffer>> heart_mesh_groups_frame_buffers;
+	glFrameBuffer* heart_group_fb;
 	std::vector<float> heart_mesh_groups_opacity;
 	// wireframe
 	float render_heart_wireframe_line_width = 1.0f;
@@ -4027,6 +4276,8 @@ private:
 	float probes_graph_height = 60;
 	float probes_graph_width = 120;
 	std::vector<Probe> probes;
+	ProbesOperator torso_probes_operator; // torso probes sampling matrix (PROBES_COUNTxN)
+	Eigen::MatrixX<Real> probes_current_values; // PROBES_COUNTx1
 	int reference_probe = -1;
 	bool probes_differentiation = false;
 	bool torso_probes_clear_before_adding = true;
@@ -4041,7 +4292,18 @@ private:
 	Server server;
 	int server_address_select = 1;
 	int server_port = 1234;
-	int server_request_counter = 0;
+	std::atomic<int> server_request_counter{ 0 };
+	std::vector<std::thread> server_workers;
+	JobQueue<std::shared_ptr<ServerRequest>> server_main_requests; // requests that need the application state
+	std::thread server_request_thread;
+	bool server_stop_requested = false;
+	std::mutex app_state_mutex; // held by the main loop while updating and rendering, and by the request thread while handling a request
+	std::mutex server_snapshot_mutex;
+	std::shared_ptr<const ServerSnapshot> server_snapshot;
+	std::vector<uint8_t> server_snapshot_state; // what the snapshot was built from
+	int transfer_matrix_version = 0; // incremented when ZBH changes
+	uint64_t transfer_matrix_inputs_hash = 0; // hash of the inputs ZBH was calculated from (saved with the matrix)
+	int interpolation_matrix_version = 0; // incremented when tmp_probes_interpolation_matrix is recalculated
 
 	// animation
 	Timer frame_timer;
@@ -4091,6 +4353,8 @@ private:
 	float heart_probes_graph_width = 120;
 	std::vector<Probe> heart_probes;
 	MatrixX<Real> heart_probes_values;
+	ProbesOperator heart_probes_operator; // heart probes sampling matrix (HEART_PROBES_COUNTxM)
+	MatrixX<Real> heart_probes_current_values; // HEART_PROBES_COUNTx1
 	int heart_probe_selected_group = 0;
 	bool heart_probes_clear_before_adding = true;
 	Eigen::Vector3<Real> heart_probe_cast_sphere_origin = {0, 0, 0};
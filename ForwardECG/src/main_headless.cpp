@@ -0,0 +1,559 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "math.h"
+#include "mesh_plot.h"
+#include "probe.h"
+#include "action_potential.h"
+#include "wave_propagation_simulation.h"
+#include "transfer_matrix.h"
+#include "forward_solver.h"
+#include "matrix_io.h"
+#include "parallel.h"
+#include "timer.h"
+
+// headless batch forward solver, runs the forward ecg without a window (no GLFW/OpenGL/ImGui)
+
+
+using namespace Eigen;
+
+enum TMPValuesSource
+{
+	TMP_SOURCE_ACTION_POTENTIAL_PARAMETERS = 1,
+	TMP_SOURCE_TMP_DIRECT_VALUES = 2,
+	TMP_SOURCE_WAVE_PROPAGATION = 3,
+};
+
+struct HeadlessOptions
+{
+	std::string torso_model_path = "models/torso_model_fixed.fbx";
+	std::string heart_model_path = "models/heart_model_7.fbx";
+	Vector3<Real> heart_pos = { 0.07, 0.4, 0.05 };
+	Real heart_scale = 1;
+	std::vector<int> heart_invert_groups;
+	TransferMatrixParameters params;
+
+	// transfer matrix
+	std::string load_matrix_path = "";
+	std::string save_matrix_path = "";
+	std::string matrix_cache_path = "";
+
+	// probes
+	std::string probes_path = "";
+	std::string reference_probe_name = "";
+
+	// TMP source
+	TMPValuesSource tmp_source = TMP_SOURCE_ACTION_POTENTIAL_PARAMETERS;
+	std::string tmp_source_path = "";
+	bool wave_event_driven = false;
+	bool benchmark_wave = false;
+	bool single_precision = false;
+	Real dt = 0.0005;
+	Real duration = 0.5;
+
+	// outputs
+	std::string bsp_output_path = "";
+	std::string probes_output_path = "";
+	std::string tmp_output_path = "";
+};
+
+static void print_usage()
+{
+	printf("usage: ForwardECGHeadless [options]\n");
+	printf("  --torso <path>                 torso model (default: models/torso_model_fixed.fbx)\n");
+	printf("  --heart <path>                 heart model (default: models/heart_model_7.fbx)\n");
+	printf("  --heart-pos <x> <y> <z>        heart position (default: 0.07 0.4 0.05)\n");
+	printf("  --heart-scale <s>              heart scale in the BEM solve only, probes use the unscaled mesh (default: 1)\n");
+	printf("  --invert-group <i>             invert the normals of heart group i (repeatable)\n");
+	printf("  --torso-conductivity <s>       (default: 1)\n");
+	printf("  --heart-conductivity <s>       (default: 1)\n");
+	printf("  --close-range-threshold <d>    (default: 0)\n");
+	printf("  --r-power <p>                  (default: 2)\n");
+	printf("  --ignore-negative-dot-product\n");
+	printf("  --load-matrix <path>           load the transfer matrix instead of calculating it (rejected if calculated from other inputs)\n");
+	printf("  --save-matrix <path>           save the transfer matrix\n");
+	printf("  --matrix-cache <dir>           load the transfer matrix from the cache directory if it was calculated before,\n");
+	printf("                                 otherwise calculate it and store it there\n");
+	printf("  --probes <path>                torso probes file\n");
+	printf("  --reference-probe <name>       reference probe (subtracted from the body surface potentials)\n");
+	printf("  --action-potential <path>      TMP source: action potential parameters file\n");
+	printf("  --tmp-values <path>            TMP source: TMP direct values file (one column per heart vertex)\n");
+	printf("  --wave-propagation <path>      TMP source: wave propagation configuration file\n");
+	printf("  --wave-event-driven            calculate the wave depolarization times once instead of stepping\n");
+	printf("  --benchmark-wave               time the wave propagation steps of both engines\n");
+	printf("  --float32                      forward solve in single precision, prints its error against double precision\n");
+	printf("  --dt <dt>                      TMP time step (default: 0.0005)\n");
+	printf("  --duration <t>                 TMP total duration (default: 0.5)\n");
+	printf("  --out-bsp <path>               body surface potentials matrix (SAMPLE_COUNTxN)\n");
+	printf("  --out-probes <path>            probes values csv\n");
+	printf("  --out-tmp <path>               heart potentials matrix (SAMPLE_COUNTxM)\n");
+}
+
+static bool parse_options(int argc, char** argv, HeadlessOptions& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		int args_left = argc-i-1;
+
+		// options without a value
+		if (strcmp(arg, "--help") == 0)
+		{
+			return false;
+		}
+		else if (strcmp(arg, "--ignore-negative-dot-product") == 0)
+		{
+			options.params.ignore_negative_dot_product = true;
+			continue;
+		}
+		else if (strcmp(arg, "--wave-event-driven") == 0)
+		{
+			options.wave_event_driven = true;
+			continue;
+		}
+		else if (strcmp(arg, "--benchmark-wave") == 0)
+		{
+			options.benchmark_wave = true;
+			continue;
+		}
+		else if (strcmp(arg, "--float32") == 0)
+		{
+			options.single_precision = true;
+			continue;
+		}
+
+		// options with a value
+		if (args_left < 1)
+		{
+			printf("Missing value for option \"%s\"\n", arg);
+			return false;
+		}
+
+		if (strcmp(arg, "--torso") == 0)
+		{
+			options.torso_model_path = argv[++i];
+		}
+		else if (strcmp(arg, "--heart") == 0)
+		{
+			options.heart_model_path = argv[++i];
+		}
+		else if (strcmp(arg, "--heart-pos") == 0)
+		{
+			if (args_left < 3)
+			{
+				printf("Missing value for option \"%s\"\n", arg);
+				return false;
+			}
+			options.heart_pos.x() = atof(argv[++i]);
+			options.heart_pos.y() = atof(argv[++i]);
+			options.heart_pos.z() = atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--heart-scale") == 0)
+		{
+			options.heart_scale = atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--invert-group") == 0)
+		{
+			options.heart_invert_groups.push_back(atoi(argv[++i]));
+		}
+		else if (strcmp(arg, "--torso-conductivity") == 0)
+		{
+			options.params.torso_conductivity = atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--heart-conductivity") == 0)
+		{
+			options.params.heart_conductivity = atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--close-range-threshold") == 0)
+		{
+			options.params.close_range_threshold = atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--r-power") == 0)
+		{
+			options.params.r_power = atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--load-matrix") == 0)
+		{
+			options.load_matrix_path = argv[++i];
+		}
+		else if (strcmp(arg, "--save-matrix") == 0)
+		{
+			options.save_matrix_path = argv[++i];
+		}
+		else if (strcmp(arg, "--matrix-cache") == 0)
+		{
+			options.matrix_cache_path = argv[++i];
+		}
+		else if (strcmp(arg, "--probes") == 0)
+		{
+			options.probes_path = argv[++i];
+		}
+		else if (strcmp(arg, "--reference-probe") == 0)
+		{
+			options.reference_probe_name = argv[++i];
+		}
+		else if (strcmp(arg, "--action-potential") == 0)
+		{
+			options.tmp_source = TMP_SOURCE_ACTION_POTENTIAL_PARAMETERS;
+			options.tmp_source_path = argv[++i];
+		}
+		else if (strcmp(arg, "--tmp-values") == 0)
+		{
+			options.tmp_source = TMP_SOURCE_TMP_DIRECT_VALUES;
+			options.tmp_source_path = argv[++i];
+		}
+		else if (strcmp(arg, "--wave-propagation") == 0)
+		{
+			options.tmp_source = TMP_SOURCE_WAVE_PROPAGATION;
+			options.tmp_source_path = argv[++i];
+		}
+		else if (strcmp(arg, "--dt") == 0)
+		{
+			options.dt = atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--duration") == 0)
+		{
+			options.duration = atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--out-bsp") == 0)
+		{
+			options.bsp_output_path = argv[++i];
+		}
+		else if (strcmp(arg, "--out-probes") == 0)
+		{
+			options.probes_output_path = argv[++i];
+		}
+		else if (strcmp(arg, "--out-tmp") == 0)
+		{
+			options.tmp_output_path = argv[++i];
+		}
+		else
+		{
+			printf("Unknown option \"%s\"\n", arg);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// times the simulation steps of a full run with the stepping and the event-driven engines
+static void benchmark_wave_propagation(WavePropagationSimulation& wave_prop, int sample_count, int M)
+{
+	bool event_driven = wave_prop.is_event_driven();
+	for (int mode = 0; mode < 2; mode++)
+	{
+		wave_prop.set_event_driven(mode == 1);
+		wave_prop.reset();
+
+		Timer timer;
+		timer.start();
+		for (int sample = 0; sample < sample_count; sample++)
+		{
+			wave_prop.simulation_step();
+		}
+		Real elapsed = timer.elapsed_seconds();
+
+		printf("Wave propagation (%s): %d vertices, %d links, %d steps in: %.3f sec (%.3f us/step)\n", 
+			mode == 1 ? "event-driven" : "stepping", M, wave_prop.get_links_count(), sample_count, 
+			elapsed, sample_count > 0 ? elapsed*1e6/sample_count : 0);
+	}
+	wave_prop.set_event_driven(event_driven);
+}
+
+int main(int argc, char** argv)
+{
+	HeadlessOptions options;
+	if (!parse_options(argc, argv, options))
+	{
+		print_usage();
+		return 1;
+	}
+
+	Timer timer;
+	timer.start();
+
+	// load models
+	MeshPlot* torso = load_mesh_plot(options.torso_model_path.c_str());
+	if (!torso)
+	{
+		printf("Failed to load torso model \"%s\"\n", options.torso_model_path.c_str());
+		return 1;
+	}
+	MeshPlot* heart_mesh = load_mesh_plot(options.heart_model_path.c_str(), true);
+	if (!heart_mesh)
+	{
+		printf("Failed to load heart model \"%s\"\n", options.heart_model_path.c_str());
+		return 1;
+	}
+	int N = torso->vertices.size();
+	int M = heart_mesh->vertices.size();
+	printf("Loaded models: Vertex count: Troso: %d vertex  \tHeart: %d vertex\n", N, M);
+
+	// transfer matrix inputs
+	TransferMatrixInputs inputs;
+	inputs.torso = torso;
+	inputs.heart = heart_mesh;
+	inputs.heart_pos = options.heart_pos;
+	inputs.heart_scale = options.heart_scale;
+	inputs.heart_invert_group_normal.resize(heart_mesh->groups_vertices.size(), false);
+	for (int group : options.heart_invert_groups)
+	{
+		if (group >= 0 && group < inputs.heart_invert_group_normal.size())
+		{
+			inputs.heart_invert_group_normal[group] = true;
+		}
+	}
+	inputs.params = options.params;
+	uint64_t inputs_hash = hash_transfer_matrix_inputs(inputs);
+
+	// transfer matrix
+	MatrixX<Real> ZBH;
+	if (options.load_matrix_path != "")
+	{
+		Timer load_timer;
+		load_timer.start();
+		if (!load_transfer_matrix_file(options.load_matrix_path, inputs_hash, ZBH))
+		{
+			printf("Failed to load matrix \"%s\"\n", options.load_matrix_path.c_str());
+			return 1;
+		}
+		if (ZBH.rows() != N || ZBH.cols() != M)
+		{
+			printf("Matrix size doesn't match, expected: %dx%d, got: %dx%d\n", N, M, (int)ZBH.rows(), (int)ZBH.cols());
+			return 1;
+		}
+		printf("Loaded matrix \"%s\" in: %.3f sec\n", options.load_matrix_path.c_str(), load_timer.elapsed_seconds());
+	}
+	else
+	{
+		printf("Calculating the transfer matrix (%d threads)...\n", get_parallel_threads_count());
+		TransferMatrixPipeline transfer_matrix_pipeline;
+		transfer_matrix_pipeline.get_cache().set_directory(options.matrix_cache_path);
+		transfer_matrix_pipeline.set_inputs(inputs);
+		transfer_matrix_pipeline.update(ZBH);
+		if (transfer_matrix_pipeline.get_cache().is_enabled())
+		{
+			TransferMatrixCacheStats cache_stats = transfer_matrix_pipeline.get_cache().get_stats();
+			printf("Transfer matrix cache: %s, %d matrices, %.1f MB\n", (cache_stats.hits > 0) ? "hit" : "miss", 
+				cache_stats.files_count, cache_stats.size/(1024.0*1024.0));
+		}
+	}
+
+	if (options.save_matrix_path != "")
+	{
+		if (!save_matrix_file(options.save_matrix_path, ZBH, inputs_hash))
+		{
+			printf("Failed to save matrix \"%s\"\n", options.save_matrix_path.c_str());
+			return 1;
+		}
+		printf("Saved matrix \"%s\"\n", options.save_matrix_path.c_str());
+	}
+
+	// probes
+	std::vector<Probe> probes;
+	if (options.probes_path != "")
+	{
+		if (!import_probes(options.probes_path, probes))
+		{
+			printf("Failed to import probes \"%s\"\n", options.probes_path.c_str());
+			return 1;
+		}
+	}
+	int reference_probe = -1;
+	if (options.reference_probe_name != "")
+	{
+		for (int i = 0; i < probes.size(); i++)
+		{
+			if (probes[i].name == options.reference_probe_name)
+			{
+				reference_probe = i;
+				break;
+			}
+		}
+		if (reference_probe == -1)
+		{
+			printf("Reference probe \"%s\" doesn't exist\n", options.reference_probe_name.c_str());
+			return 1;
+		}
+	}
+
+	// TMP source
+	std::vector<ActionPotentialParameters> heart_action_potential_params(M,
+		ActionPotentialParameters{ ACTION_POTENTIAL_RESTING_POTENTIAL, ACTION_POTENTIAL_PEAK_POTENTIAL, ACTION_POTENTIAL_DEPOLARIZATION_TIME, ACTION_POTENTIAL_REPOLARIZATION_TIME });
+	MatrixX<Real> tmp_direct_values;
+	WavePropagationSimulation wave_prop;
+	int sample_count = options.duration/options.dt + 1;
+	Real TMP_dt = options.dt;
+	if (options.tmp_source == TMP_SOURCE_ACTION_POTENTIAL_PARAMETERS)
+	{
+		if (options.tmp_source_path != "" && !import_action_potential_parameters(options.tmp_source_path, heart_action_potential_params))
+		{
+			printf("Failed to import action potential parameters \"%s\"\n", options.tmp_source_path.c_str());
+			return 1;
+		}
+		if (heart_action_potential_params.size() != M)
+		{
+			printf("Action potential parameters count doesn't match the heart vertex count\n");
+			return 1;
+		}
+	}
+	else if (options.tmp_source == TMP_SOURCE_TMP_DIRECT_VALUES)
+	{
+		if (!import_tmp_direct_values(options.tmp_source_path, tmp_direct_values, M))
+		{
+			printf("Failed to import TMP direct values \"%s\"\n", options.tmp_source_path.c_str());
+			return 1;
+		}
+		sample_count = tmp_direct_values.rows();
+	}
+	else /*TMP_SOURCE_WAVE_PROPAGATION*/
+	{
+		wave_prop.set_mesh(heart_mesh, options.heart_pos);
+		if (!wave_prop.load_from_file(options.tmp_source_path))
+		{
+			printf("Failed to load wave propagation configuration \"%s\"\n", options.tmp_source_path.c_str());
+			return 1;
+		}
+		sample_count = wave_prop.get_duration()/wave_prop.get_dt();
+		TMP_dt = wave_prop.get_dt();
+
+		if (options.benchmark_wave)
+		{
+			benchmark_wave_propagation(wave_prop, sample_count, M);
+		}
+	}
+
+	// heart potentials of all the samples (MxSAMPLE_COUNT)
+	Timer solve_timer;
+	solve_timer.start();
+	MatrixX<Real> QH_samples;
+	if (options.tmp_source == TMP_SOURCE_ACTION_POTENTIAL_PARAMETERS)
+	{
+		calculate_action_potential_tmp_samples(heart_action_potential_params, sample_count, TMP_dt, QH_samples);
+	}
+	else if (options.tmp_source == TMP_SOURCE_TMP_DIRECT_VALUES)
+	{
+		QH_samples = tmp_direct_values.transpose();
+	}
+	else /*TMP_SOURCE_WAVE_PROPAGATION*/
+	{
+		wave_prop.set_event_driven(options.wave_event_driven);
+		wave_prop.calculate_potentials_samples(sample_count, QH_samples);
+	}
+
+	// forward solve of all the samples
+	SparseMatrix<Real, RowMajor> probes_sampling_matrix;
+	build_probe_sampling_matrix(*torso, probes, probes_sampling_matrix);
+	MatrixX<Real> QB_samples, probes_samples;
+	MatrixX<Real> ZPH;
+	if (options.bsp_output_path != "")
+	{
+		calculate_torso_potentials_samples(ZBH, QH_samples, QB_samples);
+		if (reference_probe != -1)
+		{
+			apply_reference_probe(probes_sampling_matrix, reference_probe, QB_samples);
+		}
+		probes_samples = probes_sampling_matrix*QB_samples;
+	}
+	else
+	{
+		// only the probes are needed, skip the body surface potentials
+		calculate_probes_transfer_matrix(probes_sampling_matrix, ZBH, reference_probe, ZPH);
+		calculate_torso_potentials_samples(ZPH, QH_samples, probes_samples);
+	}
+	printf("Calculated %d samples in: %.3f sec\n", sample_count, solve_timer.elapsed_seconds());
+
+	// single precision forward solve, its values replace the double precision values
+	if (options.single_precision)
+	{
+		MatrixX<float> QB_samples_f32, probes_samples_f32;
+		SinglePrecisionMatrix Z_single;
+		Timer single_precision_timer;
+		if (options.bsp_output_path != "")
+		{
+			// the reference probe is folded into the transfer matrix in double precision
+			MatrixX<Real> ZBH_referenced = ZBH;
+			if (reference_probe != -1)
+			{
+				ZBH_referenced.rowwise() -= probes_sampling_matrix.row(reference_probe)*ZBH;
+			}
+			make_single_precision_matrix(ZBH_referenced, Z_single);
+			single_precision_timer.start();
+			calculate_torso_potentials_samples(Z_single, QH_samples, QB_samples_f32);
+			probes_samples_f32 = probes_sampling_matrix.cast<float>()*QB_samples_f32;
+		}
+		else
+		{
+			make_single_precision_matrix(ZPH, Z_single);
+			single_precision_timer.start();
+			calculate_torso_potentials_samples(Z_single, QH_samples, probes_samples_f32);
+		}
+		printf("Calculated %d samples in single precision in: %.3f sec\n", sample_count, single_precision_timer.elapsed_seconds());
+
+		if (options.bsp_output_path != "")
+		{
+			print_precision_error_report("body surface potentials", calculate_precision_error(QB_samples, QB_samples_f32));
+			QB_samples = QB_samples_f32.cast<Real>();
+		}
+		print_precision_error_report("probes", calculate_precision_error(probes_samples, probes_samples_f32));
+		probes_samples = probes_samples_f32.cast<Real>();
+	}
+
+	MatrixX<Real> TMP_values = QH_samples.transpose();
+	MatrixX<Real> BSP_values = QB_samples.transpose();
+	MatrixX<Real> probes_values = probes_samples.transpose();
+
+	// outputs
+	bool success = true;
+	if (options.bsp_output_path != "")
+	{
+		if (save_matrix_to_file(options.bsp_output_path, BSP_values))
+		{
+			printf("Saved body surface potentials to \"%s\"\n", options.bsp_output_path.c_str());
+		}
+		else
+		{
+			printf("Failed to save body surface potentials to \"%s\"\n", options.bsp_output_path.c_str());
+			success = false;
+		}
+	}
+	if (options.tmp_output_path != "")
+	{
+		if (export_tmp_direct_values(options.tmp_output_path, TMP_values))
+		{
+			printf("Saved heart potentials to \"%s\"\n", options.tmp_output_path.c_str());
+		}
+		else
+		{
+			printf("Failed to save heart potentials to \"%s\"\n", options.tmp_output_path.c_str());
+			success = false;
+		}
+	}
+	if (options.probes_output_path != "")
+	{
+		std::vector<std::string> names(probes.size(), "");
+		for (int i = 0; i < probes.size(); i++)
+		{
+			names[i] = probes[i].name;
+		}
+		if (dump_matrix_to_csv(options.probes_output_path, names, probes_values))
+		{
+			printf("Saved probes values to \"%s\"\n", options.probes_output_path.c_str());
+		}
+		else
+		{
+			printf("Failed to save probes values to \"%s\"\n", options.probes_output_path.c_str());
+			success = false;
+		}
+	}
+
+	printf("Finished in: %.3f sec\n", timer.elapsed_seconds());
+
+	delete torso;
+	delete heart_mesh;
+
+	return success ? 0 : 1;
+}
@@ -52,7 +52,7 @@ Eigen::Vector3<Real> glm2eigen(const glm::vec3& v3)
 
 glm::vec3 eigen2glm(const Eigen::Vector3<Real>& v3)
 {
-	return { v3.x(), v3.y(), v3.z() };
+	return { (float)v3.x(), (float)v3.y(), (float)v3.z() };
 }
 
 
@@ -0,0 +1,318 @@
+#include "matrix_io.h"
+#include "file_io.h"
+#include "network/serializer.h"
+#include <stdio.h>
+#include <string.h>
+#include <limits>
+
+
+using namespace Eigen;
+
+
+static const char MATRIX_FILE_MAGIC[8] = { 'E', 'C', 'G', 'M', 'A', 'T', 0, 0 };
+static const uint32_t MATRIX_FILE_BYTE_ORDER = 0x01020304; // written in the native byte order
+static const uint64_t MATRIX_FILE_DATA_OFFSET = 64;
+
+// native byte order
+struct MatrixFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t dtype; // ArrayDataType
+	uint32_t flags; // reserved
+	uint64_t rows;
+	uint64_t cols;
+	uint64_t inputs_hash;
+	uint64_t data_offset;
+	uint8_t reserved[8];
+};
+static_assert(sizeof(MatrixFileHeader) == MATRIX_FILE_DATA_OFFSET, "matrix file header must fill the data offset");
+
+
+bool import_tmp_direct_values(const std::string& file_name, MatrixX<Real>& tmp_direct_values, int tmp_points_count)
+{
+	// read file contents
+	std::vector<uint8_t> contents;
+	if (!file_read_vector(file_name.c_str(), contents))
+	{
+		return false;
+	}
+
+	Deserializer des(contents);
+
+	// parse
+
+	// vertex count
+	uint32_t rows_count = des.parse_u32();
+	uint32_t cols_count = des.parse_u32();
+	if (cols_count != tmp_points_count)
+	{
+		printf("TMP points count doesn't match\n");
+		return false;
+	}
+
+	MatrixX<Real> new_tmp_direct_values = MatrixX<Real>::Zero(rows_count, cols_count);
+
+	for (int i = 0; i < rows_count; i++)
+	{
+		for (int j = 0; j < cols_count; j++)
+		{
+			new_tmp_direct_values(i, j) = des.parse_double();
+		}
+	}
+
+	// set parameters
+	tmp_direct_values = new_tmp_direct_values;
+
+	return true;
+}
+
+bool export_tmp_direct_values(const std::string& file_name, const MatrixX<Real>& tmp_direct_values)
+{
+	Serializer ser;
+
+	// write
+
+	// rows and columns count
+	ser.push_u32(tmp_direct_values.rows());
+	ser.push_u32(tmp_direct_values.cols());
+
+	for (int i = 0; i < tmp_direct_values.rows(); i++)
+	{
+		for (int j = 0; j < tmp_direct_values.cols(); j++)
+		{
+			ser.push_double(tmp_direct_values(i, j));
+		}
+	}
+
+	return file_write(file_name.c_str(), ser.get_data());
+}
+
+bool dump_matrix_to_csv(const std::string& file_name, const std::vector<std::string>& names, const MatrixX<Real>& matrix)
+{
+	FILE* file = fopen(file_name.c_str(), "w");
+	if (!file)
+	{
+		return false;
+	}
+
+	std::string line = "";
+
+	// column names
+	for (int i = 0; i < names.size(); i++)
+	{
+		if (i != 0)
+		{
+			line += ", ";
+		}
+		line += names[i];
+	}
+	line += "\n";
+	fwrite(line.c_str(), sizeof(char), line.size(), file);
+
+	// values
+	for (int i = 0; i < matrix.rows(); i++)
+	{
+		line = "";
+
+		// TMP values
+		for (int j = 0; j < matrix.cols(); j++)
+		{
+			if (j != 0)
+			{
+				line += ", ";
+			}
+			line += std::to_string(matrix(i, j));
+		}
+
+		line += "\n";
+		fwrite(line.c_str(), sizeof(char), line.size(), file);
+	}
+
+	fclose(file);
+	return true;
+}
+
+bool save_matrix_to_file(const std::string& file_name, const MatrixX<Real>& matrix)
+{
+	Serializer ser;
+
+	// write matrix file header
+	ser.push_string("BinaryMatrixFile");
+	
+	// matrix dimensions
+	ser.push_u32(matrix.rows());
+	ser.push_u32(matrix.cols());
+
+	// values
+	for (int i = 0; i < matrix.rows(); i++)
+	{
+		for (int j = 0; j < matrix.cols(); j++)
+		{
+			ser.push_double(matrix(i, j));
+		}
+	}
+
+	return file_write(file_name.c_str(), ser.get_data());
+}
+
+bool load_matrix_from_file(const std::string& file_name, MatrixX<Real>& matrix)
+{
+	// read file contents
+	std::vector<uint8_t> contents;
+	bool result = file_read_vector(file_name.c_str(), contents);
+	if (!result)
+	{
+		return false;
+	}
+
+	Deserializer des(contents);
+
+	// write matrix file header
+	std::string header = des.parse_string();
+	if (header != "BinaryMatrixFile")
+	{
+		return false;
+	}
+
+	// matrix dimensions
+	uint32_t rows_count = des.parse_u32();
+	uint32_t cols_count = des.parse_u32();
+	matrix.resize(rows_count, cols_count);
+
+	// values
+	for (int i = 0; i < rows_count; i++)
+	{
+		for (int j = 0; j < cols_count; j++)
+		{
+			matrix(i, j) = des.parse_double();
+		}
+	}
+
+	return true;
+}
+
+bool save_matrix_file(const std::string& file_name, const MatrixX<Real>& matrix, uint64_t inputs_hash)
+{
+	MatrixFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+	header.version = MATRIX_FILE_VERSION;
+	header.byte_order = MATRIX_FILE_BYTE_ORDER;
+	header.dtype = ARRAY_DTYPE_F64;
+	header.rows = matrix.rows();
+	header.cols = matrix.cols();
+	header.inputs_hash = inputs_hash;
+	header.data_offset = MATRIX_FILE_DATA_OFFSET;
+
+	FILE* file = fopen(file_name.c_str(), "wb");
+	if (!file)
+	{
+		return false;
+	}
+
+	// header and the column major values as they are in memory
+	bool result = fwrite(&header, sizeof(header), 1, file) == 1
+		&& (matrix.size() == 0 || fwrite(matrix.data(), sizeof(Real), matrix.size(), file) == matrix.size());
+
+	return fclose(file) == 0 && result;
+}
+
+
+// MatrixFile
+
+bool MatrixFile::open(const std::string& file_name)
+{
+	close();
+
+	if (!m_file.open(file_name.c_str()))
+	{
+		return false;
+	}
+
+	MatrixFileHeader header;
+	if (m_file.get_size() < sizeof(header))
+	{
+		close();
+		return false;
+	}
+	memcpy(&header, m_file.get_data(), sizeof(header));
+
+	if (memcmp(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic)) != 0
+		|| header.version != MATRIX_FILE_VERSION
+		|| header.byte_order != MATRIX_FILE_BYTE_ORDER
+		|| header.dtype != ARRAY_DTYPE_F64
+		|| header.data_offset < sizeof(header)
+		|| header.data_offset % MATRIX_FILE_DATA_OFFSET != 0 // the values are 64 bytes aligned
+		|| header.data_offset > m_file.get_size())
+	{
+		close();
+		return false;
+	}
+
+	// the values must fit in the file (without overflowing rows*cols)
+	const uint64_t values_count = (m_file.get_size() - header.data_offset)/sizeof(Real);
+	if (header.rows > (uint64_t)std::numeric_limits<Eigen::Index>::max()
+		|| header.cols > (uint64_t)std::numeric_limits<Eigen::Index>::max()
+		|| (header.cols != 0 && header.rows > values_count/header.cols))
+	{
+		close();
+		return false;
+	}
+
+	m_rows = header.rows;
+	m_cols = header.cols;
+	m_inputs_hash = header.inputs_hash;
+	m_values = (const Real*)(m_file.get_data() + header.data_offset);
+	return true;
+}
+
+void MatrixFile::close()
+{
+	m_file.close();
+	m_rows = 0;
+	m_cols = 0;
+	m_inputs_hash = 0;
+	m_values = NULL;
+}
+
+bool MatrixFile::is_open() const
+{
+	return m_file.is_open();
+}
+
+uint64_t MatrixFile::get_inputs_hash() const
+{
+	return m_inputs_hash;
+}
+
+Map<const MatrixX<Real>> MatrixFile::get_matrix() const
+{
+	return Map<const MatrixX<Real>>(m_values, m_rows, m_cols);
+}
+
+
+bool load_transfer_matrix_file(const std::string& file_name, uint64_t inputs_hash, MatrixX<Real>& matrix)
+{
+	MatrixFile matrix_file;
+	if (!matrix_file.open(file_name))
+	{
+		// older format, its inputs are unknown
+		if (!load_matrix_from_file(file_name, matrix))
+		{
+			return false;
+		}
+		printf("Matrix file \"%s\" doesn't record its inputs, it is assumed to match\n", file_name.c_str());
+		return true;
+	}
+
+	if (matrix_file.get_inputs_hash() != inputs_hash)
+	{
+		printf("Matrix file \"%s\" was calculated from different inputs (meshes, placement or parameters)\n", file_name.c_str());
+		return false;
+	}
+
+	matrix = matrix_file.get_matrix();
+	return true;
+}
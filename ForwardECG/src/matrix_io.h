@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include "math.h"
+#include "file_io.h"
+
+
+// binary matrix file ("BinaryMatrixFile" header, rows, cols, row major values)
+bool save_matrix_to_file(const std::string& file_name, const Eigen::MatrixX<Real>& matrix);
+bool load_matrix_from_file(const std::string& file_name, Eigen::MatrixX<Real>& matrix);
+
+// native matrix file ("ECGMAT"): a 64 bytes header (version, byte order, element type, dimensions and the hash of the
+// inputs the matrix was calculated from) followed by the column major values at a 64 bytes aligned offset,
+// so the values can be used in place from a memory mapping of the file
+#define MATRIX_FILE_VERSION 1
+
+bool save_matrix_file(const std::string& file_name, const Eigen::MatrixX<Real>& matrix, uint64_t inputs_hash);
+
+// memory mapped native matrix file
+class MatrixFile
+{
+public:
+	MatrixFile() = default;
+	~MatrixFile() = default;
+
+	// fails for other formats, versions, byte orders and element types
+	bool open(const std::string& file_name);
+	void close();
+	bool is_open() const;
+
+	uint64_t get_inputs_hash() const;
+	// the values in the mapping, valid until the file is closed
+	Eigen::Map<const Eigen::MatrixX<Real>> get_matrix() const;
+
+private:
+	MappedFile m_file;
+	uint64_t m_rows = 0;
+	uint64_t m_cols = 0;
+	uint64_t m_inputs_hash = 0;
+	const Real* m_values = NULL;
+};
+
+// loads a native matrix file, or a binary matrix file (which doesn't record its inputs),
+// fails if the matrix was calculated from inputs other than inputs_hash
+bool load_transfer_matrix_file(const std::string& file_name, uint64_t inputs_hash, Eigen::MatrixX<Real>& matrix);
+
+// TMP direct values file (SAMPLE_COUNTxPOINTS_COUNT), fails if the points count doesn't match
+bool import_tmp_direct_values(const std::string& file_name, Eigen::MatrixX<Real>& tmp_direct_values, int tmp_points_count);
+bool export_tmp_direct_values(const std::string& file_name, const Eigen::MatrixX<Real>& tmp_direct_values);
+
+// csv file with a header line of column names
+bool dump_matrix_to_csv(const std::string& file_name, const std::vector<std::string>& names, const Eigen::MatrixX<Real>& matrix);
@@ -0,0 +1,392 @@
+#include "mesh_bvh.h"
+#include <algorithm>
+#include <float.h>
+
+
+using namespace Eigen;
+
+
+// faces in a leaf node
+#define MAX_LEAF_FACES 4
+// bins of the centroids tested for the split of a node
+#define SAH_BINS_COUNT 16
+// deeper nodes are split at the median, so the depth stays below MAX_SAH_DEPTH + log2(faces count)
+#define MAX_SAH_DEPTH 32
+// deep enough for any tree
+#define MAX_STACK_SIZE 64
+
+
+// range of t where the line (origin + t*direction) is in the box, returns false if the line misses the box
+static bool line_box_intersect(const Vector3<Real>& origin, const Vector3<Real>& direction, const Vector3<Real>& inv_direction,
+	const glm::vec3& box_min, const glm::vec3& box_max, Real& t_near, Real& t_far)
+{
+	t_near = -INFINITY;
+	t_far = INFINITY;
+	for (int i = 0; i < 3; i++)
+	{
+		if (direction[i] == 0)
+		{
+			// parallel to the slab
+			if (origin[i] < box_min[i] || origin[i] > box_max[i])
+			{
+				return false;
+			}
+			continue;
+		}
+
+		Real t1 = (box_min[i] - origin[i])*inv_direction[i];
+		Real t2 = (box_max[i] - origin[i])*inv_direction[i];
+		if (t1 > t2)
+		{
+			std::swap(t1, t2);
+		}
+		t_near = (t1 > t_near) ? t1 : t_near;
+		t_far = (t2 < t_far) ? t2 : t_far;
+		if (t_near > t_far)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+MeshBVH::MeshBVH(const MeshPlot& mesh)
+{
+	// the padding is relative to the size of the mesh
+	glm::vec3 mesh_min(FLT_MAX), mesh_max(-FLT_MAX);
+	for (const MeshPlotVertex& vertex : mesh.vertices)
+	{
+		mesh_min = glm::min(mesh_min, vertex.pos);
+		mesh_max = glm::max(mesh_max, vertex.pos);
+	}
+	m_padding = mesh.vertices.empty() ? 0 : 1e-5f*glm::length(mesh_max - mesh_min);
+
+	std::vector<FaceBounds> faces_bounds(mesh.faces.size());
+	for (int i = 0; i < mesh.faces.size(); i++)
+	{
+		const MeshPlotFace& face = mesh.faces[i];
+		const glm::vec3& a = mesh.vertices[face.idx[0]].pos;
+		const glm::vec3& b = mesh.vertices[face.idx[1]].pos;
+		const glm::vec3& c = mesh.vertices[face.idx[2]].pos;
+		faces_bounds[i].min = glm::min(a, glm::min(b, c));
+		faces_bounds[i].max = glm::max(a, glm::max(b, c));
+		faces_bounds[i].centroid = (a + b + c)/3.0f;
+	}
+
+	// all the faces
+	m_all.faces.resize(mesh.faces.size());
+	for (int i = 0; i < mesh.faces.size(); i++)
+	{
+		m_all.faces[i] = i;
+	}
+	build_tree(faces_bounds, m_all);
+
+	// faces of every group, a face is in all the groups of its vertices
+	m_groups.resize(mesh.groups_vertices.size());
+	for (int i = 0; i < mesh.faces.size(); i++)
+	{
+		const MeshPlotFace& face = mesh.faces[i];
+		for (int j = 0; j < 3; j++)
+		{
+			int group = mesh.vertices[face.idx[j]].group;
+			bool counted = (j > 0 && mesh.vertices[face.idx[0]].group == group) || (j > 1 && mesh.vertices[face.idx[1]].group == group);
+			if (group >= 0 && group < m_groups.size() && !counted)
+			{
+				m_groups[group].faces.push_back(i);
+			}
+		}
+	}
+	for (Tree& group_tree : m_groups)
+	{
+		build_tree(faces_bounds, group_tree);
+	}
+
+	refit(mesh);
+}
+
+void MeshBVH::refit(const MeshPlot& mesh)
+{
+	refit_tree(mesh, m_all);
+	for (Tree& group_tree : m_groups)
+	{
+		refit_tree(mesh, group_tree);
+	}
+}
+
+bool MeshBVH::intersect(const MeshPlot& mesh, const Eigen::Vector3<Real>& mesh_position, const Ray& ray, Real& t, int& tri_idx, int group_index) const
+{
+	t = INFINITY;
+	tri_idx = -1;
+
+	if (group_index == -1)
+	{
+		return intersect_tree(m_all, mesh, mesh_position, ray, t, tri_idx);
+	}
+	if (group_index < 0 || group_index >= m_groups.size())
+	{
+		// no face has a vertex in the group
+		return false;
+	}
+	return intersect_tree(m_groups[group_index], mesh, mesh_position, ray, t, tri_idx);
+}
+
+int MeshBVH::get_nodes_count() const
+{
+	size_t nodes_count = m_all.nodes.size();
+	for (const Tree& group_tree : m_groups)
+	{
+		nodes_count += group_tree.nodes.size();
+	}
+	return nodes_count;
+}
+
+void MeshBVH::build_tree(const std::vector<FaceBounds>& faces_bounds, Tree& tree)
+{
+	tree.nodes.clear();
+	if (tree.faces.empty())
+	{
+		return;
+	}
+
+	tree.nodes.reserve(2*(tree.faces.size()/MAX_LEAF_FACES + 1));
+	tree.nodes.push_back(Node());
+	build_node(faces_bounds, tree, 0, 0, tree.faces.size(), 0);
+}
+
+static float box_area(const glm::vec3& min, const glm::vec3& max)
+{
+	glm::vec3 size = max - min;
+	return size.x*size.y + size.y*size.z + size.z*size.x;
+}
+
+void MeshBVH::build_node(const std::vector<FaceBounds>& faces_bounds, Tree& tree, int node_index, int first, int count, int depth)
+{
+	if (count <= MAX_LEAF_FACES)
+	{
+		tree.nodes[node_index].first = first;
+		tree.nodes[node_index].count = count;
+		return;
+	}
+
+	glm::vec3 centroids_min(FLT_MAX), centroids_max(-FLT_MAX);
+	for (int i = first; i < first + count; i++)
+	{
+		centroids_min = glm::min(centroids_min, faces_bounds[tree.faces[i]].centroid);
+		centroids_max = glm::max(centroids_max, faces_bounds[tree.faces[i]].centroid);
+	}
+
+	// surface area heuristic: the split between bins of the centroids that minimizes
+	// the area of each side times its faces count (the chance of a ray entering it times the cost)
+	int best_axis = -1;
+	int best_split = 0;
+	float best_cost = FLT_MAX;
+	for (int axis = 0; axis < 3 && depth < MAX_SAH_DEPTH; axis++)
+	{
+		float extent = centroids_max[axis] - centroids_min[axis];
+		if (extent <= 0)
+		{
+			continue;
+		}
+
+		int bins_count[SAH_BINS_COUNT] = {};
+		glm::vec3 bins_min[SAH_BINS_COUNT], bins_max[SAH_BINS_COUNT];
+		for (int i = 0; i < SAH_BINS_COUNT; i++)
+		{
+			bins_min[i] = glm::vec3(FLT_MAX);
+			bins_max[i] = glm::vec3(-FLT_MAX);
+		}
+		for (int i = first; i < first + count; i++)
+		{
+			const FaceBounds& bounds = faces_bounds[tree.faces[i]];
+			int bin = std::min((int)(SAH_BINS_COUNT*(bounds.centroid[axis] - centroids_min[axis])/extent), SAH_BINS_COUNT-1);
+			bins_count[bin]++;
+			bins_min[bin] = glm::min(bins_min[bin], bounds.min);
+			bins_max[bin] = glm::max(bins_max[bin], bounds.max);
+		}
+
+		// area and count of the bins left of each split
+		float left_area[SAH_BINS_COUNT];
+		int left_count[SAH_BINS_COUNT];
+		glm::vec3 left_min(FLT_MAX), left_max(-FLT_MAX);
+		int left_total = 0;
+		for (int i = 0; i < SAH_BINS_COUNT-1; i++)
+		{
+			left_min = glm::min(left_min, bins_min[i]);
+			left_max = glm::max(left_max, bins_max[i]);
+			left_total += bins_count[i];
+			left_area[i] = left_total ? box_area(left_min, left_max) : 0;
+			left_count[i] = left_total;
+		}
+
+		// split i: bins [0 : i] on the left, (i : SAH_BINS_COUNT) on the right
+		glm::vec3 right_min(FLT_MAX), right_max(-FLT_MAX);
+		int right_total = 0;
+		for (int i = SAH_BINS_COUNT-2; i >= 0; i--)
+		{
+			right_min = glm::min(right_min, bins_min[i+1]);
+			right_max = glm::max(right_max, bins_max[i+1]);
+			right_total += bins_count[i+1];
+			if (left_count[i] == 0 || right_total == 0)
+			{
+				continue;
+			}
+
+			float cost = left_area[i]*left_count[i] + box_area(right_min, right_max)*right_total;
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_axis = axis;
+				best_split = i;
+			}
+		}
+	}
+
+	int middle;
+	if (best_axis != -1)
+	{
+		float extent = centroids_max[best_axis] - centroids_min[best_axis];
+		middle = std::partition(tree.faces.begin() + first, tree.faces.begin() + first + count, [&](int face)
+		{
+			int bin = std::min((int)(SAH_BINS_COUNT*(faces_bounds[face].centroid[best_axis] - centroids_min[best_axis])/extent), SAH_BINS_COUNT-1);
+			return bin <= best_split;
+		}) - tree.faces.begin();
+	}
+	else
+	{
+		// all the centroids in the same place, or the tree is too deep: median split (balanced)
+		glm::vec3 extent = centroids_max - centroids_min;
+		int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : ((extent.y > extent.z) ? 1 : 2);
+		middle = first + count/2;
+		std::nth_element(tree.faces.begin() + first, tree.faces.begin() + middle, tree.faces.begin() + first + count,
+			[&faces_bounds, axis](int a, int b) { return faces_bounds[a].centroid[axis] < faces_bounds[b].centroid[axis]; });
+	}
+
+	// children are next to each other, after their parent
+	int left = tree.nodes.size();
+	tree.nodes.push_back(Node());
+	tree.nodes.push_back(Node());
+	tree.nodes[node_index].first = left;
+	tree.nodes[node_index].count = 0;
+	build_node(faces_bounds, tree, left, first, middle - first, depth + 1);
+	build_node(faces_bounds, tree, left + 1, middle, first + count - middle, depth + 1);
+}
+
+void MeshBVH::refit_tree(const MeshPlot& mesh, Tree& tree)
+{
+	// children come after their parents, so the nodes are updated in reverse order
+	for (int i = (int)tree.nodes.size() - 1; i >= 0; i--)
+	{
+		Node& node = tree.nodes[i];
+		if (node.count > 0)
+		{
+			node.min = glm::vec3(FLT_MAX);
+			node.max = glm::vec3(-FLT_MAX);
+			for (int j = node.first; j < node.first + node.count; j++)
+			{
+				const MeshPlotFace& face = mesh.faces[tree.faces[j]];
+				for (int k = 0; k < 3; k++)
+				{
+					node.min = glm::min(node.min, mesh.vertices[face.idx[k]].pos);
+					node.max = glm::max(node.max, mesh.vertices[face.idx[k]].pos);
+				}
+			}
+			node.min -= glm::vec3(m_padding);
+			node.max += glm::vec3(m_padding);
+		}
+		else
+		{
+			const Node& left = tree.nodes[node.first];
+			const Node& right = tree.nodes[node.first + 1];
+			node.min = glm::min(left.min, right.min);
+			node.max = glm::max(left.max, right.max);
+		}
+	}
+}
+
+bool MeshBVH::intersect_tree(const Tree& tree, const MeshPlot& mesh, const Eigen::Vector3<Real>& mesh_position, const Ray& ray, Real& t, int& tri_idx) const
+{
+	if (tree.nodes.empty())
+	{
+		return false;
+	}
+
+	// the boxes are in the mesh space, the intersections are tested like ray_mesh_intersect does:
+	// along the whole line, the closest is the one with the smallest t (even if it's negative)
+	Vector3<Real> origin = ray.origin - mesh_position;
+	Vector3<Real> inv_direction = ray.direction.cwiseInverse();
+
+	Real root_t_near, root_t_far;
+	if (!line_box_intersect(origin, ray.direction, inv_direction, tree.nodes[0].min, tree.nodes[0].max, root_t_near, root_t_far))
+	{
+		return false;
+	}
+
+	// nodes that the line enters at t_near
+	struct StackEntry
+	{
+		int node;
+		Real t_near;
+	};
+
+	bool intersected = false;
+	StackEntry stack[MAX_STACK_SIZE];
+	int stack_size = 0;
+	stack[stack_size++] = { 0, root_t_near };
+	while (stack_size > 0)
+	{
+		// skip the boxes entered after the closest intersection so far
+		StackEntry entry = stack[--stack_size];
+		if (entry.t_near > t)
+		{
+			continue;
+		}
+
+		const Node& node = tree.nodes[entry.node];
+		if (node.count == 0)
+		{
+			// the child entered first is visited first
+			Real left_t_near, right_t_near, t_far;
+			bool left_hit = line_box_intersect(origin, ray.direction, inv_direction, tree.nodes[node.first].min, tree.nodes[node.first].max, left_t_near, t_far);
+			bool right_hit = line_box_intersect(origin, ray.direction, inv_direction, tree.nodes[node.first+1].min, tree.nodes[node.first+1].max, right_t_near, t_far);
+			if (left_hit && right_hit)
+			{
+				bool left_first = left_t_near <= right_t_near;
+				stack[stack_size++] = left_first ? StackEntry{ node.first + 1, right_t_near } : StackEntry{ node.first, left_t_near };
+				stack[stack_size++] = left_first ? StackEntry{ node.first, left_t_near } : StackEntry{ node.first + 1, right_t_near };
+			}
+			else if (left_hit)
+			{
+				stack[stack_size++] = { node.first, left_t_near };
+			}
+			else if (right_hit)
+			{
+				stack[stack_size++] = { node.first + 1, right_t_near };
+			}
+			continue;
+		}
+
+		for (int i = node.first; i < node.first + node.count; i++)
+		{
+			int face_idx = tree.faces[i];
+			const MeshPlotFace& face = mesh.faces[face_idx];
+			Triangle tri = { mesh_position + glm2eigen(mesh.vertices[face.idx[0]].pos),
+							 mesh_position + glm2eigen(mesh.vertices[face.idx[1]].pos),
+							 mesh_position + glm2eigen(mesh.vertices[face.idx[2]].pos) };
+			Real new_t;
+			if (ray.intersect_triangle(tri, new_t))
+			{
+				// equal intersections resolve to the first face, like testing the faces in order
+				intersected = true;
+				if (new_t < t || (new_t == t && face_idx < tri_idx))
+				{
+					t = new_t;
+					tri_idx = face_idx;
+				}
+			}
+		}
+	}
+
+	return intersected;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "geometry.h"
+
+
+// bounding volume hierarchy of the faces of a mesh plot, for the ray intersection queries
+// a tree of all the faces, and a tree for every group (the faces with any vertex in the group)
+class MeshBVH
+{
+public:
+	MeshBVH(const MeshPlot& mesh);
+	~MeshBVH() = default;
+
+	// recalculates the bounding boxes after the vertices moved, the tree structure stays the same
+	void refit(const MeshPlot& mesh);
+
+	// same result as testing the ray against every face (-1 group index = all groups)
+	bool intersect(const MeshPlot& mesh, const Eigen::Vector3<Real>& mesh_position, const Ray& ray, Real& t, int& tri_idx, int group_index = -1) const;
+
+	int get_nodes_count() const;
+
+private:
+	struct Node
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+		int first; // leaf: first face index in the tree faces, internal: left child (right child = first+1)
+		int count; // faces count, 0 for internal nodes
+	};
+
+	struct Tree
+	{
+		std::vector<Node> nodes;
+		std::vector<int> faces;
+	};
+
+	struct FaceBounds
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+		glm::vec3 centroid;
+	};
+
+	void build_tree(const std::vector<FaceBounds>& faces_bounds, Tree& tree);
+	void build_node(const std::vector<FaceBounds>& faces_bounds, Tree& tree, int node_index, int first, int count, int depth);
+	void refit_tree(const MeshPlot& mesh, Tree& tree);
+	bool intersect_tree(const Tree& tree, const MeshPlot& mesh, const Eigen::Vector3<Real>& mesh_position, const Ray& ray, Real& t, int& tri_idx) const;
+
+private:
+	Tree m_all;
+	std::vector<Tree> m_groups;
+	float m_padding; // the boxes are enlarged by the padding to include the rounding errors of the triangle test
+};
@@ -1,14 +1,12 @@
 ﻿#include "mesh_plot.h"
+#include "mesh_bvh.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
-#include "main_dev.h"
-#include "transform.h"
-#include "opengl/gl_texture.h"
-#include "opengl/gl_shader.h"
-#include "opengl/gl_vertex_buffer.h"
-#include "opengl/gl_index_buffer.h"
-#include "opengl/gl_vertex_layout.h"
+#include <stdio.h>
+#include <algorithm>
+
+// GPU buffers and MeshPlotRenderer are in mesh_plot_renderer.cpp
 
 
 #define MAX_DEPTH 10
@@ -32,7 +30,6 @@ static glm::vec3 aivec3_convert(const aiVector3D& v)
 static void process_node(aiNode* node, const aiScene* scene, MeshPlot& mesh_plot, unsigned int depth = 0)
 {
 	glm::mat4 this_transform = aimat4_convert(node->mTransformation);
-	glm::mat3 this_transform_rot = this_transform;
 
 	for (int i = 0; i < node->mNumMeshes; i++)
 	{
@@ -41,7 +38,6 @@ static void process_node(aiNode* node, const aiScene* scene, MeshPlot& mesh_plot
 			continue;
 
 		const unsigned vertex_count = mesh->mNumVertices;
-		const unsigned face_count = mesh->mNumFaces;
 
 		// Load vertices.
 		for (int j = 0; j < vertex_count; j++)
@@ -78,41 +74,39 @@ static void process_node(aiNode* node, const aiScene* scene, MeshPlot& mesh_plot
 MeshPlot::MeshPlot() :
 	faces_count(0),
 	vertex_buffer(nullptr),
-	index_buffer(nullptr)
+	values_buffer(nullptr),
+	index_buffer(nullptr),
+	bvh(nullptr)
 {
 
 }
 
 MeshPlot::~MeshPlot()
 {
-	if (vertex_buffer)
-	{
-		delete vertex_buffer;
-	}
-
-	if (index_buffer)
-	{
-		delete index_buffer;
-	}
+	destroy_gpu_buffers();
+	destroy_bvh();
 }
 
-void MeshPlot::create_gpu_buffers()
+void MeshPlot::create_bvh()
 {
-	// Load buffers into GPU.
-	vertex_buffer = gdevGet()->createVertexBuffer(vertices.size() * sizeof(MeshPlotVertex), USAGE_DYNAMIC, NULL);
-	index_buffer = gdevGet()->createIndexBuffer(faces_count * 3 * sizeof(int), USAGE_DYNAMIC, NULL);
+	destroy_bvh();
+	bvh = new MeshBVH(*this);
 }
 
-void MeshPlot::update_gpu_buffers()
+void MeshPlot::update_bvh()
 {
-	// update buffers into GPU.
-	if (vertex_buffer)
+	if (bvh)
 	{
-		vertex_buffer->update(0, vertices.size() * sizeof(MeshPlotVertex), &vertices[0]);
+		bvh->refit(*this);
 	}
-	if (index_buffer)
+}
+
+void MeshPlot::destroy_bvh()
+{
+	if (bvh)
 	{
-		index_buffer->update(0, faces_count * 3 * sizeof(int), &faces[0]);
+		delete bvh;
+		bvh = nullptr;
 	}
 }
 
@@ -247,264 +241,9 @@ MeshPlot* load_mesh_plot(const char* file_name, bool classify_into_groups)
 	mesh->create_gpu_buffers();
 	mesh->update_gpu_buffers();
 
-	return mesh;
-}
-
-
-///////////////////////////////////////////////////////////
-// MeshPlotRenderer
-///////////////////////////////////////////////////////////
-
-
-// plot shader
-
-static const char* plot_vert = R"(
-#version 330 core
-layout (location = 0) in vec3 pos;
-layout (location = 1) in vec3 normal;
-layout (location = 2) in float value;
-layout (location = 3) in float opacity;
-layout (location = 4) in float group;
-
-uniform mat4 projection;
-uniform mat4 model;
-
-layout (location = 0) out float value_out;
-layout (location = 1) out vec3 normal_out;
-layout (location = 2) out float opacity_out;
-
-void main()
-{
-	value_out = value;
-	gl_Position = projection*model*vec4(pos, 1.0); // w = 1 for points, w = 0 for vectors.
-	normal_out = (projection*model*vec4(normal, 0)).xyz;
-	opacity_out = opacity;
-	// ignore group for now (may be used later)
-}
-)";
-static const char* plot_frag = R"(
-#version 330 core
-layout (location = 0) in float value;
-layout (location = 1) in vec3 normal;
-layout (location = 2) in float opacity;
-
-uniform vec4 color_n;
-uniform vec4 color_p;
-uniform float mix_color_hsv; // 0 = RGB, 1 = HSV
-uniform float min_val;
-uniform float max_val;
-uniform float opacity_threshold;
-uniform float ambient;
-uniform float specular;
-
-out vec4 FragColor;
-
-vec3 rgb2hsv(vec3 c)
-{
-    vec4 K = vec4(0.0, -1.0 / 3.0, 2.0 / 3.0, -1.0);
-    vec4 p = mix(vec4(c.bg, K.wz), vec4(c.gb, K.xy), step(c.b, c.g));
-    vec4 q = mix(vec4(p.xyw, c.r), vec4(c.r, p.yzx), step(p.x, c.r));
-
-    float d = q.x - min(q.w, q.y);
-    float e = 1.0e-10;
-    return vec3(abs(q.z + (q.w - q.y) / (6.0 * d + e)), d / (q.x + e), q.x);
-}
-
-vec3 hsv2rgb(vec3 c)
-{
-	vec4 K = vec4(1.0, 2.0 / 3.0, 1.0 / 3.0, 3.0);
-    vec3 p = abs(fract(c.xxx + K.xyz) * 6.0 - K.www);
-    return c.z * mix(K.xxx, clamp(p - K.xxx, 0.0, 1.0), c.y);
-}
-
-void main()
-{
-	float value_normalized = (value-min_val)/(max_val-min_val);
-	value_normalized = clamp(value_normalized, 0, 1);	
-
-	float mix_percentage = value_normalized;
-	vec3 color_rgb = mix(color_n.xyz, color_p.xyz, mix_percentage);
-	vec3 color_hsv = hsv2rgb(mix(rgb2hsv(color_n.xyz), rgb2hsv(color_p.xyz), mix_percentage));
-	
-	vec3 color = (1-mix_color_hsv)*color_rgb + mix_color_hsv*color_hsv;
-
-	float brightness = ambient + (1-ambient)*max(pow(dot(normal, vec3(0, 0, -1)), specular), 0.0);
-	color = color * brightness;
-
-	// debug
-	//color = normal/2+0.5 + 0.01*color;
-	
-	// discard fragment if opacity is less than the opacity_threshold
-	if (opacity < opacity_threshold)
-	{
-		discard;
-	}
-
-	FragColor = vec4(color, mix(color_n.a, color_p.a, mix_percentage)*opacity);
-}
-)";
-
-
-// wireframe shader
-
-static const char* wireframe_vert = R"(
-#version 330 core
-layout (location = 0) in vec3 pos;
-layout (location = 1) in vec3 normal;
-layout (location = 2) in float value;
-layout (location = 3) in float opacity;
-layout (location = 4) in float group;
-
-uniform mat4 projection;
-uniform mat4 model;
-
-layout (location = 2) out float opacity_out;
-
-void main()
-{
-	gl_Position = projection*model*vec4(pos, 1.0); // w = 1 for points, w = 0 for vectors.
-	gl_Position.z -= 0.001; // advance the depth a little bit
-	opacity_out = opacity;
-}
-)";
-static const char* wireframe_frag = R"(
-#version 330 core
-layout (location = 2) in float opacity;
-
-uniform vec4 color;
-uniform float opacity_threshold;
-
-out vec4 FragColor;
-
-void main()
-{
-	// discard fragment if opacity is less than the opacity_threshold
-	if (opacity < opacity_threshold)
-	{
-		discard;
-	}
+	// after the groups, the bvh has a tree for every group
+	mesh->create_bvh();
 
-	FragColor = vec4(color.xyz, color.w*opacity);
-}
-)";
-
-
-MeshPlotRenderer::MeshPlotRenderer()
-{
-	m_plot_shader = gdevGet()->createShader(plot_vert, plot_frag);
-	m_wireframe_shader = gdevGet()->createShader(wireframe_vert, wireframe_frag);
-	m_vertex_layout = gdevGet()->createVertexLayout({
-		{VertexLayoutElement::VEC3, "pos"},
-		{VertexLayoutElement::VEC3, "normal"},
-		{VertexLayoutElement::FLOAT, "value"},
-		{VertexLayoutElement::FLOAT, "opacity"},
-		{VertexLayoutElement::INT, "group"}
-		});
-	m_view_matrix = glm::mat4(1);
-	m_color_mix_type = MIX_HSV;
-	m_color_n = glm::vec4(0, 0, 1, 1);
-	m_color_p = glm::vec4(1, 0, 0, 1);
-	m_min_val = -1;
-	m_max_val = 1;
-	m_opacity_threshold = 0;
-	m_ambient = 0.8;
-	m_specular = 5;
-}
-
-MeshPlotRenderer::~MeshPlotRenderer()
-{
-	delete m_plot_shader;
-	delete m_wireframe_shader;
-	delete m_vertex_layout;
-}
-
-void MeshPlotRenderer::set_view_projection_matrix(const glm::mat4& view)
-{
-	m_view_matrix = view;
-}
-
-void MeshPlotRenderer::set_colors(const glm::vec4& color_p, const glm::vec4& color_n)
-{
-	m_color_p = color_p;
-	m_color_n = color_n;
-}
-
-void MeshPlotRenderer::set_color_mix_type(const ColorMixType& color_mix_type)
-{
-	m_color_mix_type = color_mix_type;
-}
-
-void MeshPlotRenderer::set_values_range(float min_value, float max_value)
-{
-	m_min_val = min_value;
-	m_max_val = max_value;
-}
-
-void MeshPlotRenderer::set_opacity_threshold(float opacity_threshold)
-{
-	m_opacity_threshold = opacity_threshold;
-}
-
-void MeshPlotRenderer::set_ambient(float ambient)
-{
-	m_ambient = ambient;
-}
-
-void MeshPlotRenderer::set_specular(float specular)
-{
-	m_specular = specular;
-}
-
-void MeshPlotRenderer::render_mesh_plot(const glm::mat4& transform, MeshPlot* mesh_plot, bool render_wireframe, const glm::vec4& wireframe_color, float wireframe_line_width)
-{
-	// check for vertex and index buffer
-	if (!mesh_plot->vertex_buffer || !mesh_plot->index_buffer)
-	{
-		return;
-	}
-
-	// Drawing.
-	mesh_plot->vertex_buffer->bind();
-	mesh_plot->index_buffer->bind();
-	m_vertex_layout->bind();
-
-
-	// plot render
-
-	// Bind shader.
-	m_plot_shader->bind();
-	m_plot_shader->setMat4("projection", m_view_matrix);
-	m_plot_shader->setMat4("model", transform);
-	m_plot_shader->setVec4("color_n", m_color_n);
-	m_plot_shader->setVec4("color_p", m_color_p);
-	m_plot_shader->setFloat("mix_color_hsv", m_color_mix_type == MIX_RGB ? 0 : 1);
-	m_plot_shader->setFloat("min_val", m_min_val);
-	m_plot_shader->setFloat("max_val", m_max_val);
-	m_plot_shader->setFloat("opacity_threshold", m_opacity_threshold);
-	m_plot_shader->setFloat("ambient", m_ambient);
-	m_plot_shader->setFloat("specular", m_specular);
-
-	gdevGet()->setPolygonMode(FACE_FRONT_AND_BACK, POLYGON_MODE_FILL);
-	gdevGet()->drawElements(TOPOLOGY_TRIANGLE_LIST, 0, 3*mesh_plot->faces_count, INDEX_UNSIGNED_INT);
-
-
-	// wireframe render
-	if (render_wireframe)
-	{
-		// Bind shader.
-		m_wireframe_shader->bind();
-		m_wireframe_shader->setMat4("projection", m_view_matrix);
-		m_wireframe_shader->setMat4("model", transform);
-		m_wireframe_shader->setVec4("color", wireframe_color);
-		m_wireframe_shader->setFloat("opacity_threshold", m_opacity_threshold);
-
-		gdevGet()->setPolygonMode(FACE_FRONT_AND_BACK, POLYGON_MODE_LINE);
-		gdevGet()->setLineWidth(wireframe_line_width);
-		gdevGet()->drawElements(TOPOLOGY_TRIANGLE_LIST, 0, 3*mesh_plot->faces_count, INDEX_UNSIGNED_INT);
-	}
-
-
-	// restore polygon mode
-	gdevGet()->setPolygonMode(FACE_FRONT_AND_BACK, POLYGON_MODE_FILL);
+	return mesh;
 }
 
@@ -7,6 +7,7 @@ class glVertexLayout;
 class glVertexBuffer;
 class glIndexBuffer;
 class glShader;
+class MeshBVH;
 
 struct MeshPlotVertex
 {
@@ -17,11 +18,31 @@ struct MeshPlotVertex
 	int group;
 };
 
+// vertex parts as uploaded to the GPU, the geometry once and the values every update
+struct MeshPlotVertexGeometry
+{
+	glm::vec3 pos;
+	glm::vec3 normal;
+	int group;
+};
+
+struct MeshPlotVertexValues
+{
+	float value;
+	float opacity;
+};
+
 struct MeshPlotFace
 {
 	int idx[3];
 };
 
+struct MeshPlotFacesRange
+{
+	int first;
+	int count;
+};
+
 class MeshPlot
 {
 public:
@@ -40,11 +61,27 @@ public:
 	std::vector<std::vector<int>> groups_vertices;
 
 	// GPU buffers
-	glVertexBuffer* vertex_buffer;
+	glVertexBuffer* vertex_buffer; // static geometry (MeshPlotVertexGeometry)
+	glVertexBuffer* values_buffer; // dynamic values (MeshPlotVertexValues)
+	std::vector<MeshPlotVertexValues> gpu_values; // values_buffer contents, reused by every update
 	glIndexBuffer* index_buffer;
+	// the index buffer holds the faces sorted by group, the faces of every group are a range of it
+	std::vector<MeshPlotFacesRange> groups_faces_ranges;
+
+	// Ray Intersection Hierarchy (see ray_mesh_intersect)
+	MeshBVH* bvh;
 
 	void create_gpu_buffers();
+	// uploads only the values and opacities
 	void update_gpu_buffers();
+	// call after changing the positions, normals, groups or faces
+	void update_gpu_geometry();
+	void destroy_gpu_buffers();
+
+	void create_bvh();
+	// call after moving the vertices
+	void update_bvh();
+	void destroy_bvh();
 };
 
 MeshPlot* load_mesh_plot(const char* file_name, bool classify_into_groups = false);
@@ -70,11 +107,17 @@ public:
 	void set_ambient(float ambient);
 	void set_specular(float specular);
 	void render_mesh_plot(const glm::mat4& transform, MeshPlot* mesh, bool render_wireframe = false, const glm::vec4& wireframe_color = {0, 0, 0, 1}, float wireframe_line_width = 1.0f);
+	// renders only the faces of a group
+	void render_mesh_plot_group(const glm::mat4& transform, MeshPlot* mesh, int group_index, bool render_wireframe = false, const glm::vec4& wireframe_color = {0, 0, 0, 1}, float wireframe_line_width = 1.0f);
+
+private:
+	void render_faces(const glm::mat4& transform, MeshPlot* mesh, int first_face, int faces_count, bool render_wireframe, const glm::vec4& wireframe_color, float wireframe_line_width);
 
 private:
 	glShader* m_plot_shader;
 	glShader* m_wireframe_shader;
-	glVertexLayout* m_vertex_layout;
+	glVertexLayout* m_geometry_layout;
+	glVertexLayout* m_values_layout;
 	glm::mat4 m_view_matrix;
 	glm::vec4 m_color_p, m_color_n;
 	ColorMixType m_color_mix_type;
@@ -0,0 +1,385 @@
+#include "mesh_plot.h"
+#include "main_dev.h"
+#include "transform.h"
+#include "opengl/gl_texture.h"
+#include "opengl/gl_shader.h"
+#include "opengl/gl_vertex_buffer.h"
+#include "opengl/gl_index_buffer.h"
+#include "opengl/gl_vertex_layout.h"
+
+
+void MeshPlot::create_gpu_buffers()
+{
+	// Load buffers into GPU.
+	// the geometry and the indices don't change while rendering, only the values are streamed (see update_gpu_buffers)
+	vertex_buffer = gdevGet()->createVertexBuffer(vertices.size() * sizeof(MeshPlotVertexGeometry), USAGE_STATIC, NULL);
+	values_buffer = gdevGet()->createVertexBuffer(vertices.size() * sizeof(MeshPlotVertexValues), USAGE_DYNAMIC, NULL);
+	index_buffer = gdevGet()->createIndexBuffer(faces_count * 3 * sizeof(int), USAGE_STATIC, NULL);
+	update_gpu_geometry();
+}
+
+void MeshPlot::update_gpu_buffers()
+{
+	// update values into GPU.
+	if (values_buffer)
+	{
+		gpu_values.resize(vertices.size());
+		for (int i = 0; i < vertices.size(); i++)
+		{
+			gpu_values[i] = { vertices[i].value, vertices[i].opacity };
+		}
+		values_buffer->replace(&gpu_values[0]);
+	}
+}
+
+void MeshPlot::update_gpu_geometry()
+{
+	// update geometry into GPU.
+	if (vertex_buffer)
+	{
+		std::vector<MeshPlotVertexGeometry> geometry(vertices.size());
+		for (int i = 0; i < vertices.size(); i++)
+		{
+			geometry[i] = { vertices[i].pos, vertices[i].normal, vertices[i].group };
+		}
+		vertex_buffer->update(0, geometry.size() * sizeof(MeshPlotVertexGeometry), &geometry[0]);
+	}
+	if (index_buffer)
+	{
+		// sort the faces by group (the group of the first vertex, a face can't connect two groups)
+		std::vector<std::vector<int>> groups_faces(groups_vertices.size());
+		std::vector<int> ungrouped_faces;
+		for (int i = 0; i < faces_count; i++)
+		{
+			int group = vertices[faces[i].idx[0]].group;
+			if (group >= 0 && group < groups_faces.size())
+			{
+				groups_faces[group].push_back(i);
+			}
+			else
+			{
+				ungrouped_faces.push_back(i);
+			}
+		}
+
+		std::vector<MeshPlotFace> sorted_faces;
+		sorted_faces.reserve(faces_count);
+		groups_faces_ranges.resize(groups_faces.size());
+		for (int group = 0; group < groups_faces.size(); group++)
+		{
+			groups_faces_ranges[group] = { (int)sorted_faces.size(), (int)groups_faces[group].size() };
+			for (int face_idx : groups_faces[group])
+			{
+				sorted_faces.push_back(faces[face_idx]);
+			}
+		}
+		for (int face_idx : ungrouped_faces)
+		{
+			sorted_faces.push_back(faces[face_idx]);
+		}
+
+		index_buffer->update(0, faces_count * 3 * sizeof(int), &sorted_faces[0]);
+	}
+}
+
+void MeshPlot::destroy_gpu_buffers()
+{
+	if (vertex_buffer)
+	{
+		delete vertex_buffer;
+		vertex_buffer = nullptr;
+	}
+
+	if (values_buffer)
+	{
+		delete values_buffer;
+		values_buffer = nullptr;
+	}
+
+	if (index_buffer)
+	{
+		delete index_buffer;
+		index_buffer = nullptr;
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+// MeshPlotRenderer
+///////////////////////////////////////////////////////////
+
+
+// plot shader
+
+static const char* plot_vert = R"(
+#version 330 core
+layout (location = 0) in vec3 pos;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in float group;
+layout (location = 3) in float value;
+layout (location = 4) in float opacity;
+
+uniform mat4 projection;
+uniform mat4 model;
+
+layout (location = 0) out float value_out;
+layout (location = 1) out vec3 normal_out;
+layout (location = 2) out float opacity_out;
+
+void main()
+{
+	value_out = value;
+	gl_Position = projection*model*vec4(pos, 1.0); // w = 1 for points, w = 0 for vectors.
+	normal_out = (projection*model*vec4(normal, 0)).xyz;
+	opacity_out = opacity;
+	// ignore group for now (may be used later)
+}
+)";
+static const char* plot_frag = R"(
+#version 330 core
+layout (location = 0) in float value;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in float opacity;
+
+uniform vec4 color_n;
+uniform vec4 color_p;
+uniform float mix_color_hsv; // 0 = RGB, 1 = HSV
+uniform float min_val;
+uniform float max_val;
+uniform float opacity_threshold;
+uniform float ambient;
+uniform float specular;
+
+out vec4 FragColor;
+
+vec3 rgb2hsv(vec3 c)
+{
+    vec4 K = vec4(0.0, -1.0 / 3.0, 2.0 / 3.0, -1.0);
+    vec4 p = mix(vec4(c.bg, K.wz), vec4(c.gb, K.xy), step(c.b, c.g));
+    vec4 q = mix(vec4(p.xyw, c.r), vec4(c.r, p.yzx), step(p.x, c.r));
+
+    float d = q.x - min(q.w, q.y);
+    float e = 1.0e-10;
+    return vec3(abs(q.z + (q.w - q.y) / (6.0 * d + e)), d / (q.x + e), q.x);
+}
+
+vec3 hsv2rgb(vec3 c)
+{
+	vec4 K = vec4(1.0, 2.0 / 3.0, 1.0 / 3.0, 3.0);
+    vec3 p = abs(fract(c.xxx + K.xyz) * 6.0 - K.www);
+    return c.z * mix(K.xxx, clamp(p - K.xxx, 0.0, 1.0), c.y);
+}
+
+void main()
+{
+	float value_normalized = (value-min_val)/(max_val-min_val);
+	value_normalized = clamp(value_normalized, 0, 1);	
+
+	float mix_percentage = value_normalized;
+	vec3 color_rgb = mix(color_n.xyz, color_p.xyz, mix_percentage);
+	vec3 color_hsv = hsv2rgb(mix(rgb2hsv(color_n.xyz), rgb2hsv(color_p.xyz), mix_percentage));
+	
+	vec3 color = (1-mix_color_hsv)*color_rgb + mix_color_hsv*color_hsv;
+
+	float brightness = ambient + (1-ambient)*max(pow(dot(normal, vec3(0, 0, -1)), specular), 0.0);
+	color = color * brightness;
+
+	// debug
+	//color = normal/2+0.5 + 0.01*color;
+	
+	// discard fragment if opacity is less than the opacity_threshold
+	if (opacity < opacity_threshold)
+	{
+		discard;
+	}
+
+	FragColor = vec4(color, mix(color_n.a, color_p.a, mix_percentage)*opacity);
+}
+)";
+
+
+// wireframe shader
+
+static const char* wireframe_vert = R"(
+#version 330 core
+layout (location = 0) in vec3 pos;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in float group;
+layout (location = 3) in float value;
+layout (location = 4) in float opacity;
+
+uniform mat4 projection;
+uniform mat4 model;
+
+layout (location = 2) out float opacity_out;
+
+void main()
+{
+	gl_Position = projection*model*vec4(pos, 1.0); // w = 1 for points, w = 0 for vectors.
+	gl_Position.z -= 0.001; // advance the depth a little bit
+	opacity_out = opacity;
+}
+)";
+static const char* wireframe_frag = R"(
+#version 330 core
+layout (location = 2) in float opacity;
+
+uniform vec4 color;
+uniform float opacity_threshold;
+
+out vec4 FragColor;
+
+void main()
+{
+	// discard fragment if opacity is less than the opacity_threshold
+	if (opacity < opacity_threshold)
+	{
+		discard;
+	}
+
+	FragColor = vec4(color.xyz, color.w*opacity);
+}
+)";
+
+
+MeshPlotRenderer::MeshPlotRenderer()
+{
+	m_plot_shader = gdevGet()->createShader(plot_vert, plot_frag);
+	m_wireframe_shader = gdevGet()->createShader(wireframe_vert, wireframe_frag);
+	m_geometry_layout = gdevGet()->createVertexLayout({
+		{VertexLayoutElement::VEC3, "pos"},
+		{VertexLayoutElement::VEC3, "normal"},
+		{VertexLayoutElement::INT, "group"}
+		});
+	m_values_layout = gdevGet()->createVertexLayout({
+		{VertexLayoutElement::FLOAT, "value"},
+		{VertexLayoutElement::FLOAT, "opacity"}
+		}, 3);
+	m_view_matrix = glm::mat4(1);
+	m_color_mix_type = MIX_HSV;
+	m_color_n = glm::vec4(0, 0, 1, 1);
+	m_color_p = glm::vec4(1, 0, 0, 1);
+	m_min_val = -1;
+	m_max_val = 1;
+	m_opacity_threshold = 0;
+	m_ambient = 0.8;
+	m_specular = 5;
+}
+
+MeshPlotRenderer::~MeshPlotRenderer()
+{
+	delete m_plot_shader;
+	delete m_wireframe_shader;
+	delete m_geometry_layout;
+	delete m_values_layout;
+}
+
+void MeshPlotRenderer::set_view_projection_matrix(const glm::mat4& view)
+{
+	m_view_matrix = view;
+}
+
+void MeshPlotRenderer::set_colors(const glm::vec4& color_p, const glm::vec4& color_n)
+{
+	m_color_p = color_p;
+	m_color_n = color_n;
+}
+
+void MeshPlotRenderer::set_color_mix_type(const ColorMixType& color_mix_type)
+{
+	m_color_mix_type = color_mix_type;
+}
+
+void MeshPlotRenderer::set_values_range(float min_value, float max_value)
+{
+	m_min_val = min_value;
+	m_max_val = max_value;
+}
+
+void MeshPlotRenderer::set_opacity_threshold(float opacity_threshold)
+{
+	m_opacity_threshold = opacity_threshold;
+}
+
+void MeshPlotRenderer::set_ambient(float ambient)
+{
+	m_ambient = ambient;
+}
+
+void MeshPlotRenderer::set_specular(float specular)
+{
+	m_specular = specular;
+}
+
+void MeshPlotRenderer::render_mesh_plot(const glm::mat4& transform, MeshPlot* mesh_plot, bool render_wireframe, const glm::vec4& wireframe_color, float wireframe_line_width)
+{
+	render_faces(transform, mesh_plot, 0, mesh_plot->faces_count, render_wireframe, wireframe_color, wireframe_line_width);
+}
+
+void MeshPlotRenderer::render_mesh_plot_group(const glm::mat4& transform, MeshPlot* mesh_plot, int group_index, bool render_wireframe, const glm::vec4& wireframe_color, float wireframe_line_width)
+{
+	if (group_index < 0 || group_index >= mesh_plot->groups_faces_ranges.size())
+	{
+		return;
+	}
+
+	const MeshPlotFacesRange& range = mesh_plot->groups_faces_ranges[group_index];
+	render_faces(transform, mesh_plot, range.first, range.count, render_wireframe, wireframe_color, wireframe_line_width);
+}
+
+void MeshPlotRenderer::render_faces(const glm::mat4& transform, MeshPlot* mesh_plot, int first_face, int faces_count, bool render_wireframe, const glm::vec4& wireframe_color, float wireframe_line_width)
+{
+	// check for vertex and index buffer
+	if (!mesh_plot->vertex_buffer || !mesh_plot->values_buffer || !mesh_plot->index_buffer || faces_count == 0)
+	{
+		return;
+	}
+
+	// Drawing.
+	// the layouts read their attributes from the buffer bound when they are bound
+	mesh_plot->vertex_buffer->bind();
+	m_geometry_layout->bind();
+	mesh_plot->values_buffer->bind();
+	m_values_layout->bind();
+	mesh_plot->index_buffer->bind();
+
+
+	// plot render
+
+	// Bind shader.
+	m_plot_shader->bind();
+	m_plot_shader->setMat4("projection", m_view_matrix);
+	m_plot_shader->setMat4("model", transform);
+	m_plot_shader->setVec4("color_n", m_color_n);
+	m_plot_shader->setVec4("color_p", m_color_p);
+	m_plot_shader->setFloat("mix_color_hsv", m_color_mix_type == MIX_RGB ? 0 : 1);
+	m_plot_shader->setFloat("min_val", m_min_val);
+	m_plot_shader->setFloat("max_val", m_max_val);
+	m_plot_shader->setFloat("opacity_threshold", m_opacity_threshold);
+	m_plot_shader->setFloat("ambient", m_ambient);
+	m_plot_shader->setFloat("specular", m_specular);
+
+	gdevGet()->setPolygonMode(FACE_FRONT_AND_BACK, POLYGON_MODE_FILL);
+	gdevGet()->drawElements(TOPOLOGY_TRIANGLE_LIST, first_face*3*sizeof(int), 3*faces_count, INDEX_UNSIGNED_INT);
+
+
+	// wireframe render
+	if (render_wireframe)
+	{
+		// Bind shader.
+		m_wireframe_shader->bind();
+		m_wireframe_shader->setMat4("projection", m_view_matrix);
+		m_wireframe_shader->setMat4("model", transform);
+		m_wireframe_shader->setVec4("color", wireframe_color);
+		m_wireframe_shader->setFloat("opacity_threshold", m_opacity_threshold);
+
+		gdevGet()->setPolygonMode(FACE_FRONT_AND_BACK, POLYGON_MODE_LINE);
+		gdevGet()->setLineWidth(wireframe_line_width);
+		gdevGet()->drawElements(TOPOLOGY_TRIANGLE_LIST, first_face*3*sizeof(int), 3*faces_count, INDEX_UNSIGNED_INT);
+	}
+
+
+	// restore polygon mode
+	gdevGet()->setPolygonMode(FACE_FRONT_AND_BACK, POLYGON_MODE_FILL);
+}
+
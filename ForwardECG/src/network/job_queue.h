@@ -0,0 +1,107 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+
+// thread-safe FIFO queue, consumers can block until an item is pushed or the queue is closed
+template<typename T>
+class JobQueue
+{
+public:
+	JobQueue() = default;
+	~JobQueue() = default;
+
+	// returns false if the queue is closed
+	bool push(const T& item)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_closed)
+			{
+				return false;
+			}
+			m_items.push_back(item);
+			if (m_items.size() > m_max_size)
+			{
+				m_max_size = m_items.size();
+			}
+		}
+		m_cond.notify_one();
+		return true;
+	}
+
+	// blocks until an item is available, returns false if the queue is closed
+	bool pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cond.wait(lock, [this]() { return m_closed || !m_items.empty(); });
+		if (m_closed)
+		{
+			return false;
+		}
+
+		item = m_items.front();
+		m_items.pop_front();
+		return true;
+	}
+
+	// returns false if the queue is empty or closed
+	bool try_pop(T& item)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_closed || m_items.empty())
+		{
+			return false;
+		}
+
+		item = m_items.front();
+		m_items.pop_front();
+		return true;
+	}
+
+	// wakes all the waiting consumers, the items left in the queue are returned
+	std::deque<T> close()
+	{
+		std::deque<T> items;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_closed = true;
+			items.swap(m_items);
+		}
+		m_cond.notify_all();
+		return items;
+	}
+
+	void reopen()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closed = false;
+	}
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_items.size();
+	}
+
+	// the largest size the queue reached since the last reset
+	size_t max_size() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_max_size;
+	}
+
+	void reset_max_size()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_max_size = m_items.size();
+	}
+
+private:
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::deque<T> m_items;
+	bool m_closed = false;
+	size_t m_max_size = 0;
+};
@@ -1,18 +1,68 @@
 #include "serializer.h"
 #include <assert.h>
+#include <string.h>
 #include "sockimpl.h"
 
 
+static size_t array_dtype_size(const ArrayDataType dtype)
+{
+	switch (dtype)
+	{
+	case ARRAY_DTYPE_U8:
+		return sizeof(uint8_t);
+	case ARRAY_DTYPE_I32:
+		return sizeof(int32_t);
+	case ARRAY_DTYPE_F32:
+		return sizeof(float);
+	case ARRAY_DTYPE_F64:
+		return sizeof(double);
+	default:
+		return 0;
+	}
+}
+
+static bool is_little_endian()
+{
+	const uint16_t value = 1;
+	return *(const uint8_t*)&value == 1;
+}
+
+// reverses the bytes of each element (little endian <-> big endian)
+static void swap_elements_bytes(uint8_t* bytes, const size_t elements_count, const size_t element_size)
+{
+	for (size_t i = 0; i < elements_count; i++)
+	{
+		uint8_t* element = bytes + i*element_size;
+		for (size_t j = 0; j < element_size/2; j++)
+		{
+			uint8_t temp = element[j];
+			element[j] = element[element_size-1-j];
+			element[element_size-1-j] = temp;
+		}
+	}
+}
+
+
 Serializer::Serializer()
 {
 	
 }
 
+Serializer::Serializer(const size_t size_hint)
+{
+	m_data.reserve(size_hint);
+}
+
 Serializer::~Serializer()
 {
 
 }
 
+void Serializer::reserve(const size_t size)
+{
+	m_data.reserve(m_data.size() + size);
+}
+
 
 void Serializer::push_i8(const int8_t val)
 {
@@ -98,6 +148,49 @@ void Serializer::push_array_u8(const uint8_t* buffer, const size_t size)
 }
 
 
+void Serializer::push_array(const ArrayDataType dtype, const void* elements, const std::vector<uint32_t>& shape)
+{
+	const size_t element_size = array_dtype_size(dtype);
+	size_t elements_count = 1;
+	for (uint32_t dimension : shape)
+	{
+		elements_count *= dimension;
+	}
+
+	// header
+	const size_t header_size = 4 + shape.size()*sizeof(uint32_t);
+	const uint8_t padding_size = (element_size - (m_data.size() + header_size) % element_size) % element_size;
+	reserve(header_size + padding_size + elements_count*element_size);
+	push_u8(dtype);
+	push_u8('<');
+	push_u8(shape.size());
+	push_u8(padding_size);
+	for (uint32_t dimension : shape)
+	{
+		push_u32(dimension);
+	}
+	m_data.resize(m_data.size() + padding_size, 0);
+
+	// elements
+	const size_t elements_offset = m_data.size();
+	push_bytes((const uint8_t*)elements, elements_count*element_size);
+	if (!is_little_endian())
+	{
+		swap_elements_bytes(&m_data[elements_offset], elements_count, element_size);
+	}
+}
+
+void Serializer::push_array(const float* elements, const uint32_t rows, const uint32_t cols)
+{
+	push_array(ARRAY_DTYPE_F32, elements, { rows, cols });
+}
+
+void Serializer::push_array(const double* elements, const uint32_t rows, const uint32_t cols)
+{
+	push_array(ARRAY_DTYPE_F64, elements, { rows, cols });
+}
+
+
 void Serializer::push_bytes(const std::vector<uint8_t>& bytes)
 {
 	push_bytes(&bytes[0], bytes.size());
@@ -105,11 +198,7 @@ void Serializer::push_bytes(const std::vector<uint8_t>& bytes)
 
 void Serializer::push_bytes(const uint8_t* buffer, const size_t size)
 {
-	m_data.reserve(size);
-	for (size_t i = 0; i < size; i++)
-	{
-		m_data.push_back(buffer[i]);
-	}
+	m_data.insert(m_data.end(), buffer, buffer + size);
 }
 
 
@@ -148,16 +237,16 @@ Deserializer::~Deserializer()
 
 int8_t Deserializer::parse_i8()
 {
-	uint8_t val;
+	uint8_t val = 0;
 
-	parse_bytes((uint8_t*)&val, sizeof(int16_t));
+	parse_bytes((uint8_t*)&val, sizeof(int8_t));
 
-	return *(int16_t*)&val;
+	return *(int8_t*)&val;
 }
 
 int16_t Deserializer::parse_i16()
 {
-	uint16_t val_n;
+	uint16_t val_n = 0;
 
 	parse_bytes((uint8_t*)&val_n, sizeof(int16_t));
 	uint16_t val = ntohs(val_n);
@@ -167,7 +256,7 @@ int16_t Deserializer::parse_i16()
 
 int32_t Deserializer::parse_i32()
 {
-	uint32_t val_n;
+	uint32_t val_n = 0;
 
 	parse_bytes((uint8_t*)&val_n, sizeof(int32_t));
 	uint32_t val = ntohl(val_n);
@@ -177,7 +266,7 @@ int32_t Deserializer::parse_i32()
 
 int64_t Deserializer::parse_i64()
 {
-	uint64_t val_n;
+	uint64_t val_n = 0;
 
 	parse_bytes((uint8_t*)&val_n, sizeof(int64_t));
 	uint64_t val = ntohll(val_n);
@@ -187,7 +276,7 @@ int64_t Deserializer::parse_i64()
 
 uint8_t Deserializer::parse_u8()
 {
-	uint8_t val;
+	uint8_t val = 0;
 	
 	parse_bytes((uint8_t*)&val, sizeof(uint8_t));
 	return val;
@@ -195,7 +284,7 @@ uint8_t Deserializer::parse_u8()
 
 uint16_t Deserializer::parse_u16()
 {
-	uint16_t val_n;
+	uint16_t val_n = 0;
 
 	parse_bytes((uint8_t*)&val_n, sizeof(uint16_t));
 	return ntohs(val_n);
@@ -203,7 +292,7 @@ uint16_t Deserializer::parse_u16()
 
 uint32_t Deserializer::parse_u32()
 {
-	uint32_t val_n;
+	uint32_t val_n = 0;
 
 	parse_bytes((uint8_t*)&val_n, sizeof(uint32_t));
 	return ntohl(val_n);
@@ -211,7 +300,7 @@ uint32_t Deserializer::parse_u32()
 
 uint64_t Deserializer::parse_u64()
 {
-	uint64_t val_n;
+	uint64_t val_n = 0;
 
 	parse_bytes((uint8_t*)&val_n, sizeof(uint64_t));
 	return ntohll(val_n);
@@ -219,7 +308,7 @@ uint64_t Deserializer::parse_u64()
 
 float Deserializer::parse_float()
 {
-	uint32_t val_n;
+	uint32_t val_n = 0;
 
 	parse_bytes((uint8_t*)&val_n, sizeof(float));
 	return ntohf(val_n);
@@ -227,7 +316,7 @@ float Deserializer::parse_float()
 
 double Deserializer::parse_double()
 {
-	uint64_t val_n;
+	uint64_t val_n = 0;
 
 	parse_bytes((uint8_t*)&val_n, sizeof(double));
 	return ntohd(val_n);
@@ -262,23 +351,63 @@ std::vector<uint8_t> Deserializer::push_array_u8()
 	return parse_bytes(size);
 }
 
-
-std::vector<uint8_t> Deserializer::parse_bytes(const size_t size)
+std::vector<double> Deserializer::parse_array_f64(std::vector<uint32_t>& shape)
 {
-	std::vector<uint8_t> bytes;
+	// header
+	const ArrayDataType dtype = (ArrayDataType)parse_u8();
+	const bool little_endian = parse_u8() == '<';
+	const uint8_t dimensions_count = parse_u8();
+	const uint8_t padding_size = parse_u8();
+	shape.resize(dimensions_count);
+	size_t elements_count = 1;
+	for (uint8_t i = 0; i < dimensions_count; i++)
+	{
+		shape[i] = parse_u32();
+		elements_count *= shape[i];
+	}
+	parse_bytes(padding_size);
 
-	bytes.resize(size);
+	const size_t element_size = array_dtype_size(dtype);
+	if ((dtype != ARRAY_DTYPE_F32 && dtype != ARRAY_DTYPE_F64) || remaining_size() < elements_count*element_size)
+	{
+		printf("Warning: invalid array while deserializing\n");
+		assert(false);
+		shape.clear();
+		return std::vector<double>();
+	}
 
-	for (size_t i = 0; i < size; i++)
+	// elements
+	std::vector<uint8_t> bytes = parse_bytes(elements_count*element_size);
+	if (elements_count > 0 && little_endian != is_little_endian())
 	{
-		if (remaining_size() == 0)
+		swap_elements_bytes(&bytes[0], elements_count, element_size);
+	}
+
+	std::vector<double> elements(elements_count);
+	for (size_t i = 0; i < elements_count; i++)
+	{
+		if (dtype == ARRAY_DTYPE_F32)
 		{
-			printf("Warning: reached the end of the data before deserializing\n");
-			assert(false);
-			break;
+			float value;
+			memcpy(&value, &bytes[i*element_size], sizeof(float));
+			elements[i] = value;
 		}
+		else
+		{
+			memcpy(&elements[i], &bytes[i*element_size], sizeof(double));
+		}
+	}
 
-		bytes[i] = m_data[m_pointer++];
+	return elements;
+}
+
+
+std::vector<uint8_t> Deserializer::parse_bytes(const size_t size)
+{
+	std::vector<uint8_t> bytes(size, 0);
+	if (size > 0)
+	{
+		parse_bytes(&bytes[0], size);
 	}
 
 	return bytes;
@@ -286,16 +415,18 @@ std::vector<uint8_t> Deserializer::parse_bytes(const size_t size)
 
 void Deserializer::parse_bytes(uint8_t* buffer, const size_t size)
 {
-	for (size_t i = 0; i < size; i++)
+	size_t parse_size = size;
+	if (remaining_size() < size)
 	{
-		if (remaining_size() == 0)
-		{
-			printf("Warning: reached the end of the data before deserializing\n");
-			assert(false);
-			break;
-		}
+		printf("Warning: reached the end of the data before deserializing\n");
+		assert(false);
+		parse_size = remaining_size();
+	}
 
-		buffer[i] = m_data[m_pointer++];
+	if (parse_size > 0)
+	{
+		memcpy(buffer, &m_data[m_pointer], parse_size);
+		m_pointer += parse_size;
 	}
 }
 
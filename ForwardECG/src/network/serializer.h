@@ -8,6 +8,18 @@
 //   * serializer serializes data to a series of bytes, all data is converted to network byte order.
 //   * strings are serialized with the size (uint16_t) + the null-terminated string for security.
 //   * arrays are serialized with the size (uint32_t) + the elements of the array
+//   * bulk arrays (push_array) are serialized with a header + the elements copied as one block in little-endian order:
+//       dtype (uint8_t), byte order (uint8_t '<'), dimensions count (uint8_t), padding size (uint8_t), dimensions (uint32_t each),
+//       padding (aligns the elements to their size from the start of the data), elements (row major)
+
+
+enum ArrayDataType
+{
+	ARRAY_DTYPE_U8 = 1,
+	ARRAY_DTYPE_I32 = 2,
+	ARRAY_DTYPE_F32 = 3,
+	ARRAY_DTYPE_F64 = 4
+};
 
 
 // Serializer
@@ -16,8 +28,13 @@ class Serializer
 {
 public:
 	Serializer();
+	// preallocates size_hint bytes
+	Serializer(const size_t size_hint);
 	~Serializer();
 
+	// preallocates size more bytes
+	void reserve(const size_t size);
+
 	void push_i8(const int8_t val);
 	void push_i16(const int16_t val);
 	void push_i32(const int32_t val);
@@ -33,6 +50,11 @@ public:
 	void push_array_u8(const std::vector<uint8_t>& bytes);
 	void push_array_u8(const uint8_t* buffer, const size_t size);
 
+	// bulk arrays, elements are contiguous in row major order
+	void push_array(const ArrayDataType dtype, const void* elements, const std::vector<uint32_t>& shape);
+	void push_array(const float* elements, const uint32_t rows, const uint32_t cols);
+	void push_array(const double* elements, const uint32_t rows, const uint32_t cols);
+
 	// push individual bytes
 	void push_bytes(const std::vector<uint8_t>& bytes);
 	void push_bytes(const uint8_t* buffer, const size_t size);
@@ -66,6 +88,8 @@ public:
 
 	std::string parse_string();
 	std::vector<uint8_t> push_array_u8();
+	// parses a bulk array of floating point elements (either F32 or F64) and converts them to double
+	std::vector<double> parse_array_f64(std::vector<uint32_t>& shape);
 
 	std::vector<uint8_t> parse_bytes(const size_t size);
 	void parse_bytes(uint8_t* buffer, const size_t size);
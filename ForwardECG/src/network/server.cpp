@@ -1,8 +1,260 @@
 #include "server.h"
 #include "sockimpl.h"
 #include <functional>
+#include <stdio.h>
+#include <string.h>
 
 
+static uint32_t read_u32(const uint8_t* bytes)
+{
+	uint32_t value_n;
+	memcpy(&value_n, bytes, sizeof(uint32_t));
+	return ntohl(value_n);
+}
+
+static void push_u32(std::vector<uint8_t>& bytes, uint32_t value)
+{
+	uint32_t value_n = htonl(value);
+	bytes.insert(bytes.end(), (uint8_t*)&value_n, (uint8_t*)&value_n + sizeof(uint32_t));
+}
+
+// frame: magic, request id, size, bytes
+static void push_frame(std::vector<uint8_t>& out, uint32_t magic, uint32_t request_id, const std::vector<uint8_t>& bytes)
+{
+	push_u32(out, magic);
+	push_u32(out, request_id);
+	push_u32(out, bytes.size());
+	out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+static double seconds_between(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+	return std::chrono::duration<double>(end - start).count();
+}
+
+// chunks a streamed response can be ahead of its connection
+static const size_t MAX_PENDING_CHUNKS = 2;
+// larger requests are malformed (the size word of a single request can't be mistaken for the frame magic)
+static const uint32_t MAX_REQUEST_SIZE = 1u << 30;
+// bytes read from a connection at a time
+static const size_t RECV_BUFFER_SIZE = 64*1024;
+// pipelined bytes read ahead while a request of the connection is in progress
+static const size_t MAX_PIPELINED_SIZE = 1024*1024;
+// bytes waiting to be sent before taking more chunks of a streamed response
+static const size_t MAX_PENDING_OUTPUT_SIZE = 256*1024;
+// longest wait between checking the timeouts (milliseconds)
+static const int POLL_TIMEOUT = 100;
+
+
+// ServerRequest
+
+ServerRequest::ServerRequest(const std::vector<uint8_t>& request_bytes, const Address& addr, const Port port, const bool can_stream,
+	std::function<void()> notify)
+	: m_request_bytes(request_bytes), m_addr(addr), m_port(port), m_received_time(std::chrono::steady_clock::now()), m_can_stream(can_stream),
+	m_notify(notify)
+{
+
+}
+
+const std::vector<uint8_t>& ServerRequest::get_bytes() const
+{
+	return m_request_bytes;
+}
+
+Address ServerRequest::get_address() const
+{
+	return m_addr;
+}
+
+Port ServerRequest::get_port() const
+{
+	return m_port;
+}
+
+double ServerRequest::get_elapsed_seconds() const
+{
+	return seconds_between(m_received_time, std::chrono::steady_clock::now());
+}
+
+double ServerRequest::get_latency() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_latency;
+}
+
+void ServerRequest::set_type(uint32_t type)
+{
+	m_type = type;
+}
+
+uint32_t ServerRequest::get_type() const
+{
+	return m_type;
+}
+
+void ServerRequest::respond(const std::vector<uint8_t>& response_bytes)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_done)
+		{
+			return;
+		}
+		m_response_bytes = response_bytes;
+		m_latency = get_elapsed_seconds();
+		m_done = true;
+		notify();
+	}
+	m_cond.notify_all();
+}
+
+void ServerRequest::cancel()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_done)
+		{
+			return;
+		}
+		m_cancelled = true;
+		m_done = true;
+		m_chunks.clear();
+		notify();
+	}
+	m_cond.notify_all();
+}
+
+bool ServerRequest::wait_response(std::vector<uint8_t>& response_bytes)
+{
+	Part part;
+	while ((part = wait_part(response_bytes)) == Part::Chunk)
+	{
+		// chunks are dropped
+	}
+
+	return part == Part::Response;
+}
+
+bool ServerRequest::can_stream() const
+{
+	return m_can_stream;
+}
+
+bool ServerRequest::send_chunk(const std::vector<uint8_t>& chunk_bytes)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cond.wait(lock, [this]() { return m_done || m_chunks.size() < MAX_PENDING_CHUNKS; });
+		if (m_done)
+		{
+			return false;
+		}
+		m_chunks.push_back(chunk_bytes);
+		notify();
+	}
+	m_cond.notify_all();
+	return true;
+}
+
+ServerRequest::Part ServerRequest::wait_part(std::vector<uint8_t>& bytes)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_cond.wait(lock, [this]() { return m_done || !m_chunks.empty(); });
+	return take_part(lock, bytes);
+}
+
+ServerRequest::Part ServerRequest::poll_part(std::vector<uint8_t>& bytes)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (!m_done && m_chunks.empty())
+	{
+		return Part::None;
+	}
+	return take_part(lock, bytes);
+}
+
+ServerRequest::Part ServerRequest::take_part(std::unique_lock<std::mutex>& lock, std::vector<uint8_t>& bytes)
+{
+	if (!m_chunks.empty())
+	{
+		bytes.swap(m_chunks.front());
+		m_chunks.pop_front();
+
+		// wake the sender waiting for room
+		lock.unlock();
+		m_cond.notify_all();
+		return Part::Chunk;
+	}
+
+	if (m_cancelled)
+	{
+		return Part::Cancelled;
+	}
+
+	bytes.swap(m_response_bytes);
+	return Part::Response;
+}
+
+void ServerRequest::notify()
+{
+	// called with the mutex locked, once the request is done (and the notify returned) it's never called again
+	if (m_notify)
+	{
+		m_notify();
+	}
+}
+
+
+// LatencyHistogram
+
+void LatencyHistogram::add(double latency)
+{
+	double microseconds = latency*1e6;
+	int bucket = 0;
+	while (bucket < BUCKETS_COUNT-1 && microseconds >= (double)(1ull << bucket))
+	{
+		bucket++;
+	}
+
+	buckets[bucket]++;
+	count++;
+	total += latency;
+	if (latency > max)
+	{
+		max = latency;
+	}
+}
+
+double LatencyHistogram::average() const
+{
+	return (count > 0) ? total/count : 0;
+}
+
+double LatencyHistogram::percentile(double quantile) const
+{
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	uint64_t rank = (uint64_t)(quantile*count + 0.5);
+	uint64_t accumulated = 0;
+	for (int i = 0; i < BUCKETS_COUNT; i++)
+	{
+		accumulated += buckets[i];
+		if (accumulated >= rank && accumulated > 0)
+		{
+			double upper_bound = (double)(1ull << i)*1e-6;
+			return (upper_bound < max) ? upper_bound : max;
+		}
+	}
+
+	return max;
+}
+
+
+// Server
+
 Server::Server()
 {
 
@@ -10,13 +262,18 @@ Server::Server()
 
 Server::~Server()
 {
+	stop();
+}
 
+void Server::set_timeouts(const ServerTimeouts& timeouts)
+{
+	m_timeouts = timeouts;
 }
 
 bool Server::start(const Address addr, const Port port)
 {
-	// check if socket is running
-	if (m_sock.is_valid())
+	// check if the server is running
+	if (m_io_thread.joinable())
 	{
 		return false;
 	}
@@ -28,37 +285,56 @@ bool Server::start(const Address addr, const Port port)
 		return false;
 	}
 
-	if (!m_sock.bind(addr, port))
+	if (!m_sock.bind(addr, port) || !m_sock.listen() || !m_sock.be_non_blocking())
+	{
+		m_sock.close();
+		m_sock = Socket();
+		return false;
+	}
+
+	// the other threads wake the polling thread by sending a datagram to this socket
+	Address wake_addr;
+	Port wake_port;
+	m_wake_sock = Socket(Socket::Type::Dgram);
+	if (!m_wake_sock.is_valid() || !m_wake_sock.bind(ADDRESS_LOCALHOST, 0) || !m_wake_sock.get_local(wake_addr, wake_port)
+		|| !m_wake_sock.connect(ADDRESS_LOCALHOST, wake_port) || !m_wake_sock.be_non_blocking())
 	{
+		m_wake_sock.close();
+		m_wake_sock = Socket();
 		m_sock.close();
 		m_sock = Socket();
 		return false;
 	}
-	
-	m_sock.listen();
+	m_wake_pending = false;
 
 
-	// start server thread
-	m_server_thread = std::thread(std::bind(&Server::server_thread_routine, this));
-	m_server_thread.detach();
+	// start polling
+	m_requests.reopen();
+	m_stop_requested = false;
 	m_is_running = true;
+	{
+		std::lock_guard<std::mutex> lock(m_stats_mutex);
+		m_rate_start = std::chrono::steady_clock::now();
+		m_rate_count = 0;
+	}
+	m_io_thread = std::thread(std::bind(&Server::io_thread_routine, this));
 
 	return true;
 }
 
 bool Server::stop()
 {
-	if (!m_sock.is_valid())
+	if (!m_io_thread.joinable())
 	{
 		return false;
 	}
 
-	m_sock.close();
-	m_sock = Socket();
-	if (m_server_thread.joinable())
-	{
-		m_server_thread.join();
-	}
+	// the polling thread finishes the requests in progress and closes everything
+	m_stop_requested = true;
+	wake();
+	m_io_thread.join();
+
+	m_is_running = false;
 	return true;
 }
 
@@ -68,93 +344,463 @@ bool Server::is_running() const
 }
 
 
-bool Server::poll_request(std::vector<uint8_t>& request_bytes, Address* req_address, Port* req_port)
+bool Server::poll_request(std::shared_ptr<ServerRequest>& request)
 {
-	if (m_got_request)
-	{
-		request_bytes = m_request_bytes;
-		*req_address = m_request_addr;
-		*req_port = m_request_port;
+	return m_requests.try_pop(request);
+}
 
-		return true;
+bool Server::wait_request(std::shared_ptr<ServerRequest>& request)
+{
+	return m_requests.pop(request);
+}
+
+ServerStats Server::get_stats() const
+{
+	ServerStats stats;
+	{
+		std::lock_guard<std::mutex> lock(m_stats_mutex);
+		stats.requests_count = m_responded_count;
+		stats.last_latency = m_last_latency;
+		stats.average_latency = (m_responded_count > 0) ? m_total_latency/m_responded_count : 0;
+		stats.max_latency = m_max_latency;
+		stats.type_latency = m_type_latency;
+
+		// the window of the last rate is over if no request was responded since
+		double rate_elapsed = seconds_between(m_rate_start, std::chrono::steady_clock::now());
+		stats.requests_per_second = (rate_elapsed >= 1) ? m_rate_count/rate_elapsed : m_requests_per_second;
 	}
+	stats.queue_depth = m_requests.size();
+	stats.max_queue_depth = m_requests.max_size();
+	stats.connections_count = m_connections_count;
+	stats.accepted_connections = m_accepted_connections;
+	stats.timed_out_connections = m_timed_out_connections;
+	stats.bytes_received = m_bytes_received;
+	stats.bytes_sent = m_bytes_sent;
+	return stats;
+}
 
-	return false;
+void Server::reset_stats()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_stats_mutex);
+		m_responded_count = 0;
+		m_total_latency = 0;
+		m_last_latency = 0;
+		m_max_latency = 0;
+		m_type_latency.clear();
+		m_rate_start = std::chrono::steady_clock::now();
+		m_rate_count = 0;
+		m_requests_per_second = 0;
+	}
+	m_requests.reset_max_size();
+	m_accepted_connections = 0;
+	m_timed_out_connections = 0;
+	m_bytes_received = 0;
+	m_bytes_sent = 0;
 }
 
-bool Server::push_response(const std::vector<uint8_t>& response_bytes)
+
+void Server::io_thread_routine()
 {
-	if (!m_got_request)
+	m_recv_buffer.resize(RECV_BUFFER_SIZE);
+	std::vector<SocketPoll> polls;
+	std::chrono::steady_clock::time_point stop_time;
+	bool stopping = false;
+	while (true)
 	{
-		return false;
+		// stop accepting connections and requests
+		if (m_stop_requested && !stopping)
+		{
+			stopping = true;
+			stop_time = std::chrono::steady_clock::now();
+			m_sock.close();
+			m_sock = Socket();
+		}
+
+		// wake socket, listening socket, then the connections in order
+		polls.clear();
+		polls.push_back({ &m_wake_sock, true, false });
+		if (!stopping)
+		{
+			polls.push_back({ &m_sock, true, false });
+		}
+		for (Connection& connection : m_connections)
+		{
+			size_t pending_input = connection.in_buffer.size() - connection.in_offset;
+			bool read = !connection.read_closed && (!connection.request || pending_input < MAX_PIPELINED_SIZE);
+			bool write = connection.out_offset < connection.out_buffer.size();
+			polls.push_back({ &connection.sock, read, write });
+		}
+
+		if (poll_sockets(&polls[0], (int)polls.size(), POLL_TIMEOUT) == -1)
+		{
+			printf("Server polling failed\n");
+			break;
+		}
+
+		// clear the flag before looking at the requests, any later change wakes the next poll
+		if (polls[0].readable)
+		{
+			m_wake_pending = false;
+			char wake_buffer[16];
+			while (m_wake_sock.recv(wake_buffer, sizeof(wake_buffer)) > 0)
+			{
+				// drain
+			}
+		}
+
+		if (!stopping && polls[1].readable)
+		{
+			accept_connections();
+		}
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		size_t poll_index = stopping ? 1 : 2;
+		for (auto connection = m_connections.begin(); connection != m_connections.end(); )
+		{
+			// connections accepted in this iteration weren't polled yet
+			bool polled = poll_index < polls.size();
+			const SocketPoll poll = polled ? polls[poll_index++] : SocketPoll{ NULL };
+
+			bool ok = true;
+			if (poll.readable)
+			{
+				ok = receive(*connection);
+			}
+			else if (poll.error)
+			{
+				ok = false;
+			}
+			ok = ok && update_connection(*connection, stopping);
+			if (ok && connection->out_offset < connection->out_buffer.size())
+			{
+				ok = send(*connection);
+			}
+			if (ok && !check_timeouts(*connection, now))
+			{
+				m_timed_out_connections++;
+				ok = false;
+			}
+
+			// when stopping, the connections close as soon as they have nothing in progress
+			if (ok && stopping && !connection->request && connection->out_offset == connection->out_buffer.size())
+			{
+				ok = false;
+			}
+
+			if (!ok)
+			{
+				close_connection(*connection);
+				connection = m_connections.erase(connection);
+				m_connections_count = m_connections.size();
+			}
+			else
+			{
+				connection++;
+			}
+		}
+
+		if (stopping && (m_connections.empty() || seconds_between(stop_time, now) >= m_timeouts.stop))
+		{
+			break;
+		}
 	}
 
-	m_response_bytes = response_bytes;
-	m_got_request = false;
-	m_response_semaphore.notify();
+	// cancel the requests that are not taken yet, and wake the threads waiting for requests
+	std::deque<std::shared_ptr<ServerRequest>> pending_requests = m_requests.close();
+	for (std::shared_ptr<ServerRequest>& request : pending_requests)
+	{
+		request->cancel();
+	}
 
-	return true;
-}
+	// cancel the requests that didn't finish in time
+	for (Connection& connection : m_connections)
+	{
+		close_connection(connection);
+	}
+	m_connections.clear();
+	m_connections_count = 0;
 
+	// no request can wake the thread anymore
+	if (m_sock.is_valid())
+	{
+		m_sock.close();
+		m_sock = Socket();
+	}
+	m_wake_sock.close();
+	m_wake_sock = Socket();
+}
 
-void Server::server_thread_routine()
+void Server::accept_connections()
 {
 	while (true)
 	{
-		// Accept the new connection
-		Socket new_sock;
+		// accept the new connections until there are no more
 		Address new_addr;
 		Port new_port;
-		new_sock = m_sock.accept(new_addr, new_port);
+		Socket new_sock = m_sock.accept(new_addr, new_port);
 		if (!new_sock.is_valid())
 		{
-			// exit if the main socket closed
 			break;
 		}
 
-		// handle request
+		// responses are sent as whole messages, don't delay them
+		new_sock.be_no_delay();
+		if (!new_sock.be_non_blocking())
+		{
+			new_sock.close();
+			continue;
+		}
+
+		Connection connection;
+		connection.sock = new_sock;
+		connection.addr = new_addr;
+		connection.port = new_port;
+		connection.last_activity = std::chrono::steady_clock::now();
+		m_connections.push_back(connection);
+		m_connections_count = m_connections.size();
+		m_accepted_connections++;
+	}
+}
+
+bool Server::receive(Connection& connection)
+{
+	int received = connection.sock.recv((char*)&m_recv_buffer[0], (int)m_recv_buffer.size());
+	if (received < 0)
+	{
+		return Socket::would_block();
+	}
+	if (received == 0)
+	{
+		connection.read_closed = true;
+		return true;
+	}
+
+	m_bytes_received += received;
+	connection.last_activity = std::chrono::steady_clock::now();
+
+	// a responded single request connection only waits for the close
+	if (connection.is_done)
+	{
+		return true;
+	}
+
+	// first bytes of the next request
+	if (!connection.request && connection.in_offset == connection.in_buffer.size())
+	{
+		connection.request_start = connection.last_activity;
+	}
+	connection.in_buffer.insert(connection.in_buffer.end(), m_recv_buffer.begin(), m_recv_buffer.begin() + received);
+	return true;
+}
+
+bool Server::send(Connection& connection)
+{
+	while (connection.out_offset < connection.out_buffer.size())
+	{
+		size_t remaining = connection.out_buffer.size() - connection.out_offset;
+		int sent = connection.sock.send((const char*)&connection.out_buffer[connection.out_offset], (remaining < (size_t)INT32_MAX) ? (int)remaining : INT32_MAX);
+		if (sent < 0)
+		{
+			return Socket::would_block();
+		}
+
+		connection.out_offset += sent;
+		m_bytes_sent += sent;
+		connection.last_activity = std::chrono::steady_clock::now();
+	}
+
+	connection.out_buffer.clear();
+	connection.out_offset = 0;
+	return true;
+}
+
+bool Server::update_connection(Connection& connection, bool stopping)
+{
+	// parts of the request in progress, the chunks wait while the client is behind
+	while (connection.request && connection.out_buffer.size() - connection.out_offset < MAX_PENDING_OUTPUT_SIZE)
+	{
+		std::vector<uint8_t> bytes;
+		ServerRequest::Part part = connection.request->poll_part(bytes);
+		if (part == ServerRequest::Part::None)
+		{
+			break;
+		}
+		else if (part == ServerRequest::Part::Cancelled)
+		{
+			return false;
+		}
+		else if (part == ServerRequest::Part::Chunk)
+		{
+			push_frame(connection.out_buffer, SERVER_CHUNK_MAGIC, connection.request_id, bytes);
+		}
+		else
+		{
+			if (connection.is_framed)
+			{
+				push_frame(connection.out_buffer, SERVER_FRAME_MAGIC, connection.request_id, bytes);
+			}
+			else
+			{
+				// response size, response
+				push_u32(connection.out_buffer, bytes.size());
+				connection.out_buffer.insert(connection.out_buffer.end(), bytes.begin(), bytes.end());
+				connection.is_done = true;
+			}
+			record_response(*connection.request);
+			connection.request.reset();
+
+			// the next pipelined request started waiting now
+			connection.request_start = std::chrono::steady_clock::now();
+		}
+	}
+
+	// next request
+	if (!connection.request && !connection.is_done && !stopping && !parse_request(connection))
+	{
+		return false;
+	}
+
+	// the client closed the connection, after the last response (or in the middle of a request)
+	// a single request connection is closed by the client after reading the response
+	if (connection.read_closed && !connection.request && connection.out_offset == connection.out_buffer.size())
+	{
+		return false;
+	}
 
-		// read request size
-		uint32_t request_size = 0;
-		new_sock.recv((char*)&request_size, sizeof(uint32_t));
-		request_size = ntohl(request_size);
+	return true;
+}
 
-		// read request
-		int read_size = 0;
-		std::vector<uint8_t> request_bytes(request_size, 0);
-		read_size = new_sock.recv_large((char*)&request_bytes[0], request_bytes.size());
-		request_bytes.resize(read_size);
+bool Server::parse_request(Connection& connection)
+{
+	// a connection either starts with a frame (persistent connection carrying any number of requests),
+	// or with the size of its only request
+	size_t available = connection.in_buffer.size() - connection.in_offset;
+	const uint8_t* data = connection.in_buffer.data() + connection.in_offset;
+	if (available < sizeof(uint32_t))
+	{
+		return true;
+	}
 
-		m_request_bytes = request_bytes;
-		m_request_addr = new_addr;
-		m_request_port = new_port;
+	uint32_t header = read_u32(data);
+	bool is_frame = header == SERVER_FRAME_MAGIC;
+	uint32_t request_id = 0;
+	uint32_t request_size = header;
+	size_t header_size = sizeof(uint32_t);
+	if (is_frame)
+	{
+		// frame: magic, request id, request size, request
+		header_size = 3*sizeof(uint32_t);
+		if (available < header_size)
+		{
+			return true;
+		}
+		request_id = read_u32(data + sizeof(uint32_t));
+		request_size = read_u32(data + 2*sizeof(uint32_t));
+	}
+	if (request_size > MAX_REQUEST_SIZE)
+	{
+		printf("Server: malformed request from %s:%d\n", connection.addr.to_string().c_str(), connection.port);
+		return false;
+	}
+	if (available < header_size + request_size)
+	{
+		return true;
+	}
 
-		// wait for response
-		m_got_request = true;
-		m_response_semaphore.wait();
+	std::vector<uint8_t> request_bytes(data + header_size, data + header_size + request_size);
+	connection.in_offset += header_size + request_size;
+	if (connection.in_offset == connection.in_buffer.size())
+	{
+		connection.in_buffer.clear();
+		connection.in_offset = 0;
+	}
+	else if (connection.in_offset >= RECV_BUFFER_SIZE)
+	{
+		connection.in_buffer.erase(connection.in_buffer.begin(), connection.in_buffer.begin() + connection.in_offset);
+		connection.in_offset = 0;
+	}
 
-		m_got_request = false;
-		std::vector<uint8_t> response_bytes = m_response_bytes;
+	// the parts of the response wake the polling thread
+	connection.is_framed = is_frame;
+	connection.request_id = request_id;
+	connection.request = std::make_shared<ServerRequest>(request_bytes, connection.addr, connection.port, is_frame, std::bind(&Server::wake, this));
+	if (!m_requests.push(connection.request))
+	{
+		connection.request->cancel();
+		return false;
+	}
 
-		// send response size
-		uint32_t response_size = response_bytes.size();
-		response_size = htonl(response_size);
-		new_sock.send_all((char*)&response_size, sizeof(uint32_t));
+	return true;
+}
 
-		// send response
-		new_sock.send_all((const char*)&response_bytes[0], response_bytes.size());
+bool Server::check_timeouts(const Connection& connection, std::chrono::steady_clock::time_point now) const
+{
+	// requests in progress don't time out, their connection waits for them
+	if (connection.request)
+	{
+		return true;
+	}
 
-		// wait for connection close
-		read_size = new_sock.recv((char*)&request_bytes[0], request_bytes.size());
-		new_sock.close();
+	if (connection.out_offset < connection.out_buffer.size())
+	{
+		// the client stopped reading the response
+		return seconds_between(connection.last_activity, now) < m_timeouts.send;
+	}
+	else if (connection.in_offset < connection.in_buffer.size())
+	{
+		// the client started a request and didn't finish it
+		return seconds_between(connection.request_start, now) < m_timeouts.request;
+	}
+	else
+	{
+		return seconds_between(connection.last_activity, now) < m_timeouts.idle;
+	}
+}
 
+void Server::close_connection(Connection& connection)
+{
+	// stop the request from producing more chunks
+	if (connection.request)
+	{
+		connection.request->cancel();
+		connection.request.reset();
 	}
+	connection.sock.close();
+}
 
-	if (m_sock.is_valid())
+void Server::wake()
+{
+	// one pending datagram is enough to wake the poll
+	if (!m_wake_pending.exchange(true))
 	{
-		m_sock.close();
-		m_sock = Socket();
+		char wake_byte = 0;
+		m_wake_sock.send(&wake_byte, 1);
 	}
-	m_is_running = false;
 }
 
+void Server::record_response(const ServerRequest& request)
+{
+	double latency = request.get_latency();
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> lock(m_stats_mutex);
+	m_responded_count++;
+	m_total_latency += latency;
+	m_last_latency = latency;
+	if (latency > m_max_latency)
+	{
+		m_max_latency = latency;
+	}
+	m_type_latency[request.get_type()].add(latency);
+
+	// requests per second over windows of at least a second
+	m_rate_count++;
+	double rate_elapsed = seconds_between(m_rate_start, now);
+	if (rate_elapsed >= 1)
+	{
+		m_requests_per_second = m_rate_count/rate_elapsed;
+		m_rate_start = now;
+		m_rate_count = 0;
+	}
+}
@@ -1,35 +1,217 @@
 #pragma once
 #include <vector>
+#include <list>
+#include <deque>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <condition_variable>
 #include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include "socket.h"
-#include "semaphore.h"
+#include "job_queue.h"
 
 
+// first word of a request/response frame on a persistent connection, connections that start with
+// anything else carry a single request prefixed by its size (no request can be that large)
+#define SERVER_FRAME_MAGIC 0xEC6F0001u
+// first word of a response chunk frame, a streamed response is sent as chunks followed by the response frame
+#define SERVER_CHUNK_MAGIC 0xEC6F0002u
+
+
+// a request received by the server, its connection waits until it is responded or cancelled
+class ServerRequest
+{
+public:
+	enum class Part
+	{
+		None,
+		Chunk,
+		Response,
+		Cancelled
+	};
+
+	// notify: called whenever a chunk, the response or the cancel is available (from the thread that made it available)
+	ServerRequest(const std::vector<uint8_t>& request_bytes, const Address& addr, const Port port, const bool can_stream = false,
+		std::function<void()> notify = nullptr);
+	~ServerRequest() = default;
+
+	const std::vector<uint8_t>& get_bytes() const;
+	Address get_address() const;
+	Port get_port() const;
+	// seconds since the request was received
+	double get_elapsed_seconds() const;
+	// seconds from receiving the request until it was responded
+	double get_latency() const;
+	// request type used to group the latency stats, set by whoever parses the request
+	void set_type(uint32_t type);
+	uint32_t get_type() const;
+
+	// only the first response (or cancel) is used
+	void respond(const std::vector<uint8_t>& response_bytes);
+	void cancel();
+	// blocks until the request is responded, returns false if it was cancelled
+	bool wait_response(std::vector<uint8_t>& response_bytes);
+
+	// chunks can be sent before the response only on persistent connections
+	bool can_stream() const;
+	// blocks while the connection is behind by too many chunks, returns false if the request was cancelled
+	bool send_chunk(const std::vector<uint8_t>& chunk_bytes);
+	// blocks until a chunk or the response is available, chunks come first
+	Part wait_part(std::vector<uint8_t>& bytes);
+	// same as wait_part, returns Part::None instead of blocking
+	Part poll_part(std::vector<uint8_t>& bytes);
+
+private:
+	Part take_part(std::unique_lock<std::mutex>& lock, std::vector<uint8_t>& bytes);
+	void notify();
+
+private:
+	std::vector<uint8_t> m_request_bytes;
+	Address m_addr;
+	Port m_port;
+	std::chrono::steady_clock::time_point m_received_time;
+	double m_latency = 0;
+	std::atomic<uint32_t> m_type{ 0 };
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cond;
+	bool m_done = false;
+	bool m_cancelled = false;
+	std::vector<uint8_t> m_response_bytes;
+	bool m_can_stream;
+	std::deque<std::vector<uint8_t>> m_chunks;
+	std::function<void()> m_notify;
+};
+
+// latencies in power of 2 microseconds buckets
+struct LatencyHistogram
+{
+	// bucket i counts the latencies below 2^i microseconds (and not in a lower bucket)
+	static const int BUCKETS_COUNT = 32;
+
+	uint64_t buckets[BUCKETS_COUNT] = {};
+	uint64_t count = 0;
+	double total = 0; // seconds
+	double max = 0;
+
+	void add(double latency);
+	double average() const;
+	// upper bound of the bucket holding the quantile (0..1) in seconds
+	double percentile(double quantile) const;
+};
+
+struct ServerStats
+{
+	uint64_t requests_count = 0; // responded requests
+	double last_latency = 0; // seconds
+	double average_latency = 0;
+	double max_latency = 0;
+	double requests_per_second = 0; // over the last second
+	size_t queue_depth = 0; // requests waiting to be taken
+	size_t max_queue_depth = 0;
+	size_t connections_count = 0; // open connections
+	uint64_t accepted_connections = 0;
+	uint64_t timed_out_connections = 0;
+	uint64_t bytes_received = 0;
+	uint64_t bytes_sent = 0;
+	std::map<uint32_t, LatencyHistogram> type_latency; // latencies of every request type
+};
+
+struct ServerTimeouts
+{
+	double idle = 120; // seconds a connection can wait between requests
+	double request = 30; // seconds to receive a whole request once it started
+	double send = 30; // seconds the client can stop reading a response
+	double stop = 5; // seconds to finish the requests in progress when the server stops
+};
+
+// a single thread polls the listening socket and all the connections (non-blocking), requests are pushed into
+// a job queue that any number of threads can take requests from, their responses are sent by the polling thread
+// a connection either carries a single request: [u32 size][request] -> [u32 size][response],
+// or it is kept alive and carries frames: [u32 magic][u32 request id][u32 size][request] -> [u32 magic][u32 request id][u32 size][response]
+// until the client closes it, a streamed response is preceded by chunk frames with the same request id,
+// the requests of a connection are handled one at a time in order
 class Server
 {
 public:
 	Server();
 	~Server();
 
+	void set_timeouts(const ServerTimeouts& timeouts);
 	bool start(const Address addr, const Port port);
+	// stops accepting connections and requests, waits for the requests in progress (up to the stop timeout),
+	// then cancels the rest and closes all the connections
 	bool stop();
 	bool is_running() const;
 
-	bool poll_request(std::vector<uint8_t>& request_bytes, Address* req_address = NULL, Port* req_port = NULL);
-	bool push_response(const std::vector<uint8_t>& response_bytes);
+	// returns false if there is no request
+	bool poll_request(std::shared_ptr<ServerRequest>& request);
+	// blocks until a request is received, returns false if the server stopped
+	bool wait_request(std::shared_ptr<ServerRequest>& request);
+
+	ServerStats get_stats() const;
+	void reset_stats();
 
 private:
-	void server_thread_routine();
+	struct Connection
+	{
+		Socket sock;
+		Address addr;
+		Port port;
+		bool is_framed = false; // persistent connection
+		std::vector<uint8_t> in_buffer; // received bytes not parsed yet
+		size_t in_offset = 0;
+		std::vector<uint8_t> out_buffer; // bytes not sent yet
+		size_t out_offset = 0;
+		std::shared_ptr<ServerRequest> request; // request waiting for its response
+		uint32_t request_id = 0;
+		bool read_closed = false; // the client won't send more
+		bool is_done = false; // single request connection responded, waits for the client to close
+		std::chrono::steady_clock::time_point last_activity; // last bytes received or sent
+		std::chrono::steady_clock::time_point request_start; // first byte of the request being received
+	};
+
+	void io_thread_routine();
+	void accept_connections();
+	// returns false if the connection failed
+	bool receive(Connection& connection);
+	bool send(Connection& connection);
+	// sends the parts of the request that are ready, then starts the next received request
+	bool update_connection(Connection& connection, bool stopping);
+	// returns false if the request is malformed
+	bool parse_request(Connection& connection);
+	// returns false if the connection timed out
+	bool check_timeouts(const Connection& connection, std::chrono::steady_clock::time_point now) const;
+	void close_connection(Connection& connection);
+	void wake();
+	void record_response(const ServerRequest& request);
 
 private:
 	Socket m_sock;
-	std::thread m_server_thread;
-	bool m_is_running = false;
-	Semaphore m_response_semaphore;
-	bool m_got_request = false;
-	Address m_request_addr = {0, 0, 0, 0}; Port m_request_port = 0;
-	std::vector<uint8_t> m_request_bytes;
-	std::vector<uint8_t> m_response_bytes;
+	Socket m_wake_sock; // loopback datagram socket connected to itself, wakes the polling thread
+	std::atomic<bool> m_wake_pending{ false };
+	std::thread m_io_thread;
+	std::atomic<bool> m_is_running{ false };
+	std::atomic<bool> m_stop_requested{ false };
+	ServerTimeouts m_timeouts;
+	JobQueue<std::shared_ptr<ServerRequest>> m_requests;
+	std::list<Connection> m_connections; // only used by the polling thread
+	std::vector<uint8_t> m_recv_buffer;
+	mutable std::mutex m_stats_mutex;
+	uint64_t m_responded_count = 0;
+	double m_total_latency = 0;
+	double m_last_latency = 0;
+	double m_max_latency = 0;
+	std::map<uint32_t, LatencyHistogram> m_type_latency;
+	std::chrono::steady_clock::time_point m_rate_start;
+	uint64_t m_rate_count = 0;
+	double m_requests_per_second = 0;
+	std::atomic<size_t> m_connections_count{ 0 };
+	std::atomic<uint64_t> m_accepted_connections{ 0 };
+	std::atomic<uint64_t> m_timed_out_connections{ 0 };
+	std::atomic<uint64_t> m_bytes_received{ 0 };
+	std::atomic<uint64_t> m_bytes_sent{ 0 };
 
 };
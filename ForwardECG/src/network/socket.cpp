@@ -185,6 +185,28 @@ bool Socket::be_broadcast()
 	return true;
 }
 
+bool Socket::be_no_delay()
+{
+	if (m_type != Type::Stream)
+	{
+		return false;
+	}
+
+	int no_delay = 1;
+	if (setsockopt(m_sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay)) == -1)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+bool Socket::be_non_blocking()
+{
+	return set_non_blocking_impl(m_sock);
+}
+
 
 bool Socket::connect(const Address& address, const Port port)
 {
@@ -270,7 +292,7 @@ int Socket::recv_large(char* buff, int len)
 int Socket::send(const char* buff, int len)
 {
 	int sent;
-	if ((sent = ::send(m_sock, (const char*)buff, len, 0)) == -1)
+	if ((sent = ::send(m_sock, (const char*)buff, len, MSG_NOSIGNAL)) == -1)
 	{
 		return -1;
 	}
@@ -279,13 +301,20 @@ int Socket::send(const char* buff, int len)
 	return sent;
 }
 
-void Socket::send_all(const char* buff, int len)
+bool Socket::send_all(const char* buff, int len)
 {
 	int sent = 0;
 	while (sent < len)
 	{
-		sent += send((buff + sent), len - sent);
+		int sent_now = send((buff + sent), len - sent);
+		if (sent_now <= 0)
+		{
+			return false;
+		}
+		sent += sent_now;
 	}
+
+	return true;
 }
 
 
@@ -303,13 +332,55 @@ void Socket::get_peer(Address& peer_addr, Port& peer_port) const
 	create_address_from_sockaddr(peer_addr, peer_port, (const sockaddr_storage*)&peer_sockaddr);
 }
 
-int Socket::get_total_recv() const
+bool Socket::get_local(Address& local_addr, Port& local_port) const
+{
+	sockaddr_storage local_sockaddr;
+	socklen_t local_sockaddr_len = sizeof(local_sockaddr);
+	if (::getsockname(m_sock, (sockaddr*)&local_sockaddr, &local_sockaddr_len) == -1)
+	{
+		return false;
+	}
+
+	create_address_from_sockaddr(local_addr, local_port, &local_sockaddr);
+	return true;
+}
+
+uint64_t Socket::get_total_recv() const
 {
 	return m_stats.recv;
 }
 
-int Socket::get_total_sent() const
+uint64_t Socket::get_total_sent() const
 {
 	return m_stats.sent;
 }
 
+bool Socket::would_block()
+{
+	return would_block_impl();
+}
+
+
+// Poll
+
+int poll_sockets(SocketPoll* polls, int count, int timeout)
+{
+	std::vector<pollfd> fds(count);
+	for (int i = 0; i < count; i++)
+	{
+		fds[i].fd = polls[i].sock->m_sock;
+		fds[i].events = (polls[i].read ? POLLIN : 0) | (polls[i].write ? POLLOUT : 0);
+		fds[i].revents = 0;
+	}
+
+	int result = poll_impl(count ? &fds[0] : NULL, count, timeout);
+	for (int i = 0; i < count; i++)
+	{
+		polls[i].readable = (fds[i].revents & POLLIN) != 0;
+		polls[i].writable = (fds[i].revents & POLLOUT) != 0;
+		polls[i].error = (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+	}
+
+	return result;
+}
+
@@ -5,6 +5,7 @@
 
 
 struct sockaddr_storage;
+struct SocketPoll;
 
 
 typedef uint16_t Port;
@@ -59,6 +60,10 @@ public:
 	bool shutdown(How how);
 	bool close();
 	bool be_broadcast();
+	// disable Nagle's algorithm (small messages are sent immediately)
+	bool be_no_delay();
+	// operations that would block fail instead (see would_block)
+	bool be_non_blocking();
 
 	bool connect(const Address& address, const Port port);
 	bool bind(const Address& address, const Port port);
@@ -68,19 +73,43 @@ public:
 	int recv(char* buff, int len);
 	int recv_large(char* buff, int len);
 	int send(const char* buff, int len);
-	void send_all(const char* buff, int len);
+	// returns false if the connection failed before sending everything
+	bool send_all(const char* buff, int len);
 
 	void get_peer(Address& connected_addr, Port& connected_port) const;
-	int get_total_recv() const;
-	int get_total_sent() const;
+	bool get_local(Address& local_addr, Port& local_port) const;
+	uint64_t get_total_recv() const;
+	uint64_t get_total_sent() const;
+
+	// the last operation failed only because the socket is non-blocking
+	static bool would_block();
 
 private:
+	friend int poll_sockets(SocketPoll* polls, int count, int timeout);
+
 	int m_sock = -1;
 	Type m_type = Type::Stream;
 	struct Stats
 	{
-		int recv;
-		int sent;
+		uint64_t recv;
+		uint64_t sent;
 	} m_stats = { 0, 0 };
 };
 
+
+// Poll
+
+struct SocketPoll
+{
+	Socket* sock = NULL;
+	bool read = false; // wait for data, a connection to accept or the connection close
+	bool write = false; // wait for room to send
+	bool readable = false;
+	bool writable = false;
+	bool error = false; // the connection failed or closed
+};
+
+// blocks until any of the sockets is ready or timeout milliseconds passed (-1 waits forever),
+// returns the count of ready sockets, or -1 if polling failed
+int poll_sockets(SocketPoll* polls, int count, int timeout);
+
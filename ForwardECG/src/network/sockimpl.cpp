@@ -39,6 +39,22 @@ int socket_impl(int af, int type, int protocol)
 	return socket(af, type, protocol);
 }
 
+int poll_impl(pollfd* fds, size_t count, int timeout)
+{
+	return WSAPoll(fds, (ULONG)count, timeout);
+}
+
+bool set_non_blocking_impl(int sock)
+{
+	u_long non_blocking = 1;
+	return ioctlsocket(sock, FIONBIO, &non_blocking) == 0;
+}
+
+bool would_block_impl()
+{
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+
 
 #else
 
@@ -46,12 +62,15 @@ int socket_impl(int af, int type, int protocol)
 // UNIX
 ////////////////////
 
+#include <fcntl.h>
+#include <errno.h>
+
 bool initialize_sockets_api()
 {
 	return true;
 }
 
-int close_impl_impl(int sock)
+int close_impl(int sock)
 {
 	return close(sock);
 }
@@ -66,6 +85,22 @@ int socket_impl(int af, int type, int protocol)
 	return socket(af, type, protocol);
 }
 
+int poll_impl(pollfd* fds, size_t count, int timeout)
+{
+	return poll(fds, count, timeout);
+}
+
+bool set_non_blocking_impl(int sock)
+{
+	int flags = fcntl(sock, F_GETFL, 0);
+	return flags != -1 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+bool would_block_impl()
+{
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
 #endif
 
 
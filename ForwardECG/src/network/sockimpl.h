@@ -14,6 +14,9 @@
 #define SHUT_WR SD_SEND
 #define SHUT_RDWR SD_BOTH
 
+// there is no SIGPIPE on windows
+#define MSG_NOSIGNAL 0
+
 typedef int socklen_t;
 
 #else
@@ -23,8 +26,26 @@ typedef int socklen_t;
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+
+// winsock provides these, define them for UNIX
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+inline uint64_t htonll(uint64_t val) { return __builtin_bswap64(val); }
+inline uint64_t ntohll(uint64_t val) { return __builtin_bswap64(val); }
+#else
+inline uint64_t htonll(uint64_t val) { return val; }
+inline uint64_t ntohll(uint64_t val) { return val; }
+#endif
+
+inline uint32_t htonf(float val) { uint32_t bits; memcpy(&bits, &val, sizeof(bits)); return htonl(bits); }
+inline float ntohf(uint32_t val) { uint32_t bits = ntohl(val); float res; memcpy(&res, &bits, sizeof(res)); return res; }
+inline uint64_t htond(double val) { uint64_t bits; memcpy(&bits, &val, sizeof(bits)); return htonll(bits); }
+inline double ntohd(uint64_t val) { uint64_t bits = ntohll(val); double res; memcpy(&res, &bits, sizeof(res)); return res; }
 
 #endif
 
@@ -35,3 +56,7 @@ int close_impl(int sock);
 
 int getaddrinfo_impl(const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res);
 int socket_impl(int af, int type, int protocol);
+int poll_impl(pollfd* fds, size_t count, int timeout);
+bool set_non_blocking_impl(int sock);
+// the last socket operation failed because it would have blocked
+bool would_block_impl();
@@ -291,9 +291,9 @@ glUniformBuffer* glGraphicsDevice::createUniformBuffer(unsigned int size, Usage
 	return glUniformBuffer::create(size, usage, data);
 }
 
-glVertexLayout* glGraphicsDevice::createVertexLayout(const VertexLayoutElementList& element_list)
+glVertexLayout* glGraphicsDevice::createVertexLayout(const VertexLayoutElementList& element_list, unsigned first_location)
 {
-	return glVertexLayout::create(element_list);
+	return glVertexLayout::create(element_list, first_location);
 }
 
 glFrameBuffer* glGraphicsDevice::createFramebuffer(const std::vector<glTexture*>& color_tex, glTexture* depth_tex)
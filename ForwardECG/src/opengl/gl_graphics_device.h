@@ -56,7 +56,7 @@ public:
 	glVertexBuffer* createVertexBuffer(unsigned int size, Usage usage, const void* data = nullptr);
 	glIndexBuffer* createIndexBuffer(unsigned int size, Usage usage, const void* data = nullptr);
 	glUniformBuffer* createUniformBuffer(unsigned int size, Usage usage, const void* data = nullptr);
-	glVertexLayout* createVertexLayout(const VertexLayoutElementList& element_list);
+	glVertexLayout* createVertexLayout(const VertexLayoutElementList& element_list, unsigned first_location = 0);
 	glFrameBuffer* createFramebuffer(const std::vector<glTexture*>& color_tex, glTexture* depth_tex);
 
 private:
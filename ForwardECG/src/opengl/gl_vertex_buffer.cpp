@@ -18,6 +18,7 @@ glVertexBuffer* glVertexBuffer::create(unsigned int size, Usage usage, const voi
 {
 	glVertexBuffer* created = new glVertexBuffer();
 	created->m_size = size;
+	created->m_usage = usage;
 
 	glGenBuffers(1, &created->m_id);
 	glBindBuffer(GL_ARRAY_BUFFER, created->m_id);
@@ -41,6 +42,14 @@ void glVertexBuffer::update(unsigned offset, unsigned size, const void* data)
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
+void glVertexBuffer::replace(const void* data)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, m_id);
+	glBufferData(GL_ARRAY_BUFFER, m_size, NULL, usage_to_glenum(m_usage));
+	glBufferSubData(GL_ARRAY_BUFFER, 0, m_size, data);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 void glVertexBuffer::bind()
 {
 	glBindBuffer(GL_ARRAY_BUFFER, m_id);
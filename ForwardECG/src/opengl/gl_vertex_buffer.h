@@ -10,6 +10,8 @@ public:
 	~glVertexBuffer();
 
 	void update(unsigned offset, unsigned size, const void* data);
+	// replaces the whole buffer with new storage (orphaning), the draws still using the old storage don't stall the upload
+	void replace(const void* data);
 
 	void bind();
 	void unbind();
@@ -17,4 +19,5 @@ public:
 private:
 	GLuint m_id;
 	unsigned m_size;
+	Usage m_usage;
 };
@@ -46,11 +46,12 @@ static GLenum type_to_count(VertexLayoutElement::Type type)
 	return 0;
 }
 
-glVertexLayout* glVertexLayout::create(const VertexLayoutElementList& element_list)
+glVertexLayout* glVertexLayout::create(const VertexLayoutElementList& element_list, unsigned first_location)
 {
 	glVertexLayout* created = new glVertexLayout();
 
 	created->m_element_list = element_list;
+	created->m_first_location = first_location;
 	created->m_size = 0;
 	for (const VertexLayoutElement& element : element_list)
 		created->m_size += type_size(element.type);
@@ -66,7 +67,7 @@ glVertexLayout::~glVertexLayout()
 void glVertexLayout::bind()
 {
 	unsigned offset = 0;
-	unsigned location = 0;
+	unsigned location = m_first_location;
 	for (const VertexLayoutElement& element : m_element_list)
 	{
 		glVertexAttribPointer(location, type_to_count(element.type), type_to_glenum(element.type), GL_TRUE, m_size, (const void*)offset);
@@ -5,7 +5,8 @@
 class glVertexLayout
 {
 public:
-	static glVertexLayout* create(const VertexLayoutElementList& element_list);
+	// first_location: attribute location of the first element, to read other attributes from another buffer
+	static glVertexLayout* create(const VertexLayoutElementList& element_list, unsigned first_location = 0);
 
 	~glVertexLayout();
 
@@ -15,4 +16,5 @@ public:
 private:
 	VertexLayoutElementList m_element_list;
 	unsigned m_size;
+	unsigned m_first_location;
 };
@@ -0,0 +1,70 @@
+#include "parallel.h"
+#include <thread>
+#include <atomic>
+#include <vector>
+
+
+int get_parallel_threads_count()
+{
+	int threads_count = std::thread::hardware_concurrency();
+	return (threads_count > 0) ? threads_count : 1;
+}
+
+void parallel_for(int count, int block_size, const std::function<void(int begin, int end)>& func)
+{
+	parallel_for(count, block_size, 0, func);
+}
+
+void parallel_for(int count, int block_size, int threads_count, const std::function<void(int begin, int end)>& func)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+	if (block_size < 1)
+	{
+		block_size = 1;
+	}
+
+	const int blocks_count = (count + block_size - 1)/block_size;
+	if (threads_count <= 0 || threads_count > get_parallel_threads_count())
+	{
+		threads_count = get_parallel_threads_count();
+	}
+	if (threads_count > blocks_count)
+	{
+		threads_count = blocks_count;
+	}
+
+	// blocks are picked dynamically to balance uneven workloads
+	std::atomic<int> next_block(0);
+	auto worker = [&]()
+	{
+		while (true)
+		{
+			const int block = next_block++;
+			if (block >= blocks_count)
+			{
+				break;
+			}
+
+			const int begin = block*block_size;
+			const int end = (begin + block_size < count) ? begin + block_size : count;
+			func(begin, end);
+		}
+	};
+
+	// the calling thread works as one of the threads
+	std::vector<std::thread> threads;
+	threads.reserve(threads_count-1);
+	for (int i = 0; i < threads_count-1; i++)
+	{
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
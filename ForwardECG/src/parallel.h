@@ -0,0 +1,14 @@
+#pragma once
+#include <functional>
+
+
+// returns the number of threads used by parallel_for
+int get_parallel_threads_count();
+
+// splits the range [0 : count) into blocks of block_size and calls func(begin, end)
+// for each block across all the available threads, blocks are picked in increasing order
+void parallel_for(int count, int block_size, const std::function<void(int begin, int end)>& func);
+// same as parallel_for on at most threads_count threads (1 = only the calling thread, 0 = all the available threads),
+// for callers that already run on one of many threads (e.g. server workers)
+void parallel_for(int count, int block_size, int threads_count, const std::function<void(int begin, int end)>& func);
+
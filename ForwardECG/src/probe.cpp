@@ -1,13 +1,15 @@
 #include "probe.h"
+#include <stdio.h>
+#include <string.h>
 #include "geometry.h"
 
 
-Real evaluate_probe(const MeshPlot& mesh, const Probe& probe)
+bool get_probe_weights(const MeshPlot& mesh, const Probe& probe, int vertices_idx[3], Real weights[3])
 {
 	// check that tringle index exists
 	if (probe.triangle_idx >= mesh.faces.size())
 	{
-		return 0;
+		return false;
 	}
 
 	const MeshPlotFace& face = mesh.faces[probe.triangle_idx];
@@ -15,23 +17,127 @@ Real evaluate_probe(const MeshPlot& mesh, const Probe& probe)
 					 glm2eigen(mesh.vertices[face.idx[1]].pos),
 					 glm2eigen(mesh.vertices[face.idx[2]].pos) };
 
-	if (is_point_in_triangle(tri, probe.point))
+	if (!is_point_in_triangle(tri, probe.point))
+	{
+		return false;
+	}
+
+	Real scaler_a = perpendicular_distance(tri.b, tri.c, probe.point);
+	Real scaler_b = perpendicular_distance(tri.a, tri.c, probe.point);
+	Real scaler_c = perpendicular_distance(tri.a, tri.b, probe.point);
+	Real total = scaler_a+scaler_b+scaler_c;
+	scaler_a /= total;
+	scaler_b /= total;
+	scaler_c /= total;
+
+	vertices_idx[0] = face.idx[0];
+	vertices_idx[1] = face.idx[1];
+	vertices_idx[2] = face.idx[2];
+	weights[0] = scaler_a;
+	weights[1] = scaler_b;
+	weights[2] = scaler_c;
+	return true;
+}
+
+Real evaluate_probe(const MeshPlot& mesh, const Probe& probe)
+{
+	int idx[3];
+	Real weights[3];
+	if (get_probe_weights(mesh, probe, idx, weights))
+	{
+		return weights[0]*mesh.vertices[idx[0]].value + weights[1]*mesh.vertices[idx[1]].value + weights[2]*mesh.vertices[idx[2]].value;
+	}
+
+	return 0;
+}
+
+Real evaluate_probe(const MeshPlot& mesh, const Probe& probe, const Eigen::VectorX<Real>& values)
+{
+	int idx[3];
+	Real weights[3];
+	if (get_probe_weights(mesh, probe, idx, weights))
 	{
-		Real scaler_a = perpendicular_distance(tri.b, tri.c, probe.point);
-		Real scaler_b = perpendicular_distance(tri.a, tri.c, probe.point);
-		Real scaler_c = perpendicular_distance(tri.a, tri.b, probe.point);
-		Real total = scaler_a+scaler_b+scaler_c;
-		scaler_a /= total;
-		scaler_b /= total;
-		scaler_c /= total;
-
-		return scaler_a*mesh.vertices[face.idx[0]].value + scaler_b*mesh.vertices[face.idx[1]].value + scaler_c*mesh.vertices[face.idx[2]].value;
+		return weights[0]*values(idx[0]) + weights[1]*values(idx[1]) + weights[2]*values(idx[2]);
 	}
 
 	return 0;
 }
 
 
+void build_probe_sampling_matrix(const MeshPlot& mesh, const std::vector<Probe>& probes, Eigen::SparseMatrix<Real, Eigen::RowMajor>& sampling_matrix)
+{
+	std::vector<Eigen::Triplet<Real>> weights;
+	weights.reserve(probes.size()*3);
+	for (int i = 0; i < probes.size(); i++)
+	{
+		int idx[3];
+		Real w[3];
+		if (get_probe_weights(mesh, probes[i], idx, w))
+		{
+			weights.push_back(Eigen::Triplet<Real>(i, idx[0], w[0]));
+			weights.push_back(Eigen::Triplet<Real>(i, idx[1], w[1]));
+			weights.push_back(Eigen::Triplet<Real>(i, idx[2], w[2]));
+		}
+	}
+
+	sampling_matrix.resize(probes.size(), mesh.vertices.size());
+	sampling_matrix.setFromTriplets(weights.begin(), weights.end());
+}
+
+const Eigen::SparseMatrix<Real, Eigen::RowMajor>& ProbesOperator::get_matrix(const MeshPlot& mesh, const std::vector<Probe>& probes)
+{
+	if (is_valid(mesh, probes))
+	{
+		return m_matrix;
+	}
+
+	build_probe_sampling_matrix(mesh, probes, m_matrix);
+
+	// remember what the matrix was built from
+	m_valid = true;
+	m_version++;
+	m_mesh = &mesh;
+	m_mesh_vertices_count = mesh.vertices.size();
+	m_probes_triangle_idx.resize(probes.size());
+	m_probes_point.resize(probes.size());
+	for (int i = 0; i < probes.size(); i++)
+	{
+		m_probes_triangle_idx[i] = probes[i].triangle_idx;
+		m_probes_point[i] = probes[i].point;
+	}
+
+	return m_matrix;
+}
+
+void ProbesOperator::invalidate()
+{
+	m_valid = false;
+}
+
+int ProbesOperator::get_version() const
+{
+	return m_version;
+}
+
+bool ProbesOperator::is_valid(const MeshPlot& mesh, const std::vector<Probe>& probes) const
+{
+	if (!m_valid || m_mesh != &mesh || m_mesh_vertices_count != mesh.vertices.size() || m_probes_triangle_idx.size() != probes.size())
+	{
+		return false;
+	}
+
+	for (int i = 0; i < probes.size(); i++)
+	{
+		if (m_probes_triangle_idx[i] != probes[i].triangle_idx || m_probes_point[i] != probes[i].point)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
 struct ProbeSerialized
 {
 	int tri;
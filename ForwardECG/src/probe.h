@@ -1,6 +1,9 @@
 #pragma once
 #include "math.h"
+#include <Eigen/Sparse>
 #include "mesh_plot.h"
+#include <string>
+#include <vector>
 
 struct Probe
 {
@@ -10,7 +13,41 @@ struct Probe
 	std::string name;
 };
 
+// barycentric weights of the probe point in its triangle, returns false if the point is outside the triangle
+bool get_probe_weights(const MeshPlot& mesh, const Probe& probe, int vertices_idx[3], Real weights[3]);
+
 Real evaluate_probe(const MeshPlot& mesh, const Probe& probe);
+// evaluates the probe on the given per-vertex values instead of the mesh vertices values
+Real evaluate_probe(const MeshPlot& mesh, const Probe& probe, const Eigen::VectorX<Real>& values);
+
+// probes sampling matrix (PROBES_COUNTxVERTICES_COUNT), row i holds the barycentric weights of probe i,
+// rows of probes outside their triangle are empty (evaluate to 0 like evaluate_probe)
+void build_probe_sampling_matrix(const MeshPlot& mesh, const std::vector<Probe>& probes, Eigen::SparseMatrix<Real, Eigen::RowMajor>& sampling_matrix);
+
+// cached probes sampling matrix, rebuilt only when the probes (triangle or point) or the mesh change
+class ProbesOperator
+{
+public:
+	ProbesOperator() = default;
+	~ProbesOperator() = default;
+
+	const Eigen::SparseMatrix<Real, Eigen::RowMajor>& get_matrix(const MeshPlot& mesh, const std::vector<Probe>& probes);
+	void invalidate();
+	// incremented every time the matrix is rebuilt
+	int get_version() const;
+
+private:
+	bool is_valid(const MeshPlot& mesh, const std::vector<Probe>& probes) const;
+
+private:
+	Eigen::SparseMatrix<Real, Eigen::RowMajor> m_matrix;
+	bool m_valid = false;
+	int m_version = 0;
+	const MeshPlot* m_mesh = nullptr;
+	int m_mesh_vertices_count = 0;
+	std::vector<int> m_probes_triangle_idx;
+	std::vector<Eigen::Vector3<Real>> m_probes_point;
+};
 
 bool import_probes(const std::string& file_name, std::vector<Probe>& probes);
 bool export_probes(const std::string& file_name, const std::vector<Probe>& probes);
@@ -0,0 +1,724 @@
+#include "transfer_matrix.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <algorithm>
+#include "timer.h"
+#include "matrix_io.h"
+
+
+using namespace Eigen;
+
+// rows are split across threads in blocks, and faces are processed in tiles so that
+// a tile of the face table stays in cache while it is applied to all the block rows.
+// each row still visits the faces in increasing order, which keeps the accumulation
+// order (and the result) identical to a plain serial loop.
+static const int ASSEMBLY_ROWS_BLOCK_SIZE = 64;
+static const int ASSEMBLY_FACES_TILE_SIZE = 1024;
+static const int SOLVE_COLUMNS_BLOCK_SIZE = 256;
+
+
+// FNV-1a
+static void hash_bytes(uint64_t& hash, const void* data, size_t size)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
+	}
+}
+
+template<typename T>
+static void hash_value(uint64_t& hash, const T& value)
+{
+	hash_bytes(hash, &value, sizeof(T));
+}
+
+static void hash_mesh(uint64_t& hash, const MeshPlot* mesh)
+{
+	if (!mesh)
+	{
+		hash_value(hash, (uint32_t)0);
+		return;
+	}
+
+	hash_value(hash, (uint32_t)mesh->vertices.size());
+	for (const MeshPlotVertex& vertex : mesh->vertices)
+	{
+		hash_value(hash, vertex.pos.x);
+		hash_value(hash, vertex.pos.y);
+		hash_value(hash, vertex.pos.z);
+		hash_value(hash, vertex.group);
+	}
+	hash_value(hash, (uint32_t)mesh->faces.size());
+	for (const MeshPlotFace& face : mesh->faces)
+	{
+		hash_value(hash, face.idx);
+	}
+}
+
+uint64_t hash_transfer_matrix_inputs(const TransferMatrixInputs& inputs)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	hash_mesh(hash, inputs.torso);
+	hash_mesh(hash, inputs.heart);
+	hash_value(hash, inputs.heart_pos.x());
+	hash_value(hash, inputs.heart_pos.y());
+	hash_value(hash, inputs.heart_pos.z());
+	hash_value(hash, inputs.heart_scale);
+	hash_value(hash, (uint32_t)inputs.heart_invert_group_normal.size());
+	for (bool invert : inputs.heart_invert_group_normal)
+	{
+		hash_value(hash, (uint8_t)invert);
+	}
+	hash_value(hash, inputs.params.torso_conductivity);
+	hash_value(hash, inputs.params.heart_conductivity);
+	hash_value(hash, inputs.params.close_range_threshold);
+	hash_value(hash, inputs.params.r_power);
+	hash_value(hash, (uint8_t)inputs.params.ignore_negative_dot_product);
+	return hash;
+}
+
+
+int BEMFaceTable::size() const
+{
+	return area.size();
+}
+
+// mesh_scale is applied here only, callers that read mesh.vertices see the unscaled mesh
+void build_bem_face_table(const MeshPlot& mesh, const Vector3<Real>& mesh_pos, Real mesh_scale, 
+	const std::vector<bool>& invert_group_normal, BEMFaceTable& table)
+{
+	const int faces_count = mesh.faces.size();
+	table.center_x.resize(faces_count);
+	table.center_y.resize(faces_count);
+	table.center_z.resize(faces_count);
+	table.normal_x.resize(faces_count);
+	table.normal_y.resize(faces_count);
+	table.normal_z.resize(faces_count);
+	table.area.resize(faces_count);
+	table.idx0.resize(faces_count);
+	table.idx1.resize(faces_count);
+	table.idx2.resize(faces_count);
+
+	for (int f = 0; f < faces_count; f++)
+	{
+		const MeshPlotFace& face = mesh.faces[f];
+		Vector3<Real> a = mesh_pos + mesh_scale*glm2eigen(mesh.vertices[face.idx[0]].pos);
+		Vector3<Real> b = mesh_pos + mesh_scale*glm2eigen(mesh.vertices[face.idx[1]].pos);
+		Vector3<Real> c = mesh_pos + mesh_scale*glm2eigen(mesh.vertices[face.idx[2]].pos);
+		Vector3<Real> face_normal = (b-a).cross(c-a).normalized();
+
+		// flip normal
+		if (invert_group_normal.size() > 0)
+		{
+			if (invert_group_normal[mesh.vertices[face.idx[0]].group]
+				|| invert_group_normal[mesh.vertices[face.idx[1]].group]
+				|| invert_group_normal[mesh.vertices[face.idx[2]].group])
+			{
+				face_normal = -face_normal;
+			}
+		}
+
+		Real area = ((b-a).cross(c-a)).norm()/2;
+		Vector3<Real> center = (a+b+c)/3; // triangle center
+
+		table.center_x[f] = center.x();
+		table.center_y[f] = center.y();
+		table.center_z[f] = center.z();
+		table.normal_x[f] = face_normal.x();
+		table.normal_y[f] = face_normal.y();
+		table.normal_z[f] = face_normal.z();
+		table.area[f] = area;
+		table.idx0[f] = face.idx[0];
+		table.idx1[f] = face.idx[1];
+		table.idx2[f] = face.idx[2];
+	}
+}
+
+// adds the faces effect on the observation points to rows of matrix
+// const_val = coefficient*omega, where omega = (r^.n^ * ds)/(r^r_power)
+// if columns is not null, only the marked columns are updated
+static void assemble_bem_rows(const std::vector<Vector3<Real>>& points, const BEMFaceTable& table, Real coefficient, 
+	const TransferMatrixParameters& params, bool use_close_range_threshold, const std::vector<bool>* columns, MatrixX<Real>& matrix)
+{
+	const int faces_count = table.size();
+
+	parallel_for(points.size(), ASSEMBLY_ROWS_BLOCK_SIZE, [&](int rows_begin, int rows_end)
+	{
+		for (int tile_begin = 0; tile_begin < faces_count; tile_begin += ASSEMBLY_FACES_TILE_SIZE)
+		{
+			const int tile_end = (tile_begin + ASSEMBLY_FACES_TILE_SIZE < faces_count) ? tile_begin + ASSEMBLY_FACES_TILE_SIZE : faces_count;
+
+			for (int i = rows_begin; i < rows_end; i++)
+			{
+				const Vector3<Real>& r = points[i];
+
+				for (int f = tile_begin; f < tile_end; f++)
+				{
+					const Vector3<Real> center(table.center_x[f], table.center_y[f], table.center_z[f]);
+					const Vector3<Real> face_normal(table.normal_x[f], table.normal_y[f], table.normal_z[f]);
+					Vector3<Real> r_vec = r-center; // r-c
+					Real solid_angle = r_vec.normalized().dot(face_normal)*table.area[f] / (pow(r_vec.norm(), params.r_power)); // omega = (r^.n^ * ds)/(r*r)
+					Real const_val = coefficient*solid_angle;
+
+					// skip for close region triangles
+					if (use_close_range_threshold && r_vec.norm() < params.close_range_threshold)
+					{
+						continue;
+					}
+
+					// ignore negative dot product
+					if (params.ignore_negative_dot_product && r_vec.dot(face_normal) < 0)
+					{
+						continue;
+					}
+
+					if (!columns)
+					{
+						matrix(i, table.idx0[f]) += const_val/3;
+						matrix(i, table.idx1[f]) += const_val/3;
+						matrix(i, table.idx2[f]) += const_val/3;
+					}
+					else
+					{
+						if ((*columns)[table.idx0[f]]) matrix(i, table.idx0[f]) += const_val/3;
+						if ((*columns)[table.idx1[f]]) matrix(i, table.idx1[f]) += const_val/3;
+						if ((*columns)[table.idx2[f]]) matrix(i, table.idx2[f]) += const_val/3;
+					}
+				}
+			}
+		}
+	});
+}
+
+static std::vector<Vector3<Real>> get_mesh_points(const MeshPlot& mesh)
+{
+	std::vector<Vector3<Real>> points(mesh.vertices.size());
+	for (int i = 0; i < mesh.vertices.size(); i++)
+	{
+		points[i] = glm2eigen(mesh.vertices[i].pos);
+	}
+
+	return points;
+}
+
+void assemble_pbb_matrix(const MeshPlot& torso, const TransferMatrixParameters& params, MatrixX<Real>& PBB)
+{
+	const int N = torso.vertices.size();
+	std::vector<Vector3<Real>> points = get_mesh_points(torso);
+
+	BEMFaceTable table;
+	build_bem_face_table(torso, { 0, 0, 0 }, 1, {}, table);
+
+	PBB = MatrixX<Real>::Zero(N, N);
+	assemble_bem_rows(points, table, 1/(4*PI), params, true, nullptr, PBB);
+
+	for (int i = 0; i < N; i++)
+	{
+		PBB(i, i) = PBB(i, i) + 1;
+	}
+}
+
+void assemble_pbh_matrix(const MeshPlot& torso, const MeshPlot& heart, const Vector3<Real>& heart_pos, Real heart_scale, 
+	const std::vector<bool>& heart_invert_group_normal, const TransferMatrixParameters& params, MatrixX<Real>& PBH)
+{
+	const int N = torso.vertices.size();
+	const int M = heart.vertices.size();
+	std::vector<Vector3<Real>> points = get_mesh_points(torso);
+
+	BEMFaceTable table;
+	build_bem_face_table(heart, heart_pos, heart_scale, heart_invert_group_normal, table);
+
+	PBH = MatrixX<Real>::Zero(N, M);
+	assemble_bem_rows(points, table, -params.heart_conductivity/(4*PI*params.torso_conductivity), params, false, nullptr, PBH);
+}
+
+void assemble_pbh_matrix_columns(const MeshPlot& torso, const MeshPlot& heart, const Vector3<Real>& heart_pos, Real heart_scale, 
+	const std::vector<bool>& heart_invert_group_normal, const TransferMatrixParameters& params, const std::vector<bool>& columns, MatrixX<Real>& PBH)
+{
+	std::vector<Vector3<Real>> points = get_mesh_points(torso);
+
+	BEMFaceTable table;
+	build_bem_face_table(heart, heart_pos, heart_scale, heart_invert_group_normal, table);
+
+	// keep only the faces touching the marked columns (in the same order),
+	// these are all the faces that contribute to the marked columns
+	int kept_count = 0;
+	for (int f = 0; f < table.size(); f++)
+	{
+		if (columns[table.idx0[f]] || columns[table.idx1[f]] || columns[table.idx2[f]])
+		{
+			table.center_x[kept_count] = table.center_x[f];
+			table.center_y[kept_count] = table.center_y[f];
+			table.center_z[kept_count] = table.center_z[f];
+			table.normal_x[kept_count] = table.normal_x[f];
+			table.normal_y[kept_count] = table.normal_y[f];
+			table.normal_z[kept_count] = table.normal_z[f];
+			table.area[kept_count] = table.area[f];
+			table.idx0[kept_count] = table.idx0[f];
+			table.idx1[kept_count] = table.idx1[f];
+			table.idx2[kept_count] = table.idx2[f];
+			kept_count++;
+		}
+	}
+	table.center_x.resize(kept_count);
+	table.center_y.resize(kept_count);
+	table.center_z.resize(kept_count);
+	table.normal_x.resize(kept_count);
+	table.normal_y.resize(kept_count);
+	table.normal_z.resize(kept_count);
+	table.area.resize(kept_count);
+	table.idx0.resize(kept_count);
+	table.idx1.resize(kept_count);
+	table.idx2.resize(kept_count);
+
+	// clear the marked columns
+	for (int j = 0; j < PBH.cols(); j++)
+	{
+		if (columns[j])
+		{
+			PBH.col(j).setZero();
+		}
+	}
+
+	assemble_bem_rows(points, table, -params.heart_conductivity/(4*PI*params.torso_conductivity), params, false, &columns, PBH);
+}
+
+void TransferMatrixSolver::factorize(const MatrixX<Real>& PBB)
+{
+	m_lu.compute(PBB);
+	m_is_factorized = true;
+}
+
+void TransferMatrixSolver::clear()
+{
+	m_lu = PartialPivLU<MatrixX<Real>>();
+	m_is_factorized = false;
+}
+
+bool TransferMatrixSolver::is_factorized() const
+{
+	return m_is_factorized;
+}
+
+void TransferMatrixSolver::solve(const MatrixX<Real>& PBH, MatrixX<Real>& ZBH) const
+{
+	ZBH.resize(PBH.rows(), PBH.cols());
+
+	parallel_for(PBH.cols(), SOLVE_COLUMNS_BLOCK_SIZE, [&](int cols_begin, int cols_end)
+	{
+		ZBH.middleCols(cols_begin, cols_end-cols_begin) = m_lu.solve(PBH.middleCols(cols_begin, cols_end-cols_begin));
+	});
+}
+
+void TransferMatrixSolver::solve_columns(const MatrixX<Real>& PBH, const std::vector<int>& columns, MatrixX<Real>& ZBH) const
+{
+	// gather the columns into a contiguous right hand side
+	MatrixX<Real> rhs(PBH.rows(), columns.size());
+	for (int i = 0; i < columns.size(); i++)
+	{
+		rhs.col(i) = PBH.col(columns[i]);
+	}
+
+	MatrixX<Real> result;
+	solve(rhs, result);
+
+	for (int i = 0; i < columns.size(); i++)
+	{
+		ZBH.col(columns[i]) = result.col(i);
+	}
+}
+
+
+void TransferMatrixPipeline::set_inputs(const TransferMatrixInputs& inputs)
+{
+	m_inputs = inputs;
+}
+
+const TransferMatrixInputs& TransferMatrixPipeline::get_inputs() const
+{
+	return m_inputs;
+}
+
+bool TransferMatrixPipeline::needs_update() const
+{
+	const TransferMatrixInputs& a = m_inputs;
+	const TransferMatrixInputs& b = m_built_inputs;
+
+	// PBB and PBH aren't kept for matrices loaded from the cache, they are only needed to update ZBH
+	return !m_zbh_valid
+		|| a.torso != b.torso
+		|| a.heart != b.heart
+		|| a.heart_pos != b.heart_pos
+		|| a.heart_scale != b.heart_scale
+		|| a.heart_invert_group_normal != b.heart_invert_group_normal
+		|| a.params.torso_conductivity != b.params.torso_conductivity
+		|| a.params.heart_conductivity != b.params.heart_conductivity
+		|| a.params.close_range_threshold != b.params.close_range_threshold
+		|| a.params.r_power != b.params.r_power
+		|| a.params.ignore_negative_dot_product != b.params.ignore_negative_dot_product;
+}
+
+void TransferMatrixPipeline::update(MatrixX<Real>& ZBH, bool store_in_cache)
+{
+	if (!needs_update())
+	{
+		return;
+	}
+
+	const TransferMatrixInputs& in = m_inputs;
+	const TransferMatrixInputs& built = m_built_inputs;
+	if (!in.torso || !in.heart)
+	{
+		return;
+	}
+
+	Timer timer;
+	timer.start();
+
+	// calculated before
+	uint64_t inputs_hash = 0;
+	if (m_cache.is_enabled())
+	{
+		inputs_hash = hash_transfer_matrix_inputs(in);
+		if (m_cache.load(inputs_hash, in.torso->vertices.size(), in.heart->vertices.size(), ZBH))
+		{
+			adopt_transfer_matrix(in);
+
+			printf("Loaded transfer matrix (ZBH) from the cache in: %.3f sec\n", timer.elapsed_seconds());
+			return;
+		}
+	}
+
+	// which blocks are affected
+	const bool rebuild_pbb = !m_pbb_valid
+		|| in.torso != built.torso
+		|| in.params.close_range_threshold != built.params.close_range_threshold
+		|| in.params.r_power != built.params.r_power
+		|| in.params.ignore_negative_dot_product != built.params.ignore_negative_dot_product;
+	const bool rebuild_pbh = !m_pbh_valid
+		|| in.torso != built.torso
+		|| in.heart != built.heart
+		|| in.heart_pos != built.heart_pos
+		|| in.heart_scale != built.heart_scale
+		|| in.heart_invert_group_normal.size() != built.heart_invert_group_normal.size()
+		|| in.params.torso_conductivity != built.params.torso_conductivity
+		|| in.params.heart_conductivity != built.params.heart_conductivity
+		|| in.params.r_power != built.params.r_power
+		|| in.params.ignore_negative_dot_product != built.params.ignore_negative_dot_product;
+
+	// PBB (NxN)
+	if (rebuild_pbb)
+	{
+		MatrixX<Real> PBB;
+		assemble_pbb_matrix(*in.torso, in.params, PBB);
+
+		// print status
+		printf("Calculated PBB matrix in: %.3f sec\n", timer.elapsed_seconds());
+		timer.start();
+
+		// PBB = LU
+		m_solver.factorize(PBB);
+		m_pbb_valid = true;
+
+		// print status
+		printf("Factorized PBB matrix in: %.3f sec\n", timer.elapsed_seconds());
+		timer.start();
+	}
+
+	// PBH (NxM)
+	std::vector<int> changed_columns;
+	if (rebuild_pbh)
+	{
+		assemble_pbh_matrix(*in.torso, *in.heart, in.heart_pos, in.heart_scale, in.heart_invert_group_normal, in.params, m_PBH);
+		m_pbh_valid = true;
+
+		// print status
+		printf("Calculated PBH matrix in: %.3f sec\n", timer.elapsed_seconds());
+		timer.start();
+	}
+	else if (in.heart_invert_group_normal != built.heart_invert_group_normal)
+	{
+		// flipped groups
+		std::vector<bool> changed_groups(in.heart_invert_group_normal.size());
+		for (int g = 0; g < changed_groups.size(); g++)
+		{
+			changed_groups[g] = in.heart_invert_group_normal[g] != built.heart_invert_group_normal[g];
+		}
+
+		// all the vertices of faces that touch a flipped group
+		const MeshPlot& heart = *in.heart;
+		std::vector<bool> columns(heart.vertices.size(), false);
+		for (const MeshPlotFace& face : heart.faces)
+		{
+			if (changed_groups[heart.vertices[face.idx[0]].group]
+				|| changed_groups[heart.vertices[face.idx[1]].group]
+				|| changed_groups[heart.vertices[face.idx[2]].group])
+			{
+				columns[face.idx[0]] = true;
+				columns[face.idx[1]] = true;
+				columns[face.idx[2]] = true;
+			}
+		}
+		for (int j = 0; j < columns.size(); j++)
+		{
+			if (columns[j])
+			{
+				changed_columns.push_back(j);
+			}
+		}
+
+		assemble_pbh_matrix_columns(*in.torso, *in.heart, in.heart_pos, in.heart_scale, in.heart_invert_group_normal, in.params, columns, m_PBH);
+
+		// print status
+		printf("Calculated %d PBH matrix columns in: %.3f sec\n", (int)changed_columns.size(), timer.elapsed_seconds());
+		timer.start();
+	}
+
+	// ZBH = PBB^-1 * PBH
+	const bool partial_solve = !rebuild_pbb && !rebuild_pbh && m_zbh_valid
+		&& ZBH.rows() == m_PBH.rows() && ZBH.cols() == m_PBH.cols();
+	if (partial_solve)
+	{
+		m_solver.solve_columns(m_PBH, changed_columns, ZBH);
+	}
+	else
+	{
+		m_solver.solve(m_PBH, ZBH);
+	}
+	m_zbh_valid = true;
+	m_built_inputs = m_inputs;
+
+	// print status
+	printf("Calculated transfer matrix (ZBH) in: %.3f sec\n", timer.elapsed_seconds());
+	timer.start();
+
+	if (store_in_cache && m_cache.is_enabled() && !m_cache.store(inputs_hash, ZBH))
+	{
+		printf("Failed to store the transfer matrix in the cache \"%s\"\n", m_cache.get_directory().c_str());
+	}
+}
+
+void TransferMatrixPipeline::invalidate()
+{
+	m_pbb_valid = false;
+	m_pbh_valid = false;
+	m_zbh_valid = false;
+	m_solver.clear();
+	m_PBH = MatrixX<Real>();
+}
+
+void TransferMatrixPipeline::adopt_transfer_matrix(const TransferMatrixInputs& inputs)
+{
+	const TransferMatrixInputs& built = m_built_inputs;
+
+	// PBB depends only on the torso and its parameters, its factorization is kept if they didn't change
+	const bool keep_pbb = m_pbb_valid
+		&& inputs.torso == built.torso
+		&& inputs.params.close_range_threshold == built.params.close_range_threshold
+		&& inputs.params.r_power == built.params.r_power
+		&& inputs.params.ignore_negative_dot_product == built.params.ignore_negative_dot_product;
+	if (!keep_pbb)
+	{
+		m_pbb_valid = false;
+		m_solver.clear();
+	}
+
+	// PBH belongs to other inputs, the next update rebuilds it
+	m_pbh_valid = false;
+	m_PBH = MatrixX<Real>();
+
+	m_inputs = inputs;
+	m_built_inputs = inputs;
+	m_zbh_valid = true;
+}
+
+
+TransferMatrixCache& TransferMatrixPipeline::get_cache()
+{
+	return m_cache;
+}
+
+
+// TransferMatrixCache
+
+static bool is_cache_file_name(const std::string& name)
+{
+	static const std::string extension = ".ecgmat";
+	return name.size() > extension.size() && name.compare(name.size()-extension.size(), extension.size(), extension) == 0;
+}
+
+void TransferMatrixCache::set_directory(const std::string& directory)
+{
+	m_directory = directory;
+	if (m_directory != "")
+	{
+		directory_create(m_directory.c_str());
+	}
+	update_stats();
+}
+
+const std::string& TransferMatrixCache::get_directory() const
+{
+	return m_directory;
+}
+
+bool TransferMatrixCache::is_enabled() const
+{
+	return m_directory != "";
+}
+
+void TransferMatrixCache::set_max_size(uint64_t max_size)
+{
+	m_max_size = max_size;
+	evict("");
+	update_stats();
+}
+
+uint64_t TransferMatrixCache::get_max_size() const
+{
+	return m_max_size;
+}
+
+bool TransferMatrixCache::load(uint64_t inputs_hash, int rows, int cols, MatrixX<Real>& ZBH)
+{
+	MatrixFile matrix_file;
+	if (!is_enabled() || !matrix_file.open(get_file_path(inputs_hash)) || matrix_file.get_inputs_hash() != inputs_hash
+		|| matrix_file.get_matrix().rows() != rows || matrix_file.get_matrix().cols() != cols)
+	{
+		m_stats.misses++;
+		return false;
+	}
+
+	ZBH = matrix_file.get_matrix();
+	m_stats.hits++;
+
+	// recently used, evicted last
+	file_touch(get_file_path(inputs_hash).c_str());
+	return true;
+}
+
+bool TransferMatrixCache::store(uint64_t inputs_hash, const MatrixX<Real>& ZBH)
+{
+	if (!is_enabled() || (uint64_t)ZBH.size()*sizeof(Real) > m_max_size)
+	{
+		return false;
+	}
+
+	// written under a temporary name, a partially written file is never picked up
+	std::string file_path = get_file_path(inputs_hash);
+	std::string tmp_file_path = file_path + ".tmp";
+	remove(file_path.c_str());
+	bool result = save_matrix_file(tmp_file_path, ZBH, inputs_hash) && rename(tmp_file_path.c_str(), file_path.c_str()) == 0;
+	if (!result)
+	{
+		remove(tmp_file_path.c_str());
+	}
+
+	// make room for the new matrix
+	evict(file_path.substr(m_directory.size() + 1));
+
+	update_stats();
+	return result;
+}
+
+void TransferMatrixCache::clear()
+{
+	std::vector<DirectoryFile> files;
+	if (list_files(files))
+	{
+		for (const DirectoryFile& file : files)
+		{
+			remove((m_directory + "/" + file.name).c_str());
+		}
+	}
+
+	update_stats();
+}
+
+TransferMatrixCacheStats TransferMatrixCache::get_stats() const
+{
+	return m_stats;
+}
+
+void TransferMatrixCache::reset_stats()
+{
+	m_stats.hits = 0;
+	m_stats.misses = 0;
+}
+
+std::string TransferMatrixCache::get_file_path(uint64_t inputs_hash) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.ecgmat", (unsigned long long)inputs_hash);
+	return m_directory + "/" + name;
+}
+
+bool TransferMatrixCache::list_files(std::vector<DirectoryFile>& files) const
+{
+	files.clear();
+	std::vector<DirectoryFile> all_files;
+	if (!is_enabled() || !directory_list_files(m_directory.c_str(), all_files))
+	{
+		return false;
+	}
+
+	for (const DirectoryFile& file : all_files)
+	{
+		if (is_cache_file_name(file.name))
+		{
+			files.push_back(file);
+		}
+	}
+	return true;
+}
+
+void TransferMatrixCache::evict(const std::string& keep_file_name)
+{
+	std::vector<DirectoryFile> files;
+	if (!list_files(files))
+	{
+		return;
+	}
+
+	uint64_t size = 0;
+	for (const DirectoryFile& file : files)
+	{
+		size += file.size;
+	}
+
+	// least recently used first
+	std::vector<int> order(files.size());
+	for (int i = 0; i < order.size(); i++)
+	{
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&files](int a, int b)
+		{
+			return files[a].modified_time < files[b].modified_time;
+		});
+
+	for (int i = 0; i < order.size() && size > m_max_size; i++)
+	{
+		const DirectoryFile& file = files[order[i]];
+		if (file.name != keep_file_name && remove((m_directory + "/" + file.name).c_str()) == 0)
+		{
+			size -= file.size;
+		}
+	}
+}
+
+void TransferMatrixCache::update_stats()
+{
+	m_stats.files_count = 0;
+	m_stats.size = 0;
+
+	std::vector<DirectoryFile> files;
+	list_files(files);
+	for (const DirectoryFile& file : files)
+	{
+		m_stats.files_count++;
+		m_stats.size += file.size;
+	}
+}
@@ -0,0 +1,173 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <Eigen/Dense>
+#include "math.h"
+#include "mesh_plot.h"
+#include "file_io.h"
+
+
+// BEM transfer matrix parameters
+struct TransferMatrixParameters
+{
+	Real torso_conductivity = 1;
+	Real heart_conductivity = 1;
+	Real close_range_threshold = 0; // torso faces closer than the threshold are skipped (PBB only)
+	Real r_power = 2; // omega = (r^.n^ * ds)/(r^r_power)
+	bool ignore_negative_dot_product = false;
+};
+
+// everything the transfer matrix (ZBH) depends on
+struct TransferMatrixInputs
+{
+	const MeshPlot* torso = nullptr;
+	const MeshPlot* heart = nullptr;
+	Eigen::Vector3<Real> heart_pos = { 0, 0, 0 };
+	Real heart_scale = 1; // scales the heart in the BEM geometry only, the heart mesh itself isn't scaled
+	std::vector<bool> heart_invert_group_normal;
+	TransferMatrixParameters params;
+};
+
+// hash of everything the transfer matrix depends on (mesh geometry, placement and parameters),
+// stored with saved matrices to detect the ones calculated from different inputs
+uint64_t hash_transfer_matrix_inputs(const TransferMatrixInputs& inputs);
+
+// per-face geometry used by the BEM assembly (structure of arrays)
+struct BEMFaceTable
+{
+	std::vector<Real> center_x, center_y, center_z;
+	std::vector<Real> normal_x, normal_y, normal_z;
+	std::vector<Real> area;
+	std::vector<int> idx0, idx1, idx2;
+
+	int size() const;
+};
+
+// builds the face table of a mesh scaled by mesh_scale and placed at mesh_pos,
+// normals of faces touching an inverted group are flipped
+void build_bem_face_table(const MeshPlot& mesh, const Eigen::Vector3<Real>& mesh_pos, Real mesh_scale, 
+	const std::vector<bool>& invert_group_normal, BEMFaceTable& table);
+
+// PBB (NxN): torso faces effect on the torso vertices
+void assemble_pbb_matrix(const MeshPlot& torso, const TransferMatrixParameters& params, Eigen::MatrixX<Real>& PBB);
+
+// PBH (NxM): heart faces effect on the torso vertices
+void assemble_pbh_matrix(const MeshPlot& torso, const MeshPlot& heart, const Eigen::Vector3<Real>& heart_pos, Real heart_scale, 
+	const std::vector<bool>& heart_invert_group_normal, const TransferMatrixParameters& params, Eigen::MatrixX<Real>& PBH);
+
+// rebuilds only the PBH columns marked in columns, the result is identical to assemble_pbh_matrix
+void assemble_pbh_matrix_columns(const MeshPlot& torso, const MeshPlot& heart, const Eigen::Vector3<Real>& heart_pos, Real heart_scale, 
+	const std::vector<bool>& heart_invert_group_normal, const TransferMatrixParameters& params, const std::vector<bool>& columns, Eigen::MatrixX<Real>& PBH);
+
+// solves PBB*ZBH = PBH for ZBH using a factorization of PBB,
+// the factorization is kept so that only PBH has to be rebuilt when the heart changes
+class TransferMatrixSolver
+{
+public:
+	TransferMatrixSolver() = default;
+	~TransferMatrixSolver() = default;
+
+	void factorize(const Eigen::MatrixX<Real>& PBB);
+	void clear();
+	bool is_factorized() const;
+
+	// solves all the right hand sides in column blocks across all the available threads
+	void solve(const Eigen::MatrixX<Real>& PBH, Eigen::MatrixX<Real>& ZBH) const;
+	// solves only the given columns, ZBH must already have the size of PBH
+	void solve_columns(const Eigen::MatrixX<Real>& PBH, const std::vector<int>& columns, Eigen::MatrixX<Real>& ZBH) const;
+
+private:
+	Eigen::PartialPivLU<Eigen::MatrixX<Real>> m_lu;
+	bool m_is_factorized = false;
+};
+
+struct TransferMatrixCacheStats
+{
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	int files_count = 0; // matrices in the cache directory
+	uint64_t size = 0; // bytes
+};
+
+#define TRANSFER_MATRIX_CACHE_DEFAULT_MAX_SIZE (1024ull*1024*1024)
+
+// directory of saved transfer matrices (native matrix files) named by the hash of their inputs,
+// the least recently used matrices are removed when the directory grows over the maximum size
+class TransferMatrixCache
+{
+public:
+	TransferMatrixCache() = default;
+	~TransferMatrixCache() = default;
+
+	// an empty directory disables the cache
+	void set_directory(const std::string& directory);
+	const std::string& get_directory() const;
+	bool is_enabled() const;
+	void set_max_size(uint64_t max_size);
+	uint64_t get_max_size() const;
+
+	// fails if the matrix of the inputs isn't cached (or isn't rows x cols)
+	bool load(uint64_t inputs_hash, int rows, int cols, Eigen::MatrixX<Real>& ZBH);
+	// fails if the matrix is larger than the maximum size
+	bool store(uint64_t inputs_hash, const Eigen::MatrixX<Real>& ZBH);
+	// removes all the cached matrices
+	void clear();
+
+	TransferMatrixCacheStats get_stats() const;
+	void reset_stats();
+
+private:
+	std::string get_file_path(uint64_t inputs_hash) const;
+	// cached matrices in the cache directory
+	bool list_files(std::vector<DirectoryFile>& files) const;
+	// removes the least recently used matrices (but keep_file_name) until the cache fits in the maximum size
+	void evict(const std::string& keep_file_name);
+	// rescans the cache directory
+	void update_stats();
+
+private:
+	std::string m_directory;
+	uint64_t m_max_size = TRANSFER_MATRIX_CACHE_DEFAULT_MAX_SIZE;
+	TransferMatrixCacheStats m_stats;
+};
+
+// keeps the intermediate blocks (PBB factorization, PBH) of the last calculation,
+// and recomputes only the blocks affected by the inputs that changed since then:
+// - torso or PBB parameters changed: PBB is rebuilt and factorized
+// - heart position, scale or conductivities changed: PBH is rebuilt and solved
+// - heart group normals flipped: only the PBH columns of the affected vertices are rebuilt and solved
+// if a cache is enabled, a matrix calculated before from the same inputs is loaded from it instead,
+// and new matrices are stored in it (unless the update asks not to)
+class TransferMatrixPipeline
+{
+public:
+	TransferMatrixPipeline() = default;
+	~TransferMatrixPipeline() = default;
+
+	void set_inputs(const TransferMatrixInputs& inputs);
+	const TransferMatrixInputs& get_inputs() const;
+	bool needs_update() const;
+
+	// brings ZBH up to date with the inputs, ZBH must be the same matrix passed to the previous update,
+	// store_in_cache: false for frequent updates (e.g. while moving the heart) that would fill the cache
+	void update(Eigen::MatrixX<Real>& ZBH, bool store_in_cache = true);
+
+	// drops all the cached blocks
+	void invalidate();
+	// ZBH was replaced outside of the pipeline with a matrix built from inputs (e.g. loaded from a file),
+	// PBH is rebuilt by the next update that needs it, PBB is kept if the torso didn't change
+	void adopt_transfer_matrix(const TransferMatrixInputs& inputs);
+
+	TransferMatrixCache& get_cache();
+
+private:
+	TransferMatrixInputs m_inputs;
+	TransferMatrixInputs m_built_inputs; // inputs used to build the cached blocks
+	bool m_pbb_valid = false;
+	bool m_pbh_valid = false;
+	bool m_zbh_valid = false;
+	TransferMatrixSolver m_solver;
+	Eigen::MatrixX<Real> m_PBH;
+	TransferMatrixCache m_cache;
+};
+
@@ -1,15 +1,102 @@
 #include "wave_propagation_simulation.h"
-#include "imgui/imgui.h"
-#include "imgui/imgui_my_types.h"
 #include "geometry.h"
-#include "renderer3d.h"
-#include "opengl/gl_headers.h"
-#include "GLFW/glfw3.h"
-#include "main_dev.h"
 #include "action_potential.h"
 #include "file_io.h"
-#include "filedialog.h"
 #include "network/serializer.h"
+#include "parallel.h"
+#include <queue>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <algorithm>
+
+// rendering, gui and input handling are in wave_propagation_simulation_gui.cpp
+
+
+// for each vertex, the vertices (including itself) within the manhattan distance max_distance in increasing index order,
+// vertices are hashed into a uniform grid so only the neighbouring cells are checked
+static void find_close_vertices(const MeshPlot& mesh, Real max_distance, std::vector<std::vector<int>>& close_vertices)
+{
+	int vertices_count = mesh.vertices.size();
+	close_vertices.clear();
+	close_vertices.resize(vertices_count);
+	if (vertices_count == 0)
+	{
+		return;
+	}
+
+	// mesh bounds
+	glm::vec3 min_pos = mesh.vertices[0].pos;
+	glm::vec3 max_pos = mesh.vertices[0].pos;
+	for (const MeshPlotVertex& vertex : mesh.vertices)
+	{
+		min_pos = glm::min(min_pos, vertex.pos);
+		max_pos = glm::max(max_pos, vertex.pos);
+	}
+	Real extent = rmax(max_pos.x-min_pos.x, rmax(max_pos.y-min_pos.y, max_pos.z-min_pos.z));
+
+	// cells slightly bigger than max_distance, so close vertices are at most one cell apart,
+	// and not more than 1024 cells across the mesh
+	Real cell_size = rmax(max_distance*1.01, extent/1024);
+	if (cell_size <= 0)
+	{
+		cell_size = 1;
+	}
+	auto vertex_cell = [&](int i, int offset)
+	{
+		return (int64_t)((mesh.vertices[i].pos[offset]-min_pos[offset])/cell_size);
+	};
+	auto cell_key = [](int64_t x, int64_t y, int64_t z)
+	{
+		return (x*2048 + y)*2048 + z;
+	};
+
+	// vertices of each cell in increasing index order
+	std::unordered_map<int64_t, std::vector<int>> cells;
+	for (int i = 0; i < vertices_count; i++)
+	{
+		cells[cell_key(vertex_cell(i, 0), vertex_cell(i, 1), vertex_cell(i, 2))].push_back(i);
+	}
+
+	for (int i = 0; i < vertices_count; i++)
+	{
+		int64_t x = vertex_cell(i, 0);
+		int64_t y = vertex_cell(i, 1);
+		int64_t z = vertex_cell(i, 2);
+		std::vector<int>& result = close_vertices[i];
+
+		// neighbouring cells
+		for (int64_t dx = -1; dx <= 1; dx++)
+		{
+			for (int64_t dy = -1; dy <= 1; dy++)
+			{
+				for (int64_t dz = -1; dz <= 1; dz++)
+				{
+					auto it = cells.find(cell_key(x+dx, y+dy, z+dz));
+					if (it == cells.end())
+					{
+						continue;
+					}
+
+					for (int j : it->second)
+					{
+						Real distance =
+							abs(mesh.vertices[i].pos.x - mesh.vertices[j].pos.x)
+							+ abs(mesh.vertices[i].pos.y - mesh.vertices[j].pos.y)
+							+ abs(mesh.vertices[i].pos.z - mesh.vertices[j].pos.z);
+						if (distance <= max_distance)
+						{
+							result.push_back(j);
+						}
+					}
+				}
+			}
+		}
+
+		// same order as the full search
+		std::sort(result.begin(), result.end());
+	}
+}
 
 
 void WavePropagationSimulation::set_mesh(MeshPlot * mesh, const Eigen::Vector3<Real>& mesh_pos)
@@ -70,7 +157,14 @@ void WavePropagationSimulation::reset()
 		}
 	}
 
-	recalculate_links();
+	// links are rebuilt only if their parameters or the operators changed
+	update_links();
+
+	// all the depolarization times from the initial state
+	if (m_event_driven)
+	{
+		calculate_activation_times();
+	}
 }
 
 int WavePropagationSimulation::get_sample_count()
@@ -88,6 +182,11 @@ Real WavePropagationSimulation::get_dt()
 	return m_dt;
 }
 
+Real WavePropagationSimulation::get_duration()
+{
+	return m_duration;
+}
+
 const VectorX<Real>& WavePropagationSimulation::get_potentials() const
 {
 	return m_potentials;
@@ -110,29 +209,42 @@ void WavePropagationSimulation::simulation_step()
 	m_t = m_dt*m_sample;
 
 	// propagate the depolarization wave
-	for (const VertexLink& link : m_links)
+	if (m_event_driven)
 	{
-		Real distance = glm2eigen(m_mesh->vertices[link.v1_idx].pos - m_mesh->vertices[link.v2_idx].pos).norm();
-		Real link_speed = m_base_speed*link.multiply_speed + link.constant_speed;
-		Real link_lag = distance/link_speed + link.constant_delay;
+		apply_activation_times();
+	}
+	else
+	{
+		update_links_lag();
 
-		if (m_vars[link.v1_idx].is_depolarized && !m_vars[link.v2_idx].is_depolarized)
+		const int* links_v1 = m_links_v1.data();
+		const int* links_v2 = m_links_v2.data();
+		const Real* links_lag = m_links_lag.data();
+		VertexVars* vars = m_vars.data();
+		int links_count = m_links_lag.size();
+		for (int k = 0; k < links_count; k++)
 		{
-			// propagate depolarization to v2
-			if (m_t >= (m_vars[link.v1_idx].depolarization_time + link_lag))
+			VertexVars& v1 = vars[links_v1[k]];
+			VertexVars& v2 = vars[links_v2[k]];
+
+			if (v1.is_depolarized && !v2.is_depolarized)
 			{
-				m_vars[link.v2_idx].is_depolarized = true;
-				m_vars[link.v2_idx].depolarization_time = m_vars[link.v1_idx].depolarization_time + link_lag;
+				// propagate depolarization to v2
+				if (m_t >= (v1.depolarization_time + links_lag[k]))
+				{
+					v2.is_depolarized = true;
+					v2.depolarization_time = v1.depolarization_time + links_lag[k];
+				}
 			}
-		}
 
-		if (m_vars[link.v2_idx].is_depolarized && !m_vars[link.v1_idx].is_depolarized)
-		{
-			// propagate depolarization to v1
-			if (m_t >= (m_vars[link.v2_idx].depolarization_time + link_lag))
+			if (v2.is_depolarized && !v1.is_depolarized)
 			{
-				m_vars[link.v1_idx].is_depolarized = true;
-				m_vars[link.v1_idx].depolarization_time = m_vars[link.v2_idx].depolarization_time + link_lag;
+				// propagate depolarization to v1
+				if (m_t >= (v2.depolarization_time + links_lag[k]))
+				{
+					v1.is_depolarized = true;
+					v1.depolarization_time = v2.depolarization_time + links_lag[k];
+				}
 			}
 		}
 	}
@@ -140,282 +252,82 @@ void WavePropagationSimulation::simulation_step()
 	// update potentials
 	for (int i = 0; i < m_mesh->vertices.size(); i++)
 	{
-		ActionPotentialParameters vertex_action_potential_param = { ACTION_POTENTIAL_RESTING_POTENTIAL, ACTION_POTENTIAL_PEAK_POTENTIAL, m_vars[i].depolarization_time, m_vars[i].depolarization_time+m_params[i].deplorized_duration };
-
-		if (m_vars[i].is_depolarized && m_t > m_vars[i].depolarization_time)
-		{
-			// select from different extracellular potential shapes
-			switch (m_selected_extracellular_potential_curve)
-			{
-			case 0:
-				m_potentials(i) = action_potential_value(m_t, vertex_action_potential_param);
-				break;
-			case 1:
-				m_potentials(i) = action_potential_value_2(m_t, vertex_action_potential_param, m_depolarization_slope_duration, m_repolarization_slope_duration);
-				break;
-			case 2:
-				m_potentials(i) = action_potential_value_with_hyperdepolarizaton(m_t, vertex_action_potential_param, m_depolarization_slope_duration, m_repolarization_slope_duration);
-				break;
-			case 3:
-				m_potentials(i) = action_potential_value_with_hyperdepolarizaton_new(m_t, vertex_action_potential_param, m_depolarization_slope_duration, m_repolarization_slope_duration);
-				break;
-			default:
-				m_potentials(i) = ACTION_POTENTIAL_RESTING_POTENTIAL;
-				break;
-			}
-
-			// apply the amplitude multiplier
-			m_potentials(i) = ACTION_POTENTIAL_RESTING_POTENTIAL + m_params[i].amplitude_multiplier*(m_potentials(i)-ACTION_POTENTIAL_RESTING_POTENTIAL);
-		}
-		else
-		{
-			m_potentials(i) = ACTION_POTENTIAL_RESTING_POTENTIAL;
-		}
+		m_potentials(i) = calculate_vertex_potential(i, m_vars[i].is_depolarized, m_vars[i].depolarization_time, m_t);
 	}
 
 }
 
-void WavePropagationSimulation::render()
+void WavePropagationSimulation::calculate_potentials_samples(int sample_count, MatrixX<Real>& potentials_samples)
 {
-	// reset m_mesh_in_preview
-	m_mesh_in_preview = false;
+	potentials_samples.resize(m_mesh->vertices.size(), sample_count);
 
-	// operators render
-	for (int i = 0; i < m_operators.size(); i++)
-	{
-		if (m_operators_render[i] || i == m_selected_operator)
-		{
-			m_operators[i]->render();
-		}
-	}
-}
-
-void WavePropagationSimulation::render_gui()
-{
-	ImGui::Text("Time: %.4f s, Sample: %d", m_t, m_sample);
-	ImGui::InputReal("Wave Simulation Duration", &m_duration);
-	ImGui::InputReal("Time Simulation Step", &m_dt, 0.001, 0.01, "%.5f");
-	m_dt = clamp_value<Real>(m_dt, 0.000001, 5);
-
-	ImGui::InputReal("Wave Propagation Speed", &m_base_speed);
-	ImGui::InputReal("Wave Depolarization Duration", &m_depolarization_duration);
-	ImGui::InputReal("Depolarization Slope Duration", &m_depolarization_slope_duration);
-	ImGui::InputReal("Repolarization Slope Duration", &m_repolarization_slope_duration);
-	// connect close vertices from different groups
-	ImGui::InputReal("Close Vertices Threshold", &m_close_vertices_threshold);
-	// heart groups opacity
-	if (ImGui::BeginTable("Mesh Groups Speed", m_mesh_groups_speed.size(), ImGuiTableFlags_Resizable | ImGuiTableFlags_NoSavedSettings | ImGuiTableFlags_Borders))
-	{
-		for (int i = 0; i < m_mesh_groups_speed.size(); i++)
-		{
-			ImGui::TableNextRow();
-			ImGui::TableNextColumn();
-			ImGui::Text("Group(%d)", i);
-			ImGui::TableNextColumn();
-			ImGui::InputReal((std::string("Speed_") + std::to_string(i)).c_str(), &m_mesh_groups_speed[i], 0, 1);
-		}
-		ImGui::EndTable();
-	}
-	ImGui::Checkbox("Connect Close Vertices From Different Groups", &m_connect_close_vertices_from_different_groups);
-	ImGui::Checkbox("Connect Close Vertices From The Same Groups", &m_connect_close_vertices_from_same_group);
-	if (ImGui::Button("Recalculate Links"))
-	{
-		recalculate_links();
-	}
-	if (ImGui::Button("Reset Wave"))
+	if (!m_event_driven)
 	{
-		reset();
-	}
-	
-	// extracellular potential select
-	const char* im_extracellular_potential_curve_items[] = { 
-		"TMP Potential 1 (OLD)", 
-		"TMP Potential 2", 
-		"TMP Potential Over Depolarization",
-		"TMP Potential Over Depolarization (NEW)",
-	};
-	ImGui::Combo("TMP Potential Curve", &m_selected_extracellular_potential_curve, im_extracellular_potential_curve_items, IM_ARRAYSIZE(im_extracellular_potential_curve_items));
-	static Real preview_dep_time = 0.2;
-	static Real preview_rep_time = 0.7;
-	ImGui::InputReal("Preview Depolarization Time", &preview_dep_time);
-	ImGui::InputReal("Preview Repolarization Time", &preview_rep_time);
-	static std::vector<float> im_extracellular_potential_curve_preview;
-	im_extracellular_potential_curve_preview.resize(250);
-	ActionPotentialParameters preview_parameters = { ACTION_POTENTIAL_RESTING_POTENTIAL, ACTION_POTENTIAL_PEAK_POTENTIAL, preview_dep_time, preview_rep_time };
-	for (int i = 0; i < im_extracellular_potential_curve_preview.size(); i++)
-	{
-		float t = (float)i/(float)im_extracellular_potential_curve_preview.size();
-		switch(m_selected_extracellular_potential_curve)
+		// every step depends on the previous one
+		for (int sample = 0; sample < sample_count; sample++)
 		{
-		case 0:
-			im_extracellular_potential_curve_preview[i] = action_potential_value(t, preview_parameters);
-			break;
-		case 1:
-			im_extracellular_potential_curve_preview[i] = action_potential_value_2(t, preview_parameters, m_depolarization_slope_duration, m_repolarization_slope_duration);
-			break;
-		case 2:
-			im_extracellular_potential_curve_preview[i] = action_potential_value_with_hyperdepolarizaton(t, preview_parameters, m_depolarization_slope_duration, m_repolarization_slope_duration);
-			break;
-		case 3:
-			im_extracellular_potential_curve_preview[i] = action_potential_value_with_hyperdepolarizaton_new(t, preview_parameters, m_depolarization_slope_duration, m_repolarization_slope_duration);
-			break;
-		default:
-			im_extracellular_potential_curve_preview[i] = 0;
-			break;
+			if (sample == 0)
+			{
+				reset();
+			}
+			simulation_step();
+			potentials_samples.col(sample) = m_potentials;
 		}
+		return;
 	}
-	ImGui::PlotLines("Extracellular Potential Curve Plot", &im_extracellular_potential_curve_preview[0], im_extracellular_potential_curve_preview.size(), 0, NULL, FLT_MAX, FLT_MAX, ImVec2(0, 120));
 
-	// resize operators options
-	m_operators_enable.resize(m_operators.size(), true);
-	m_operators_render.resize(m_operators.size(), false);
-
-	// operators list
-	ImGui::Text("Operators");
-	if (ImGui::BeginTable("Operators", 4, ImGuiTableFlags_Resizable | ImGuiTableFlags_NoSavedSettings | ImGuiTableFlags_Borders))
+	// the samples are independent lookups in the activation times
+	reset();
+	m_sample_count = m_duration/m_dt;
+	parallel_for(sample_count, 64, [&](int samples_begin, int samples_end)
 	{
-		ImGui::TableNextRow();
-		ImGui::TableNextColumn();
-		ImGui::Text("Index");
-		ImGui::TableNextColumn();
-		ImGui::Text("Type");
-		ImGui::TableNextColumn();
-		ImGui::Text("Enabled");
-		ImGui::TableNextColumn();
-		ImGui::Text("Render");
-
-		for (int i = 0; i < m_operators.size(); i++)
+		for (int sample = samples_begin; sample < samples_end; sample++)
 		{
-			ImGui::TableNextRow();
-			ImGui::TableNextColumn();
-
-			bool is_selected = i==m_selected_operator;
-			ImGui::Selectable(std::to_string(i).c_str(), &is_selected);
-			if (is_selected)
+			// same time as the (sample+1)th simulation_step after reset
+			Real t = m_dt*((sample+1)%m_sample_count);
+			for (int i = 0; i < m_mesh->vertices.size(); i++)
 			{
-				m_selected_operator = i;
+				bool is_depolarized = m_activation_times[i] != std::numeric_limits<Real>::infinity();
+				potentials_samples(i, sample) = calculate_vertex_potential(i, is_depolarized, m_activation_times[i], t);
 			}
-			
-			// type
-			ImGui::TableNextColumn();
-			ImGui::Text("%s", m_operators[i]->get_type().c_str());
-
-			// is enabled
-			ImGui::TableNextColumn();
-			bool op_enable = m_operators_enable[i];
-			ImGui::Checkbox(("E" + std::to_string(i)).c_str(), &op_enable);
-			m_operators_enable[i] = op_enable;
-
-			// render
-			ImGui::TableNextColumn();
-			bool op_render = m_operators_render[i];
-			ImGui::Checkbox(("R" + std::to_string(i)).c_str(), &op_render);
-			m_operators_render[i] = op_render;
-
 		}
-		ImGui::EndTable();
-	}
+	});
 
-	// selected operator add
-	const char* im_add_operator_type_items[] = { "Plane Cut", "Force Depolarization", "Link Two Groups", "Conduction Path", "Set Params In Plane", "Set Params In Select"};
-	ImGui::Combo("Add Operator Type", &m_selected_operator_add, im_add_operator_type_items, 6);
-	if (ImGui::Button("Add Operator") && m_selected_operator_add != -1)
+	// leave the simulation at the last sample
+	if (sample_count > 0)
 	{
-		switch (m_selected_operator_add)
-		{
-		case 0:
-			m_operators.push_back(std::shared_ptr<WavePropagationPlaneCut>(new WavePropagationPlaneCut(this, m_mesh_pos + Vector3<Real>(0, 0, 0), { -1, 1, 0 })));
-			break;
-		case 1:
-			m_operators.push_back(std::shared_ptr<WavePropagationForceDepolarization>(new WavePropagationForceDepolarization(this)));
-			break;
-		case 2:
-			m_operators.push_back(std::shared_ptr<WavePropagationLinkTwoGroups>(new WavePropagationLinkTwoGroups(this)));
-			break;
-		case 3:
-			m_operators.push_back(std::shared_ptr<WavePropagationConductionPath>(new WavePropagationConductionPath(this)));
-			break;
-		case 4:
-			m_operators.push_back(std::shared_ptr<WavePropagationSetParamsInPlane>(new WavePropagationSetParamsInPlane(this, m_mesh_pos + Vector3<Real>(0, 0, 0), { -1, 1, 0 })));
-			break;
-		case 5:
-			m_operators.push_back(std::shared_ptr<WavePropagationSetParamsInSelect>(new WavePropagationSetParamsInSelect(this)));
-			break;
-		default:
-			break;
-		}
+		m_sample = sample_count%m_sample_count;
+		m_t = m_dt*m_sample;
+		apply_activation_times();
+		m_potentials = potentials_samples.col(sample_count-1);
 	}
+}
 
-	// selected operator remove
-	if (ImGui::Button("Remove Operator"))
-	{
-		if (m_selected_operator != -1 && m_selected_operator < m_operators.size())
-		{
-			m_operators.erase(m_operators.begin() + m_selected_operator);
-		}
-	}
+void WavePropagationSimulation::set_event_driven(bool event_driven)
+{
+	bool changed = event_driven != m_event_driven;
+	m_event_driven = event_driven;
 
-	// Import probes locations
-	if (ImGui::Button("Load Wave Propagation Configuration"))
+	// start over with the new engine
+	if (changed && m_mesh)
 	{
-		// open file dialog
-		std::string file_name = open_file_dialog("", "All\0*.*\0");
-
-		// import
-		if (file_name != "")
-		{
-			if (load_from_file(file_name))
-			{
-				printf("Loaded wave propagation configuration to \"%s\" to file\n", file_name.c_str());
-			}
-			else
-			{
-				printf("Failed to load wave propagation configuration to \"%s\" file\n", file_name.c_str());
-			}
-		}
+		reset();
 	}
-	// Export probes locations
-	if (ImGui::Button("Save Wave Propagation Configuration"))
-	{
-		// save file dialog
-		std::string file_name = save_file_dialog("", "All\0*.*\0");
+}
 
-		// export
-		if (file_name != "")
-		{
-			if (save_to_file(file_name))
-			{
-				printf("Saved wave propagation configuration to \"%s\" to file\n", file_name.c_str());
-			}
-			else
-			{
-				printf("Failed to save wave propagation configuration to \"%s\" file\n", file_name.c_str());
-			}
-		}
-	}
-	
-	// operator controls
-	if (m_selected_operator != -1 && m_selected_operator < m_operators.size())
-	{
-		bool operator_controls = true;
-		ImGui::Begin("Operator Controls", &operator_controls);
-		m_operators[m_selected_operator]->render_gui();
-		ImGui::End();
-		if (!operator_controls)
-		{
-			m_selected_operator = -1;
-		}
-	}
+bool WavePropagationSimulation::is_event_driven() const
+{
+	return m_event_driven;
+}
 
+const std::vector<Real>& WavePropagationSimulation::get_activation_times() const
+{
+	return m_activation_times;
 }
 
-void WavePropagationSimulation::handle_input(const LookAtCamera& camera)
+int WavePropagationSimulation::get_links_count() const
 {
-	// operators handle input
-	if (m_selected_operator != -1 && m_selected_operator < m_operators.size())
-	{
-		m_operators[m_selected_operator]->handle_input(camera);
-	}
+	return m_links.size();
 }
 
 bool WavePropagationSimulation::is_mesh_in_preview()
@@ -446,23 +358,21 @@ void WavePropagationSimulation::recalculate_links()
 	}
 	
 	// connect close vertices
-	for (int i = 0; i < m_mesh->vertices.size(); i++)
+	std::vector<std::vector<int>> close_vertices;
+	if (m_connect_close_vertices_from_different_groups || m_connect_close_vertices_from_same_group)
+	{
+		find_close_vertices(*m_mesh, m_close_vertices_threshold*m_close_vertices_threshold, close_vertices);
+	}
+	for (int i = 0; i < close_vertices.size(); i++)
 	{
-		for (int j = 0; j < m_mesh->vertices.size(); j++)
+		for (int j : close_vertices[i])
 		{
 			// skip if in the same group
 			if ((m_connect_close_vertices_from_different_groups && m_mesh->vertices[i].group != m_mesh->vertices[j].group)
 				|| (m_connect_close_vertices_from_same_group && m_mesh->vertices[i].group == m_mesh->vertices[j].group))
 			{
-				Real distance_square =
-					abs(m_mesh->vertices[i].pos.x - m_mesh->vertices[j].pos.x)
-					+ abs(m_mesh->vertices[i].pos.y - m_mesh->vertices[j].pos.y)
-					+ abs(m_mesh->vertices[i].pos.z - m_mesh->vertices[j].pos.z);
-				if (distance_square <= m_close_vertices_threshold*m_close_vertices_threshold)
-				{
-					Real speed = m_mesh_groups_speed[m_mesh->vertices[i].group];
-					m_links.push_back({ i, j, speed, 0, 0 });
-				}
+				Real speed = m_mesh_groups_speed[m_mesh->vertices[i].group];
+				m_links.push_back({ i, j, speed, 0, 0 });
 			}
 		}
 	}
@@ -475,6 +385,191 @@ void WavePropagationSimulation::recalculate_links()
 			m_operators[i]->apply_links();
 		}
 	}
+
+	m_links_state = get_links_state();
+	m_links_lag_valid = false;
+}
+
+void WavePropagationSimulation::update_links()
+{
+	if (get_links_state() != m_links_state)
+	{
+		recalculate_links();
+	}
+}
+
+void WavePropagationSimulation::update_links_lag()
+{
+	if (m_links_lag_valid && m_links_lag_base_speed == m_base_speed && m_links_lag.size() == m_links.size())
+	{
+		return;
+	}
+
+	m_links_v1.resize(m_links.size());
+	m_links_v2.resize(m_links.size());
+	m_links_lag.resize(m_links.size());
+	for (int k = 0; k < m_links.size(); k++)
+	{
+		const VertexLink& link = m_links[k];
+		Real distance = glm2eigen(m_mesh->vertices[link.v1_idx].pos - m_mesh->vertices[link.v2_idx].pos).norm();
+		Real link_speed = m_base_speed*link.multiply_speed + link.constant_speed;
+
+		m_links_v1[k] = link.v1_idx;
+		m_links_v2[k] = link.v2_idx;
+		m_links_lag[k] = distance/link_speed + link.constant_delay;
+	}
+
+	m_links_lag_valid = true;
+	m_links_lag_base_speed = m_base_speed;
+}
+
+std::vector<uint8_t> WavePropagationSimulation::get_links_state()
+{
+	// everything the links are built from
+	Serializer ser;
+	ser.push_u64((uint64_t)m_mesh);
+	ser.push_u32(m_mesh->vertices.size());
+	ser.push_u32(m_mesh->faces.size());
+	ser.push_double(m_mesh_pos.x());
+	ser.push_double(m_mesh_pos.y());
+	ser.push_double(m_mesh_pos.z());
+	ser.push_double(m_close_vertices_threshold);
+	ser.push_u8(m_connect_close_vertices_from_different_groups);
+	ser.push_u8(m_connect_close_vertices_from_same_group);
+	ser.push_u32(m_mesh_groups_speed.size());
+	for (int i = 0; i < m_mesh_groups_speed.size(); i++)
+	{
+		ser.push_double(m_mesh_groups_speed[i]);
+	}
+
+	// enabled operators
+	ser.push_u32(m_operators.size());
+	for (int i = 0; i < m_operators.size(); i++)
+	{
+		ser.push_u8(m_operators_enable[i]);
+		if (m_operators_enable[i])
+		{
+			ser.push_string(m_operators[i]->get_type());
+			m_operators[i]->serialize(ser);
+		}
+	}
+
+	return ser.get_data();
+}
+
+void WavePropagationSimulation::calculate_activation_times()
+{
+	const Real infinity = std::numeric_limits<Real>::infinity();
+	int vertices_count = m_mesh->vertices.size();
+
+	// links adjacency (both directions) with the link lag as the weight
+	update_links_lag();
+	int links_count = m_links_lag.size();
+	std::vector<int> adjacency_begin(vertices_count+1, 0);
+	for (int k = 0; k < links_count; k++)
+	{
+		adjacency_begin[m_links_v1[k]+1]++;
+		adjacency_begin[m_links_v2[k]+1]++;
+	}
+	for (int i = 0; i < vertices_count; i++)
+	{
+		adjacency_begin[i+1] += adjacency_begin[i];
+	}
+	std::vector<int> adjacency_vertex(adjacency_begin[vertices_count]);
+	std::vector<Real> adjacency_lag(adjacency_begin[vertices_count]);
+	std::vector<int> adjacency_end(adjacency_begin.begin(), adjacency_begin.end()-1);
+	for (int k = 0; k < links_count; k++)
+	{
+		int v1 = m_links_v1[k];
+		int v2 = m_links_v2[k];
+		adjacency_vertex[adjacency_end[v1]] = v2;
+		adjacency_lag[adjacency_end[v1]++] = m_links_lag[k];
+		adjacency_vertex[adjacency_end[v2]] = v1;
+		adjacency_lag[adjacency_end[v2]++] = m_links_lag[k];
+	}
+
+	// dijkstra from the vertices depolarized at reset, their depolarization time is kept
+	typedef std::pair<Real, int> QueueItem; // (depolarization time, vertex index)
+	std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+	std::vector<bool> is_done(vertices_count, false);
+	m_activation_times.assign(vertices_count, infinity);
+	for (int i = 0; i < vertices_count; i++)
+	{
+		if (m_vars[i].is_depolarized)
+		{
+			m_activation_times[i] = m_vars[i].depolarization_time;
+			queue.push({ m_activation_times[i], i });
+		}
+	}
+
+	while (!queue.empty())
+	{
+		QueueItem item = queue.top();
+		queue.pop();
+		int v = item.second;
+		if (is_done[v])
+		{
+			continue;
+		}
+		is_done[v] = true;
+
+		for (int k = adjacency_begin[v]; k < adjacency_begin[v+1]; k++)
+		{
+			int u = adjacency_vertex[k];
+			Real time = m_activation_times[v] + adjacency_lag[k];
+			if (!is_done[u] && !m_vars[u].is_depolarized && time < m_activation_times[u])
+			{
+				m_activation_times[u] = time;
+				queue.push({ time, u });
+			}
+		}
+	}
+}
+
+void WavePropagationSimulation::apply_activation_times()
+{
+	for (int i = 0; i < m_mesh->vertices.size(); i++)
+	{
+		if (!m_vars[i].is_depolarized && m_activation_times[i] <= m_t)
+		{
+			m_vars[i].is_depolarized = true;
+			m_vars[i].depolarization_time = m_activation_times[i];
+		}
+	}
+}
+
+Real WavePropagationSimulation::calculate_vertex_potential(int vertex_idx, bool is_depolarized, Real depolarization_time, Real t) const
+{
+	if (!is_depolarized || t <= depolarization_time)
+	{
+		return ACTION_POTENTIAL_RESTING_POTENTIAL;
+	}
+
+	ActionPotentialParameters vertex_action_potential_param = { ACTION_POTENTIAL_RESTING_POTENTIAL, ACTION_POTENTIAL_PEAK_POTENTIAL, depolarization_time, depolarization_time+m_params[vertex_idx].deplorized_duration };
+
+	// select from different extracellular potential shapes
+	Real potential;
+	switch (m_selected_extracellular_potential_curve)
+	{
+	case 0:
+		potential = action_potential_value(t, vertex_action_potential_param);
+		break;
+	case 1:
+		potential = action_potential_value_2(t, vertex_action_potential_param, m_depolarization_slope_duration, m_repolarization_slope_duration);
+		break;
+	case 2:
+		potential = action_potential_value_with_hyperdepolarizaton(t, vertex_action_potential_param, m_depolarization_slope_duration, m_repolarization_slope_duration);
+		break;
+	case 3:
+		potential = action_potential_value_with_hyperdepolarizaton_new(t, vertex_action_potential_param, m_depolarization_slope_duration, m_repolarization_slope_duration);
+		break;
+	default:
+		potential = ACTION_POTENTIAL_RESTING_POTENTIAL;
+		break;
+	}
+
+	// apply the amplitude multiplier
+	return ACTION_POTENTIAL_RESTING_POTENTIAL + m_params[vertex_idx].amplitude_multiplier*(potential-ACTION_POTENTIAL_RESTING_POTENTIAL);
 }
 
 bool WavePropagationSimulation::load_from_file(const std::string& path)
@@ -552,6 +647,10 @@ bool WavePropagationSimulation::load_from_file(const std::string& path)
 		m_operators.back()->deserialize(des);
 	}
 
+	// resize operators options
+	m_operators_enable.resize(m_operators.size(), true);
+	m_operators_render.resize(m_operators.size(), false);
+
 	return true;
 }
 
@@ -607,18 +706,6 @@ void WavePropagationOperator::apply_links()
 {
 }
 
-void WavePropagationOperator::render()
-{
-}
-
-void WavePropagationOperator::render_gui()
-{
-}
-
-void WavePropagationOperator::handle_input(const LookAtCamera& camera)
-{
-}
-
 std::string WavePropagationOperator::get_type() const
 {
 	return m_type;
@@ -665,24 +752,6 @@ void WavePropagationPlaneCut::apply_links()
 	}
 }
 
-void WavePropagationPlaneCut::render()
-{
-	gdevGet()->depthTest(STATE_ENABLED);
-	Renderer3D::setStyle(Renderer3D::Style(true, 1, { 0.8, 0, 0, 1 }, false, { 0.75, 0, 0 ,1 }));
-	Renderer3D::drawLineList(m_cut_links_lines);
-
-}
-
-void WavePropagationPlaneCut::render_gui()
-{
-	ImGui::DragVector3Eigen("Point", m_point);
-	ImGui::DragVector3Eigen("Normal", m_normal);
-}
-
-void WavePropagationPlaneCut::handle_input(const LookAtCamera & camera)
-{
-}
-
 void WavePropagationPlaneCut::serialize(Serializer & ser)
 {
 	ser.push_double(m_point.x());
@@ -729,50 +798,6 @@ void WavePropagationForceDepolarization::apply_reset()
 	}
 }
 
-void WavePropagationForceDepolarization::render()
-{
-	m_brush.render();
-
-	// update mesh values
-	if (m_view_drawing)
-	{
-		for (int i = 0; i < m_prop_sim->m_mesh->vertices.size(); i++)
-		{
-			m_prop_sim->m_mesh->vertices[i].value = 0*(!m_selected[i]) + 1*m_selected[i];
-		}
-
-		m_prop_sim->m_mesh_in_preview = true;
-		m_prop_sim->m_mesh_in_preview_max = 1;
-		m_prop_sim->m_mesh_in_preview_min = 0;
-	}
-}
-
-void WavePropagationForceDepolarization::render_gui()
-{
-	ImGui::InputReal("Depolarization Time", &m_depolarization_time);
-
-	ImGui::Dummy(ImVec2(0.0f, 20.0f)); // spacer
-	m_brush.render_gui();
-	ImGui::Checkbox("Select", &m_brush_select);
-	ImGui::Checkbox("View Drawing", &m_view_drawing);
-
-}
-
-void WavePropagationForceDepolarization::handle_input(const LookAtCamera & camera)
-{
-	m_selected.resize(m_prop_sim->m_mesh->vertices.size());
-
-	m_brush.handle_input(camera, m_prop_sim->m_mesh, m_prop_sim->m_mesh_pos);
-
-	for (int i = 0; i < m_brush.get_intersected().size(); i++)
-	{
-		if (m_brush.get_intersected()[i])
-		{
-			m_selected[i] = m_brush_select;
-		}
-	}
-}
-
 void WavePropagationForceDepolarization::serialize(Serializer & ser)
 {
 	ser.push_u32(m_selected.size());
@@ -808,161 +833,6 @@ CircularBrush::CircularBrush(bool enable_drawing, Real brush_radius, bool only_v
 	m_mesh_group_selected = 0;
 }
 
-void CircularBrush::render()
-{
-	// render drawing preview
-	if (m_enable_drawing && m_drawing_is_intersected && m_drawing_values_preview.size() >= 2)
-	{
-		gdevGet()->depthTest(STATE_ENABLED);
-		Renderer3D::setStyle(Renderer3D::Style(true, 1, { 1, 1, 1, 1 }, false, { 0.75, 0, 0, 0.2 }));
-		m_drawing_values_preview.push_back(m_drawing_values_preview[0]);
-		Renderer3D::drawPolygon(&m_drawing_values_preview[0], m_drawing_values_preview.size(), false);
-	}
-
-}
-
-void CircularBrush::render_gui()
-{
-	ImGui::Checkbox("Enable Drawing", &m_enable_drawing);
-	ImGui::Checkbox("Draw Only Vertices Facing Camera", &m_only_vertices_facing_camera);
-
-	// mesh select group
-	if (ImGui::ListBoxHeader("Mesh Selected Group", m_mesh_groups_count+1))
-	{
-		// ALL GROUPS
-		if (ImGui::Selectable("ALL GROUPS", -1==m_mesh_group_selected))
-		{
-			m_mesh_group_selected = -1;
-		}
-
-		for (int i = 0; i < m_mesh_groups_count; i++)
-		{
-			std::string name = std::string("Group ") + std::to_string(i);
-			if (ImGui::Selectable(name.c_str(), i==m_mesh_group_selected))
-			{
-				m_mesh_group_selected = i;
-			}
-		}
-		ImGui::ListBoxFooter();
-	}
-
-	Real im_brush_radius = log10(m_brush_radius);
-	ImGui::DragReal("Drawing Brush Radius", &im_brush_radius, 0.01);
-	m_brush_radius = pow(10, im_brush_radius);
-	// HANDLED BY THE CALLER
-	//ImGui::InputReal("drawing value", &drawing_value);
-	//ImGui::Checkbox("view target channel", &drawing_view_target_channel);
-}
-
-void CircularBrush::handle_input(const LookAtCamera & camera, MeshPlot * mesh, const Vector3<Real>& mesh_pos)
-{
-	m_mesh_groups_count = mesh->groups_vertices.size();
-	m_drawing_is_intersected = false;
-	m_intersected.resize(mesh->vertices.size());
-
-	for (int i = 0; i < m_intersected.size(); i++)
-	{
-		m_intersected[i] = false;
-	}
-
-	if (!m_enable_drawing)
-	{
-		return;
-	}
-
-	// drawing
-	
-	// normalized screen coordinates
-	Real x = Input::getCursorXPosNorm();
-	Real y = Input::getCursorYPosNorm();
-
-	// camera axis
-	Vector3<Real> forward = glm2eigen(camera.look_at-camera.eye).normalized();
-	Vector3<Real> up = glm2eigen(camera.up).normalized();
-	Vector3<Real> right = forward.cross(up).normalized();
-	// calculate the pointer direction
-	Vector3<Real> direction = forward + up*tan(0.5*y*camera.fov) + right*tan(0.5*x*camera.aspect*camera.fov);
-	direction = direction.normalized();
-
-	std::vector<Vector3<Real>> origin_points(m_drawing_values_points_count, Vector3<Real>(0, 0, 0));
-
-	// generate origin points
-	for (int i = 0; i < m_drawing_values_points_count; i++)
-	{
-		Real theta = ((Real)i/(Real)m_drawing_values_points_count)*2*PI;
-		origin_points[i] = glm2eigen(camera.eye) + m_brush_radius*sin(theta)*up + m_brush_radius*cos(theta)*right;
-	}
-
-	// intersect preview
-	m_drawing_values_preview.clear();
-	Ray ray = { glm2eigen(camera.eye), direction };
-	// calculate average t
-	Real t_min = 1e3;
-	Real t_average = 0;
-	int intersected_points = 0;
-	for (int i = 0; i < m_drawing_values_points_count; i++)
-	{
-		Real t;
-		int tri_idx;
-		ray.origin = origin_points[i];
-		if (ray_mesh_intersect(*mesh, mesh_pos, ray, t, tri_idx, m_mesh_group_selected))
-		{
-			m_drawing_is_intersected = true;
-			t_average += t;
-			t_min = rmin(t_min, t);
-			intersected_points++;
-		}
-	}
-	t_average /= intersected_points;
-
-	// actual intersection
-	Real t;
-	int tri_idx;
-	for (int i = 0; i < m_drawing_values_points_count; i++)
-	{
-		ray.origin = origin_points[i];
-		if (!ray_mesh_intersect(*mesh, mesh_pos, ray, t, tri_idx, m_mesh_group_selected))
-		{
-			t = t_min; // set t to t_average when no intersection
-		}
-		t = t_min; // set t to t_average when no intersection
-
-		m_drawing_values_preview.push_back(eigen2glm(ray.point_at_dir(t)));
-	}
-
-	// apply drawing value to mesh vertices
-	if (Input::isButtonDown(GLFW_MOUSE_BUTTON_LEFT))
-	{
-		std::vector<int> intersected_values;
-		for (int i = 0; i < mesh->vertices.size(); i++)
-		{
-			// skip current vertex if not in the selected group
-			if (m_mesh_group_selected != -1 && mesh->vertices[i].group != m_mesh_group_selected)
-			{
-				continue;
-			}
-
-			if (perpendicular_distance(glm2eigen(camera.eye), glm2eigen(camera.eye)+direction, mesh_pos+glm2eigen(mesh->vertices[i].pos)) < m_brush_radius)
-			{
-				if (m_only_vertices_facing_camera && glm2eigen(mesh->vertices[i].normal).dot(-forward) > 0)
-				{
-					intersected_values.push_back(i);
-				}
-				else if (!m_only_vertices_facing_camera)
-				{
-					intersected_values.push_back(i);
-				}
-			}
-		}
-
-		// set value
-		for (int i = 0; i < intersected_values.size(); i++)
-		{
-			m_intersected[intersected_values[i]] = true;
-		}
-	}
-}
-
 const std::vector<bool>& CircularBrush::get_intersected() const
 {
 	return m_intersected;
@@ -999,68 +869,6 @@ void WavePropagationLinkTwoGroups::apply_links()
 	}
 }
 
-void WavePropagationLinkTwoGroups::render()
-{
-	m_brush.render();
-
-	// update mesh values
-	if (m_view_drawing)
-	{
-		for (int i = 0; i < m_prop_sim->m_mesh->vertices.size(); i++)
-		{
-			if (m_selected_group == 0)
-			{
-				m_prop_sim->m_mesh->vertices[i].value = 0*(!m_group_a_selected[i]) + 1*m_group_a_selected[i];
-			}
-			else if (m_selected_group == 1)
-			{
-				m_prop_sim->m_mesh->vertices[i].value = 0*(!m_group_b_selected[i]) + 1*m_group_b_selected[i];
-			}
-		}
-
-		m_prop_sim->m_mesh_in_preview = true;
-		m_prop_sim->m_mesh_in_preview_max = 1;
-		m_prop_sim->m_mesh_in_preview_min = 0;
-	}
-}
-
-void WavePropagationLinkTwoGroups::render_gui()
-{
-	ImGui::InputReal("Multiply Speed", &m_multiply_speed);
-	ImGui::InputReal("Constant Speed", &m_constant_speed);
-	ImGui::InputReal("Constant Delay", &m_constant_delay);
-
-	ImGui::Dummy(ImVec2(0.0f, 20.0f)); // spacer
-	const char* group_select_choices[] = {"Group A", "Group B"};
-	ImGui::ListBox("Group Select", &m_selected_group, group_select_choices, 2, 2);
-	m_brush.render_gui();
-	ImGui::Checkbox("Select", &m_brush_select);
-	ImGui::Checkbox("View Drawing", &m_view_drawing);
-}
-
-void WavePropagationLinkTwoGroups::handle_input(const LookAtCamera& camera)
-{
-	m_group_a_selected.resize(m_prop_sim->m_mesh->vertices.size());
-	m_group_b_selected.resize(m_prop_sim->m_mesh->vertices.size());
-
-	m_brush.handle_input(camera, m_prop_sim->m_mesh, m_prop_sim->m_mesh_pos);
-
-	for (int i = 0; i < m_brush.get_intersected().size(); i++)
-	{
-		if (m_brush.get_intersected()[i])
-		{
-			if (m_selected_group == 0)
-			{
-				m_group_a_selected[i] = m_brush_select;
-			}
-			else if (m_selected_group == 1)
-			{
-				m_group_b_selected[i] = m_brush_select;
-			}
-		}
-	}
-}
-
 void WavePropagationLinkTwoGroups::serialize(Serializer & ser)
 {
 	// group A
@@ -1122,146 +930,6 @@ void WavePropagationConductionPath::apply_links()
 	}
 }
 
-void WavePropagationConductionPath::render()
-{
-	// construct line points
-	std::vector<glm::vec3> points_list;
-	points_list.resize(m_points_list.size());
-	for (int i = 0; i < m_points_list.size(); i++)
-	{
-		points_list[i] = eigen2glm(m_prop_sim->m_mesh_pos) + m_prop_sim->m_mesh->vertices[m_points_list[i]].pos;
-	}
-
-	// render line
-	Renderer3D::setStyle(Renderer3D::Style(true, 2, { 0.8, 0, 0, 1 }, false, { 0.75, 0, 0 ,1 }));
-	Renderer3D::drawPolygon(&points_list[0], points_list.size());
-
-	// selected point
-	if (m_selected_point != -1 && m_selected_point < m_points_list.size())
-	{
-		Renderer3D::drawPoint(points_list[m_selected_point], { 0, 0.8, 0, 1 }, 3);
-	}
-
-	// adding point preview
-	if (m_adding_points && m_adding_points_preview_idx != -1 && m_adding_points_preview_idx < m_points_list.size())
-	{
-		Renderer3D::drawPoint(eigen2glm(m_prop_sim->m_mesh_pos) + m_prop_sim->m_mesh->vertices[m_adding_points_preview_idx].pos, { 0, 0, 0.8, 1 }, 3);
-	}
-}
-
-void WavePropagationConductionPath::render_gui()
-{
-	ImGui::InputReal("Multiply Speed", &m_multiply_speed);
-	ImGui::InputReal("Constant Speed", &m_constant_speed);
-	ImGui::InputReal("Constant Delay", &m_constant_delay);
-
-	ImGui::Dummy(ImVec2(0.0f, 20.0f)); // spacer
-	if (ImGui::ListBoxHeader("Points List", { 0, 120 }))
-	{
-		for (int i = 0; i < m_points_list.size(); i++)
-		{
-			bool is_selected = i==m_selected_point;
-			ImGui::Selectable(std::to_string(i).c_str(), &is_selected);
-			if (is_selected)
-			{
-				m_selected_point = i;
-			}
-
-			// value
-			ImGui::SameLine();
-			ImGui::Text(" %d, (%.3f, %.3f, %.3f)", m_points_list[i],
-				(eigen2glm(m_prop_sim->m_mesh_pos) + m_prop_sim->m_mesh->vertices[m_points_list[i]].pos).x,
-				(eigen2glm(m_prop_sim->m_mesh_pos) + m_prop_sim->m_mesh->vertices[m_points_list[i]].pos).y,
-				(eigen2glm(m_prop_sim->m_mesh_pos) + m_prop_sim->m_mesh->vertices[m_points_list[i]].pos).z);
-		}
-		ImGui::ListBoxFooter();
-	}
-
-	// mesh select group
-	if (ImGui::ListBoxHeader("Mesh Selected Group", m_prop_sim->m_mesh->groups_vertices.size()+1))
-	{
-		// ALL GROUPS
-		if (ImGui::Selectable("ALL GROUPS", -1==m_selected_group))
-		{
-			m_selected_group = -1;
-		}
-
-		for (int i = 0; i < m_prop_sim->m_mesh->groups_vertices.size(); i++)
-		{
-			std::string name = std::string("Group ") + std::to_string(i);
-			if (ImGui::Selectable(name.c_str(), i==m_selected_group))
-			{
-				m_selected_group = i;
-			}
-		}
-		ImGui::ListBoxFooter();
-	}
-
-	if (ImGui::Button("Remove Point"))
-	{
-		if (m_selected_point != -1 && m_selected_point < m_points_list.size())
-		{
-			m_points_list.erase(m_points_list.begin() + m_selected_point);
-		}
-	}
-	if (ImGui::Button("Clear Points List"))
-	{
-		m_points_list.clear();
-	}
-	ImGui::Checkbox("Adding Points", &m_adding_points);
-}
-
-void WavePropagationConductionPath::handle_input(const LookAtCamera& camera)
-{
-	if (m_adding_points)
-	{
-		// camera mouse ray
-		Ray mouse_ray = camera_screen_to_world_ray(camera, Input::getCursorXPosNorm(), Input::getCursorYPosNorm());
-		
-		// find the nearest point
-		int nearest_point_idx = -1;
-
-		// hit ray to mesh and find the intersecting triangle
-		Real t;
-		int tri_idx;
-		if (ray_mesh_intersect(*m_prop_sim->m_mesh, m_prop_sim->m_mesh_pos, mouse_ray, t, tri_idx, m_selected_group))
-		{
-			// find the nearest point on that triangle to our intersecting point
-			Vector3<Real> intersection_point = mouse_ray.point_at_dir(t);
-			Real d0 = (glm2eigen(m_prop_sim->m_mesh->vertices[m_prop_sim->m_mesh->faces[tri_idx].idx[0]].pos) - intersection_point).norm();
-			Real d1 = (glm2eigen(m_prop_sim->m_mesh->vertices[m_prop_sim->m_mesh->faces[tri_idx].idx[1]].pos) - intersection_point).norm();
-			Real d2 = (glm2eigen(m_prop_sim->m_mesh->vertices[m_prop_sim->m_mesh->faces[tri_idx].idx[2]].pos) - intersection_point).norm();
-			if (d0 < d1 && d0 < d2)
-			{
-				nearest_point_idx = m_prop_sim->m_mesh->faces[tri_idx].idx[0];
-			}
-			else if (d1 < d2)
-			{
-				nearest_point_idx = m_prop_sim->m_mesh->faces[tri_idx].idx[1];
-			}
-			else
-			{
-				nearest_point_idx = m_prop_sim->m_mesh->faces[tri_idx].idx[2];
-			}
-		}
-
-		// set preview
-		m_adding_points_preview_idx = nearest_point_idx;
-
-		// add point at left mouse click
-		if (Input::isButtonPressed(GLFW_MOUSE_BUTTON_LEFT) && nearest_point_idx != -1)
-		{
-			m_points_list.push_back(nearest_point_idx);
-		}
-	}
-
-	// Escape: cancel adding points
-	if (Input::isKeyPressed(GLFW_KEY_ESCAPE))
-	{
-		m_adding_points = false;
-	}
-}
-
 void WavePropagationConductionPath::serialize(Serializer & ser)
 {
 	ser.push_double(m_multiply_speed);
@@ -1312,60 +980,6 @@ void WavePropagationSetParamsInPlane::apply_reset()
 	}
 }
 
-void WavePropagationSetParamsInPlane::render()
-{
-	// update mesh values
-	for (int i = 0; i < m_prop_sim->m_mesh->vertices.size(); i++)
-	{
-		// skip if vertex isn't from the selected group
-		if (m_mesh_group_selected != -1 && m_prop_sim->m_mesh->vertices[i].group != m_mesh_group_selected)
-		{
-			continue;
-		}
-
-		Vector3<Real> vertex_pos = m_prop_sim->m_mesh_pos + glm2eigen(m_prop_sim->m_mesh->vertices[i].pos);
-		bool is_selected = ((vertex_pos - m_point).dot(m_normal) > 0);
-		m_prop_sim->m_mesh->vertices[i].value = 0*(!is_selected) + 1*is_selected;
-	}
-
-	m_prop_sim->m_mesh_in_preview = true;
-	m_prop_sim->m_mesh_in_preview_max = 1;
-	m_prop_sim->m_mesh_in_preview_min = 0;
-}
-
-void WavePropagationSetParamsInPlane::render_gui()
-{
-	ImGui::DragVector3Eigen("Point", m_point);
-	ImGui::DragVector3Eigen("Normal", m_normal);
-
-	// mesh select group
-	if (ImGui::ListBoxHeader("Mesh Selected Group", m_prop_sim->m_mesh->groups_vertices.size()+1))
-	{
-		// ALL GROUPS
-		if (ImGui::Selectable("ALL GROUPS", -1==m_mesh_group_selected))
-		{
-			m_mesh_group_selected = -1;
-		}
-
-		for (int i = 0; i < m_prop_sim->m_mesh->groups_vertices.size(); i++)
-		{
-			std::string name = std::string("Group ") + std::to_string(i);
-			if (ImGui::Selectable(name.c_str(), i==m_mesh_group_selected))
-			{
-				m_mesh_group_selected = i;
-			}
-		}
-		ImGui::ListBoxFooter();
-	}
-
-	ImGui::InputReal("Deplorized Duration", &m_params.deplorized_duration);
-	ImGui::InputReal("Amplitude Multiplier", &m_params.amplitude_multiplier);
-}
-
-void WavePropagationSetParamsInPlane::handle_input(const LookAtCamera & camera)
-{
-}
-
 void WavePropagationSetParamsInPlane::serialize(Serializer & ser)
 {
 	ser.push_double(m_point.x());
@@ -1420,50 +1034,6 @@ void WavePropagationSetParamsInSelect::apply_reset()
 	}
 }
 
-void WavePropagationSetParamsInSelect::render()
-{
-	m_brush.render();
-
-	// update mesh values
-	if (m_view_drawing)
-	{
-		for (int i = 0; i < m_prop_sim->m_mesh->vertices.size(); i++)
-		{
-			m_prop_sim->m_mesh->vertices[i].value = 0*(!m_selected[i]) + 1*m_selected[i];
-		}
-
-		m_prop_sim->m_mesh_in_preview = true;
-		m_prop_sim->m_mesh_in_preview_max = 1;
-		m_prop_sim->m_mesh_in_preview_min = 0;
-	}
-}
-
-void WavePropagationSetParamsInSelect::render_gui()
-{
-	ImGui::InputReal("Deplorized Duration", &m_params.deplorized_duration);
-	ImGui::InputReal("Amplitude Multiplier", &m_params.amplitude_multiplier);
-
-	ImGui::Dummy(ImVec2(0.0f, 20.0f)); // spacer
-	m_brush.render_gui();
-	ImGui::Checkbox("Select", &m_brush_select);
-	ImGui::Checkbox("View Drawing", &m_view_drawing);
-}
-
-void WavePropagationSetParamsInSelect::handle_input(const LookAtCamera & camera)
-{
-	m_selected.resize(m_prop_sim->m_mesh->vertices.size());
-
-	m_brush.handle_input(camera, m_prop_sim->m_mesh, m_prop_sim->m_mesh_pos);
-
-	for (int i = 0; i < m_brush.get_intersected().size(); i++)
-	{
-		if (m_brush.get_intersected()[i])
-		{
-			m_selected[i] = m_brush_select;
-		}
-	}
-}
-
 void WavePropagationSetParamsInSelect::serialize(Serializer & ser)
 {
 	ser.push_u32(m_selected.size());
@@ -34,8 +34,19 @@ public:
 	int get_sample_count();
 	int get_current_sample();
 	Real get_dt();
+	Real get_duration();
 	const VectorX<Real>& get_potentials() const;
 	void simulation_step();
+	// resets the simulation and calculates the potentials of the next sample_count steps (MxSAMPLE_COUNT)
+	void calculate_potentials_samples(int sample_count, MatrixX<Real>& potentials_samples);
+
+	// event-driven mode: the depolarization times of all the vertices are calculated once at reset
+	// (shortest path over the links), simulation steps only evaluate the potentials
+	void set_event_driven(bool event_driven);
+	bool is_event_driven() const;
+	// depolarization time of each vertex since the last reset (infinity if it is never depolarized)
+	const std::vector<Real>& get_activation_times() const;
+	int get_links_count() const;
 	void render();
 	void render_gui();
 	void handle_input(const LookAtCamera& camera);
@@ -43,12 +54,18 @@ public:
 	Real get_mesh_in_preview_min();
 	Real get_mesh_in_preview_max();
 
-private:
-	void recalculate_links();
-
 	bool load_from_file(const std::string& path);
 	bool save_to_file(const std::string& path);
 
+private:
+	void recalculate_links();
+	void update_links();
+	void update_links_lag();
+	std::vector<uint8_t> get_links_state();
+	void calculate_activation_times();
+	void apply_activation_times();
+	Real calculate_vertex_potential(int vertex_idx, bool is_depolarized, Real depolarization_time, Real t) const;
+
 private:
 	// vertex variables
 	struct VertexVars
@@ -89,8 +106,18 @@ private:
 	Real m_depolarization_slope_duration = 0.050;
 	Real m_repolarization_slope_duration = 0.200;
 	std::vector<VertexLink> m_links; // vertex links
+	std::vector<uint8_t> m_links_state; // parameters and operators the links were built from
+	// links as parallel arrays with the lag precomputed (rebuilt when the links or the base speed change)
+	std::vector<int> m_links_v1;
+	std::vector<int> m_links_v2;
+	std::vector<Real> m_links_lag;
+	bool m_links_lag_valid = false;
+	Real m_links_lag_base_speed = 0; // base speed the lags were calculated with
 	std::vector<VertexVars> m_vars; // vertex vars
 	std::vector<VertexParams> m_params; // vertex params
+	bool m_event_driven = false;
+	std::vector<Real> m_activation_times; // vertex depolarization times (event-driven mode)
+	bool m_view_activation_map = false;
 	VectorX<Real> m_potentials;
 	std::vector<std::shared_ptr<WavePropagationOperator>> m_operators;
 	std::vector<bool> m_operators_enable;
@@ -0,0 +1,830 @@
+#include "wave_propagation_simulation.h"
+#include "imgui/imgui.h"
+#include "imgui/imgui_my_types.h"
+#include "geometry.h"
+#include "renderer3d.h"
+#include "opengl/gl_headers.h"
+#include "GLFW/glfw3.h"
+#include "main_dev.h"
+#include "action_potential.h"
+#include "filedialog.h"
+
+
+void WavePropagationSimulation::render()
+{
+	// reset m_mesh_in_preview
+	m_mesh_in_preview = false;
+
+	// operators render
+	for (int i = 0; i < m_operators.size(); i++)
+	{
+		if (m_operators_render[i] || i == m_selected_operator)
+		{
+			m_operators[i]->render();
+		}
+	}
+
+	// activation map preview (vertices that are never depolarized take the duration)
+	if (m_event_driven && m_view_activation_map && m_activation_times.size() == m_mesh->vertices.size())
+	{
+		for (int i = 0; i < m_mesh->vertices.size(); i++)
+		{
+			m_mesh->vertices[i].value = rmin(m_activation_times[i], m_duration);
+		}
+
+		m_mesh_in_preview = true;
+		m_mesh_in_preview_max = m_duration;
+		m_mesh_in_preview_min = 0;
+	}
+}
+
+void WavePropagationSimulation::render_gui()
+{
+	ImGui::Text("Time: %.4f s, Sample: %d", m_t, m_sample);
+	ImGui::InputReal("Wave Simulation Duration", &m_duration);
+	ImGui::InputReal("Time Simulation Step", &m_dt, 0.001, 0.01, "%.5f");
+	m_dt = clamp_value<Real>(m_dt, 0.000001, 5);
+
+	ImGui::InputReal("Wave Propagation Speed", &m_base_speed);
+	ImGui::InputReal("Wave Depolarization Duration", &m_depolarization_duration);
+	ImGui::InputReal("Depolarization Slope Duration", &m_depolarization_slope_duration);
+	ImGui::InputReal("Repolarization Slope Duration", &m_repolarization_slope_duration);
+	// connect close vertices from different groups
+	ImGui::InputReal("Close Vertices Threshold", &m_close_vertices_threshold);
+	// heart groups opacity
+	if (ImGui::BeginTable("Mesh Groups Speed", m_mesh_groups_speed.size(), ImGuiTableFlags_Resizable | ImGuiTableFlags_NoSavedSettings | ImGuiTableFlags_Borders))
+	{
+		for (int i = 0; i < m_mesh_groups_speed.size(); i++)
+		{
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("Group(%d)", i);
+			ImGui::TableNextColumn();
+			ImGui::InputReal((std::string("Speed_") + std::to_string(i)).c_str(), &m_mesh_groups_speed[i], 0, 1);
+		}
+		ImGui::EndTable();
+	}
+	ImGui::Checkbox("Connect Close Vertices From Different Groups", &m_connect_close_vertices_from_different_groups);
+	ImGui::Checkbox("Connect Close Vertices From The Same Groups", &m_connect_close_vertices_from_same_group);
+	if (ImGui::Button("Recalculate Links"))
+	{
+		recalculate_links();
+	}
+	if (ImGui::Button("Reset Wave"))
+	{
+		reset();
+	}
+	bool event_driven = m_event_driven;
+	if (ImGui::Checkbox("Event-Driven Activation", &event_driven))
+	{
+		set_event_driven(event_driven);
+	}
+	if (m_event_driven)
+	{
+		ImGui::Checkbox("View Activation Map", &m_view_activation_map);
+	}
+	
+	// extracellular potential select
+	const char* im_extracellular_potential_curve_items[] = { 
+		"TMP Potential 1 (OLD)", 
+		"TMP Potential 2", 
+		"TMP Potential Over Depolarization",
+		"TMP Potential Over Depolarization (NEW)",
+	};
+	ImGui::Combo("TMP Potential Curve", &m_selected_extracellular_potential_curve, im_extracellular_potential_curve_items, IM_ARRAYSIZE(im_extracellular_potential_curve_items));
+	static Real preview_dep_time = 0.2;
+	static Real preview_rep_time = 0.7;
+	ImGui::InputReal("Preview Depolarization Time", &preview_dep_time);
+	ImGui::InputReal("Preview Repolarization Time", &preview_rep_time);
+	static std::vector<float> im_extracellular_potential_curve_preview;
+	im_extracellular_potential_curve_preview.resize(250);
+	ActionPotentialParameters preview_parameters = { ACTION_POTENTIAL_RESTING_POTENTIAL, ACTION_POTENTIAL_PEAK_POTENTIAL, preview_dep_time, preview_rep_time };
+	for (int i = 0; i < im_extracellular_potential_curve_preview.size(); i++)
+	{
+		float t = (float)i/(float)im_extracellular_potential_curve_preview.size();
+		switch(m_selected_extracellular_potential_curve)
+		{
+		case 0:
+			im_extracellular_potential_curve_preview[i] = action_potential_value(t, preview_parameters);
+			break;
+		case 1:
+			im_extracellular_potential_curve_preview[i] = action_potential_value_2(t, preview_parameters, m_depolarization_slope_duration, m_repolarization_slope_duration);
+			break;
+		case 2:
+			im_extracellular_potential_curve_preview[i] = action_potential_value_with_hyperdepolarizaton(t, preview_parameters, m_depolarization_slope_duration, m_repolarization_slope_duration);
+			break;
+		case 3:
+			im_extracellular_potential_curve_preview[i] = action_potential_value_with_hyperdepolarizaton_new(t, preview_parameters, m_depolarization_slope_duration, m_repolarization_slope_duration);
+			break;
+		default:
+			im_extracellular_potential_curve_preview[i] = 0;
+			break;
+		}
+	}
+	ImGui::PlotLines("Extracellular Potential Curve Plot", &im_extracellular_potential_curve_preview[0], im_extracellular_potential_curve_preview.size(), 0, NULL, FLT_MAX, FLT_MAX, ImVec2(0, 120));
+
+	// resize operators options
+	m_operators_enable.resize(m_operators.size(), true);
+	m_operators_render.resize(m_operators.size(), false);
+
+	// operators list
+	ImGui::Text("Operators");
+	if (ImGui::BeginTable("Operators", 4, ImGuiTableFlags_Resizable | ImGuiTableFlags_NoSavedSettings | ImGuiTableFlags_Borders))
+	{
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::Text("Index");
+		ImGui::TableNextColumn();
+		ImGui::Text("Type");
+		ImGui::TableNextColumn();
+		ImGui::Text("Enabled");
+		ImGui::TableNextColumn();
+		ImGui::Text("Render");
+
+		for (int i = 0; i < m_operators.size(); i++)
+		{
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+
+			bool is_selected = i==m_selected_operator;
+			ImGui::Selectable(std::to_string(i).c_str(), &is_selected);
+			if (is_selected)
+			{
+				m_selected_operator = i;
+			}
+			
+			// type
+			ImGui::TableNextColumn();
+			ImGui::Text("%s", m_operators[i]->get_type().c_str());
+
+			// is enabled
+			ImGui::TableNextColumn();
+			bool op_enable = m_operators_enable[i];
+			ImGui::Checkbox(("E" + std::to_string(i)).c_str(), &op_enable);
+			m_operators_enable[i] = op_enable;
+
+			// render
+			ImGui::TableNextColumn();
+			bool op_render = m_operators_render[i];
+			ImGui::Checkbox(("R" + std::to_string(i)).c_str(), &op_render);
+			m_operators_render[i] = op_render;
+
+		}
+		ImGui::EndTable();
+	}
+
+	// selected operator add
+	const char* im_add_operator_type_items[] = { "Plane Cut", "Force Depolarization", "Link Two Groups", "Conduction Path", "Set Params In Plane", "Set Params In Select"};
+	ImGui::Combo("Add Operator Type", &m_selected_operator_add, im_add_operator_type_items, 6);
+	if (ImGui::Button("Add Operator") && m_selected_operator_add != -1)
+	{
+		switch (m_selected_operator_add)
+		{
+		case 0:
+			m_operators.push_back(std::shared_ptr<WavePropagationPlaneCut>(new WavePropagationPlaneCut(this, m_mesh_pos + Vector3<Real>(0, 0, 0), { -1, 1, 0 })));
+			break;
+		case 1:
+			m_operators.push_back(std::shared_ptr<WavePropagationForceDepolarization>(new WavePropagationForceDepolarization(this)));
+			break;
+		case 2:
+			m_operators.push_back(std::shared_ptr<WavePropagationLinkTwoGroups>(new WavePropagationLinkTwoGroups(this)));
+			break;
+		case 3:
+			m_operators.push_back(std::shared_ptr<WavePropagationConductionPath>(new WavePropagationConductionPath(this)));
+			break;
+		case 4:
+			m_operators.push_back(std::shared_ptr<WavePropagationSetParamsInPlane>(new WavePropagationSetParamsInPlane(this, m_mesh_pos + Vector3<Real>(0, 0, 0), { -1, 1, 0 })));
+			break;
+		case 5:
+			m_operators.push_back(std::shared_ptr<WavePropagationSetParamsInSelect>(new WavePropagationSetParamsInSelect(this)));
+			break;
+		default:
+			break;
+		}
+	}
+
+	// selected operator remove
+	if (ImGui::Button("Remove Operator"))
+	{
+		if (m_selected_operator != -1 && m_selected_operator < m_operators.size())
+		{
+			m_operators.erase(m_operators.begin() + m_selected_operator);
+		}
+	}
+
+	// Import probes locations
+	if (ImGui::Button("Load Wave Propagation Configuration"))
+	{
+		// open file dialog
+		std::string file_name = open_file_dialog("", "All\0*.*\0");
+
+		// import
+		if (file_name != "")
+		{
+			if (load_from_file(file_name))
+			{
+				printf("Loaded wave propagation configuration to \"%s\" to file\n", file_name.c_str());
+			}
+			else
+			{
+				printf("Failed to load wave propagation configuration to \"%s\" file\n", file_name.c_str());
+			}
+		}
+	}
+	// Export probes locations
+	if (ImGui::Button("Save Wave Propagation Configuration"))
+	{
+		// save file dialog
+		std::string file_name = save_file_dialog("", "All\0*.*\0");
+
+		// export
+		if (file_name != "")
+		{
+			if (save_to_file(file_name))
+			{
+				printf("Saved wave propagation configuration to \"%s\" to file\n", file_name.c_str());
+			}
+			else
+			{
+				printf("Failed to save wave propagation configuration to \"%s\" file\n", file_name.c_str());
+			}
+		}
+	}
+	
+	// operator controls
+	if (m_selected_operator != -1 && m_selected_operator < m_operators.size())
+	{
+		bool operator_controls = true;
+		ImGui::Begin("Operator Controls", &operator_controls);
+		m_operators[m_selected_operator]->render_gui();
+		ImGui::End();
+		if (!operator_controls)
+		{
+			m_selected_operator = -1;
+		}
+	}
+
+}
+
+void WavePropagationSimulation::handle_input(const LookAtCamera& camera)
+{
+	// operators handle input
+	if (m_selected_operator != -1 && m_selected_operator < m_operators.size())
+	{
+		m_operators[m_selected_operator]->handle_input(camera);
+	}
+}
+
+
+// Wave Propagation Operator
+
+void WavePropagationOperator::render()
+{
+}
+
+void WavePropagationOperator::render_gui()
+{
+}
+
+void WavePropagationOperator::handle_input(const LookAtCamera& camera)
+{
+}
+
+
+// Paper Cut
+
+void WavePropagationPlaneCut::render()
+{
+	gdevGet()->depthTest(STATE_ENABLED);
+	Renderer3D::setStyle(Renderer3D::Style(true, 1, { 0.8, 0, 0, 1 }, false, { 0.75, 0, 0 ,1 }));
+	Renderer3D::drawLineList(m_cut_links_lines);
+
+}
+
+void WavePropagationPlaneCut::render_gui()
+{
+	ImGui::DragVector3Eigen("Point", m_point);
+	ImGui::DragVector3Eigen("Normal", m_normal);
+}
+
+void WavePropagationPlaneCut::handle_input(const LookAtCamera & camera)
+{
+}
+
+
+// Force Depolarization
+
+void WavePropagationForceDepolarization::render()
+{
+	m_brush.render();
+
+	// update mesh values
+	if (m_view_drawing)
+	{
+		for (int i = 0; i < m_prop_sim->m_mesh->vertices.size(); i++)
+		{
+			m_prop_sim->m_mesh->vertices[i].value = 0*(!m_selected[i]) + 1*m_selected[i];
+		}
+
+		m_prop_sim->m_mesh_in_preview = true;
+		m_prop_sim->m_mesh_in_preview_max = 1;
+		m_prop_sim->m_mesh_in_preview_min = 0;
+	}
+}
+
+void WavePropagationForceDepolarization::render_gui()
+{
+	ImGui::InputReal("Depolarization Time", &m_depolarization_time);
+
+	ImGui::Dummy(ImVec2(0.0f, 20.0f)); // spacer
+	m_brush.render_gui();
+	ImGui::Checkbox("Select", &m_brush_select);
+	ImGui::Checkbox("View Drawing", &m_view_drawing);
+
+}
+
+void WavePropagationForceDepolarization::handle_input(const LookAtCamera & camera)
+{
+	m_selected.resize(m_prop_sim->m_mesh->vertices.size());
+
+	m_brush.handle_input(camera, m_prop_sim->m_mesh, m_prop_sim->m_mesh_pos);
+
+	for (int i = 0; i < m_brush.get_intersected().size(); i++)
+	{
+		if (m_brush.get_intersected()[i])
+		{
+			m_selected[i] = m_brush_select;
+		}
+	}
+}
+
+
+// Circular Brush
+
+void CircularBrush::render()
+{
+	// render drawing preview
+	if (m_enable_drawing && m_drawing_is_intersected && m_drawing_values_preview.size() >= 2)
+	{
+		gdevGet()->depthTest(STATE_ENABLED);
+		Renderer3D::setStyle(Renderer3D::Style(true, 1, { 1, 1, 1, 1 }, false, { 0.75, 0, 0, 0.2 }));
+		m_drawing_values_preview.push_back(m_drawing_values_preview[0]);
+		Renderer3D::drawPolygon(&m_drawing_values_preview[0], m_drawing_values_preview.size(), false);
+	}
+
+}
+
+void CircularBrush::render_gui()
+{
+	ImGui::Checkbox("Enable Drawing", &m_enable_drawing);
+	ImGui::Checkbox("Draw Only Vertices Facing Camera", &m_only_vertices_facing_camera);
+
+	// mesh select group
+	if (ImGui::ListBoxHeader("Mesh Selected Group", m_mesh_groups_count+1))
+	{
+		// ALL GROUPS
+		if (ImGui::Selectable("ALL GROUPS", -1==m_mesh_group_selected))
+		{
+			m_mesh_group_selected = -1;
+		}
+
+		for (int i = 0; i < m_mesh_groups_count; i++)
+		{
+			std::string name = std::string("Group ") + std::to_string(i);
+			if (ImGui::Selectable(name.c_str(), i==m_mesh_group_selected))
+			{
+				m_mesh_group_selected = i;
+			}
+		}
+		ImGui::ListBoxFooter();
+	}
+
+	Real im_brush_radius = log10(m_brush_radius);
+	ImGui::DragReal("Drawing Brush Radius", &im_brush_radius, 0.01);
+	m_brush_radius = pow(10, im_brush_radius);
+	// HANDLED BY THE CALLER
+	//ImGui::InputReal("drawing value", &drawing_value);
+	//ImGui::Checkbox("view target channel", &drawing_view_target_channel);
+}
+
+void CircularBrush::handle_input(const LookAtCamera & camera, MeshPlot * mesh, const Vector3<Real>& mesh_pos)
+{
+	m_mesh_groups_count = mesh->groups_vertices.size();
+	m_drawing_is_intersected = false;
+	m_intersected.resize(mesh->vertices.size());
+
+	for (int i = 0; i < m_intersected.size(); i++)
+	{
+		m_intersected[i] = false;
+	}
+
+	if (!m_enable_drawing)
+	{
+		return;
+	}
+
+	// drawing
+	
+	// normalized screen coordinates
+	Real x = Input::getCursorXPosNorm();
+	Real y = Input::getCursorYPosNorm();
+
+	// camera axis
+	Vector3<Real> forward = glm2eigen(camera.look_at-camera.eye).normalized();
+	Vector3<Real> up = glm2eigen(camera.up).normalized();
+	Vector3<Real> right = forward.cross(up).normalized();
+	// calculate the pointer direction
+	Vector3<Real> direction = forward + up*tan(0.5*y*camera.fov) + right*tan(0.5*x*camera.aspect*camera.fov);
+	direction = direction.normalized();
+
+	std::vector<Vector3<Real>> origin_points(m_drawing_values_points_count, Vector3<Real>(0, 0, 0));
+
+	// generate origin points
+	for (int i = 0; i < m_drawing_values_points_count; i++)
+	{
+		Real theta = ((Real)i/(Real)m_drawing_values_points_count)*2*PI;
+		origin_points[i] = glm2eigen(camera.eye) + m_brush_radius*sin(theta)*up + m_brush_radius*cos(theta)*right;
+	}
+
+	// intersect preview
+	m_drawing_values_preview.clear();
+	Ray ray = { glm2eigen(camera.eye), direction };
+	// calculate average t
+	Real t_min = 1e3;
+	Real t_average = 0;
+	int intersected_points = 0;
+	for (int i = 0; i < m_drawing_values_points_count; i++)
+	{
+		Real t;
+		int tri_idx;
+		ray.origin = origin_points[i];
+		if (ray_mesh_intersect(*mesh, mesh_pos, ray, t, tri_idx, m_mesh_group_selected))
+		{
+			m_drawing_is_intersected = true;
+			t_average += t;
+			t_min = rmin(t_min, t);
+			intersected_points++;
+		}
+	}
+	t_average /= intersected_points;
+
+	// actual intersection
+	Real t;
+	int tri_idx;
+	for (int i = 0; i < m_drawing_values_points_count; i++)
+	{
+		ray.origin = origin_points[i];
+		if (!ray_mesh_intersect(*mesh, mesh_pos, ray, t, tri_idx, m_mesh_group_selected))
+		{
+			t = t_min; // set t to t_average when no intersection
+		}
+		t = t_min; // set t to t_average when no intersection
+
+		m_drawing_values_preview.push_back(eigen2glm(ray.point_at_dir(t)));
+	}
+
+	// apply drawing value to mesh vertices
+	if (Input::isButtonDown(GLFW_MOUSE_BUTTON_LEFT))
+	{
+		std::vector<int> intersected_values;
+		for (int i = 0; i < mesh->vertices.size(); i++)
+		{
+			// skip current vertex if not in the selected group
+			if (m_mesh_group_selected != -1 && mesh->vertices[i].group != m_mesh_group_selected)
+			{
+				continue;
+			}
+
+			if (perpendicular_distance(glm2eigen(camera.eye), glm2eigen(camera.eye)+direction, mesh_pos+glm2eigen(mesh->vertices[i].pos)) < m_brush_radius)
+			{
+				if (m_only_vertices_facing_camera && glm2eigen(mesh->vertices[i].normal).dot(-forward) > 0)
+				{
+					intersected_values.push_back(i);
+				}
+				else if (!m_only_vertices_facing_camera)
+				{
+					intersected_values.push_back(i);
+				}
+			}
+		}
+
+		// set value
+		for (int i = 0; i < intersected_values.size(); i++)
+		{
+			m_intersected[intersected_values[i]] = true;
+		}
+	}
+}
+
+
+// Link Two Groups
+
+void WavePropagationLinkTwoGroups::render()
+{
+	m_brush.render();
+
+	// update mesh values
+	if (m_view_drawing)
+	{
+		for (int i = 0; i < m_prop_sim->m_mesh->vertices.size(); i++)
+		{
+			if (m_selected_group == 0)
+			{
+				m_prop_sim->m_mesh->vertices[i].value = 0*(!m_group_a_selected[i]) + 1*m_group_a_selected[i];
+			}
+			else if (m_selected_group == 1)
+			{
+				m_prop_sim->m_mesh->vertices[i].value = 0*(!m_group_b_selected[i]) + 1*m_group_b_selected[i];
+			}
+		}
+
+		m_prop_sim->m_mesh_in_preview = true;
+		m_prop_sim->m_mesh_in_preview_max = 1;
+		m_prop_sim->m_mesh_in_preview_min = 0;
+	}
+}
+
+void WavePropagationLinkTwoGroups::render_gui()
+{
+	ImGui::InputReal("Multiply Speed", &m_multiply_speed);
+	ImGui::InputReal("Constant Speed", &m_constant_speed);
+	ImGui::InputReal("Constant Delay", &m_constant_delay);
+
+	ImGui::Dummy(ImVec2(0.0f, 20.0f)); // spacer
+	const char* group_select_choices[] = {"Group A", "Group B"};
+	ImGui::ListBox("Group Select", &m_selected_group, group_select_choices, 2, 2);
+	m_brush.render_gui();
+	ImGui::Checkbox("Select", &m_brush_select);
+	ImGui::Checkbox("View Drawing", &m_view_drawing);
+}
+
+void WavePropagationLinkTwoGroups::handle_input(const LookAtCamera& camera)
+{
+	m_group_a_selected.resize(m_prop_sim->m_mesh->vertices.size());
+	m_group_b_selected.resize(m_prop_sim->m_mesh->vertices.size());
+
+	m_brush.handle_input(camera, m_prop_sim->m_mesh, m_prop_sim->m_mesh_pos);
+
+	for (int i = 0; i < m_brush.get_intersected().size(); i++)
+	{
+		if (m_brush.get_intersected()[i])
+		{
+			if (m_selected_group == 0)
+			{
+				m_group_a_selected[i] = m_brush_select;
+			}
+			else if (m_selected_group == 1)
+			{
+				m_group_b_selected[i] = m_brush_select;
+			}
+		}
+	}
+}
+
+
+// Conduction Path
+
+void WavePropagationConductionPath::render()
+{
+	// construct line points
+	std::vector<glm::vec3> points_list;
+	points_list.resize(m_points_list.size());
+	for (int i = 0; i < m_points_list.size(); i++)
+	{
+		points_list[i] = eigen2glm(m_prop_sim->m_mesh_pos) + m_prop_sim->m_mesh->vertices[m_points_list[i]].pos;
+	}
+
+	// render line
+	Renderer3D::setStyle(Renderer3D::Style(true, 2, { 0.8, 0, 0, 1 }, false, { 0.75, 0, 0 ,1 }));
+	Renderer3D::drawPolygon(&points_list[0], points_list.size());
+
+	// selected point
+	if (m_selected_point != -1 && m_selected_point < m_points_list.size())
+	{
+		Renderer3D::drawPoint(points_list[m_selected_point], { 0, 0.8, 0, 1 }, 3);
+	}
+
+	// adding point preview
+	if (m_adding_points && m_adding_points_preview_idx != -1 && m_adding_points_preview_idx < m_points_list.size())
+	{
+		Renderer3D::drawPoint(eigen2glm(m_prop_sim->m_mesh_pos) + m_prop_sim->m_mesh->vertices[m_adding_points_preview_idx].pos, { 0, 0, 0.8, 1 }, 3);
+	}
+}
+
+void WavePropagationConductionPath::render_gui()
+{
+	ImGui::InputReal("Multiply Speed", &m_multiply_speed);
+	ImGui::InputReal("Constant Speed", &m_constant_speed);
+	ImGui::InputReal("Constant Delay", &m_constant_delay);
+
+	ImGui::Dummy(ImVec2(0.0f, 20.0f)); // spacer
+	if (ImGui::ListBoxHeader("Points List", { 0, 120 }))
+	{
+		for (int i = 0; i < m_points_list.size(); i++)
+		{
+			bool is_selected = i==m_selected_point;
+			ImGui::Selectable(std::to_string(i).c_str(), &is_selected);
+			if (is_selected)
+			{
+				m_selected_point = i;
+			}
+
+			// value
+			ImGui::SameLine();
+			ImGui::Text(" %d, (%.3f, %.3f, %.3f)", m_points_list[i],
+				(eigen2glm(m_prop_sim->m_mesh_pos) + m_prop_sim->m_mesh->vertices[m_points_list[i]].pos).x,
+				(eigen2glm(m_prop_sim->m_mesh_pos) + m_prop_sim->m_mesh->vertices[m_points_list[i]].pos).y,
+				(eigen2glm(m_prop_sim->m_mesh_pos) + m_prop_sim->m_mesh->vertices[m_points_list[i]].pos).z);
+		}
+		ImGui::ListBoxFooter();
+	}
+
+	// mesh select group
+	if (ImGui::ListBoxHeader("Mesh Selected Group", m_prop_sim->m_mesh->groups_vertices.size()+1))
+	{
+		// ALL GROUPS
+		if (ImGui::Selectable("ALL GROUPS", -1==m_selected_group))
+		{
+			m_selected_group = -1;
+		}
+
+		for (int i = 0; i < m_prop_sim->m_mesh->groups_vertices.size(); i++)
+		{
+			std::string name = std::string("Group ") + std::to_string(i);
+			if (ImGui::Selectable(name.c_str(), i==m_selected_group))
+			{
+				m_selected_group = i;
+			}
+		}
+		ImGui::ListBoxFooter();
+	}
+
+	if (ImGui::Button("Remove Point"))
+	{
+		if (m_selected_point != -1 && m_selected_point < m_points_list.size())
+		{
+			m_points_list.erase(m_points_list.begin() + m_selected_point);
+		}
+	}
+	if (ImGui::Button("Clear Points List"))
+	{
+		m_points_list.clear();
+	}
+	ImGui::Checkbox("Adding Points", &m_adding_points);
+}
+
+void WavePropagationConductionPath::handle_input(const LookAtCamera& camera)
+{
+	if (m_adding_points)
+	{
+		// camera mouse ray
+		Ray mouse_ray = camera_screen_to_world_ray(camera, Input::getCursorXPosNorm(), Input::getCursorYPosNorm());
+		
+		// find the nearest point
+		int nearest_point_idx = -1;
+
+		// hit ray to mesh and find the intersecting triangle
+		Real t;
+		int tri_idx;
+		if (ray_mesh_intersect(*m_prop_sim->m_mesh, m_prop_sim->m_mesh_pos, mouse_ray, t, tri_idx, m_selected_group))
+		{
+			// find the nearest point on that triangle to our intersecting point
+			Vector3<Real> intersection_point = mouse_ray.point_at_dir(t);
+			Real d0 = (glm2eigen(m_prop_sim->m_mesh->vertices[m_prop_sim->m_mesh->faces[tri_idx].idx[0]].pos) - intersection_point).norm();
+			Real d1 = (glm2eigen(m_prop_sim->m_mesh->vertices[m_prop_sim->m_mesh->faces[tri_idx].idx[1]].pos) - intersection_point).norm();
+			Real d2 = (glm2eigen(m_prop_sim->m_mesh->vertices[m_prop_sim->m_mesh->faces[tri_idx].idx[2]].pos) - intersection_point).norm();
+			if (d0 < d1 && d0 < d2)
+			{
+				nearest_point_idx = m_prop_sim->m_mesh->faces[tri_idx].idx[0];
+			}
+			else if (d1 < d2)
+			{
+				nearest_point_idx = m_prop_sim->m_mesh->faces[tri_idx].idx[1];
+			}
+			else
+			{
+				nearest_point_idx = m_prop_sim->m_mesh->faces[tri_idx].idx[2];
+			}
+		}
+
+		// set preview
+		m_adding_points_preview_idx = nearest_point_idx;
+
+		// add point at left mouse click
+		if (Input::isButtonPressed(GLFW_MOUSE_BUTTON_LEFT) && nearest_point_idx != -1)
+		{
+			m_points_list.push_back(nearest_point_idx);
+		}
+	}
+
+	// Escape: cancel adding points
+	if (Input::isKeyPressed(GLFW_KEY_ESCAPE))
+	{
+		m_adding_points = false;
+	}
+}
+
+
+// Set Params In Plane
+
+void WavePropagationSetParamsInPlane::render()
+{
+	// update mesh values
+	for (int i = 0; i < m_prop_sim->m_mesh->vertices.size(); i++)
+	{
+		// skip if vertex isn't from the selected group
+		if (m_mesh_group_selected != -1 && m_prop_sim->m_mesh->vertices[i].group != m_mesh_group_selected)
+		{
+			continue;
+		}
+
+		Vector3<Real> vertex_pos = m_prop_sim->m_mesh_pos + glm2eigen(m_prop_sim->m_mesh->vertices[i].pos);
+		bool is_selected = ((vertex_pos - m_point).dot(m_normal) > 0);
+		m_prop_sim->m_mesh->vertices[i].value = 0*(!is_selected) + 1*is_selected;
+	}
+
+	m_prop_sim->m_mesh_in_preview = true;
+	m_prop_sim->m_mesh_in_preview_max = 1;
+	m_prop_sim->m_mesh_in_preview_min = 0;
+}
+
+void WavePropagationSetParamsInPlane::render_gui()
+{
+	ImGui::DragVector3Eigen("Point", m_point);
+	ImGui::DragVector3Eigen("Normal", m_normal);
+
+	// mesh select group
+	if (ImGui::ListBoxHeader("Mesh Selected Group", m_prop_sim->m_mesh->groups_vertices.size()+1))
+	{
+		// ALL GROUPS
+		if (ImGui::Selectable("ALL GROUPS", -1==m_mesh_group_selected))
+		{
+			m_mesh_group_selected = -1;
+		}
+
+		for (int i = 0; i < m_prop_sim->m_mesh->groups_vertices.size(); i++)
+		{
+			std::string name = std::string("Group ") + std::to_string(i);
+			if (ImGui::Selectable(name.c_str(), i==m_mesh_group_selected))
+			{
+				m_mesh_group_selected = i;
+			}
+		}
+		ImGui::ListBoxFooter();
+	}
+
+	ImGui::InputReal("Deplorized Duration", &m_params.deplorized_duration);
+	ImGui::InputReal("Amplitude Multiplier", &m_params.amplitude_multiplier);
+}
+
+void WavePropagationSetParamsInPlane::handle_input(const LookAtCamera & camera)
+{
+}
+
+
+// Set Params In Select
+
+void WavePropagationSetParamsInSelect::render()
+{
+	m_brush.render();
+
+	// update mesh values
+	if (m_view_drawing)
+	{
+		for (int i = 0; i < m_prop_sim->m_mesh->vertices.size(); i++)
+		{
+			m_prop_sim->m_mesh->vertices[i].value = 0*(!m_selected[i]) + 1*m_selected[i];
+		}
+
+		m_prop_sim->m_mesh_in_preview = true;
+		m_prop_sim->m_mesh_in_preview_max = 1;
+		m_prop_sim->m_mesh_in_preview_min = 0;
+	}
+}
+
+void WavePropagationSetParamsInSelect::render_gui()
+{
+	ImGui::InputReal("Deplorized Duration", &m_params.deplorized_duration);
+	ImGui::InputReal("Amplitude Multiplier", &m_params.amplitude_multiplier);
+
+	ImGui::Dummy(ImVec2(0.0f, 20.0f)); // spacer
+	m_brush.render_gui();
+	ImGui::Checkbox("Select", &m_brush_select);
+	ImGui::Checkbox("View Drawing", &m_view_drawing);
+}
+
+void WavePropagationSetParamsInSelect::handle_input(const LookAtCamera & camera)
+{
+	m_selected.resize(m_prop_sim->m_mesh->vertices.size());
+
+	m_brush.handle_input(camera, m_prop_sim->m_mesh, m_prop_sim->m_mesh_pos);
+
+	for (int i = 0; i < m_brush.get_intersected().size(); i++)
+	{
+		if (m_brush.get_intersected()[i])
+		{
+			m_selected[i] = m_brush_select;
+		}
+	}
+}
+
@@ -1,36 +1,218 @@
 import socket
 import serializer
+import dataset
+
+
+# first word of a request/response frame on a persistent connection
+FRAME_MAGIC = 0xEC6F0001
+# first word of a response chunk frame (streamed responses)
+CHUNK_MAGIC = 0xEC6F0002
+
+# request type flags
+REQUEST_FLAG_BULK_ARRAYS = 0x10000 # matrices are sent as bulk arrays (numpy arrays on this side)
+REQUEST_FLAG_STREAM = 0x20000 # the response is streamed in chunks
+REQUEST_FLAG_SINGLE_PRECISION = 0x40000 # values are sent as floats (and calculated in single precision when possible)
 
 
 class Client:
-    def __init__(self, server_addr, server_port):
+    def __init__(self, server_addr, server_port, keep_alive=True, pipeline_depth=64, bulk_arrays=False, single_precision=False):
+        # keep_alive: reuse one connection for all the requests (otherwise a connection per request)
+        # pipeline_depth: maximum count of requests sent before reading their responses
+        # bulk_arrays: matrices are transferred as bulk arrays and returned as numpy arrays (otherwise lists)
+        # single_precision: values are transferred as floats (float32 numpy arrays with bulk_arrays), half the size
         self.server_addr = server_addr
         self.server_port = server_port
+        self.keep_alive = keep_alive
+        self.pipeline_depth = pipeline_depth
+        self.bulk_arrays = bulk_arrays
+        self.single_precision = single_precision
+        self.sock = None
+        self.next_request_id = 0
+    
+    
+    def __enter__(self):
+        return self
+    
+    
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+    
+    
+    def connect(self):
+        self.close()
+        self.sock = socket.create_connection((self.server_addr, self.server_port))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    
+    
+    def close(self):
+        if self.sock is not None:
+            self.sock.close()
+            self.sock = None
+    
+    
+    def recv_exact(self, size):
+        # received directly into one buffer, bulk arrays are parsed from it without copying
+        data = bytearray(size)
+        view = memoryview(data)
+        received = 0
+        while received < size:
+            count = self.sock.recv_into(view[received:], size - received)
+            if count == 0:
+                raise ConnectionError("Connection closed by the server")
+            received += count
+        return data
+    
+    
+    def send_stream_request(self, request_bytes):
+        # yields the chunks of a streamed response as they are received, then the response
+        if not self.keep_alive:
+            raise ValueError("Streamed responses need a persistent connection (keep_alive)")
+        
+        if self.sock is None:
+            self.connect()
+        
+        completed = False
+        try:
+            request_id, frame = self.form_frame(request_bytes)
+            self.sock.sendall(frame)
+            
+            while not completed:
+                magic, response_id, response_bytes = self.recv_frame()
+                if magic not in (FRAME_MAGIC, CHUNK_MAGIC) or response_id != request_id:
+                    raise ConnectionError("Invalid response frame")
+                completed = magic == FRAME_MAGIC
+                yield response_bytes
+        finally:
+            if not completed:
+                # the rest of the stream is still on the connection, reconnect on the next request
+                self.close()
+    
+    
+    def form_frame(self, request_bytes):
+        # magic, request id, request size, request
+        request_id = self.next_request_id
+        self.next_request_id = (self.next_request_id + 1) & 0xFFFFFFFF
+        
+        frame = bytearray()
+        frame += FRAME_MAGIC.to_bytes(4, 'big', signed=False)
+        frame += request_id.to_bytes(4, 'big', signed=False)
+        frame += len(request_bytes).to_bytes(4, 'big', signed=False)
+        frame += request_bytes
+        return request_id, frame
+    
+    
+    def recv_frame(self):
+        # returns the magic, request id and the response
+        header = self.recv_exact(12)
+        magic = int.from_bytes(header[0:4], 'big', signed=False)
+        request_id = int.from_bytes(header[4:8], 'big', signed=False)
+        response_size = int.from_bytes(header[8:12], 'big', signed=False)
+        return magic, request_id, self.recv_exact(response_size)
+    
+    
+    def form_request(self, request_type):
+        ser = serializer.Serializer()
+        flags = REQUEST_FLAG_BULK_ARRAYS if self.bulk_arrays else 0
+        flags |= REQUEST_FLAG_SINGLE_PRECISION if self.single_precision else 0
+        ser.push_u32(request_type | flags)
+        return ser
+    
+    
+    def parse_matrix(self, des, rows_count, cols_count):
+        # row major matrix, a numpy array for bulk arrays (otherwise a list of rows)
+        if self.bulk_arrays:
+            return des.parse_array()
+        
+        parse_value = des.parse_float if self.single_precision else des.parse_double
+        values = []
+        for i in range(rows_count):
+            row = []
+            for j in range(cols_count):
+                row.append(parse_value())
+            values.append(row)
+        return values
+    
+    
+    def parse_split_matrix(self, des):
+        # sample count, left and right columns count, then the matrix SAMPLE_COUNTx(LEFT_COLS+RIGHT_COLS)
+        # returns the left and the right columns as two matrices
+        sample_count = des.parse_u32()
+        left_cols_count = des.parse_u32()
+        right_cols_count = des.parse_u32()
+        
+        values = self.parse_matrix(des, sample_count, left_cols_count + right_cols_count)
+        if self.bulk_arrays:
+            # views of the same array
+            return values[:, :left_cols_count], values[:, left_cols_count:]
+        
+        left_values = [row[:left_cols_count] for row in values]
+        right_values = [row[left_cols_count:] for row in values]
+        return left_values, right_values
     
     
     def send_request(self, request_bytes):
-        data = bytearray()
+        if not self.keep_alive:
+            return self.send_single_request(request_bytes)
         
-        with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
-            s.connect((self.server_addr, self.server_port))
-            
-            # send request size
-            s.send(len(request_bytes).to_bytes(4, 'big', signed=False));
-            # send request
-            s.sendall(request_bytes);
-            
-            # receive response size
-            response_size = int.from_bytes(s.recv(4), 'big', signed=False)
-            # receive response
-            #print("Receiving {} bytes".format(response_size))
-            data = s.recv(response_size);
+        return self.send_requests([request_bytes])[0]
+    
+    
+    def send_single_request(self, request_bytes):
+        # one connection for one request
+        self.connect()
+        try:
+            # send request size and request
+            self.sock.sendall(len(request_bytes).to_bytes(4, 'big', signed=False) + bytes(request_bytes))
             
-            # close socket
-            s.close()
+            # receive response size and response
+            response_size = int.from_bytes(self.recv_exact(4), 'big', signed=False)
+            data = self.recv_exact(response_size)
+        finally:
+            self.close()
         
         return data
     
     
+    def send_requests(self, requests_bytes):
+        # pipelined requests on the persistent connection, returns the responses in the same order
+        if not self.keep_alive:
+            return [self.send_single_request(request_bytes) for request_bytes in requests_bytes]
+        
+        if self.sock is None:
+            self.connect()
+        
+        responses = []
+        try:
+            for start in range(0, len(requests_bytes), self.pipeline_depth):
+                batch = requests_bytes[start:start+self.pipeline_depth]
+                
+                # send the frames of the batch at once
+                data = bytearray()
+                request_ids = []
+                for request_bytes in batch:
+                    request_id, frame = self.form_frame(request_bytes)
+                    request_ids.append(request_id)
+                    data += frame
+                self.sock.sendall(data)
+                
+                # receive the response frames, matched by the request id
+                batch_responses = {}
+                for i in range(len(batch)):
+                    magic, request_id, response_bytes = self.recv_frame()
+                    if magic != FRAME_MAGIC or request_id not in request_ids:
+                        raise ConnectionError("Invalid response frame")
+                    batch_responses[request_id] = response_bytes
+                
+                for request_id in request_ids:
+                    responses.append(batch_responses[request_id])
+        except Exception:
+            # the connection state is unknown, reconnect on the next request
+            self.close()
+            raise
+        
+        return responses
+    
+    
     def get_probes_values(self):
         # form request
         ser = serializer.Serializer()
@@ -99,6 +281,19 @@ class Client:
     
     
     def calculate_values_for_vector(self, x, y, z):
+        response_bytes = self.send_request(self.form_values_for_vector_request(x, y, z))
+        
+        return self.parse_values_for_vector_response(response_bytes)
+    
+    
+    def calculate_values_for_vectors(self, vectors):
+        # same as calculate_values_for_vector for each vector (x, y, z), requests are pipelined
+        requests_bytes = [self.form_values_for_vector_request(vec[0], vec[1], vec[2]) for vec in vectors]
+        
+        return [self.parse_values_for_vector_response(response_bytes) for response_bytes in self.send_requests(requests_bytes)]
+    
+    
+    def form_values_for_vector_request(self, x, y, z):
         # form request
         ser = serializer.Serializer()
         ser.push_u32(4) # request REQUEST_CALCULATE_VALUES_FOR_VECTOR
@@ -107,8 +302,10 @@ class Client:
         ser.push_double(y)
         ser.push_double(z)
         
-        response_bytes = self.send_request(ser.get_data())
-        
+        return ser.get_data()
+    
+    
+    def parse_values_for_vector_response(self, response_bytes):
         # handle response
         des = serializer.Deserializer(response_bytes)
         
@@ -127,8 +324,7 @@ class Client:
     
     def calculate_values_for_random_vectors(self, random_samples_count, maximum_radius=1):
         # form request
-        ser = serializer.Serializer()
-        ser.push_u32(5) # request REQUEST_CALCULATE_VALUES_FOR_RANDOM_VECTORS
+        ser = self.form_request(5) # request REQUEST_CALCULATE_VALUES_FOR_RANDOM_VECTORS
         ser.push_u32(random_samples_count) # random samples count
         ser.push_double(maximum_radius) # maximum radius
         
@@ -137,23 +333,10 @@ class Client:
         # handle response
         des = serializer.Deserializer(response_bytes)
         
-        probes_count = des.parse_u32()-3 # -3 for dipole vector x, y and z
+        values_count = des.parse_u32() # dipole vector x, y, z and the probes values
         
-        # parse row by row (each row is a sample containing dipole vector x, y, z and probes values)
-        values = []
-        for j in range(random_samples_count):
-            row = []
-            # dipole vector x, y and z
-            row.append(des.parse_double())
-            row.append(des.parse_double())
-            row.append(des.parse_double())
-            # probes_values
-            for i in range(probes_count):
-                row.append(des.parse_double())
-            # append row to matrix
-            values.append(row)
-        
-        return values
+        # rows (each row is a sample containing dipole vector x, y, z and probes values)
+        return self.parse_matrix(des, random_samples_count, values_count)
 
     def set_dipole_vector_values(self, vec_values):
         # vec_values: n rows, 3 columns
@@ -186,56 +369,34 @@ class Client:
         #   * BSP_values: SAMPLE_COUNTxBSP_POINTS_COUNT
     
         # form request
-        ser = serializer.Serializer()
-        ser.push_u32(7) # request REQUEST_GET_TMP_BSP_VALUES
+        ser = self.form_request(7) # request REQUEST_GET_TMP_BSP_VALUES
         
         response_bytes = self.send_request(ser.get_data())
         
         # parse response
         des = serializer.Deserializer(response_bytes)
         
-        sample_count = des.parse_u32()
-        tmp_points_count = des.parse_u32()
-        bsp_count = des.parse_u32()
-        
-        # parse row by row
-        tmp_values = []
-        bsp_values = []
-        for j in range(sample_count):
-            # TMP values
-            tmp_row = []
-            # tmp_values
-            for i in range(tmp_points_count):
-                tmp_row.append(des.parse_double())
-            # append row to matrix
-            tmp_values.append(tmp_row)
-            
-            # probes values
-            bsp_row = []
-            # bsp_values
-            for i in range(bsp_count):
-                bsp_row.append(des.parse_double())
-            # append row to matrix
-            bsp_values.append(bsp_row)
-        
-        return tmp_values, bsp_values
+        return self.parse_split_matrix(des)
     
     
     def set_tmp_values(self, tmp_values):
         # sends tmp_values matrix: SAMPLE_COUNTxHEART_PROBES_COUNT
     
         # form request
-        ser = serializer.Serializer()
-        ser.push_u32(8) # request REQUEST_SET_TMP_VALUES
-        
-        # send matrix dimensions
-        ser.push_u32(len(tmp_values))    # rows count
-        ser.push_u32(len(tmp_values[0])) # cols count
-        
-        # send matrix
-        for i in range(len(tmp_values)):
-            for j in range(len(tmp_values[0])):
-                ser.push_double(tmp_values[i][j])
+        ser = self.form_request(8) # request REQUEST_SET_TMP_VALUES
+        
+        if self.bulk_arrays:
+            # send matrix with its dimensions
+            ser.push_array(tmp_values)
+        else:
+            # send matrix dimensions
+            ser.push_u32(len(tmp_values))    # rows count
+            ser.push_u32(len(tmp_values[0])) # cols count
+            
+            # send matrix
+            for i in range(len(tmp_values)):
+                for j in range(len(tmp_values[0])):
+                    ser.push_double(tmp_values[i][j])
         
         response_bytes = self.send_request(ser.get_data())
         
@@ -253,39 +414,14 @@ class Client:
         #   * probes_values: SAMPLE_COUNTxPROBES_COUNT
     
         # form request
-        ser = serializer.Serializer()
-        ser.push_u32(9) # request REQUEST_GET_TMP_BSP_VALUES_PROBES
+        ser = self.form_request(9) # request REQUEST_GET_TMP_BSP_VALUES_PROBES
         
         response_bytes = self.send_request(ser.get_data())
         
         # parse response
         des = serializer.Deserializer(response_bytes)
         
-        sample_count = des.parse_u32()
-        tmp_points_count = des.parse_u32()
-        probes_count = des.parse_u32()
-        
-        # parse row by row
-        tmp_values = []
-        probes_values = []
-        for j in range(sample_count):
-            # TMP values
-            tmp_row = []
-            # probes_values
-            for i in range(tmp_points_count):
-                tmp_row.append(des.parse_double())
-            # append row to matrix
-            tmp_values.append(tmp_row)
-            
-            # probes values
-            probes_row = []
-            # probes_values
-            for i in range(probes_count):
-                probes_row.append(des.parse_double())
-            # append row to matrix
-            probes_values.append(probes_row)
-        
-        return tmp_values, probes_values
+        return self.parse_split_matrix(des)
     
 
     def get_tmp_bsp_values_probes_2(self):
@@ -294,39 +430,14 @@ class Client:
         #   * probes_values: SAMPLE_COUNTxPROBES_COUNT
     
         # form request
-        ser = serializer.Serializer()
-        ser.push_u32(10) # request REQUEST_GET_TMP_BSP_VALUES_PROBES_2
+        ser = self.form_request(10) # request REQUEST_GET_TMP_BSP_VALUES_PROBES_2
         
         response_bytes = self.send_request(ser.get_data())
         
         # parse response
         des = serializer.Deserializer(response_bytes)
         
-        sample_count = des.parse_u32()
-        tmp_points_count = des.parse_u32()
-        probes_count = des.parse_u32()
-        
-        # parse row by row
-        tmp_values = []
-        probes_values = []
-        for j in range(sample_count):
-            # TMP values
-            tmp_row = []
-            # probes_values
-            for i in range(tmp_points_count):
-                tmp_row.append(des.parse_double())
-            # append row to matrix
-            tmp_values.append(tmp_row)
-            
-            # probes values
-            probes_row = []
-            # probes_values
-            for i in range(probes_count):
-                probes_row.append(des.parse_double())
-            # append row to matrix
-            probes_values.append(probes_row)
-        
-        return tmp_values, probes_values
+        return self.parse_split_matrix(des)
 
         
     def get_tmp_bsp_values_probes_train(self, sample_count):
@@ -335,8 +446,7 @@ class Client:
         #   * probes_values: SAMPLE_COUNTxPROBES_COUNT
     
         # form request
-        ser = serializer.Serializer()
-        ser.push_u32(11) # request REQUEST_GET_TMP_BSP_VALUES_PROBES_TRAIN
+        ser = self.form_request(11) # request REQUEST_GET_TMP_BSP_VALUES_PROBES_TRAIN
         
         # push sample count
         ser.push_u32(sample_count)
@@ -346,30 +456,80 @@ class Client:
         # parse response
         des = serializer.Deserializer(response_bytes)
         
-        sample_count = des.parse_u32()
-        tmp_points_count = des.parse_u32()
-        probes_count = des.parse_u32()
+        return self.parse_split_matrix(des)
+    
+    
+    def get_tmp_bsp_values_probes_dataset(self, compress=False):
+        # returns a dataset.Dataset of the heart probes and probes channels (SAMPLE_COUNTx(HEART_PROBES_COUNT+PROBES_COUNT)),
+        # with the time axis and the channels names, values are floats if single_precision is set
+    
+        # form request
+        ser = self.form_request(12) # request REQUEST_GET_TMP_BSP_VALUES_PROBES_DATASET
+        ser.push_u8(1 if compress else 0)
         
-        # parse row by row
-        tmp_values = []
-        probes_values = []
-        for j in range(sample_count):
-            # TMP values
-            tmp_row = []
-            # probes_values
-            for i in range(tmp_points_count):
-                tmp_row.append(des.parse_double())
-            # append row to matrix
-            tmp_values.append(tmp_row)
-            
-            # probes values
-            probes_row = []
-            # probes_values
-            for i in range(probes_count):
-                probes_row.append(des.parse_double())
-            # append row to matrix
-            probes_values.append(probes_row)
+        response_bytes = self.send_request(ser.get_data())
         
-        return tmp_values, probes_values
+        # the response is the dataset file
+        return dataset.read_dataset(response_bytes)
+
+
+    def get_server_stats(self):
+        # returns a dict of the server counters, 'latency' maps every request type (number) to its
+        # count, average, p50, p90, p99 and max latencies (seconds)
+
+        # form request
+        ser = self.form_request(13) # request REQUEST_GET_SERVER_STATS
+
+        response_bytes = self.send_request(ser.get_data())
+
+        # parse response
+        des = serializer.Deserializer(response_bytes)
+
+        stats = {}
+        stats['requests_count'] = des.parse_u64()
+        stats['requests_per_second'] = des.parse_double()
+        stats['bytes_received'] = des.parse_u64()
+        stats['bytes_sent'] = des.parse_u64()
+        stats['connections_count'] = des.parse_u32()
+        stats['accepted_connections'] = des.parse_u64()
+        stats['timed_out_connections'] = des.parse_u64()
+        stats['queue_depth'] = des.parse_u32()
+        stats['max_queue_depth'] = des.parse_u32()
+        stats['main_queue_depth'] = des.parse_u32()
+        stats['latency'] = {}
+        for i in range(des.parse_u32()):
+            request_type = des.parse_u32()
+            latency = {}
+            latency['count'] = des.parse_u64()
+            latency['average'] = des.parse_double()
+            latency['p50'] = des.parse_double()
+            latency['p90'] = des.parse_double()
+            latency['p99'] = des.parse_double()
+            latency['max'] = des.parse_double()
+            stats['latency'][request_type] = latency
+
+        return stats
+
+    
+    def stream_tmp_bsp_values_probes_train(self, sample_count):
+        # same as get_tmp_bsp_values_probes_train, but yields chunks of samples as soon as they are calculated:
+        #   * TMP_values:    CHUNK_SAMPLE_COUNTxTMP_POINTS_COUNT
+        #   * probes_values: CHUNK_SAMPLE_COUNTxPROBES_COUNT
+        #   * progress:      ratio of the samples received so far
         
-        
\ No newline at end of file
+        # form request
+        ser = self.form_request(11 | REQUEST_FLAG_STREAM) # request REQUEST_GET_TMP_BSP_VALUES_PROBES_TRAIN
+        
+        # push sample count
+        ser.push_u32(sample_count)
+        
+        for response_bytes in self.send_stream_request(ser.get_data()):
+            # parse chunk (the response ends the stream with no samples)
+            des = serializer.Deserializer(response_bytes)
+            
+            first_sample = des.parse_u32()
+            total_sample_count = des.parse_u32()
+            tmp_values, probes_values = self.parse_split_matrix(des)
+            
+            if len(tmp_values) > 0:
+                yield tmp_values, probes_values, (first_sample + len(tmp_values))/total_sample_count
@@ -0,0 +1,81 @@
+import zlib
+import numpy as np
+import serializer
+
+
+# binary columnar dataset file ("ECGDSET", see dataset.h)
+DATASET_MAGIC = b'ECGDSET\x00'
+DATASET_VERSION = 1
+
+DATASET_CHUNK_RAW = 0
+DATASET_CHUNK_SHUFFLE_ZLIB = 1
+
+HEADER_DTYPE = np.dtype([('magic', 'S8'), ('version', 'u4'), ('byte_order', 'u4'), ('dtype', 'u4'), ('flags', 'u4'),
+                         ('samples_count', 'u8'), ('channels_count', 'u4'), ('chunk_samples', 'u4'),
+                         ('t0', 'f8'), ('dt', 'f8'), ('reserved', 'u8')])
+CHUNK_ENTRY_DTYPE = np.dtype([('offset', 'u8'), ('size', 'u8'), ('encoding', 'u4'), ('reserved', 'u4')])
+
+
+class Dataset:
+    def __init__(self, names, t0, dt, values):
+        self.names = names # channels names
+        self.t0 = t0
+        self.dt = dt
+        self.values = values # SAMPLE_COUNTxCHANNELS_COUNT numpy array
+
+    def time(self):
+        return self.t0 + self.dt*np.arange(self.values.shape[0])
+
+    def channel(self, name):
+        return self.values[:, self.names.index(name)]
+
+    def to_dataframe(self):
+        import pandas as pd
+        return pd.DataFrame(self.values, columns=self.names, index=pd.Index(self.time(), name='time'))
+
+
+def read_dataset(source):
+    # source: file path, or the bytes of a dataset (e.g. a server response)
+    if isinstance(source, (bytes, bytearray, memoryview)):
+        data = memoryview(source)
+    else:
+        with open(source, 'rb') as file:
+            data = memoryview(file.read())
+
+    # the file is in the byte order of the machine that wrote it
+    byte_order = '<' if int.from_bytes(data[12:16], 'little') == 0x01020304 else '>'
+    header = np.frombuffer(data[:HEADER_DTYPE.itemsize], HEADER_DTYPE.newbyteorder(byte_order))[0]
+    if bytes(header['magic']).ljust(8, b'\x00') != DATASET_MAGIC or header['version'] != DATASET_VERSION:
+        raise ValueError('not a dataset file (or an unsupported version)')
+    dtype = serializer.ARRAY_DTYPES[int(header['dtype'])].newbyteorder(byte_order)
+    samples_count = int(header['samples_count'])
+    channels_count = int(header['channels_count'])
+    chunk_samples = int(header['chunk_samples'])
+
+    # channels names
+    pointer = HEADER_DTYPE.itemsize
+    names = []
+    for i in range(channels_count):
+        size = int(np.frombuffer(data[pointer:pointer+4], np.dtype('u4').newbyteorder(byte_order))[0])
+        names.append(bytes(data[pointer+4:pointer+4+size]).decode())
+        pointer += 4 + size
+
+    # chunks
+    chunks_count = (samples_count + chunk_samples - 1)//chunk_samples
+    chunks = np.frombuffer(data[pointer:pointer+chunks_count*CHUNK_ENTRY_DTYPE.itemsize], CHUNK_ENTRY_DTYPE.newbyteorder(byte_order))
+    values = np.empty((samples_count, channels_count), dtype=dtype.newbyteorder('='))
+    for i, chunk in enumerate(chunks):
+        first_sample = i*chunk_samples
+        count = min(chunk_samples, samples_count - first_sample)
+        chunk_bytes = data[int(chunk['offset']):int(chunk['offset'] + chunk['size'])]
+        if chunk['encoding'] == DATASET_CHUNK_SHUFFLE_ZLIB:
+            # undo the byte shuffle: byte b of value i is at b*VALUES_COUNT + i
+            shuffled = np.frombuffer(zlib.decompress(chunk_bytes), np.uint8)
+            chunk_bytes = shuffled.reshape(dtype.itemsize, -1).T.tobytes()
+        elif chunk['encoding'] != DATASET_CHUNK_RAW:
+            raise ValueError('unknown chunk encoding %d' % chunk['encoding'])
+
+        # the values of each channel are contiguous in the chunk
+        values[first_sample:first_sample+count, :] = np.frombuffer(chunk_bytes, dtype).reshape(channels_count, count).T
+
+    return Dataset(names, float(header['t0']), float(header['dt']), values)
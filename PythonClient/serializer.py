@@ -1,4 +1,9 @@
 import struct
+import numpy as np
+
+
+# bulk arrays data types (ArrayDataType in serializer.h)
+ARRAY_DTYPES = { 1: np.dtype('u1'), 2: np.dtype('i4'), 3: np.dtype('f4'), 4: np.dtype('f8') }
 
 class Serializer:
     def __init__(self):
@@ -33,6 +38,23 @@ class Serializer:
 
     def push_double(self, val):
         self.data.extend(bytearray(struct.pack(">d", val)))
+    
+    def push_array(self, arr):
+        # bulk array: header + the elements as one little-endian row major block
+        arr = np.asarray(arr)
+        dtype_code = next((code for code, dtype in ARRAY_DTYPES.items() if dtype == arr.dtype.newbyteorder('=')), 4)
+        arr = np.ascontiguousarray(arr, dtype=ARRAY_DTYPES[dtype_code].newbyteorder('<'))
+        
+        header_size = 4 + 4*arr.ndim
+        padding_size = -(len(self.data) + header_size) % arr.itemsize
+        self.push_u8(dtype_code)
+        self.push_u8(ord('<'))
+        self.push_u8(arr.ndim)
+        self.push_u8(padding_size)
+        for dimension in arr.shape:
+            self.push_u32(dimension)
+        self.data.extend(bytes(padding_size))
+        self.data.extend(arr.tobytes())
 
     
     def get_data(self):
@@ -80,12 +102,25 @@ class Deserializer:
         self.parse_u8() # null-termination
         return s
     
+    def parse_array(self):
+        # bulk array, returns a numpy array viewing the data (no copy)
+        dtype_code = self.parse_u8()
+        byte_order = chr(self.parse_u8())
+        dimensions_count = self.parse_u8()
+        padding_size = self.parse_u8()
+        shape = [self.parse_u32() for i in range(dimensions_count)]
+        self.pointer += padding_size
+        
+        dtype = ARRAY_DTYPES[dtype_code].newbyteorder(byte_order)
+        count = int(np.prod(shape))
+        arr = np.frombuffer(self.data, dtype=dtype, count=count, offset=self.pointer).reshape(shape)
+        self.pointer += count*dtype.itemsize
+        return arr
+    
     def parse_bytes(self, size):
-        arr = bytearray(size);
-        for i in range(size):
-            arr[i] = self.data[self.pointer]
-            self.pointer = self.pointer+1
-        return arr;
+        arr = self.data[self.pointer:self.pointer+size]
+        self.pointer = self.pointer+size
+        return arr
     
     
     def get_data(self):